@@ -0,0 +1,8 @@
+#pragma once
+
+#include<string>
+#include<vector>
+
+// Every benchmark takes the arguments after its name and returns the process exit code.
+int RunCullingBench(const std::vector<std::string>& args);
+int RunRenderBench(const std::vector<std::string>& args);
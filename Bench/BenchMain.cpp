@@ -0,0 +1,43 @@
+#include"Bench.h"
+
+#include<cstring>
+#include<iostream>
+
+struct BenchCommand
+{
+	const char* name;
+	const char* description;
+	int       (*run)(const std::vector<std::string>& args);
+};
+
+static const BenchCommand bench_commands[] = {
+	{ "culling", "CPU frustum culling throughput per kernel at 10k, 100k and 1M objects", RunCullingBench },
+	{ "render", "Offscreen frames of a fixed scene, JSON results checked against a baseline with --baseline", RunRenderBench },
+};
+
+static void PrintUsage()
+{
+	std::cout << "Usage: Bench <benchmark> [arguments]" << std::endl;
+	for (const auto& command : bench_commands) {
+		std::cout << "  " << command.name << "\t" << command.description << std::endl;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2) {
+		PrintUsage();
+		return 1;
+	}
+
+	std::vector<std::string> args(argv + 2, argv + argc);
+	for (const auto& command : bench_commands) {
+		if (strcmp(argv[1], command.name) == 0) {
+			return command.run(args);
+		}
+	}
+
+	std::cout << "Unknown benchmark " << argv[1] << std::endl;
+	PrintUsage();
+	return 1;
+}
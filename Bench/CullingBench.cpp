@@ -0,0 +1,89 @@
+#include"Bench.h"
+#include"CpuCuller.h"
+
+#include<glm/gtc/matrix_transform.hpp>
+
+#include<algorithm>
+#include<chrono>
+#include<cstdio>
+#include<cstdlib>
+#include<random>
+
+// Objects scattered through a cube around a camera looking down its middle, so
+// roughly a third of them end up inside the frustum.
+static void FillScene(CpuCuller& culler, uint32_t count)
+{
+	std::mt19937 random(12345);
+	std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+	std::uniform_real_distribution<float> size(0.1f, 2.0f);
+
+	culler.Resize(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		glm::vec3 center(position(random), position(random), position(random));
+		glm::vec3 extents(size(random), size(random), size(random));
+		culler.SetBounds(i, center, extents, glm::length(extents));
+	}
+}
+
+// Best and median milliseconds over the repetitions.
+static void TimeCull(const CpuCuller& culler, const Frustum& frustum, bool boxes, uint32_t repetitions,
+	std::vector<uint32_t>& visible, double& best_ms, double& median_ms, uint32_t& visible_count)
+{
+	std::vector<double> times;
+	times.reserve(repetitions);
+	for (uint32_t r = 0; r < repetitions; ++r) {
+		auto begin = std::chrono::high_resolution_clock::now();
+		visible_count = boxes
+			? culler.CullBoxes(frustum, 0, culler.GetCount(), visible.data())
+			: culler.CullSpheres(frustum, 0, culler.GetCount(), visible.data());
+		auto end = std::chrono::high_resolution_clock::now();
+		times.push_back(std::chrono::duration<double, std::milli>(end - begin).count());
+	}
+	std::sort(times.begin(), times.end());
+	best_ms = times.front();
+	median_ms = times[times.size() / 2];
+}
+
+int RunCullingBench(const std::vector<std::string>& args)
+{
+	uint32_t repetitions = 50;
+	for (size_t i = 0; i + 1 < args.size(); ++i) {
+		if (args[i] == "--repetitions") {
+			repetitions = std::max(1, atoi(args[i + 1].c_str()));
+		}
+	}
+
+	glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 150.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, -100.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	Frustum frustum = ExtractFrustum(projection * view);
+
+	std::vector<CullKernel> kernels = { CullKernel::Scalar };
+	if (CpuCuller::GetBestKernel() != CullKernel::Scalar) {
+		kernels.push_back(CullKernel::Sse);
+	}
+	if (CpuCuller::GetBestKernel() == CullKernel::Avx2) {
+		kernels.push_back(CullKernel::Avx2);
+	}
+
+	printf("%-8s %-7s %-6s %10s %10s %10s %14s\n", "objects", "volume", "kernel", "visible", "best ms", "median ms", "objects/ms");
+
+	const uint32_t object_counts[] = { 10000, 100000, 1000000 };
+	for (uint32_t object_count : object_counts) {
+		CpuCuller culler;
+		FillScene(culler, object_count);
+		std::vector<uint32_t> visible(object_count);
+
+		for (int boxes = 0; boxes < 2; ++boxes) {
+			for (CullKernel kernel : kernels) {
+				culler.SetKernel(kernel);
+				double best_ms = 0.0, median_ms = 0.0;
+				uint32_t visible_count = 0;
+				TimeCull(culler, frustum, boxes != 0, repetitions, visible, best_ms, median_ms, visible_count);
+
+				printf("%-8u %-7s %-6s %10u %10.3f %10.3f %14.0f\n", object_count, boxes ? "box" : "sphere",
+					CpuCuller::GetKernelName(kernel), visible_count, best_ms, median_ms, object_count / std::max(median_ms, 1e-6));
+			}
+		}
+	}
+	return 0;
+}
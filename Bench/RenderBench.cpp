@@ -0,0 +1,326 @@
+#include"Bench.h"
+#include"Renderer.h"
+#include"Window.h"
+#include"GltfLoader.h"
+
+#include<glm/gtc/matrix_transform.hpp>
+
+#include<algorithm>
+#include<chrono>
+#include<cmath>
+#include<cstdio>
+#include<cstdlib>
+#include<cstring>
+#include<fstream>
+#include<sstream>
+
+#ifdef _WIN32
+#include<psapi.h>
+#else
+#include<sys/resource.h>
+#endif
+
+// Metrics a baseline is checked against, all of them lower is better.
+static const char* const regression_metrics[] = {
+	"frame_p50_ms", "frame_p95_ms", "frame_p99_ms", "cpu_ms_per_frame", "gpu_p50_ms", "gpu_p95_ms", "peak_memory_bytes",
+};
+
+struct RenderBenchOptions
+{
+	std::string scene = "duck";
+	uint32_t    copies = 1;
+	uint32_t    frames = 500;
+	uint32_t    warmup = 30;
+	uint32_t    width = 800;
+	uint32_t    height = 600;
+	std::string output = "render_bench.json";
+	std::string baseline;
+	double      tolerance = 0.10;
+};
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point begin)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+}
+
+// User plus kernel time of the whole process, every thread included.
+static double ProcessCpuMilliseconds()
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+	auto to_ms = [](const FILETIME& time) {
+		return ((static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime) / 10000.0;
+	};
+	return to_ms(kernel) + to_ms(user);
+#else
+	rusage usage{};
+	getrusage(RUSAGE_SELF, &usage);
+	return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0 + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0;
+#endif
+}
+
+static uint64_t PeakMemoryBytes()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters{};
+	GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+	return counters.PeakWorkingSetSize;
+#else
+	rusage usage{};
+	getrusage(RUSAGE_SELF, &usage);
+	return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+}
+
+// Nearest rank, the same definition the profiler uses.
+static double Percentile(const std::vector<double>& sorted, double p)
+{
+	size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+	return sorted[std::max<size_t>(rank, 1) - 1];
+}
+
+// Replaces the scene's objects with copies laid out on a square grid that
+// covers the area of the original, so the camera sees all of them whatever the count.
+static void ReplicateScene(Scene* scene, uint32_t copies)
+{
+	struct Placed
+	{
+		MeshHandle mesh;
+		glm::mat4  transform;
+		uint32_t   material;
+	};
+
+	std::vector<SceneBatch> batches = scene->GetBatches();
+	std::vector<ObjectHandle> order = scene->GetBatchOrder();
+	std::vector<Placed> originals;
+	for (const auto& batch : batches) {
+		for (uint32_t i = batch.first_instance; i < batch.first_instance + batch.instance_count; ++i) {
+			originals.push_back(Placed{ batch.mesh, scene->GetTransform(order[i]), scene->GetObjectMaterial(order[i]) });
+		}
+	}
+	for (ObjectHandle object : order) {
+		scene->RemoveObject(object);
+	}
+
+	uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(copies))));
+	float scale = 1.0f / side;
+	for (uint32_t copy = 0; copy < copies; ++copy) {
+		glm::vec3 offset((copy % side + 0.5f) * scale - 0.5f, (copy / side + 0.5f) * scale - 0.5f, 0.0f);
+		glm::mat4 placement = glm::scale(glm::translate(glm::mat4(1.0f), offset), glm::vec3(scale));
+		for (const auto& original : originals) {
+			scene->AddObject(original.mesh, placement * original.transform, original.material);
+		}
+	}
+}
+
+// Finds "key": in a file this benchmark wrote, keys are unique across its sections.
+static bool ReadMetric(const std::string& json, const char* key, double& value)
+{
+	std::string pattern = std::string("\"") + key + "\":";
+	size_t position = json.find(pattern);
+	if (position == std::string::npos) {
+		return false;
+	}
+	value = strtod(json.c_str() + position + pattern.size(), nullptr);
+	return true;
+}
+
+static bool ParseOptions(const std::vector<std::string>& args, RenderBenchOptions& options)
+{
+	for (size_t i = 0; i + 1 < args.size(); i += 2) {
+		const std::string& name = args[i];
+		const std::string& value = args[i + 1];
+		if (name == "--scene") {
+			options.scene = value;
+		}
+		else if (name == "--copies") {
+			options.copies = std::max(1, atoi(value.c_str()));
+		}
+		else if (name == "--frames") {
+			options.frames = std::max(1, atoi(value.c_str()));
+		}
+		else if (name == "--warmup") {
+			options.warmup = std::max(0, atoi(value.c_str()));
+		}
+		else if (name == "--width") {
+			options.width = std::max(1, atoi(value.c_str()));
+		}
+		else if (name == "--height") {
+			options.height = std::max(1, atoi(value.c_str()));
+		}
+		else if (name == "--output") {
+			options.output = value;
+		}
+		else if (name == "--baseline") {
+			options.baseline = value;
+		}
+		else if (name == "--tolerance") {
+			options.tolerance = atof(value.c_str());
+		}
+		else {
+			std::cout << "Unknown option " << name << std::endl;
+			return false;
+		}
+	}
+	if (args.size() % 2 != 0) {
+		std::cout << "Option " << args.back() << " has no value" << std::endl;
+		return false;
+	}
+	if (options.scene != "room" && options.scene != "duck") {
+		std::cout << "Unknown scene " << options.scene << ", expected room or duck" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+int RunRenderBench(const std::vector<std::string>& args)
+{
+	RenderBenchOptions options;
+	if (!ParseOptions(args, options)) {
+		std::cout << "Usage: Bench render [--scene duck|room] [--copies N] [--frames N] [--warmup N] [--width N] [--height N]"
+			<< " [--output file] [--baseline file] [--tolerance fraction]" << std::endl;
+		return 1;
+	}
+
+	auto phase_begin = std::chrono::steady_clock::now();
+	Renderer renderer;
+	double renderer_ms = MillisecondsSince(phase_begin);
+
+	phase_begin = std::chrono::steady_clock::now();
+	// The room is the window's own model, the duck ships with the tree and needs nothing else
+	Window* window = renderer.OpenOffscreen(options.width, options.height, "bench", options.scene == "room");
+	// One turn of the scene every 12 seconds at 60 frames per second, whatever the machine does
+	window->SetFixedTimeStep(1.0f / 60.0f);
+	double window_ms = MillisecondsSince(phase_begin);
+
+	phase_begin = std::chrono::steady_clock::now();
+	Scene* scene = window->GetScene();
+	if (options.scene == "duck") {
+		// Y up and about a hundred units tall
+		glm::mat4 duck_transform = glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+		duck_transform = glm::scale(duck_transform, glm::vec3(0.004f));
+		GltfLoader().Load("../models/Duck.glb", scene, duck_transform, renderer.GetThreadPool());
+	}
+	if (options.copies > 1) {
+		ReplicateScene(scene, options.copies);
+	}
+	double scene_ms = MillisecondsSince(phase_begin);
+
+	phase_begin = std::chrono::steady_clock::now();
+	renderer.Run();
+	window->DrawFrame();
+	double first_frame_ms = MillisecondsSince(phase_begin);
+
+	// Streaming finishes at its own pace, measured frames start with every texture resident
+	phase_begin = std::chrono::steady_clock::now();
+	uint32_t streaming_frames = 0;
+	while (renderer.GetTextureStreamer()->GetPendingCount() > 0 && streaming_frames < 10000 && renderer.Run()) {
+		window->DrawFrame();
+		streaming_frames++;
+	}
+	double textures_ms = MillisecondsSince(phase_begin);
+
+	for (uint32_t frame = 0; frame < options.warmup && renderer.Run(); ++frame) {
+		window->DrawFrame();
+	}
+
+	std::vector<double> frame_ms;
+	frame_ms.reserve(options.frames);
+	double cpu_begin = ProcessCpuMilliseconds();
+	auto run_begin = std::chrono::steady_clock::now();
+	for (uint32_t frame = 0; frame < options.frames; ++frame) {
+		auto frame_begin = std::chrono::steady_clock::now();
+		if (!renderer.Run()) {
+			break;
+		}
+		window->DrawFrame();
+		frame_ms.push_back(MillisecondsSince(frame_begin));
+	}
+	vkDeviceWaitIdle(renderer.GetVulkanDevice());
+	double run_ms = MillisecondsSince(run_begin);
+	double cpu_ms = ProcessCpuMilliseconds() - cpu_begin;
+
+	if (frame_ms.empty()) {
+		std::cout << "No frame was drawn" << std::endl;
+		return 1;
+	}
+	std::vector<double> sorted = frame_ms;
+	std::sort(sorted.begin(), sorted.end());
+	double frame_total = 0.0;
+	for (double ms : frame_ms) {
+		frame_total += ms;
+	}
+
+	// GPU times come from the profiler's rolling window, the last BUILD_PROFILER_FRAME_HISTORY frames
+	FrameTimeSummary gpu = renderer.GetProfiler()->GetFrameTimeSummary(FrameTrack::Gpu);
+	MemoryAllocatorStats device_memory = renderer.GetMemoryAllocator()->GetStats();
+
+	std::ostringstream json;
+	json.setf(std::ios::fixed);
+	json.precision(4);
+	json << "{" << std::endl
+		<< "  \"config\": { \"scene\": \"" << options.scene << "\", \"copies\": " << options.copies
+		<< ", \"objects\": " << scene->GetObjectCount() << ", \"frames\": " << frame_ms.size()
+		<< ", \"warmup\": " << options.warmup << ", \"width\": " << options.width << ", \"height\": " << options.height
+		<< ", \"device\": \"" << renderer.GetVulkanPhysicalDeviceProperties().deviceName << "\" }," << std::endl
+		<< "  \"startup\": { \"renderer_ms\": " << renderer_ms << ", \"window_ms\": " << window_ms
+		<< ", \"scene_ms\": " << scene_ms << ", \"first_frame_ms\": " << first_frame_ms
+		<< ", \"textures_ms\": " << textures_ms << ", \"texture_frames\": " << streaming_frames << " }," << std::endl
+		<< "  \"frames\": { \"fps\": " << frame_ms.size() * 1000.0 / run_ms << ", \"frame_average_ms\": " << frame_total / frame_ms.size()
+		<< ", \"frame_p50_ms\": " << Percentile(sorted, 0.50) << ", \"frame_p95_ms\": " << Percentile(sorted, 0.95)
+		<< ", \"frame_p99_ms\": " << Percentile(sorted, 0.99) << ", \"frame_max_ms\": " << sorted.back()
+		<< ", \"cpu_ms_per_frame\": " << cpu_ms / frame_ms.size() << " }," << std::endl
+		<< "  \"gpu\": { \"gpu_frames\": " << gpu.count << ", \"gpu_p50_ms\": " << gpu.p50_ms
+		<< ", \"gpu_p95_ms\": " << gpu.p95_ms << ", \"gpu_p99_ms\": " << gpu.p99_ms << " }," << std::endl
+		<< "  \"memory\": { \"peak_memory_bytes\": " << PeakMemoryBytes()
+		<< ", \"device_reserved_bytes\": " << device_memory.reserved_bytes
+		<< ", \"device_used_bytes\": " << device_memory.used_bytes << " }" << std::endl
+		<< "}" << std::endl;
+
+	std::cout << json.str();
+	std::ofstream output(options.output, std::ios::out | std::ios::trunc);
+	if (!output.is_open()) {
+		std::cout << "Failed to write " << options.output << std::endl;
+		return 1;
+	}
+	output << json.str();
+
+	if (options.baseline.empty()) {
+		return 0;
+	}
+	std::ifstream baseline_file(options.baseline);
+	if (!baseline_file.is_open()) {
+		std::cout << "Failed to read baseline " << options.baseline << ", the CMake target record_render_baseline writes it" << std::endl;
+		return 1;
+	}
+	std::stringstream baseline_stream;
+	baseline_stream << baseline_file.rdbuf();
+	std::string baseline = baseline_stream.str();
+	std::string result = json.str();
+
+	// A baseline missing a metric fails rather than pass without comparing it,
+	// a GPU time of 0 means the baseline's device wrote no timestamps
+	int regressions = 0;
+	for (const char* metric : regression_metrics) {
+		double expected = 0.0, measured = 0.0;
+		if (!ReadMetric(baseline, metric, expected)) {
+			printf("Baseline %s has no %s, record it again\n", options.baseline.c_str(), metric);
+			return 1;
+		}
+		if (!ReadMetric(result, metric, measured) || expected <= 0.0) {
+			continue;
+		}
+		double limit = expected * (1.0 + options.tolerance);
+		if (measured > limit) {
+			printf("REGRESSION %s: %.4f, baseline %.4f, limit %.4f\n", metric, measured, expected, limit);
+			regressions++;
+		}
+	}
+	if (regressions > 0) {
+		printf("%d metric(s) regressed past %.0f%% of %s\n", regressions, options.tolerance * 100.0, options.baseline.c_str());
+		return 1;
+	}
+	printf("Within %.0f%% of %s\n", options.tolerance * 100.0, options.baseline.c_str());
+	return 0;
+}
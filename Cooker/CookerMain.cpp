@@ -0,0 +1,115 @@
+#include"TextureCompressor.h"
+#include"KtxFile.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include<stb_image.h>
+
+#include<algorithm>
+#include<chrono>
+#include<cstring>
+#include<iostream>
+#include<string>
+
+struct CookFormat
+{
+	const char* name;
+	VkFormat    linear_format;
+	VkFormat    srgb_format;
+	const char* description;
+};
+
+// BC5 has no sRGB variant, it only ever holds normals or other linear data
+static const CookFormat cook_formats[] = {
+	{ "bc1",   VK_FORMAT_BC1_RGB_UNORM_BLOCK, VK_FORMAT_BC1_RGB_SRGB_BLOCK, "RGB, 4 bits per texel" },
+	{ "bc3",   VK_FORMAT_BC3_UNORM_BLOCK,     VK_FORMAT_BC3_SRGB_BLOCK,     "RGBA, 8 bits per texel" },
+	{ "bc5",   VK_FORMAT_BC5_UNORM_BLOCK,     VK_FORMAT_BC5_UNORM_BLOCK,    "RG, 8 bits per texel, for normal maps" },
+	{ "bc7",   VK_FORMAT_BC7_UNORM_BLOCK,     VK_FORMAT_BC7_SRGB_BLOCK,     "RGBA, 8 bits per texel (default)" },
+	{ "rgba8", VK_FORMAT_R8G8B8A8_UNORM,      VK_FORMAT_R8G8B8A8_SRGB,      "uncompressed, 32 bits per texel" },
+};
+
+static void PrintUsage()
+{
+	std::cout << "Usage: Cooker <image> [-o <output.ktx2>] [-f <format>] [--linear]" << std::endl;
+	std::cout << "Writes the image with its mip chain as KTX2, next to it unless -o is given." << std::endl;
+	std::cout << "--linear keeps the data out of sRGB, for anything that is not a color." << std::endl;
+	for (const auto& format : cook_formats) {
+		std::cout << "  " << format.name << "\t" << format.description << std::endl;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::string input;
+	std::string output;
+	const CookFormat* format = &cook_formats[3];
+	bool linear = false;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+			output = argv[++i];
+		}
+		else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+			format = nullptr;
+			for (const auto& candidate : cook_formats) {
+				if (strcmp(argv[i + 1], candidate.name) == 0) {
+					format = &candidate;
+				}
+			}
+			if (format == nullptr) {
+				std::cout << "Unknown format " << argv[i + 1] << std::endl;
+				PrintUsage();
+				return 1;
+			}
+			++i;
+		}
+		else if (strcmp(argv[i], "--linear") == 0) {
+			linear = true;
+		}
+		else if (input.empty() && argv[i][0] != '-') {
+			input = argv[i];
+		}
+		else {
+			PrintUsage();
+			return 1;
+		}
+	}
+	if (input.empty()) {
+		PrintUsage();
+		return 1;
+	}
+	if (output.empty()) {
+		output = input.substr(0, input.find_last_of('.')) + ".ktx2";
+	}
+
+	int width, height, channels;
+	stbi_uc* pixels = stbi_load(input.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+	if (pixels == nullptr) {
+		std::cout << "Could not load " << input << ": " << stbi_failure_reason() << std::endl;
+		return 1;
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	VkFormat vk_format = linear ? format->linear_format : format->srgb_format;
+	bool srgb = vk_format != format->linear_format;
+	std::vector<std::vector<uint8_t>> levels = BuildMipChain(pixels, static_cast<uint32_t>(width), static_cast<uint32_t>(height), srgb);
+	stbi_image_free(pixels);
+
+	size_t uncompressed_size = 0;
+	size_t compressed_size = 0;
+	for (size_t i = 0; i < levels.size(); ++i) {
+		uint32_t level_width = std::max<uint32_t>(width >> i, 1);
+		uint32_t level_height = std::max<uint32_t>(height >> i, 1);
+		uncompressed_size += levels[i].size();
+		levels[i] = CompressImage(levels[i].data(), level_width, level_height, vk_format);
+		compressed_size += levels[i].size();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+	if (!KtxFile::Write(output, vk_format, static_cast<uint32_t>(width), static_cast<uint32_t>(height), levels)) {
+		std::cout << "Could not write " << output << std::endl;
+		return 1;
+	}
+	std::cout << "Cooked " << input << " into " << output << " as " << format->name << (srgb ? " sRGB" : "") << ": "
+		<< width << "x" << height << ", " << levels.size() << " levels, " << uncompressed_size / 1024 << " KiB -> "
+		<< compressed_size / 1024 << " KiB in " << seconds << " s" << std::endl;
+	return 0;
+}
@@ -0,0 +1,514 @@
+#include"TextureCompressor.h"
+
+#include<algorithm>
+#include<cfloat>
+#include<cmath>
+#include<cstring>
+
+// Interpolation weights of 4 bit BC7 indices, out of 64
+static const int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// Writes fields into a zeroed block starting at its lowest bit
+struct BlockWriter
+{
+	uint8_t* dst;
+	uint32_t bit;
+
+	void Write(uint32_t value, uint32_t count)
+	{
+		for (uint32_t k = 0; k < count; ++k, ++bit) {
+			if ((value >> k) & 1) {
+				dst[bit >> 3] |= static_cast<uint8_t>(1 << (bit & 7));
+			}
+		}
+	}
+};
+
+static void LoadBlock(const uint8_t* rgba, float pixels[16][4])
+{
+	for (int i = 0; i < 16; ++i) {
+		for (int c = 0; c < 4; ++c) {
+			pixels[i][c] = rgba[i * 4 + c];
+		}
+	}
+}
+
+// Mean of the first channels components and the direction they vary most along, zero for a flat block
+static void PrincipalAxis(const float pixels[16][4], int channels, float mean[4], float axis[4])
+{
+	for (int c = 0; c < 4; ++c) {
+		mean[c] = 0.0f;
+		axis[c] = 0.0f;
+	}
+	for (int i = 0; i < 16; ++i) {
+		for (int c = 0; c < channels; ++c) {
+			mean[c] += pixels[i][c] / 16.0f;
+		}
+	}
+
+	float covariance[4][4] = {};
+	for (int i = 0; i < 16; ++i) {
+		for (int a = 0; a < channels; ++a) {
+			for (int b = 0; b < channels; ++b) {
+				covariance[a][b] += (pixels[i][a] - mean[a]) * (pixels[i][b] - mean[b]);
+			}
+		}
+	}
+
+	// Power iteration from the row of the widest channel, which cannot be orthogonal to the axis
+	int widest = 0;
+	for (int c = 1; c < channels; ++c) {
+		if (covariance[c][c] > covariance[widest][widest]) {
+			widest = c;
+		}
+	}
+	float vector[4] = {};
+	for (int c = 0; c < channels; ++c) {
+		vector[c] = covariance[widest][c];
+	}
+	for (int iteration = 0; iteration < 8; ++iteration) {
+		float next[4] = {};
+		float largest = 0.0f;
+		for (int a = 0; a < channels; ++a) {
+			for (int b = 0; b < channels; ++b) {
+				next[a] += covariance[a][b] * vector[b];
+			}
+			largest = std::max<float>(largest, std::fabs(next[a]));
+		}
+		if (largest < FLT_EPSILON) {
+			return;
+		}
+		for (int c = 0; c < channels; ++c) {
+			vector[c] = next[c] / largest;
+		}
+	}
+
+	float length = 0.0f;
+	for (int c = 0; c < channels; ++c) {
+		length += vector[c] * vector[c];
+	}
+	length = std::sqrt(length);
+	for (int c = 0; c < channels; ++c) {
+		axis[c] = vector[c] / length;
+	}
+}
+
+// Endpoints at the extremes of the texels' projections onto axis
+static void AxisEndpoints(const float pixels[16][4], int channels, const float mean[4], const float axis[4], float low[4], float high[4])
+{
+	float t_min = FLT_MAX;
+	float t_max = -FLT_MAX;
+	for (int i = 0; i < 16; ++i) {
+		float t = 0.0f;
+		for (int c = 0; c < channels; ++c) {
+			t += (pixels[i][c] - mean[c]) * axis[c];
+		}
+		t_min = std::min<float>(t_min, t);
+		t_max = std::max<float>(t_max, t);
+	}
+	for (int c = 0; c < 4; ++c) {
+		low[c] = std::min<float>(std::max<float>(mean[c] + axis[c] * t_min, 0.0f), 255.0f);
+		high[c] = std::min<float>(std::max<float>(mean[c] + axis[c] * t_max, 0.0f), 255.0f);
+	}
+}
+
+// Least squares endpoints for fixed indices, weights[i] is how much texel i takes of endpoint 0
+static bool FitEndpoints(const float pixels[16][4], int channels, const float weights[16], float e0[4], float e1[4])
+{
+	float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+	float ax[4] = {}, bx[4] = {};
+	for (int i = 0; i < 16; ++i) {
+		float a = weights[i];
+		float b = 1.0f - a;
+		aa += a * a;
+		bb += b * b;
+		ab += a * b;
+		for (int c = 0; c < channels; ++c) {
+			ax[c] += a * pixels[i][c];
+			bx[c] += b * pixels[i][c];
+		}
+	}
+	float determinant = aa * bb - ab * ab;
+	if (std::fabs(determinant) < 1e-4f) {
+		return false;
+	}
+	for (int c = 0; c < channels; ++c) {
+		e0[c] = std::min<float>(std::max<float>((ax[c] * bb - bx[c] * ab) / determinant, 0.0f), 255.0f);
+		e1[c] = std::min<float>(std::max<float>((bx[c] * aa - ax[c] * ab) / determinant, 0.0f), 255.0f);
+	}
+	return true;
+}
+
+static uint16_t Pack565(const float* color)
+{
+	uint32_t r = static_cast<uint32_t>(color[0] * 31.0f / 255.0f + 0.5f);
+	uint32_t g = static_cast<uint32_t>(color[1] * 63.0f / 255.0f + 0.5f);
+	uint32_t b = static_cast<uint32_t>(color[2] * 31.0f / 255.0f + 0.5f);
+	return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+static void Unpack565(uint16_t packed, float* color)
+{
+	uint32_t r = packed >> 11;
+	uint32_t g = (packed >> 5) & 63;
+	uint32_t b = packed & 31;
+	color[0] = static_cast<float>((r << 3) | (r >> 2));
+	color[1] = static_cast<float>((g << 2) | (g >> 4));
+	color[2] = static_cast<float>((b << 3) | (b >> 2));
+}
+
+// Nearest of the four colors per texel as 2 bit indices, returns the squared error
+static float BC1Indices(const float pixels[16][4], uint16_t color0, uint16_t color1, uint32_t* indices)
+{
+	float palette[4][3];
+	Unpack565(color0, palette[0]);
+	Unpack565(color1, palette[1]);
+	for (int c = 0; c < 3; ++c) {
+		palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+		palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+	}
+
+	float error = 0.0f;
+	*indices = 0;
+	for (int i = 0; i < 16; ++i) {
+		float best_error = FLT_MAX;
+		uint32_t best = 0;
+		for (uint32_t k = 0; k < 4; ++k) {
+			float e = 0.0f;
+			for (int c = 0; c < 3; ++c) {
+				float d = pixels[i][c] - palette[k][c];
+				e += d * d;
+			}
+			if (e < best_error) {
+				best_error = e;
+				best = k;
+			}
+		}
+		*indices |= best << (2 * i);
+		error += best_error;
+	}
+	return error;
+}
+
+static void EncodeBC1Colors(const float pixels[16][4], uint8_t* dst)
+{
+	float mean[4], axis[4], low[4], high[4];
+	PrincipalAxis(pixels, 3, mean, axis);
+	AxisEndpoints(pixels, 3, mean, axis, low, high);
+
+	uint16_t color0 = Pack565(high);
+	uint16_t color1 = Pack565(low);
+	uint32_t indices;
+	float error = BC1Indices(pixels, color0, color1, &indices);
+
+	static const float ENDPOINT0_WEIGHT[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+	float weights[16];
+	for (int i = 0; i < 16; ++i) {
+		weights[i] = ENDPOINT0_WEIGHT[(indices >> (2 * i)) & 3];
+	}
+	float e0[4], e1[4];
+	if (FitEndpoints(pixels, 3, weights, e0, e1)) {
+		uint16_t refined0 = Pack565(e0);
+		uint16_t refined1 = Pack565(e1);
+		uint32_t refined_indices;
+		if (BC1Indices(pixels, refined0, refined1, &refined_indices) < error) {
+			color0 = refined0;
+			color1 = refined1;
+			indices = refined_indices;
+		}
+	}
+
+	// color0 > color1 selects the four color mode, swapping the endpoints flips the low index bit
+	if (color0 < color1) {
+		std::swap(color0, color1);
+		indices ^= 0x55555555u;
+	}
+	else if (color0 == color1) {
+		indices = 0;
+	}
+
+	dst[0] = static_cast<uint8_t>(color0);
+	dst[1] = static_cast<uint8_t>(color0 >> 8);
+	dst[2] = static_cast<uint8_t>(color1);
+	dst[3] = static_cast<uint8_t>(color1 >> 8);
+	memcpy(dst + 4, &indices, sizeof(indices));
+}
+
+// One channel in eight levels between its extremes
+static void EncodeBC4(const float pixels[16][4], int channel, uint8_t* dst)
+{
+	float low = 255.0f, high = 0.0f;
+	for (int i = 0; i < 16; ++i) {
+		low = std::min<float>(low, pixels[i][channel]);
+		high = std::max<float>(high, pixels[i][channel]);
+	}
+	uint8_t value0 = static_cast<uint8_t>(high);
+	uint8_t value1 = static_cast<uint8_t>(low);
+	memset(dst, 0, 8);
+	dst[0] = value0;
+	dst[1] = value1;
+	if (value0 == value1) {
+		return;
+	}
+
+	float palette[8];
+	palette[0] = value0;
+	palette[1] = value1;
+	for (int k = 2; k < 8; ++k) {
+		palette[k] = ((8 - k) * value0 + (k - 1) * value1) / 7.0f;
+	}
+	uint64_t bits = 0;
+	for (int i = 0; i < 16; ++i) {
+		uint64_t best = 0;
+		float best_error = FLT_MAX;
+		for (int k = 0; k < 8; ++k) {
+			float e = std::fabs(pixels[i][channel] - palette[k]);
+			if (e < best_error) {
+				best_error = e;
+				best = static_cast<uint64_t>(k);
+			}
+		}
+		bits |= best << (3 * i);
+	}
+	for (int b = 0; b < 6; ++b) {
+		dst[2 + b] = static_cast<uint8_t>(bits >> (8 * b));
+	}
+}
+
+void CompressBlockBC1(const uint8_t* rgba, uint8_t* dst)
+{
+	float pixels[16][4];
+	LoadBlock(rgba, pixels);
+	EncodeBC1Colors(pixels, dst);
+}
+
+void CompressBlockBC3(const uint8_t* rgba, uint8_t* dst)
+{
+	float pixels[16][4];
+	LoadBlock(rgba, pixels);
+	EncodeBC4(pixels, 3, dst);
+	EncodeBC1Colors(pixels, dst + 8);
+}
+
+void CompressBlockBC5(const uint8_t* rgba, uint8_t* dst)
+{
+	float pixels[16][4];
+	LoadBlock(rgba, pixels);
+	EncodeBC4(pixels, 0, dst);
+	EncodeBC4(pixels, 1, dst + 8);
+}
+
+// 7 bits per channel plus a p bit shared by all four, the one that lands closer
+static void QuantizeBC7Endpoint(const float* endpoint, uint32_t quantized[4], uint32_t* p_bit)
+{
+	float best_error = FLT_MAX;
+	for (uint32_t p = 0; p < 2; ++p) {
+		uint32_t candidate[4];
+		float error = 0.0f;
+		for (int c = 0; c < 4; ++c) {
+			float q = std::floor((endpoint[c] - p) / 2.0f + 0.5f);
+			candidate[c] = static_cast<uint32_t>(std::min<float>(std::max<float>(q, 0.0f), 127.0f));
+			float d = endpoint[c] - static_cast<float>((candidate[c] << 1) | p);
+			error += d * d;
+		}
+		if (error < best_error) {
+			best_error = error;
+			*p_bit = p;
+			memcpy(quantized, candidate, sizeof(candidate));
+		}
+	}
+}
+
+// Nearest of the sixteen interpolated colors per texel, returns the squared error
+static float BC7Indices(const float pixels[16][4], const uint32_t q0[4], uint32_t p0, const uint32_t q1[4], uint32_t p1, uint32_t indices[16])
+{
+	float palette[16][4];
+	for (int k = 0; k < 16; ++k) {
+		for (int c = 0; c < 4; ++c) {
+			uint32_t e0 = (q0[c] << 1) | p0;
+			uint32_t e1 = (q1[c] << 1) | p1;
+			palette[k][c] = static_cast<float>(((64 - BC7_WEIGHTS[k]) * e0 + BC7_WEIGHTS[k] * e1 + 32) >> 6);
+		}
+	}
+
+	float error = 0.0f;
+	for (int i = 0; i < 16; ++i) {
+		float best_error = FLT_MAX;
+		for (uint32_t k = 0; k < 16; ++k) {
+			float e = 0.0f;
+			for (int c = 0; c < 4; ++c) {
+				float d = pixels[i][c] - palette[k][c];
+				e += d * d;
+			}
+			if (e < best_error) {
+				best_error = e;
+				indices[i] = k;
+			}
+		}
+		error += best_error;
+	}
+	return error;
+}
+
+void CompressBlockBC7(const uint8_t* rgba, uint8_t* dst)
+{
+	float pixels[16][4];
+	LoadBlock(rgba, pixels);
+
+	float mean[4], axis[4], low[4], high[4];
+	PrincipalAxis(pixels, 4, mean, axis);
+	AxisEndpoints(pixels, 4, mean, axis, low, high);
+
+	uint32_t q0[4], q1[4], p0, p1;
+	uint32_t indices[16];
+	QuantizeBC7Endpoint(low, q0, &p0);
+	QuantizeBC7Endpoint(high, q1, &p1);
+	float error = BC7Indices(pixels, q0, p0, q1, p1, indices);
+
+	float weights[16];
+	for (int i = 0; i < 16; ++i) {
+		weights[i] = 1.0f - BC7_WEIGHTS[indices[i]] / 64.0f;
+	}
+	float e0[4], e1[4];
+	if (FitEndpoints(pixels, 4, weights, e0, e1)) {
+		uint32_t r0[4], r1[4], rp0, rp1;
+		uint32_t refined[16];
+		QuantizeBC7Endpoint(e0, r0, &rp0);
+		QuantizeBC7Endpoint(e1, r1, &rp1);
+		if (BC7Indices(pixels, r0, rp0, r1, rp1, refined) < error) {
+			memcpy(q0, r0, sizeof(q0));
+			memcpy(q1, r1, sizeof(q1));
+			memcpy(indices, refined, sizeof(indices));
+			p0 = rp0;
+			p1 = rp1;
+		}
+	}
+
+	// The first index is stored without its top bit, so it has to be below 8
+	if (indices[0] >= 8) {
+		for (int c = 0; c < 4; ++c) {
+			std::swap(q0[c], q1[c]);
+		}
+		std::swap(p0, p1);
+		for (int i = 0; i < 16; ++i) {
+			indices[i] = 15 - indices[i];
+		}
+	}
+
+	memset(dst, 0, 16);
+	BlockWriter writer = { dst, 0 };
+	writer.Write(1 << 6, 7);
+	for (int c = 0; c < 4; ++c) {
+		writer.Write(q0[c], 7);
+		writer.Write(q1[c], 7);
+	}
+	writer.Write(p0, 1);
+	writer.Write(p1, 1);
+	writer.Write(indices[0], 3);
+	for (int i = 1; i < 16; ++i) {
+		writer.Write(indices[i], 4);
+	}
+}
+
+static float SrgbToLinear(float value)
+{
+	float c = value / 255.0f;
+	return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static uint8_t LinearToSrgb(float linear)
+{
+	float c = linear <= 0.0031308f ? linear * 12.92f : 1.055f * std::pow(linear, 1.0f / 2.4f) - 0.055f;
+	return static_cast<uint8_t>(std::min<float>(std::max<float>(c * 255.0f + 0.5f, 0.0f), 255.0f));
+}
+
+std::vector<std::vector<uint8_t>> BuildMipChain(const uint8_t* rgba, uint32_t width, uint32_t height, bool srgb)
+{
+	float to_linear[256];
+	for (int i = 0; i < 256; ++i) {
+		to_linear[i] = SrgbToLinear(static_cast<float>(i));
+	}
+
+	std::vector<std::vector<uint8_t>> levels;
+	levels.emplace_back(rgba, rgba + size_t(width) * height * 4);
+	while (width > 1 || height > 1) {
+		uint32_t next_width = std::max<uint32_t>(width / 2, 1);
+		uint32_t next_height = std::max<uint32_t>(height / 2, 1);
+		const uint8_t* src = levels.back().data();
+		std::vector<uint8_t> dst(size_t(next_width) * next_height * 4);
+
+		for (uint32_t y = 0; y < next_height; ++y) {
+			uint32_t y0 = std::min<uint32_t>(y * 2, height - 1);
+			uint32_t y1 = std::min<uint32_t>(y * 2 + 1, height - 1);
+			for (uint32_t x = 0; x < next_width; ++x) {
+				uint32_t x0 = std::min<uint32_t>(x * 2, width - 1);
+				uint32_t x1 = std::min<uint32_t>(x * 2 + 1, width - 1);
+				const uint8_t* texels[4] = {
+					src + (size_t(y0) * width + x0) * 4, src + (size_t(y0) * width + x1) * 4,
+					src + (size_t(y1) * width + x0) * 4, src + (size_t(y1) * width + x1) * 4 };
+				uint8_t* out = dst.data() + (size_t(y) * next_width + x) * 4;
+				for (int c = 0; c < 4; ++c) {
+					if (srgb && c < 3) {
+						float sum = to_linear[texels[0][c]] + to_linear[texels[1][c]] + to_linear[texels[2][c]] + to_linear[texels[3][c]];
+						out[c] = LinearToSrgb(sum * 0.25f);
+					}
+					else {
+						out[c] = static_cast<uint8_t>((texels[0][c] + texels[1][c] + texels[2][c] + texels[3][c] + 2) / 4);
+					}
+				}
+			}
+		}
+
+		levels.push_back(std::move(dst));
+		width = next_width;
+		height = next_height;
+	}
+	return levels;
+}
+
+std::vector<uint8_t> CompressImage(const uint8_t* rgba, uint32_t width, uint32_t height, VkFormat format)
+{
+	void (*compress_block)(const uint8_t*, uint8_t*) = nullptr;
+	size_t block_size = 16;
+	switch (format) {
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+		compress_block = CompressBlockBC1;
+		block_size = 8;
+		break;
+	case VK_FORMAT_BC3_UNORM_BLOCK:
+	case VK_FORMAT_BC3_SRGB_BLOCK:
+		compress_block = CompressBlockBC3;
+		break;
+	case VK_FORMAT_BC5_UNORM_BLOCK:
+		compress_block = CompressBlockBC5;
+		break;
+	case VK_FORMAT_BC7_UNORM_BLOCK:
+	case VK_FORMAT_BC7_SRGB_BLOCK:
+		compress_block = CompressBlockBC7;
+		break;
+	case VK_FORMAT_R8G8B8A8_UNORM:
+	case VK_FORMAT_R8G8B8A8_SRGB:
+		return std::vector<uint8_t>(rgba, rgba + size_t(width) * height * 4);
+	default:
+		return std::vector<uint8_t>();
+	}
+
+	uint32_t blocks_x = (width + 3) / 4;
+	uint32_t blocks_y = (height + 3) / 4;
+	std::vector<uint8_t> compressed(size_t(blocks_x) * blocks_y * block_size);
+	uint8_t block[64];
+	for (uint32_t by = 0; by < blocks_y; ++by) {
+		for (uint32_t bx = 0; bx < blocks_x; ++bx) {
+			for (uint32_t y = 0; y < 4; ++y) {
+				uint32_t sy = std::min<uint32_t>(by * 4 + y, height - 1);
+				for (uint32_t x = 0; x < 4; ++x) {
+					uint32_t sx = std::min<uint32_t>(bx * 4 + x, width - 1);
+					memcpy(block + (y * 4 + x) * 4, rgba + (size_t(sy) * width + sx) * 4, 4);
+				}
+			}
+			compress_block(block, compressed.data() + (size_t(by) * blocks_x + bx) * block_size);
+		}
+	}
+	return compressed;
+}
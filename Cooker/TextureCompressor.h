@@ -0,0 +1,29 @@
+#pragma once
+
+#include<vulkan/vulkan.h>
+#include<cstdint>
+#include<vector>
+
+// CPU side of the cooker: the mip chain of an RGBA8 image and block
+// encoders for the BC formats KtxFile stores. Encoders take a 4x4 block of
+// RGBA8 texels, row by row, and write one compressed block.
+
+// BC1 without alpha: the principal axis of the colors gives the endpoints,
+// refined once by least squares over the chosen indices. Writes 8 bytes.
+void CompressBlockBC1(const uint8_t* rgba, uint8_t* dst);
+// BC1 colors after a BC4 alpha block. Writes 16 bytes.
+void CompressBlockBC3(const uint8_t* rgba, uint8_t* dst);
+// Red and green as two BC4 blocks, meant for tangent space normal maps. Writes 16 bytes.
+void CompressBlockBC5(const uint8_t* rgba, uint8_t* dst);
+// BC7 mode 6 only: one RGBA line with 7 bit endpoints, shared p bits and 4 bit
+// indices. Not what a full BC7 search reaches, but well above BC1/BC3 on
+// smooth gradients and cheap enough to cook every texture. Writes 16 bytes.
+void CompressBlockBC7(const uint8_t* rgba, uint8_t* dst);
+
+// Every level down to 1x1, level 0 is a copy of rgba. Texels are averaged
+// 2x2, in linear space when srgb is set.
+std::vector<std::vector<uint8_t>> BuildMipChain(const uint8_t* rgba, uint32_t width, uint32_t height, bool srgb);
+
+// Encodes a whole level into format, edge blocks repeat the last row and
+// column. RGBA8 formats come back unchanged. Empty for other formats.
+std::vector<uint8_t> CompressImage(const uint8_t* rgba, uint32_t width, uint32_t height, VkFormat format);
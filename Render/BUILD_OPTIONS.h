@@ -1,6 +1,85 @@
 #pragma once
 
+// 1 enables the validation layers and their debug callback, the benchmark builds with 0 so they stay out of its numbers.
+#ifndef BUILD_ENABLE_VULKAN_DEBUG
 #define BUILD_ENABLE_VULKAN_DEBUG              1
+#endif
+#ifndef BUILD_ENABLE_VULKAN_RUNTIME_DEBUG
 #define BUILD_ENABLE_VULKAN_RUNTIME_DEBUG      1
+#endif
 
-#define BUILD_USE_GLFW      0
\ No newline at end of file
+#define BUILD_USE_GLFW      0
+
+// Frames the CPU may record ahead of the GPU, Window::SetFramesInFlight overrides it.
+#define BUILD_DEFAULT_FRAMES_IN_FLIGHT      2
+
+// Size of the VkDeviceMemory blocks the memory allocator sub-allocates from.
+#define BUILD_MEMORY_BLOCK_SIZE             (64ull * 1024 * 1024)
+
+// Size of the staging ring uploads are copied through, bigger uploads get their own buffer.
+#define BUILD_UPLOAD_STAGING_SIZE           (32ull * 1024 * 1024)
+
+// 1 copies uploads on a transfer only queue family when the device exposes one.
+#define BUILD_ENABLE_TRANSFER_QUEUE         1
+
+// Where the pipeline cache is loaded from at startup and written back to at shutdown.
+#define BUILD_PIPELINE_CACHE_PATH           "pipeline_cache.bin"
+
+// Worker threads in the renderer's thread pool, 0 uses one per core minus the calling thread.
+#define BUILD_WORKER_THREADS                0
+
+// Draws each secondary command buffer records, a frame with fewer draws is recorded inline.
+#define BUILD_DRAWS_PER_RECORDING_TASK      256
+
+// 1 culls objects and writes the draw commands in a compute pass, 0 builds the draw list on the CPU.
+#define BUILD_ENABLE_GPU_CULLING            1
+
+// 1 frustum culls the CPU draw list with the SIMD culler, only used without GPU culling.
+#define BUILD_ENABLE_CPU_CULLING            1
+
+// 1 reorders imported meshes for the vertex cache and vertex fetch, logging ACMR and ATVR before and after.
+#define BUILD_ENABLE_MESH_OPTIMIZATION      1
+
+// ACMR factor the overdraw pass may give up to sort triangle clusters outside in, 0 skips the pass.
+#define BUILD_MESH_OVERDRAW_THRESHOLD       1.05f
+
+// 1 maps welded and optimized OBJ meshes from a <model>.meshcache file next to the model instead of parsing it.
+#define BUILD_ENABLE_MESH_CACHE             1
+
+// 1 uploads vertices as 20 byte PackedVertex and indices as 16 bit where every mesh allows it, 0 as fp32 Vertex and 32 bit.
+// PackedVertex clamps texture coordinates to 0..1, meshes with repeating UVs need 0.
+#define BUILD_ENABLE_VERTEX_QUANTIZATION    1
+
+// 1 decodes KHR_draco_mesh_compression primitives with the Draco library, CMake fetches it and Visual Studio expects it built in C:\draco.
+#ifndef BUILD_ENABLE_DRACO
+#define BUILD_ENABLE_DRACO                  1
+#endif
+
+// 1 loads the cooked <texture>.ktx2 (BC compressed, mips included) when it exists and the device can sample it, 0 always decodes the PNG.
+#define BUILD_ENABLE_COOKED_TEXTURES        1
+
+// Bytes of decoded textures the streamer stages per frame, one texture always goes even if it is larger.
+#define BUILD_TEXTURE_UPLOAD_BUDGET         (16ull * 1024 * 1024)
+
+// 1 generates texture mips with one compute dispatch where the format allows, 0 blits them level by level.
+#define BUILD_ENABLE_COMPUTE_MIPMAPS        1
+
+// Slots in the bindless texture table, clamped to what the device allows for update after bind sets.
+#define BUILD_BINDLESS_TEXTURE_COUNT        4096
+
+// 1 records profiler scopes and GPU timestamps and writes the trace at exit, 0 only keeps frame times.
+#define BUILD_ENABLE_PROFILER               1
+
+// Frames the rolling frame time percentiles are taken over.
+#define BUILD_PROFILER_FRAME_HISTORY        1024
+
+// Newest profiler events kept for the trace, older ones are dropped.
+#define BUILD_PROFILER_TRACE_EVENTS         (256 * 1024)
+
+// Chrome trace JSON the renderer writes on shutdown.
+#define BUILD_PROFILER_TRACE_PATH           "profile_trace.json"
+
+// Linux only: 1 opens an XCB window, 0 renders through VK_EXT_headless_surface.
+#ifndef BUILD_USE_XCB
+#define BUILD_USE_XCB       0
+#endif
\ No newline at end of file
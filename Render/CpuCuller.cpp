@@ -0,0 +1,248 @@
+#include"CpuCuller.h"
+#include"CpuFeatures.h"
+
+#include<cmath>
+
+namespace {
+
+struct CullBounds
+{
+	const float* center_x;
+	const float* center_y;
+	const float* center_z;
+	const float* extent_x;
+	const float* extent_y;
+	const float* extent_z;
+	const float* radius;
+};
+
+// The sphere is outside a plane when its signed distance is below -radius, the
+// box when it is below -(|n.x| * e.x + |n.y| * e.y + |n.z| * e.z).
+template<bool BOXES>
+uint32_t CullScalar(const CullBounds& bounds, const Frustum& frustum, uint32_t first, uint32_t end, uint32_t* visible)
+{
+	uint32_t visible_count = 0;
+	for (uint32_t i = first; i < end; ++i) {
+		bool inside = true;
+		for (const auto& plane : frustum.planes) {
+			float distance = plane.x * bounds.center_x[i] + plane.y * bounds.center_y[i] + plane.z * bounds.center_z[i] + plane.w;
+			float reach = BOXES
+				? std::fabs(plane.x) * bounds.extent_x[i] + std::fabs(plane.y) * bounds.extent_y[i] + std::fabs(plane.z) * bounds.extent_z[i]
+				: bounds.radius[i];
+			inside = inside && distance >= -reach;
+		}
+		// Written unconditionally, only counted when visible
+		visible[visible_count] = i;
+		visible_count += inside ? 1 : 0;
+	}
+	return visible_count;
+}
+
+#if CPU_X86
+
+template<bool BOXES>
+uint32_t CullSse(const CullBounds& bounds, const Frustum& frustum, uint32_t first, uint32_t end, uint32_t* visible)
+{
+	__m128 plane_x[6], plane_y[6], plane_z[6], plane_w[6];
+	__m128 abs_x[6], abs_y[6], abs_z[6];
+	for (int p = 0; p < 6; ++p) {
+		plane_x[p] = _mm_set1_ps(frustum.planes[p].x);
+		plane_y[p] = _mm_set1_ps(frustum.planes[p].y);
+		plane_z[p] = _mm_set1_ps(frustum.planes[p].z);
+		plane_w[p] = _mm_set1_ps(frustum.planes[p].w);
+		abs_x[p] = _mm_set1_ps(std::fabs(frustum.planes[p].x));
+		abs_y[p] = _mm_set1_ps(std::fabs(frustum.planes[p].y));
+		abs_z[p] = _mm_set1_ps(std::fabs(frustum.planes[p].z));
+	}
+	const __m128 zero = _mm_setzero_ps();
+
+	uint32_t visible_count = 0;
+	uint32_t i = first;
+	for (; i + 4 <= end; i += 4) {
+		__m128 center_x = _mm_loadu_ps(bounds.center_x + i);
+		__m128 center_y = _mm_loadu_ps(bounds.center_y + i);
+		__m128 center_z = _mm_loadu_ps(bounds.center_z + i);
+		__m128 extent_x = zero, extent_y = zero, extent_z = zero, negative_radius = zero;
+		if (BOXES) {
+			extent_x = _mm_loadu_ps(bounds.extent_x + i);
+			extent_y = _mm_loadu_ps(bounds.extent_y + i);
+			extent_z = _mm_loadu_ps(bounds.extent_z + i);
+		}
+		else {
+			negative_radius = _mm_sub_ps(zero, _mm_loadu_ps(bounds.radius + i));
+		}
+
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int p = 0; p < 6; ++p) {
+			__m128 distance = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(plane_x[p], center_x), _mm_mul_ps(plane_y[p], center_y)),
+				_mm_add_ps(_mm_mul_ps(plane_z[p], center_z), plane_w[p]));
+			__m128 limit = BOXES
+				? _mm_sub_ps(zero, _mm_add_ps(_mm_add_ps(_mm_mul_ps(abs_x[p], extent_x), _mm_mul_ps(abs_y[p], extent_y)), _mm_mul_ps(abs_z[p], extent_z)))
+				: negative_radius;
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, limit));
+		}
+
+		int mask = _mm_movemask_ps(inside);
+		for (uint32_t lane = 0; lane < 4; ++lane) {
+			visible[visible_count] = i + lane;
+			visible_count += (mask >> lane) & 1;
+		}
+	}
+	return visible_count + CullScalar<BOXES>(bounds, frustum, i, end, visible + visible_count);
+}
+
+template<bool BOXES>
+CPU_TARGET_AVX2 uint32_t CullAvx2(const CullBounds& bounds, const Frustum& frustum, uint32_t first, uint32_t end, uint32_t* visible)
+{
+	__m256 plane_x[6], plane_y[6], plane_z[6], plane_w[6];
+	__m256 abs_x[6], abs_y[6], abs_z[6];
+	for (int p = 0; p < 6; ++p) {
+		plane_x[p] = _mm256_set1_ps(frustum.planes[p].x);
+		plane_y[p] = _mm256_set1_ps(frustum.planes[p].y);
+		plane_z[p] = _mm256_set1_ps(frustum.planes[p].z);
+		plane_w[p] = _mm256_set1_ps(frustum.planes[p].w);
+		abs_x[p] = _mm256_set1_ps(std::fabs(frustum.planes[p].x));
+		abs_y[p] = _mm256_set1_ps(std::fabs(frustum.planes[p].y));
+		abs_z[p] = _mm256_set1_ps(std::fabs(frustum.planes[p].z));
+	}
+	const __m256 zero = _mm256_setzero_ps();
+
+	uint32_t visible_count = 0;
+	uint32_t i = first;
+	for (; i + 8 <= end; i += 8) {
+		__m256 center_x = _mm256_loadu_ps(bounds.center_x + i);
+		__m256 center_y = _mm256_loadu_ps(bounds.center_y + i);
+		__m256 center_z = _mm256_loadu_ps(bounds.center_z + i);
+		__m256 extent_x = zero, extent_y = zero, extent_z = zero, negative_radius = zero;
+		if (BOXES) {
+			extent_x = _mm256_loadu_ps(bounds.extent_x + i);
+			extent_y = _mm256_loadu_ps(bounds.extent_y + i);
+			extent_z = _mm256_loadu_ps(bounds.extent_z + i);
+		}
+		else {
+			negative_radius = _mm256_sub_ps(zero, _mm256_loadu_ps(bounds.radius + i));
+		}
+
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (int p = 0; p < 6; ++p) {
+			__m256 distance = _mm256_add_ps(
+				_mm256_add_ps(_mm256_mul_ps(plane_x[p], center_x), _mm256_mul_ps(plane_y[p], center_y)),
+				_mm256_add_ps(_mm256_mul_ps(plane_z[p], center_z), plane_w[p]));
+			__m256 limit = BOXES
+				? _mm256_sub_ps(zero, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(abs_x[p], extent_x), _mm256_mul_ps(abs_y[p], extent_y)), _mm256_mul_ps(abs_z[p], extent_z)))
+				: negative_radius;
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, limit, _CMP_GE_OQ));
+		}
+
+		int mask = _mm256_movemask_ps(inside);
+		for (uint32_t lane = 0; lane < 8; ++lane) {
+			visible[visible_count] = i + lane;
+			visible_count += (mask >> lane) & 1;
+		}
+	}
+	return visible_count + CullScalar<BOXES>(bounds, frustum, i, end, visible + visible_count);
+}
+
+#endif // CPU_X86
+
+template<bool BOXES>
+uint32_t Cull(CullKernel kernel, const CullBounds& bounds, const Frustum& frustum, uint32_t first, uint32_t end, uint32_t* visible)
+{
+	switch (kernel) {
+#if CPU_X86
+	case CullKernel::Avx2:
+		return CullAvx2<BOXES>(bounds, frustum, first, end, visible);
+	case CullKernel::Sse:
+		return CullSse<BOXES>(bounds, frustum, first, end, visible);
+#endif
+	default:
+		return CullScalar<BOXES>(bounds, frustum, first, end, visible);
+	}
+}
+
+}
+
+CpuCuller::CpuCuller()
+{
+	_kernel = GetBestKernel();
+}
+
+CullKernel CpuCuller::GetBestKernel()
+{
+#if CPU_X86
+	// SSE2 is part of every x86 target the project builds for
+	return CpuSupportsAvx2() ? CullKernel::Avx2 : CullKernel::Sse;
+#else
+	return CullKernel::Scalar;
+#endif
+}
+
+const char* CpuCuller::GetKernelName(CullKernel kernel)
+{
+	switch (kernel) {
+	case CullKernel::Sse:
+		return "sse";
+	case CullKernel::Avx2:
+		return "avx2";
+	default:
+		return "scalar";
+	}
+}
+
+void CpuCuller::Resize(uint32_t count)
+{
+	_center_x.resize(count, 0.0f);
+	_center_y.resize(count, 0.0f);
+	_center_z.resize(count, 0.0f);
+	_extent_x.resize(count, 0.0f);
+	_extent_y.resize(count, 0.0f);
+	_extent_z.resize(count, 0.0f);
+	_radius.resize(count, 0.0f);
+}
+
+uint32_t CpuCuller::GetCount() const
+{
+	return static_cast<uint32_t>(_radius.size());
+}
+
+void CpuCuller::SetBounds(uint32_t index, const glm::vec3& center, const glm::vec3& extents, float radius)
+{
+	_center_x[index] = center.x;
+	_center_y[index] = center.y;
+	_center_z[index] = center.z;
+	_extent_x[index] = extents.x;
+	_extent_y[index] = extents.y;
+	_extent_z[index] = extents.z;
+	_radius[index] = radius;
+}
+
+void CpuCuller::SetSphere(uint32_t index, const glm::vec3& center, float radius)
+{
+	SetBounds(index, center, glm::vec3(radius), radius);
+}
+
+uint32_t CpuCuller::CullSpheres(const Frustum& frustum, uint32_t first, uint32_t count, uint32_t* visible) const
+{
+	assert(first + count <= GetCount());
+	CullBounds bounds = { _center_x.data(), _center_y.data(), _center_z.data(), _extent_x.data(), _extent_y.data(), _extent_z.data(), _radius.data() };
+	return Cull<false>(_kernel, bounds, frustum, first, first + count, visible);
+}
+
+uint32_t CpuCuller::CullBoxes(const Frustum& frustum, uint32_t first, uint32_t count, uint32_t* visible) const
+{
+	assert(first + count <= GetCount());
+	CullBounds bounds = { _center_x.data(), _center_y.data(), _center_z.data(), _extent_x.data(), _extent_y.data(), _extent_z.data(), _radius.data() };
+	return Cull<true>(_kernel, bounds, frustum, first, first + count, visible);
+}
+
+void CpuCuller::SetKernel(CullKernel kernel)
+{
+	CullKernel best = GetBestKernel();
+	_kernel = static_cast<int>(kernel) <= static_cast<int>(best) ? kernel : best;
+}
+
+CullKernel CpuCuller::GetKernel() const
+{
+	return _kernel;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include"allincludes.h"
+#include"Frustum.h"
+
+enum class CullKernel
+{
+	Scalar,
+	Sse,     // 4 objects per instruction
+	Avx2,    // 8 objects per instruction
+};
+
+// Frustum culling on the CPU for targets where a compute pass is not wanted.
+// Bounds are kept as structure of arrays (one array per component), so the
+// SIMD kernels load 4 or 8 objects at a time and test all of them against a
+// plane with a handful of instructions. Every object has a bounding sphere
+// and an axis aligned box sharing the same center.
+class CpuCuller
+{
+public:
+	CpuCuller();
+
+	// Best kernel the running CPU supports.
+	static CullKernel GetBestKernel();
+	static const char* GetKernelName(CullKernel kernel);
+
+	// Changes the number of objects, new ones get empty bounds at the origin.
+	void Resize(uint32_t count);
+	uint32_t GetCount() const;
+
+	void SetBounds(uint32_t index, const glm::vec3& center, const glm::vec3& extents, float radius);
+	void SetSphere(uint32_t index, const glm::vec3& center, float radius);
+
+	// Writes the indices of the objects in [first, first + count) that touch
+	// the frustum to visible in ascending order and returns how many there are.
+	// visible needs room for count entries.
+	uint32_t CullSpheres(const Frustum& frustum, uint32_t first, uint32_t count, uint32_t* visible) const;
+	uint32_t CullBoxes(const Frustum& frustum, uint32_t first, uint32_t count, uint32_t* visible) const;
+
+	// Overrides the kernel picked at construction, falls back to the best supported one.
+	void SetKernel(CullKernel kernel);
+	CullKernel GetKernel() const;
+
+private:
+	std::vector<float> _center_x;
+	std::vector<float> _center_y;
+	std::vector<float> _center_z;
+	std::vector<float> _extent_x;
+	std::vector<float> _extent_y;
+	std::vector<float> _extent_z;
+	std::vector<float> _radius;
+
+	CullKernel         _kernel = CullKernel::Scalar;
+};
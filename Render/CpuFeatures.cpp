@@ -0,0 +1,38 @@
+#include"CpuFeatures.h"
+
+#if CPU_X86
+
+#if defined(_MSC_VER)
+#include<intrin.h>
+#endif
+
+static bool DetectAvx2()
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) {
+		return false;
+	}
+	// The OS has to save the YMM registers as well
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) {
+		return false;
+	}
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+bool CpuSupportsAvx2()
+{
+	static const bool avx2 = DetectAvx2();
+	return avx2;
+}
+
+#endif // CPU_X86
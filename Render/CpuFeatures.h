@@ -0,0 +1,22 @@
+#pragma once
+
+// x86 SIMD detection shared by the CPU kernels. CPU_X86 is 1 when SSE and AVX2
+// intrinsics are available to the compiler; CPU_TARGET_AVX2 goes in front of
+// a function that uses AVX2, which may then only run when CpuSupportsAvx2().
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CPU_X86 1
+#include<immintrin.h>
+#if defined(_MSC_VER)
+// MSVC accepts AVX2 intrinsics in any function
+#define CPU_TARGET_AVX2
+#else
+#define CPU_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#else
+#define CPU_X86 0
+#endif
+
+#if CPU_X86
+// Checked once, the result is cached.
+bool CpuSupportsAvx2();
+#endif
@@ -0,0 +1,330 @@
+#include"CpuMipGenerator.h"
+#include"CpuFeatures.h"
+
+#include<algorithm>
+#include<cmath>
+#include<cstring>
+
+namespace {
+
+// Linear values are encoded through a table this long, fine enough that the
+// steep start of the sRGB curve stays within a tenth of a step of 8 bits
+const uint32_t SRGB_ENCODE_STEPS = 16384;
+
+// Rows of a level one task takes, in texels of the level written
+const uint32_t TEXELS_PER_TASK = 64 * 1024;
+
+struct SrgbTables
+{
+	// 0..255 decode sRGB to linear, 256..511 hold the byte itself for alpha
+	float   to_linear[512];
+	uint8_t to_srgb[SRGB_ENCODE_STEPS];
+};
+
+SrgbTables BuildSrgbTables()
+{
+	SrgbTables tables;
+	for (int i = 0; i < 256; ++i) {
+		float c = i / 255.0f;
+		tables.to_linear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+		tables.to_linear[256 + i] = static_cast<float>(i);
+	}
+	for (uint32_t i = 0; i < SRGB_ENCODE_STEPS; ++i) {
+		float c = i / static_cast<float>(SRGB_ENCODE_STEPS - 1);
+		float srgb = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+		tables.to_srgb[i] = static_cast<uint8_t>(std::min<float>(srgb * 255.0f + 0.5f, 255.0f));
+	}
+	return tables;
+}
+
+const SrgbTables& GetSrgbTables()
+{
+	static const SrgbTables tables = BuildSrgbTables();
+	return tables;
+}
+
+struct MipLevelPair
+{
+	const uint8_t* src;
+	uint32_t       src_width;
+	uint32_t       src_height;
+	uint8_t*       dst;
+	uint32_t       dst_width;
+	bool           srgb;
+};
+
+// One texel from the 2x2 texels starting at a and b. Color sums are scaled to
+// the encode table, the alpha sum (and UNORM color) is averaged with rounding.
+inline void DownsampleTexel(const SrgbTables& tables, bool srgb, const uint8_t* a0, const uint8_t* a1, const uint8_t* b0, const uint8_t* b1, uint8_t* out)
+{
+	for (int c = 0; c < 4; ++c) {
+		if (srgb && c < 3) {
+			float sum = tables.to_linear[a0[c]] + tables.to_linear[a1[c]] + tables.to_linear[b0[c]] + tables.to_linear[b1[c]];
+			uint32_t index = std::min<uint32_t>(static_cast<uint32_t>(sum * (0.25f * (SRGB_ENCODE_STEPS - 1)) + 0.5f), SRGB_ENCODE_STEPS - 1);
+			out[c] = tables.to_srgb[index];
+		}
+		else {
+			out[c] = static_cast<uint8_t>((a0[c] + a1[c] + b0[c] + b1[c] + 2) / 4);
+		}
+	}
+}
+
+// Texels [first, end) of row y. A level one texel wide or high averages its only column or row with itself.
+void DownsampleRowScalar(const MipLevelPair& level, uint32_t y, uint32_t first, uint32_t end)
+{
+	const SrgbTables& tables = GetSrgbTables();
+	uint32_t y0 = y * 2;
+	uint32_t y1 = std::min<uint32_t>(y * 2 + 1, level.src_height - 1);
+	const uint8_t* row_a = level.src + size_t(y0) * level.src_width * 4;
+	const uint8_t* row_b = level.src + size_t(y1) * level.src_width * 4;
+	uint8_t* out = level.dst + size_t(y) * level.dst_width * 4;
+	for (uint32_t x = first; x < end; ++x) {
+		uint32_t x0 = x * 2;
+		uint32_t x1 = std::min<uint32_t>(x * 2 + 1, level.src_width - 1);
+		DownsampleTexel(tables, level.srgb, row_a + x0 * 4, row_a + x1 * 4, row_b + x0 * 4, row_b + x1 * 4, out + x * 4);
+	}
+}
+
+#if CPU_X86
+
+// The SIMD kernels leave whatever is left of a row after their last full step
+// to the scalar one. Once the source is at least two texels wide, texel x of
+// a row reads source texels 2x and 2x + 1, which never pass the edge.
+void DownsampleRowSse(const MipLevelPair& level, uint32_t y)
+{
+	uint32_t y0 = y * 2;
+	uint32_t y1 = std::min<uint32_t>(y * 2 + 1, level.src_height - 1);
+	const uint8_t* row_a = level.src + size_t(y0) * level.src_width * 4;
+	const uint8_t* row_b = level.src + size_t(y1) * level.src_width * 4;
+	uint8_t* out = level.dst + size_t(y) * level.dst_width * 4;
+
+	uint32_t x = 0;
+	if (level.src_width < 2) {
+		DownsampleRowScalar(level, y, 0, level.dst_width);
+		return;
+	}
+
+	if (!level.srgb) {
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i two = _mm_set1_epi16(2);
+		for (; x + 2 <= level.dst_width; x += 2) {
+			__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row_a + x * 8));
+			__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row_b + x * 8));
+			// Source texels 0 and 1 in the low sums, 2 and 3 in the high ones
+			__m128i low = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+			__m128i high = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+			__m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(low, high), _mm_unpackhi_epi64(low, high));
+			__m128i average = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(out + x * 4), _mm_packus_epi16(average, average));
+		}
+	}
+	else {
+		const SrgbTables& tables = GetSrgbTables();
+		const float* lut = tables.to_linear;
+		const __m128 scale = _mm_setr_ps(0.25f * (SRGB_ENCODE_STEPS - 1), 0.25f * (SRGB_ENCODE_STEPS - 1), 0.25f * (SRGB_ENCODE_STEPS - 1), 0.25f);
+		const __m128 limit = _mm_setr_ps(SRGB_ENCODE_STEPS - 1, SRGB_ENCODE_STEPS - 1, SRGB_ENCODE_STEPS - 1, 255.0f);
+		const __m128 half = _mm_set1_ps(0.5f);
+		alignas(16) int32_t lanes[4];
+		for (; x < level.dst_width; ++x) {
+			const uint8_t* texels[4] = { row_a + x * 8, row_a + x * 8 + 4, row_b + x * 8, row_b + x * 8 + 4 };
+			__m128 sum = _mm_setzero_ps();
+			for (const uint8_t* texel : texels) {
+				sum = _mm_add_ps(sum, _mm_setr_ps(lut[texel[0]], lut[texel[1]], lut[texel[2]], lut[256 + texel[3]]));
+			}
+			__m128 scaled = _mm_min_ps(_mm_add_ps(_mm_mul_ps(sum, scale), half), limit);
+			_mm_store_si128(reinterpret_cast<__m128i*>(lanes), _mm_cvttps_epi32(scaled));
+			uint8_t* texel_out = out + x * 4;
+			texel_out[0] = tables.to_srgb[lanes[0]];
+			texel_out[1] = tables.to_srgb[lanes[1]];
+			texel_out[2] = tables.to_srgb[lanes[2]];
+			texel_out[3] = static_cast<uint8_t>(lanes[3]);
+		}
+	}
+	DownsampleRowScalar(level, y, x, level.dst_width);
+}
+
+CPU_TARGET_AVX2 void DownsampleRowAvx2(const MipLevelPair& level, uint32_t y)
+{
+	uint32_t y0 = y * 2;
+	uint32_t y1 = std::min<uint32_t>(y * 2 + 1, level.src_height - 1);
+	const uint8_t* row_a = level.src + size_t(y0) * level.src_width * 4;
+	const uint8_t* row_b = level.src + size_t(y1) * level.src_width * 4;
+	uint8_t* out = level.dst + size_t(y) * level.dst_width * 4;
+
+	uint32_t x = 0;
+	if (level.src_width < 2) {
+		DownsampleRowScalar(level, y, 0, level.dst_width);
+		return;
+	}
+
+	if (!level.srgb) {
+		const __m256i two = _mm256_set1_epi16(2);
+		for (; x + 4 <= level.dst_width; x += 4) {
+			__m256i a_low = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row_a + x * 8)));
+			__m256i a_high = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row_a + x * 8 + 16)));
+			__m256i b_low = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row_b + x * 8)));
+			__m256i b_high = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row_b + x * 8 + 16)));
+			// 64 bit elements are source texels: low holds 0 1 | 2 3, high 4 5 | 6 7
+			__m256i low = _mm256_add_epi16(a_low, b_low);
+			__m256i high = _mm256_add_epi16(a_high, b_high);
+			// Destination texels 0 2 | 1 3, put back in order before packing
+			__m256i sum = _mm256_add_epi16(_mm256_unpacklo_epi64(low, high), _mm256_unpackhi_epi64(low, high));
+			__m256i average = _mm256_permute4x64_epi64(_mm256_srli_epi16(_mm256_add_epi16(sum, two), 2), _MM_SHUFFLE(3, 1, 2, 0));
+			__m128i packed = _mm_packus_epi16(_mm256_castsi256_si128(average), _mm256_extracti128_si256(average, 1));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 4), packed);
+		}
+	}
+	else {
+		const SrgbTables& tables = GetSrgbTables();
+		// Alpha lanes look up the second half of the table
+		const __m256i alpha_offset = _mm256_setr_epi32(0, 0, 0, 256, 0, 0, 0, 256);
+		const float color_scale = 0.25f * (SRGB_ENCODE_STEPS - 1);
+		const __m256 scale = _mm256_setr_ps(color_scale, color_scale, color_scale, 0.25f, color_scale, color_scale, color_scale, 0.25f);
+		const __m256 limit = _mm256_setr_ps(SRGB_ENCODE_STEPS - 1, SRGB_ENCODE_STEPS - 1, SRGB_ENCODE_STEPS - 1, 255.0f,
+			SRGB_ENCODE_STEPS - 1, SRGB_ENCODE_STEPS - 1, SRGB_ENCODE_STEPS - 1, 255.0f);
+		const __m256 half = _mm256_set1_ps(0.5f);
+		alignas(32) int32_t lanes[8];
+		for (; x + 2 <= level.dst_width; x += 2) {
+			// Two source texels per gather
+			__m256 a01 = _mm256_i32gather_ps(tables.to_linear, _mm256_add_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(row_a + x * 8))), alpha_offset), 4);
+			__m256 a23 = _mm256_i32gather_ps(tables.to_linear, _mm256_add_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(row_a + x * 8 + 8))), alpha_offset), 4);
+			__m256 b01 = _mm256_i32gather_ps(tables.to_linear, _mm256_add_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(row_b + x * 8))), alpha_offset), 4);
+			__m256 b23 = _mm256_i32gather_ps(tables.to_linear, _mm256_add_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(row_b + x * 8 + 8))), alpha_offset), 4);
+			__m256 column01 = _mm256_add_ps(a01, b01);
+			__m256 column23 = _mm256_add_ps(a23, b23);
+			__m256 sum = _mm256_add_ps(_mm256_permute2f128_ps(column01, column23, 0x20), _mm256_permute2f128_ps(column01, column23, 0x31));
+			__m256 scaled = _mm256_min_ps(_mm256_add_ps(_mm256_mul_ps(sum, scale), half), limit);
+			_mm256_store_si256(reinterpret_cast<__m256i*>(lanes), _mm256_cvttps_epi32(scaled));
+			uint8_t* texel_out = out + x * 4;
+			for (int i = 0; i < 8; i += 4) {
+				texel_out[i + 0] = tables.to_srgb[lanes[i + 0]];
+				texel_out[i + 1] = tables.to_srgb[lanes[i + 1]];
+				texel_out[i + 2] = tables.to_srgb[lanes[i + 2]];
+				texel_out[i + 3] = static_cast<uint8_t>(lanes[i + 3]);
+			}
+		}
+	}
+	DownsampleRowScalar(level, y, x, level.dst_width);
+}
+
+#endif // CPU_X86
+
+}
+
+CpuMipGenerator::CpuMipGenerator()
+{
+	_kernel = GetBestKernel();
+}
+
+MipKernel CpuMipGenerator::GetBestKernel()
+{
+#if CPU_X86
+	// SSE2 is part of every x86 target the project builds for
+	return CpuSupportsAvx2() ? MipKernel::Avx2 : MipKernel::Sse;
+#else
+	return MipKernel::Scalar;
+#endif
+}
+
+const char* CpuMipGenerator::GetKernelName(MipKernel kernel)
+{
+	switch (kernel) {
+	case MipKernel::Sse:
+		return "sse";
+	case MipKernel::Avx2:
+		return "avx2";
+	default:
+		return "scalar";
+	}
+}
+
+bool CpuMipGenerator::IsSupported(VkFormat format)
+{
+	switch (format) {
+	case VK_FORMAT_R8G8B8A8_UNORM:
+	case VK_FORMAT_R8G8B8A8_SRGB:
+	case VK_FORMAT_B8G8R8A8_UNORM:
+	case VK_FORMAT_B8G8R8A8_SRGB:
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool CpuMipGenerator::IsSrgb(VkFormat format)
+{
+	return format == VK_FORMAT_R8G8B8A8_SRGB || format == VK_FORMAT_B8G8R8A8_SRGB;
+}
+
+std::vector<uint8_t> CpuMipGenerator::Generate(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t mip_levels, bool srgb,
+	ThreadPool* pool, std::vector<VkDeviceSize>* level_offsets) const
+{
+	level_offsets->resize(mip_levels);
+	VkDeviceSize size = 0;
+	for (uint32_t level = 0; level < mip_levels; ++level) {
+		(*level_offsets)[level] = size;
+		size += VkDeviceSize(std::max<uint32_t>(width >> level, 1)) * std::max<uint32_t>(height >> level, 1) * 4;
+	}
+
+	std::vector<uint8_t> data(static_cast<size_t>(size));
+	memcpy(data.data(), rgba, size_t(width) * height * 4);
+
+	for (uint32_t level = 1; level < mip_levels; ++level) {
+		uint32_t src_width = std::max<uint32_t>(width >> (level - 1), 1);
+		uint32_t src_height = std::max<uint32_t>(height >> (level - 1), 1);
+		uint32_t dst_width = std::max<uint32_t>(width >> level, 1);
+		uint32_t dst_height = std::max<uint32_t>(height >> level, 1);
+		const uint8_t* src = data.data() + (*level_offsets)[level - 1];
+		uint8_t* dst = data.data() + (*level_offsets)[level];
+
+		uint32_t rows_per_task = std::max<uint32_t>(TEXELS_PER_TASK / dst_width, 1);
+		uint32_t task_count = (dst_height + rows_per_task - 1) / rows_per_task;
+		if (pool == nullptr || task_count == 1) {
+			DownsampleRows(src, src_width, src_height, dst, 0, dst_height, srgb);
+			continue;
+		}
+		pool->ParallelFor(task_count, [&](uint32_t task, uint32_t) {
+			uint32_t first_row = task * rows_per_task;
+			DownsampleRows(src, src_width, src_height, dst, first_row, std::min<uint32_t>(first_row + rows_per_task, dst_height), srgb);
+		});
+	}
+	return data;
+}
+
+void CpuMipGenerator::DownsampleRows(const uint8_t* src, uint32_t src_width, uint32_t src_height, uint8_t* dst, uint32_t first_row, uint32_t end_row, bool srgb) const
+{
+	MipLevelPair level;
+	level.src = src;
+	level.src_width = src_width;
+	level.src_height = src_height;
+	level.dst = dst;
+	level.dst_width = std::max<uint32_t>(src_width / 2, 1);
+	level.srgb = srgb;
+
+	for (uint32_t y = first_row; y < end_row; ++y) {
+		switch (_kernel) {
+#if CPU_X86
+		case MipKernel::Avx2:
+			DownsampleRowAvx2(level, y);
+			break;
+		case MipKernel::Sse:
+			DownsampleRowSse(level, y);
+			break;
+#endif
+		default:
+			DownsampleRowScalar(level, y, 0, level.dst_width);
+			break;
+		}
+	}
+}
+
+void CpuMipGenerator::SetKernel(MipKernel kernel)
+{
+	MipKernel best = GetBestKernel();
+	_kernel = static_cast<int>(kernel) <= static_cast<int>(best) ? kernel : best;
+}
+
+MipKernel CpuMipGenerator::GetKernel() const
+{
+	return _kernel;
+}
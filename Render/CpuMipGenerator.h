@@ -0,0 +1,47 @@
+#pragma once
+
+#include"allincludes.h"
+#include"ThreadPool.h"
+
+enum class MipKernel
+{
+	Scalar,
+	Sse,     // one texel per instruction
+	Avx2,    // two texels per instruction, gathers the sRGB decode
+};
+
+// Builds the mip chain of an RGBA8 image on the CPU, for formats and devices
+// where neither the compute shader nor a linear blit can. Each level is the
+// 2x2 box filter of the one above, floor(size / 2) like the GPU paths; sRGB
+// color is decoded through a table, averaged in linear space and encoded
+// through a second table, alpha is averaged as is. Rows of a level are split
+// across the thread pool, levels run one after the other.
+class CpuMipGenerator
+{
+public:
+	CpuMipGenerator();
+
+	// Best kernel the running CPU supports.
+	static MipKernel GetBestKernel();
+	static const char* GetKernelName(MipKernel kernel);
+
+	// RGBA8 and BGRA8, the filter does not care about the channel order.
+	static bool IsSupported(VkFormat format);
+	static bool IsSrgb(VkFormat format);
+
+	// Level 0 (a copy of rgba) followed by mip_levels - 1 levels below it, level i
+	// starting level_offsets[i] bytes in, the layout UploadImageLevels takes.
+	// Without a pool everything runs on the calling thread.
+	std::vector<uint8_t> Generate(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t mip_levels, bool srgb,
+		ThreadPool* pool, std::vector<VkDeviceSize>* level_offsets) const;
+
+	// Writes rows [first_row, end_row) of the level below src.
+	void DownsampleRows(const uint8_t* src, uint32_t src_width, uint32_t src_height, uint8_t* dst, uint32_t first_row, uint32_t end_row, bool srgb) const;
+
+	// Overrides the kernel picked at construction, falls back to the best supported one.
+	void SetKernel(MipKernel kernel);
+	MipKernel GetKernel() const;
+
+private:
+	MipKernel _kernel = MipKernel::Scalar;
+};
@@ -0,0 +1,38 @@
+#include"Frustum.h"
+
+Frustum ExtractFrustum(const glm::mat4& clip_from_space)
+{
+	// glm is column major, row i of the matrix is (m[0][i], m[1][i], m[2][i], m[3][i])
+	const glm::mat4& m = clip_from_space;
+	glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+	glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+	glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+	glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+	Frustum frustum;
+	frustum.planes[0] = row3 + row0;
+	frustum.planes[1] = row3 - row0;
+	frustum.planes[2] = row3 + row1;
+	frustum.planes[3] = row3 - row1;
+	// Depth runs from 0 rather than -w
+	frustum.planes[4] = row2;
+	frustum.planes[5] = row3 - row2;
+
+	for (auto& plane : frustum.planes) {
+		float length = glm::length(glm::vec3(plane));
+		if (length > 0.0f) {
+			plane /= length;
+		}
+	}
+	return frustum;
+}
+
+bool IntersectsSphere(const Frustum& frustum, const glm::vec3& center, float radius)
+{
+	for (const auto& plane : frustum.planes) {
+		if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include"allincludes.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#define GLM_FORCE_DEFAULT_ALIGNED_GENTYPES
+#include <glm/glm.hpp>
+
+// Six inward facing planes (xyz normal, w distance), normalized so that
+// dot(plane.xyz, p) + plane.w is the signed distance of p. Ordered left,
+// right, bottom, top, near, far.
+struct Frustum
+{
+	glm::vec4 planes[6];
+};
+
+// Planes of the clip volume of clip_from_space in Vulkan conventions (0 <= z <= w),
+// expressed in the space the matrix transforms from.
+Frustum ExtractFrustum(const glm::mat4& clip_from_space);
+
+// True unless the sphere lies entirely outside one of the planes.
+bool IntersectsSphere(const Frustum& frustum, const glm::vec3& center, float radius);
@@ -1,4 +1,5 @@
 #include "GltfLoader.h"
+#include "BUILD_OPTIONS.h"
 
 // Define these only in *one* .cc file.
 #define TINYGLTF_IMPLEMENTATION
@@ -6,42 +7,560 @@
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 // #define TINYGLTF_NOEXCEPTION // optional. disable exception handling.
 #include "tiny_gltf.h"
+#include "ThreadPool.h"
+
+#if BUILD_ENABLE_DRACO
+#include <draco/compression/decode.h>
+#endif
+
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 
 using namespace tinygltf;
 
+static const int GLTF_MODE_TRIANGLES = 4;
+static const char* const DRACO_EXTENSION = "KHR_draco_mesh_compression";
+
+static bool IsExternalImage(const Image& image)
+{
+	return !image.uri.empty() && image.uri.compare(0, 5, "data:") != 0;
+}
+
+// Textures are streamed by the renderer itself. Image files are left to it by
+// name, images in a buffer view or a data: URI keep their encoded bytes.
+static bool KeepEmbeddedImageData(Image* image, const int, std::string*, std::string*, int, int, const unsigned char* bytes, int size, void*)
+{
+	if (!IsExternalImage(*image)) {
+		image->image.assign(bytes, bytes + size);
+	}
+	return true;
+}
+
+static float ReadComponent(const unsigned char* data, int component_type, bool normalized)
+{
+	switch (component_type) {
+	case TINYGLTF_COMPONENT_TYPE_FLOAT: {
+		float value;
+		memcpy(&value, data, sizeof(value));
+		return value;
+	}
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+		return normalized ? *data / 255.0f : static_cast<float>(*data);
+	case TINYGLTF_COMPONENT_TYPE_BYTE: {
+		float value = static_cast<float>(*reinterpret_cast<const int8_t*>(data));
+		return normalized ? std::max<float>(value / 127.0f, -1.0f) : value;
+	}
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+		uint16_t value;
+		memcpy(&value, data, sizeof(value));
+		return normalized ? value / 65535.0f : static_cast<float>(value);
+	}
+	case TINYGLTF_COMPONENT_TYPE_SHORT: {
+		int16_t value;
+		memcpy(&value, data, sizeof(value));
+		return normalized ? std::max<float>(value / 32767.0f, -1.0f) : static_cast<float>(value);
+	}
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT: {
+		uint32_t value;
+		memcpy(&value, data, sizeof(value));
+		return static_cast<float>(value);
+	}
+	default:
+		return 0.0f;
+	}
+}
+
+// Start of the accessor's first element and the distance between elements, nullptr when it has no data.
+static const unsigned char* AccessorData(const Model& model, const Accessor& accessor, size_t* stride)
+{
+	if (accessor.bufferView < 0 || accessor.sparse.isSparse) {
+		return nullptr;
+	}
+	const BufferView& view = model.bufferViews[accessor.bufferView];
+	const Buffer& buffer = model.buffers[view.buffer];
+
+	size_t element_size = static_cast<size_t>(GetComponentSizeInBytes(accessor.componentType)) * GetNumComponentsInType(accessor.type);
+	*stride = view.byteStride != 0 ? view.byteStride : element_size;
+
+	size_t begin = view.byteOffset + accessor.byteOffset;
+	size_t end = accessor.count == 0 ? begin : begin + *stride * (accessor.count - 1) + element_size;
+	if (end > buffer.data.size() || end > view.byteOffset + view.byteLength) {
+		return nullptr;
+	}
+	return buffer.data.data() + begin;
+}
+
+static glm::mat4 NodeTransform(const Node& node)
+{
+	if (node.matrix.size() == 16) {
+		glm::dmat4 matrix = glm::make_mat4(node.matrix.data());
+		return glm::mat4(matrix);
+	}
+
+	glm::mat4 transform(1.0f);
+	if (node.translation.size() == 3) {
+		transform = glm::translate(transform, glm::vec3(node.translation[0], node.translation[1], node.translation[2]));
+	}
+	if (node.rotation.size() == 4) {
+		// glTF stores x, y, z, w
+		glm::quat rotation(static_cast<float>(node.rotation[3]), static_cast<float>(node.rotation[0]),
+			static_cast<float>(node.rotation[1]), static_cast<float>(node.rotation[2]));
+		transform = transform * glm::mat4_cast(rotation);
+	}
+	if (node.scale.size() == 3) {
+		transform = glm::scale(transform, glm::vec3(node.scale[0], node.scale[1], node.scale[2]));
+	}
+	return transform;
+}
+
+static glm::vec2 ReadVec2(const Value& value, const glm::vec2& fallback)
+{
+	if (!value.IsArray() || value.ArrayLen() != 2 || !value.Get(0).IsNumber() || !value.Get(1).IsNumber()) {
+		return fallback;
+	}
+	return glm::vec2(value.Get(0).GetNumberAsDouble(), value.Get(1).GetNumberAsDouble());
+}
+
+// KHR_texture_transform of the material's base color texture, which is also how
+// KHR_mesh_quantization dequantizes integer texture coordinates. False when there is none.
+static bool BaseColorTextureTransform(const Model& model, int material, glm::vec2* offset, glm::vec2* scale, float* rotation)
+{
+	if (material < 0) {
+		return false;
+	}
+	const auto& extensions = model.materials[material].pbrMetallicRoughness.baseColorTexture.extensions;
+	auto transform = extensions.find("KHR_texture_transform");
+	if (transform == extensions.end() || !transform->second.IsObject()) {
+		return false;
+	}
+	const Value& value = transform->second;
+	*offset = value.Has("offset") ? ReadVec2(value.Get("offset"), glm::vec2(0.0f)) : glm::vec2(0.0f);
+	*scale = value.Has("scale") ? ReadVec2(value.Get("scale"), glm::vec2(1.0f)) : glm::vec2(1.0f);
+	*rotation = value.Has("rotation") && value.Get("rotation").IsNumber() ? static_cast<float>(value.Get("rotation").GetNumberAsDouble()) : 0.0f;
+	return true;
+}
+
+static void ApplyTextureTransform(const Model& model, int material, Vertex* vertices, uint32_t vertex_count)
+{
+	glm::vec2 offset, scale;
+	float rotation;
+	if (!BaseColorTextureTransform(model, material, &offset, &scale, &rotation)) {
+		return;
+	}
+	float c = std::cos(rotation);
+	float s = std::sin(rotation);
+	for (uint32_t i = 0; i < vertex_count; ++i) {
+		glm::vec2 uv = vertices[i].texCoord * scale;
+		vertices[i].texCoord = offset + glm::vec2(c * uv.x + s * uv.y, -s * uv.x + c * uv.y);
+	}
+}
+
 GltfLoader::GltfLoader()
 {
-    loadModel();
 }
 
 GltfLoader::~GltfLoader()
 {
 }
 
-int GltfLoader::loadModel()
+bool GltfLoader::Load(const std::string& path, Scene* scene, const glm::mat4& transform, ThreadPool* pool)
 {
-    std::string filename = "../models/Duck/glTF/Duck.gltf";
+	Model model;
+	TinyGLTF loader;
+	loader.SetImageLoader(KeepEmbeddedImageData, nullptr);
+	std::string err;
+	std::string warn;
+
+	bool binary = path.size() >= 4 && (path.compare(path.size() - 4, 4, ".glb") == 0 || path.compare(path.size() - 4, 4, ".GLB") == 0);
+	bool ret = binary
+		? loader.LoadBinaryFromFile(&model, &err, &warn, path)
+		: loader.LoadASCIIFromFile(&model, &err, &warn, path);
 
-    Model model;
-    TinyGLTF loader;
-    std::string err;
-    std::string warn;
+	if (!warn.empty()) {
+		std::cout << "glTF: " << warn << std::endl;
+	}
+	if (!err.empty()) {
+		std::cout << "glTF: " << err << std::endl;
+	}
+	if (!ret) {
+		std::cout << "glTF: Failed to parse " << path << std::endl;
+		return false;
+	}
 
-    bool ret = loader.LoadASCIIFromFile(&model, &err, &warn, filename);
-    //bool ret = loader.LoadBinaryFromFile(&model, &err, &warn, filename); // for binary glTF(.glb)
+	size_t slash = path.find_last_of("/\\");
+	_directory = slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
 
-    if (!warn.empty()) {
-        printf("Warn: %s\n", warn.c_str());
-    }
+	// Materials first, primitives refer to them by index
+	_materials.clear();
+	std::vector<std::shared_ptr<const std::vector<uint8_t>>> embedded_images(model.images.size());
+	for (const auto& gltf_material : model.materials) {
+		SceneMaterial material;
+		material.name = gltf_material.name;
+		const auto& factor = gltf_material.pbrMetallicRoughness.baseColorFactor;
+		if (factor.size() == 4) {
+			material.base_color_factor = glm::vec4(factor[0], factor[1], factor[2], factor[3]);
+		}
+		int texture = gltf_material.pbrMetallicRoughness.baseColorTexture.index;
+		if (texture >= 0 && model.textures[texture].source >= 0) {
+			int source = model.textures[texture].source;
+			const Image& image = model.images[source];
+			if (IsExternalImage(image)) {
+				material.base_color_texture = _directory + image.uri;
+			}
+			else if (!image.image.empty()) {
+				// Named after the file and the image, materials sharing it share the texture
+				if (!embedded_images[source]) {
+					embedded_images[source] = std::make_shared<const std::vector<uint8_t>>(image.image.begin(), image.image.end());
+				}
+				material.base_color_texture = path + "#image" + std::to_string(source);
+				material.base_color_image = embedded_images[source];
+			}
+		}
+		_materials.push_back(scene->AddMaterial(material));
+	}
+	SceneMaterial default_material;
+	default_material.name = "default";
+	_default_material = scene->AddMaterial(default_material);
 
-    if (!err.empty()) {
-        printf("Err: %s\n", err.c_str());
-    }
+	_meshes.assign(model.meshes.size(), std::vector<MeshHandle>());
+	_DecodeDracoPrimitives(model, pool);
 
-    if (!ret) {
-        printf("Failed to parse glTF\n");
-    }
-  
+	// Without a default scene every scene's roots are placed
+	std::vector<int> roots;
+	if (model.defaultScene >= 0 && model.defaultScene < static_cast<int>(model.scenes.size())) {
+		roots = model.scenes[model.defaultScene].nodes;
+	}
+	else {
+		for (const auto& gltf_scene : model.scenes) {
+			roots.insert(roots.end(), gltf_scene.nodes.begin(), gltf_scene.nodes.end());
+		}
+	}
+	for (int root : roots) {
+		_LoadNode(model, root, transform, scene);
+	}
+
+	std::cout << "glTF: Loaded " << path << " (" << model.meshes.size() << " meshes, "
+		<< model.nodes.size() << " nodes, " << model.materials.size() << " materials)" << std::endl;
+	_draco.clear();
+	return true;
+}
+
+void GltfLoader::_LoadNode(const Model& model, int node_index, const glm::mat4& parent_transform, Scene* scene)
+{
+	const Node& node = model.nodes[node_index];
+	glm::mat4 world = parent_transform * NodeTransform(node);
+
+	if (node.mesh >= 0) {
+		const Mesh& mesh = model.meshes[node.mesh];
+		auto& handles = _meshes[node.mesh];
+		if (handles.empty()) {
+			for (size_t i = 0; i < mesh.primitives.size(); ++i) {
+				handles.push_back(_LoadPrimitive(model, node.mesh, static_cast<int>(i), scene));
+			}
+		}
+		for (size_t i = 0; i < mesh.primitives.size(); ++i) {
+			if (handles[i] == UINT32_MAX) {
+				continue;
+			}
+			int material = mesh.primitives[i].material;
+			scene->AddObject(handles[i], world, material >= 0 ? _materials[material] : _default_material);
+		}
+	}
+
+	for (int child : node.children) {
+		_LoadNode(model, child, world, scene);
+	}
+}
+
+MeshHandle GltfLoader::_LoadPrimitive(const Model& model, int mesh_index, int primitive_index, Scene* scene)
+{
+	const Primitive& primitive = model.meshes[mesh_index].primitives[primitive_index];
+	if (primitive.mode != -1 && primitive.mode != GLTF_MODE_TRIANGLES) {
+		std::cout << "glTF: Skipping a primitive that is not a triangle list" << std::endl;
+		return UINT32_MAX;
+	}
+
+	// Draco primitives were decoded up front, their accessors have no data of their own
+	if (primitive.extensions.count(DRACO_EXTENSION) != 0) {
+		DecodedPrimitive& decoded = _draco[mesh_index][primitive_index];
+		if (!decoded.decoded) {
+			std::cout << "glTF: Skipping a Draco compressed primitive that could not be decoded" << std::endl;
+			return UINT32_MAX;
+		}
+		MeshHandle mesh = scene->AddMesh(decoded.vertices, decoded.indices);
+#if BUILD_ENABLE_MESH_OPTIMIZATION
+		scene->OptimizeMesh(mesh, BUILD_MESH_OVERDRAW_THRESHOLD);
+#endif
+		decoded = DecodedPrimitive();
+		return mesh;
+	}
+	auto position = primitive.attributes.find("POSITION");
+	if (position == primitive.attributes.end()) {
+		return UINT32_MAX;
+	}
+
+	const Accessor& positions = model.accessors[position->second];
+	uint32_t vertex_count = static_cast<uint32_t>(positions.count);
+	if (vertex_count == 0) {
+		return UINT32_MAX;
+	}
+	uint32_t index_count = primitive.indices >= 0 ? static_cast<uint32_t>(model.accessors[primitive.indices].count) : vertex_count;
+
+	MeshHandle mesh = scene->AllocateMesh(vertex_count, index_count);
+	Vertex* vertices = scene->GetMeshVertices(mesh);
+	uint32_t* indices = scene->GetMeshIndices(mesh);
+
+	// COLOR_0 multiplies the material's base color in the fragment shader, white without one
+	for (uint32_t i = 0; i < vertex_count; ++i) {
+		vertices[i] = Vertex{};
+		vertices[i].color = glm::vec3(1.0f);
+	}
+
+	bool ok = _ReadFloats(model, positions, 3, &vertices[0].pos.x, sizeof(Vertex));
+
+	// Every attribute has to cover exactly the vertices the positions define
+	auto find = [&](const char* name) -> const Accessor* {
+		auto attribute = primitive.attributes.find(name);
+		if (attribute == primitive.attributes.end()) {
+			return nullptr;
+		}
+		const Accessor& accessor = model.accessors[attribute->second];
+		if (accessor.count != positions.count) {
+			ok = false;
+		}
+		return &accessor;
+	};
+
+	const Accessor* normals = find("NORMAL");
+	if (ok && normals != nullptr) {
+		ok = _ReadFloats(model, *normals, 3, &vertices[0].normal.x, sizeof(Vertex));
+	}
+	const Accessor* texcoords = find("TEXCOORD_0");
+	if (ok && texcoords != nullptr) {
+		ok = _ReadFloats(model, *texcoords, 2, &vertices[0].texCoord.x, sizeof(Vertex));
+		if (ok) {
+			ApplyTextureTransform(model, primitive.material, vertices, vertex_count);
+		}
+	}
+	const Accessor* colors = find("COLOR_0");
+	if (ok && colors != nullptr) {
+		// RGB of VEC3 and VEC4 colors alike
+		ok = _ReadFloats(model, *colors, 3, &vertices[0].color.x, sizeof(Vertex));
+	}
+
+	if (ok && primitive.indices >= 0) {
+		ok = _ReadIndices(model, model.accessors[primitive.indices], indices);
+		for (uint32_t i = 0; ok && i < index_count; ++i) {
+			ok = indices[i] < vertex_count;
+		}
+	}
+	else {
+		for (uint32_t i = 0; i < index_count; ++i) {
+			indices[i] = i;
+		}
+	}
+
+	if (!ok) {
+		std::cout << "glTF: Skipping a primitive with mismatched, sparse or out of range accessors" << std::endl;
+		scene->ReleaseMesh(mesh);
+		return UINT32_MAX;
+	}
+
+	scene->UpdateMeshBounds(mesh);
+#if BUILD_ENABLE_MESH_OPTIMIZATION
+	scene->OptimizeMesh(mesh, BUILD_MESH_OVERDRAW_THRESHOLD);
+#endif
+	return mesh;
+}
+
+void GltfLoader::_DecodeDracoPrimitives(const Model& model, ThreadPool* pool)
+{
+	_draco.assign(model.meshes.size(), std::vector<DecodedPrimitive>());
+
+	// Only meshes some node places are worth decoding
+	std::vector<std::pair<int, int>> jobs;
+	std::vector<uint8_t> used(model.meshes.size(), 0);
+	for (const auto& node : model.nodes) {
+		if (node.mesh < 0 || used[node.mesh]) {
+			continue;
+		}
+		used[node.mesh] = 1;
+		const auto& primitives = model.meshes[node.mesh].primitives;
+		for (size_t i = 0; i < primitives.size(); ++i) {
+			if (primitives[i].extensions.count(DRACO_EXTENSION) != 0) {
+				_draco[node.mesh].resize(primitives.size());
+				jobs.push_back(std::make_pair(node.mesh, static_cast<int>(i)));
+			}
+		}
+	}
+	if (jobs.empty()) {
+		return;
+	}
+#if BUILD_ENABLE_DRACO
+	// Each task owns one DecodedPrimitive, nothing else is written
+	auto decode = [&](uint32_t job, uint32_t) {
+		const Primitive& primitive = model.meshes[jobs[job].first].primitives[jobs[job].second];
+		DecodedPrimitive& decoded = _draco[jobs[job].first][jobs[job].second];
+		decoded.decoded = _DecodeDraco(model, primitive, decoded);
+	};
+	if (pool != nullptr) {
+		pool->ParallelFor(static_cast<uint32_t>(jobs.size()), decode);
+	}
+	else {
+		for (uint32_t job = 0; job < jobs.size(); ++job) {
+			decode(job, 0);
+		}
+	}
+#else
+	std::cout << "glTF: " << jobs.size() << " Draco compressed primitives need BUILD_ENABLE_DRACO" << std::endl;
+	(void)pool;
+#endif
+}
+
+bool GltfLoader::_DecodeDraco(const Model& model, const Primitive& primitive, DecodedPrimitive& decoded) const
+{
+#if BUILD_ENABLE_DRACO
+	const Value& extension = primitive.extensions.find(DRACO_EXTENSION)->second;
+	if (!extension.Has("bufferView") || !extension.Has("attributes")) {
+		return false;
+	}
+	int view_index = extension.Get("bufferView").GetNumberAsInt();
+	if (view_index < 0 || view_index >= static_cast<int>(model.bufferViews.size())) {
+		return false;
+	}
+	const BufferView& view = model.bufferViews[view_index];
+	const Buffer& buffer = model.buffers[view.buffer];
+	if (view.byteOffset + view.byteLength > buffer.data.size()) {
+		return false;
+	}
+
+	draco::DecoderBuffer draco_buffer;
+	draco_buffer.Init(reinterpret_cast<const char*>(buffer.data.data() + view.byteOffset), view.byteLength);
+	draco::Decoder decoder;
+	auto result = decoder.DecodeMeshFromBuffer(&draco_buffer);
+	if (!result.ok()) {
+		return false;
+	}
+	std::unique_ptr<draco::Mesh> mesh = std::move(result).value();
+
+	uint32_t vertex_count = mesh->num_points();
+	decoded.vertices.assign(vertex_count, Vertex{});
+	for (auto& vertex : decoded.vertices) {
+		vertex.color = glm::vec3(1.0f);
+	}
+
+	// The extension maps glTF attribute names to Draco attribute ids
+	const Value& attributes = extension.Get("attributes");
+	auto read = [&](const char* name, int components, float* first) -> bool {
+		if (!attributes.Has(name)) {
+			return false;
+		}
+		const draco::PointAttribute* attribute = mesh->GetAttributeByUniqueId(attributes.Get(name).GetNumberAsInt());
+		if (attribute == nullptr) {
+			return false;
+		}
+		for (draco::PointIndex point(0); point < vertex_count; ++point) {
+			float* element = reinterpret_cast<float*>(reinterpret_cast<unsigned char*>(first) + point.value() * sizeof(Vertex));
+			attribute->ConvertValue<float>(attribute->mapped_index(point), static_cast<int8_t>(components), element);
+		}
+		return true;
+	};
+	if (!read("POSITION", 3, &decoded.vertices[0].pos.x)) {
+		return false;
+	}
+	read("NORMAL", 3, &decoded.vertices[0].normal.x);
+	if (read("TEXCOORD_0", 2, &decoded.vertices[0].texCoord.x)) {
+		ApplyTextureTransform(model, primitive.material, decoded.vertices.data(), vertex_count);
+	}
+	read("COLOR_0", 3, &decoded.vertices[0].color.x);
+
+	decoded.indices.resize(static_cast<size_t>(mesh->num_faces()) * 3);
+	for (draco::FaceIndex face(0); face < mesh->num_faces(); ++face) {
+		const auto& corners = mesh->face(face);
+		for (int k = 0; k < 3; ++k) {
+			decoded.indices[face.value() * 3 + k] = corners[k].value();
+		}
+	}
+	return vertex_count > 0;
+#else
+	return false;
+#endif
+}
+
+bool GltfLoader::_ReadFloats(const Model& model, const Accessor& accessor, uint32_t components, float* dst, size_t dst_stride)
+{
+	size_t src_stride = 0;
+	const unsigned char* src = AccessorData(model, accessor, &src_stride);
+	if (src == nullptr) {
+		return false;
+	}
+
+	uint32_t src_components = static_cast<uint32_t>(GetNumComponentsInType(accessor.type));
+	uint32_t copied = std::min<uint32_t>(components, src_components);
+	auto* out = reinterpret_cast<unsigned char*>(dst);
+
+	// Float data with enough components is taken as is, a plain memcpy per element
+	// or one for the whole range when both sides are tightly packed
+	if (accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT && src_components >= components) {
+		size_t element_size = sizeof(float) * components;
+		if (src_stride == element_size && dst_stride == element_size) {
+			memcpy(out, src, element_size * accessor.count);
+		}
+		else {
+			for (size_t i = 0; i < accessor.count; ++i) {
+				memcpy(out + i * dst_stride, src + i * src_stride, element_size);
+			}
+		}
+		return true;
+	}
+
+	size_t component_size = static_cast<size_t>(GetComponentSizeInBytes(accessor.componentType));
+	for (size_t i = 0; i < accessor.count; ++i) {
+		float* element = reinterpret_cast<float*>(out + i * dst_stride);
+		const unsigned char* source = src + i * src_stride;
+		for (uint32_t c = 0; c < copied; ++c) {
+			element[c] = ReadComponent(source + c * component_size, accessor.componentType, accessor.normalized);
+		}
+	}
+	return true;
+}
+
+bool GltfLoader::_ReadIndices(const Model& model, const Accessor& accessor, uint32_t* dst)
+{
+	size_t src_stride = 0;
+	const unsigned char* src = AccessorData(model, accessor, &src_stride);
+	if (src == nullptr) {
+		return false;
+	}
 
-    return 0;
+	switch (accessor.componentType) {
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+		if (src_stride == sizeof(uint32_t)) {
+			memcpy(dst, src, sizeof(uint32_t) * accessor.count);
+		}
+		else {
+			for (size_t i = 0; i < accessor.count; ++i) {
+				memcpy(dst + i, src + i * src_stride, sizeof(uint32_t));
+			}
+		}
+		return true;
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+		for (size_t i = 0; i < accessor.count; ++i) {
+			uint16_t index;
+			memcpy(&index, src + i * src_stride, sizeof(index));
+			dst[i] = index;
+		}
+		return true;
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+		for (size_t i = 0; i < accessor.count; ++i) {
+			dst[i] = src[i * src_stride];
+		}
+		return true;
+	default:
+		return false;
+	}
 }
@@ -1,13 +1,63 @@
 #pragma once
 #include"allincludes.h"
+#include"Scene.h"
 
+class ThreadPool;
+
+namespace tinygltf
+{
+	class Model;
+	struct Accessor;
+	struct Primitive;
+}
+
+// Imports glTF 2.0 (.gltf with external or embedded buffers, and .glb) into a
+// Scene. Every triangle primitive becomes a mesh, every node that references a
+// mesh becomes one object per primitive, placed with the node's world
+// transform, so meshes shared between nodes are instanced. Materials are added
+// to the scene and referenced by the objects.
+//
+// Attributes are read straight out of the glTF buffers into the scene's
+// arrays: ranges whose layout already matches are copied with memcpy, only
+// mismatching component types or strides go through a converting loop. That
+// loop also covers KHR_mesh_quantization: integer positions are dequantized by
+// the node transform, texture coordinates by the material's KHR_texture_transform.
+//
+// KHR_draco_mesh_compression primitives (with BUILD_ENABLE_DRACO) are decoded
+// before the nodes are walked, one primitive per task on the thread pool.
 class GltfLoader
 {
 public:
 	GltfLoader();
 	~GltfLoader();
 
-	int loadModel();
+	// Returns false when the file cannot be parsed, transform is applied on top of the root nodes.
+	// Primitives that cannot be read are skipped with a message. Draco primitives are decoded on pool when one is given.
+	bool Load(const std::string& path, Scene* scene, const glm::mat4& transform = glm::mat4(1.0f), ThreadPool* pool = nullptr);
+
 private:
-};
+	void _LoadNode(const tinygltf::Model& model, int node_index, const glm::mat4& parent_transform, Scene* scene);
+	MeshHandle _LoadPrimitive(const tinygltf::Model& model, int mesh_index, int primitive_index, Scene* scene);
+
+	// A Draco primitive decoded into the scene's vertex layout, waiting to be added.
+	struct DecodedPrimitive
+	{
+		std::vector<Vertex>   vertices;
+		std::vector<uint32_t> indices;
+		bool                  decoded = false;
+	};
+	void _DecodeDracoPrimitives(const tinygltf::Model& model, ThreadPool* pool);
+	bool _DecodeDraco(const tinygltf::Model& model, const tinygltf::Primitive& primitive, DecodedPrimitive& decoded) const;
 
+	// Reads an accessor's elements into dst, writing components floats at dst_stride bytes apart.
+	bool _ReadFloats(const tinygltf::Model& model, const tinygltf::Accessor& accessor, uint32_t components, float* dst, size_t dst_stride);
+	bool _ReadIndices(const tinygltf::Model& model, const tinygltf::Accessor& accessor, uint32_t* dst);
+
+	std::string               _directory;
+	// Mesh handles per glTF mesh and primitive, so every node using a mesh shares it
+	std::vector<std::vector<MeshHandle>> _meshes;
+	// Per glTF mesh and primitive, empty for primitives that are not Draco compressed
+	std::vector<std::vector<DecodedPrimitive>> _draco;
+	std::vector<uint32_t>     _materials;
+	uint32_t                  _default_material = 0;
+};
@@ -0,0 +1,380 @@
+#include"GpuCuller.h"
+#include"Renderer.h"
+
+#include<algorithm>
+#include<cstring>
+
+static const uint32_t CULL_GROUP_SIZE = 64;
+static const uint32_t CULL_BINDING_COUNT = 7;
+
+GpuCuller::GpuCuller(Renderer* renderer, uint32_t frame_count)
+{
+	_renderer = renderer;
+	_draw_indirect_count = _renderer->GetVulkanPhysicalDeviceFeatures12().drawIndirectCount == VK_TRUE;
+	_multi_draw_indirect = _renderer->GetVulkanPhysicalDeviceFeatures().multiDrawIndirect == VK_TRUE;
+	_frames.resize(frame_count);
+
+	_CreateDescriptors();
+	_CreatePipelines();
+
+	std::cout << "Vulkan: GPU culler created successfully"
+		<< (_draw_indirect_count ? " (indirect count)" : " (indirect)") << std::endl;
+}
+
+GpuCuller::~GpuCuller()
+{
+	for (auto& frame : _frames) {
+		_ReleaseBuffers(frame);
+	}
+	_DestroyPipelines();
+	_DestroyDescriptors();
+	std::cout << "Vulkan: GPU culler destroyed successfully" << std::endl;
+}
+
+bool GpuCuller::IsSupported(Renderer* renderer)
+{
+	return renderer->GetVulkanPhysicalDeviceFeatures().drawIndirectFirstInstance == VK_TRUE;
+}
+
+bool GpuCuller::Update(uint32_t frame, Scene* scene, const InstanceMatrixBuilder& builder)
+{
+	PROFILE_SCOPE(_renderer->GetProfiler(), "GpuCuller::Update");
+	FrameResources& resources = _frames[frame];
+	const auto& batches = scene->GetBatches();
+
+	resources.object_count = 0;
+	resources.batch_count = 0;
+	// Bounds are tested in world space, where the instance matrices take them
+	resources.frustum = ExtractFrustum(builder.GetClipFromWorld());
+	if (scene->GetObjectCount() == 0) {
+		return false;
+	}
+	bool replaced = _Reserve(resources, scene->GetObjectCount(), static_cast<uint32_t>(batches.size()));
+
+	// Quantized vertices are dequantized by the instance matrices, the bounds follow into that space
+	bool dequantize = BUILD_ENABLE_VERTEX_QUANTIZATION != 0;
+	const auto& order = scene->GetBatchOrder();
+	auto* instances = static_cast<InstanceData*>(resources.instances.memory.mapped);
+	auto* batch_ids = static_cast<uint32_t*>(resources.batch_ids.memory.mapped);
+	auto* cull_batches = static_cast<CullBatch*>(resources.batches.memory.mapped);
+	for (const SceneBatch& batch : batches) {
+		const SceneMesh& mesh = scene->GetMesh(batch.mesh);
+		// Nothing to draw, the objects get neither a cull invocation nor a command slot
+		if (mesh.index_count == 0) {
+			continue;
+		}
+
+		CullBatch cull_batch{};
+		cull_batch.index_count    = mesh.index_count;
+		cull_batch.first_index    = mesh.first_index;
+		cull_batch.vertex_offset  = mesh.vertex_offset;
+		cull_batch.first_instance = resources.object_count;
+		cull_batch.bounds         = glm::vec4(mesh.bounds_center, mesh.bounds_radius);
+		if (dequantize) {
+			cull_batch.bounds = glm::vec4(glm::vec3(cull_batch.bounds) - glm::vec3(mesh.dequantize), mesh.bounds_radius) / mesh.dequantize.w;
+		}
+		memcpy(cull_batches + resources.batch_count, &cull_batch, sizeof(cull_batch));
+
+		scene->WriteInstances(instances + resources.object_count, order.data() + batch.first_instance, batch.instance_count,
+			batch.mesh, builder, dequantize);
+		std::fill(batch_ids + resources.object_count, batch_ids + resources.object_count + batch.instance_count, resources.batch_count);
+
+		resources.object_count += batch.instance_count;
+		resources.batch_count++;
+	}
+	return replaced;
+}
+
+void GpuCuller::RecordCull(VkCommandBuffer command_buffer, uint32_t frame)
+{
+	FrameResources& resources = _frames[frame];
+	if (resources.object_count == 0) {
+		return;
+	}
+
+	vkCmdFillBuffer(command_buffer, resources.instance_counts.buffer, 0, VK_WHOLE_SIZE, 0);
+	vkCmdFillBuffer(command_buffer, resources.draw_count.buffer, 0, VK_WHOLE_SIZE, 0);
+
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	CullConstants constants{};
+	memcpy(constants.planes, resources.frustum.planes, sizeof(constants.planes));
+	constants.object_count = resources.object_count;
+	constants.batch_count  = resources.batch_count;
+	constants.compact      = _draw_indirect_count ? 1 : 0;
+
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipeline_layout,
+		0, 1, &resources.descriptor_set, 0, nullptr);
+	vkCmdPushConstants(command_buffer, _pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _cull_pipeline);
+	vkCmdDispatch(command_buffer, (resources.object_count + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+	// The instance counts have to be final before they become draw commands
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _compact_pipeline);
+	vkCmdDispatch(command_buffer, (resources.batch_count + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+	// The vertex shader reads the visible instances as a storage buffer
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+		0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void GpuCuller::RecordDraws(VkCommandBuffer command_buffer, uint32_t frame)
+{
+	FrameResources& resources = _frames[frame];
+	if (resources.object_count == 0) {
+		return;
+	}
+
+	const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+	if (_draw_indirect_count) {
+		vkCmdDrawIndexedIndirectCount(command_buffer, resources.commands.buffer, 0,
+			resources.draw_count.buffer, 0, resources.batch_count, stride);
+	}
+	else if (_multi_draw_indirect) {
+		// Culled batches stay in place with an instance count of 0
+		vkCmdDrawIndexedIndirect(command_buffer, resources.commands.buffer, 0, resources.batch_count, stride);
+	}
+	else {
+		for (uint32_t i = 0; i < resources.batch_count; ++i) {
+			vkCmdDrawIndexedIndirect(command_buffer, resources.commands.buffer, i * stride, 1, stride);
+		}
+	}
+}
+
+VkBuffer GpuCuller::GetInstanceBuffer(uint32_t frame) const
+{
+	return _frames[frame].visible_instances.buffer;
+}
+
+uint32_t GpuCuller::GetBatchCount(uint32_t frame) const
+{
+	return _frames[frame].object_count == 0 ? 0 : _frames[frame].batch_count;
+}
+
+void GpuCuller::_CreatePipelines()
+{
+	auto device = _renderer->GetVulkanDevice();
+
+	VkPushConstantRange push_constant_range{};
+	push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	push_constant_range.offset = 0;
+	push_constant_range.size = sizeof(CullConstants);
+
+	VkPipelineLayoutCreateInfo pipeline_layout_info{};
+	pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipeline_layout_info.setLayoutCount = 1;
+	pipeline_layout_info.pSetLayouts = &_descriptor_set_layout;
+	pipeline_layout_info.pushConstantRangeCount = 1;
+	pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+	ErrorCheck(vkCreatePipelineLayout(device, &pipeline_layout_info, nullptr, &_pipeline_layout));
+
+	auto code = ReadFile("../shaders/cull.spv");
+	VkShaderModuleCreateInfo module_info{};
+	module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	module_info.codeSize = code.size();
+	module_info.pCode = reinterpret_cast<const uint32_t*>(code.data());
+	VkShaderModule shader_module = VK_NULL_HANDLE;
+	ErrorCheck(vkCreateShaderModule(device, &module_info, nullptr, &shader_module));
+
+	// Both passes live in one shader, a specialization constant picks the pass
+	uint32_t passes[2] = { 0, 1 };
+	VkSpecializationMapEntry specialization_entry{};
+	specialization_entry.constantID = 0;
+	specialization_entry.offset = 0;
+	specialization_entry.size = sizeof(uint32_t);
+
+	VkSpecializationInfo specialization_infos[2]{};
+	VkComputePipelineCreateInfo pipeline_infos[2]{};
+	for (uint32_t i = 0; i < 2; ++i) {
+		specialization_infos[i].mapEntryCount = 1;
+		specialization_infos[i].pMapEntries = &specialization_entry;
+		specialization_infos[i].dataSize = sizeof(uint32_t);
+		specialization_infos[i].pData = &passes[i];
+
+		pipeline_infos[i].sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipeline_infos[i].stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipeline_infos[i].stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipeline_infos[i].stage.module = shader_module;
+		pipeline_infos[i].stage.pName = "main";
+		pipeline_infos[i].stage.pSpecializationInfo = &specialization_infos[i];
+		pipeline_infos[i].layout = _pipeline_layout;
+	}
+
+	VkPipeline pipelines[2] = {};
+	VkResult result = vkCreateComputePipelines(device, _renderer->GetVulkanPipelineCache(), 2, pipeline_infos, nullptr, pipelines);
+	vkDestroyShaderModule(device, shader_module, nullptr);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("Vulkan: Failed to create culling pipelines!");
+	}
+	_cull_pipeline = pipelines[0];
+	_compact_pipeline = pipelines[1];
+}
+
+void GpuCuller::_DestroyPipelines()
+{
+	auto device = _renderer->GetVulkanDevice();
+	vkDestroyPipeline(device, _compact_pipeline, nullptr);
+	vkDestroyPipeline(device, _cull_pipeline, nullptr);
+	vkDestroyPipelineLayout(device, _pipeline_layout, nullptr);
+	_compact_pipeline = VK_NULL_HANDLE;
+	_cull_pipeline = VK_NULL_HANDLE;
+	_pipeline_layout = VK_NULL_HANDLE;
+}
+
+void GpuCuller::_CreateDescriptors()
+{
+	auto device = _renderer->GetVulkanDevice();
+
+	std::array<VkDescriptorSetLayoutBinding, CULL_BINDING_COUNT> bindings{};
+	for (uint32_t i = 0; i < CULL_BINDING_COUNT; ++i) {
+		bindings[i].binding = i;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layout_info{};
+	layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
+	layout_info.pBindings = bindings.data();
+	ErrorCheck(vkCreateDescriptorSetLayout(device, &layout_info, nullptr, &_descriptor_set_layout));
+
+	uint32_t frame_count = static_cast<uint32_t>(_frames.size());
+	VkDescriptorPoolSize pool_size{};
+	pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	pool_size.descriptorCount = CULL_BINDING_COUNT * frame_count;
+
+	VkDescriptorPoolCreateInfo pool_info{};
+	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_info.poolSizeCount = 1;
+	pool_info.pPoolSizes = &pool_size;
+	pool_info.maxSets = frame_count;
+	ErrorCheck(vkCreateDescriptorPool(device, &pool_info, nullptr, &_descriptor_pool));
+
+	std::vector<VkDescriptorSetLayout> layouts(frame_count, _descriptor_set_layout);
+	std::vector<VkDescriptorSet> sets(frame_count);
+	VkDescriptorSetAllocateInfo allocate_info{};
+	allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocate_info.descriptorPool = _descriptor_pool;
+	allocate_info.descriptorSetCount = frame_count;
+	allocate_info.pSetLayouts = layouts.data();
+	ErrorCheck(vkAllocateDescriptorSets(device, &allocate_info, sets.data()));
+
+	// Sets are written once the slot has buffers
+	for (uint32_t i = 0; i < frame_count; ++i) {
+		_frames[i].descriptor_set = sets[i];
+	}
+}
+
+void GpuCuller::_DestroyDescriptors()
+{
+	auto device = _renderer->GetVulkanDevice();
+	vkDestroyDescriptorPool(device, _descriptor_pool, nullptr);
+	vkDestroyDescriptorSetLayout(device, _descriptor_set_layout, nullptr);
+	_descriptor_pool = VK_NULL_HANDLE;
+	_descriptor_set_layout = VK_NULL_HANDLE;
+}
+
+bool GpuCuller::_Reserve(FrameResources& frame, uint32_t object_count, uint32_t batch_count)
+{
+	if (object_count <= frame.object_capacity && batch_count <= frame.batch_capacity) {
+		return false;
+	}
+
+	// Grow both together, the slot's previous frame is finished so nothing still reads them
+	uint32_t object_capacity = std::max<uint32_t>(object_count, frame.object_capacity * 2);
+	uint32_t batch_capacity  = std::max<uint32_t>(batch_count, frame.batch_capacity * 2);
+	_ReleaseBuffers(frame);
+
+	const VkMemoryPropertyFlags host = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	const VkMemoryPropertyFlags device = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+	_CreateBuffer(sizeof(InstanceData) * object_capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, host, frame.instances);
+	_CreateBuffer(sizeof(uint32_t) * object_capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, host, frame.batch_ids);
+	_CreateBuffer(sizeof(CullBatch) * batch_capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, host, frame.batches);
+
+	_CreateBuffer(sizeof(uint32_t) * batch_capacity,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, device, frame.instance_counts);
+	_CreateBuffer(sizeof(InstanceData) * object_capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, device, frame.visible_instances);
+	_CreateBuffer(sizeof(VkDrawIndexedIndirectCommand) * batch_capacity,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, device, frame.commands);
+	_CreateBuffer(sizeof(uint32_t),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, device, frame.draw_count);
+
+	frame.object_capacity = object_capacity;
+	frame.batch_capacity = batch_capacity;
+	_WriteDescriptorSet(frame);
+	return true;
+}
+
+void GpuCuller::_ReleaseBuffers(FrameResources& frame)
+{
+	_DestroyBuffer(frame.instances);
+	_DestroyBuffer(frame.batch_ids);
+	_DestroyBuffer(frame.batches);
+	_DestroyBuffer(frame.instance_counts);
+	_DestroyBuffer(frame.visible_instances);
+	_DestroyBuffer(frame.commands);
+	_DestroyBuffer(frame.draw_count);
+	frame.object_capacity = 0;
+	frame.batch_capacity = 0;
+}
+
+void GpuCuller::_WriteDescriptorSet(FrameResources& frame)
+{
+	// Same order as the bindings in cull.comp
+	const GpuBuffer* buffers[CULL_BINDING_COUNT] = {
+		&frame.instances, &frame.batch_ids, &frame.batches,
+		&frame.instance_counts, &frame.visible_instances, &frame.commands, &frame.draw_count
+	};
+
+	std::array<VkDescriptorBufferInfo, CULL_BINDING_COUNT> buffer_infos{};
+	std::array<VkWriteDescriptorSet, CULL_BINDING_COUNT> writes{};
+	for (uint32_t i = 0; i < CULL_BINDING_COUNT; ++i) {
+		buffer_infos[i].buffer = buffers[i]->buffer;
+		buffer_infos[i].offset = 0;
+		buffer_infos[i].range = VK_WHOLE_SIZE;
+
+		writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[i].dstSet = frame.descriptor_set;
+		writes[i].dstBinding = i;
+		writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writes[i].descriptorCount = 1;
+		writes[i].pBufferInfo = &buffer_infos[i];
+	}
+	vkUpdateDescriptorSets(_renderer->GetVulkanDevice(), static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
+
+void GpuCuller::_CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, GpuBuffer& buffer)
+{
+	// Only ever touched by the graphics queue
+	VkBufferCreateInfo buffer_info{};
+	buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_info.size = size;
+	buffer_info.usage = usage;
+	buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	ErrorCheck(vkCreateBuffer(_renderer->GetVulkanDevice(), &buffer_info, nullptr, &buffer.buffer));
+
+	buffer.memory = _renderer->GetMemoryAllocator()->AllocateForBuffer(buffer.buffer, properties);
+}
+
+void GpuCuller::_DestroyBuffer(GpuBuffer& buffer)
+{
+	vkDestroyBuffer(_renderer->GetVulkanDevice(), buffer.buffer, nullptr);
+	_renderer->GetMemoryAllocator()->Free(buffer.memory);
+	buffer.buffer = VK_NULL_HANDLE;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include"Platform.h"
+#include"Shared.h"
+#include"allincludes.h"
+#include"MemoryAllocator.h"
+#include"Scene.h"
+#include"Frustum.h"
+
+class Renderer;
+
+// Moves draw submission onto the GPU. Every frame the scene's instances and
+// batches are written into the slot's host visible buffers, a compute pass
+// tests each object's bounding sphere against the frustum and appends the
+// visible instances to its batch's range of a device local instance buffer,
+// and a second pass turns the per-batch counts into
+// VkDrawIndexedIndirectCommands. The render pass then draws everything with
+// one vkCmdDrawIndexedIndirectCount (or vkCmdDrawIndexedIndirect over all
+// batches when the device has no count support).
+//
+// The visible instances are read through the same instance buffer binding
+// the CPU path uses, so the graphics pipeline does not change.
+class GpuCuller
+{
+public:
+	GpuCuller(Renderer* renderer, uint32_t frame_count);
+	~GpuCuller();
+
+	// Needs a non zero firstInstance in indirect draws.
+	static bool IsSupported(Renderer* renderer);
+
+	// Fills the slot's inputs, the GPU must be done with the slot's previous frame.
+	// Returns true when the slot's instance buffer was replaced by a bigger one.
+	bool Update(uint32_t frame, Scene* scene, const InstanceMatrixBuilder& builder);
+
+	// Culls and writes the draw commands, recorded outside the render pass.
+	void RecordCull(VkCommandBuffer command_buffer, uint32_t frame);
+
+	// Issues the draws, the caller has bound pipeline, vertex binding 0 and the index buffer.
+	void RecordDraws(VkCommandBuffer command_buffer, uint32_t frame);
+
+	// The vertex shader's instance buffer, VK_NULL_HANDLE while the slot has nothing to draw.
+	VkBuffer GetInstanceBuffer(uint32_t frame) const;
+	uint32_t GetBatchCount(uint32_t frame) const;
+
+private:
+	// std430 layout of cull.comp's inputs
+	struct CullBatch
+	{
+		uint32_t  index_count;
+		uint32_t  first_index;
+		int32_t   vertex_offset;
+		uint32_t  first_instance;
+		glm::vec4 bounds;
+	};
+
+	struct CullConstants
+	{
+		glm::vec4 planes[6];
+		uint32_t  object_count;
+		uint32_t  batch_count;
+		uint32_t  compact;
+	};
+
+	struct GpuBuffer
+	{
+		VkBuffer         buffer = VK_NULL_HANDLE;
+		MemoryAllocation memory;
+	};
+
+	struct FrameResources
+	{
+		// Written by the host
+		GpuBuffer instances;
+		GpuBuffer batch_ids;
+		GpuBuffer batches;
+		// Written by the compute passes
+		GpuBuffer instance_counts;
+		GpuBuffer visible_instances;
+		GpuBuffer commands;
+		GpuBuffer draw_count;
+
+		uint32_t  object_capacity = 0;
+		uint32_t  batch_capacity = 0;
+		uint32_t  object_count = 0;
+		uint32_t  batch_count = 0;
+		Frustum   frustum = {};
+
+		VkDescriptorSet descriptor_set = VK_NULL_HANDLE;
+	};
+
+	void _CreatePipelines();
+	void _DestroyPipelines();
+	void _CreateDescriptors();
+	void _DestroyDescriptors();
+
+	// Returns true when the buffers had to grow.
+	bool _Reserve(FrameResources& frame, uint32_t object_count, uint32_t batch_count);
+	void _ReleaseBuffers(FrameResources& frame);
+	void _WriteDescriptorSet(FrameResources& frame);
+	void _CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, GpuBuffer& buffer);
+	void _DestroyBuffer(GpuBuffer& buffer);
+
+	Renderer*                   _renderer = nullptr;
+	bool                        _draw_indirect_count = false;
+	bool                        _multi_draw_indirect = false;
+
+	VkDescriptorSetLayout       _descriptor_set_layout = VK_NULL_HANDLE;
+	VkDescriptorPool            _descriptor_pool = VK_NULL_HANDLE;
+	VkPipelineLayout            _pipeline_layout = VK_NULL_HANDLE;
+	VkPipeline                  _cull_pipeline = VK_NULL_HANDLE;
+	VkPipeline                  _compact_pipeline = VK_NULL_HANDLE;
+
+	std::vector<FrameResources> _frames;
+};
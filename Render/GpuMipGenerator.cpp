@@ -0,0 +1,370 @@
+#include"GpuMipGenerator.h"
+#include"Renderer.h"
+
+#include<algorithm>
+#include<array>
+
+static const uint32_t MIP_GROUP_TILE = 64;
+// Storage views in mipgen.comp, levels 1 to 12
+static const uint32_t MIP_STORAGE_LEVELS = 12;
+static const uint32_t MIP_SETS_PER_POOL = 32;
+
+static bool IsSrgb(VkFormat format)
+{
+	return format == VK_FORMAT_R8G8B8A8_SRGB;
+}
+
+GpuMipGenerator::GpuMipGenerator(Renderer* renderer)
+{
+	_renderer = renderer;
+
+	VkFormatProperties format_properties;
+	vkGetPhysicalDeviceFormatProperties(_renderer->GetVulkanPhysicalDevice(), VK_FORMAT_R8G8B8A8_UNORM, &format_properties);
+	_supported = (format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT) != 0;
+	if (!_supported) {
+		std::cout << "Vulkan: Device cannot write RGBA8 storage images, mips are not generated in compute" << std::endl;
+		return;
+	}
+
+	_CreateScratch();
+	_CreatePipeline();
+	std::cout << "Vulkan: Mip generator created successfully" << std::endl;
+}
+
+GpuMipGenerator::~GpuMipGenerator()
+{
+	if (!_supported) {
+		return;
+	}
+	// The upload queue has waited for everything it submitted
+	Retire(UINT64_MAX);
+	auto device = _renderer->GetVulkanDevice();
+	for (auto pool : _descriptor_pools) {
+		vkDestroyDescriptorPool(device, pool, nullptr);
+	}
+	_descriptor_pools.clear();
+	_DestroyPipeline();
+	_DestroyScratch();
+	std::cout << "Vulkan: Mip generator destroyed successfully" << std::endl;
+}
+
+bool GpuMipGenerator::IsSupported(VkFormat format, uint32_t width, uint32_t height) const
+{
+	return _supported && (format == VK_FORMAT_R8G8B8A8_UNORM || format == VK_FORMAT_R8G8B8A8_SRGB) &&
+		width <= GPU_MIP_MAX_SIZE && height <= GPU_MIP_MAX_SIZE;
+}
+
+void GpuMipGenerator::GetImageRequirements(VkFormat format, VkImageUsageFlags* usage, VkImageCreateFlags* flags)
+{
+	*usage = VK_IMAGE_USAGE_STORAGE_BIT;
+	// The sRGB format cannot be stored to, only its UNORM views
+	*flags = IsSrgb(format) ? VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT | VK_IMAGE_CREATE_EXTENDED_USAGE_BIT : 0;
+}
+
+void GpuMipGenerator::Record(VkCommandBuffer command_buffer, VkImage image, VkFormat format, uint32_t width, uint32_t height, uint32_t mip_levels, UploadTicket ticket)
+{
+	auto device = _renderer->GetVulkanDevice();
+
+	Dispatch dispatch;
+	dispatch.ticket = ticket;
+	dispatch.descriptor_set = _AllocateDescriptorSet(&dispatch.descriptor_pool);
+	dispatch.views.push_back(_CreateView(image, format, 0, VK_IMAGE_USAGE_SAMPLED_BIT));
+	for (uint32_t level = 1; level < mip_levels; ++level) {
+		dispatch.views.push_back(_CreateView(image, VK_FORMAT_R8G8B8A8_UNORM, level, VK_IMAGE_USAGE_STORAGE_BIT));
+	}
+
+	VkDescriptorImageInfo source_info{};
+	source_info.sampler = _sampler;
+	source_info.imageView = dispatch.views[0];
+	source_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	std::array<VkDescriptorImageInfo, MIP_STORAGE_LEVELS> level_infos{};
+	for (uint32_t i = 0; i < MIP_STORAGE_LEVELS; ++i) {
+		level_infos[i].imageView = dispatch.views[std::min<uint32_t>(i + 1, mip_levels - 1)];
+		level_infos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+	}
+
+	VkDescriptorBufferInfo scratch_info{};
+	scratch_info.buffer = _scratch_buffer;
+	scratch_info.offset = 0;
+	scratch_info.range = VK_WHOLE_SIZE;
+
+	std::array<VkWriteDescriptorSet, 3> writes{};
+	for (auto& write : writes) {
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = dispatch.descriptor_set;
+		write.descriptorCount = 1;
+	}
+	writes[0].dstBinding = 0;
+	writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	writes[0].pImageInfo = &source_info;
+	writes[1].dstBinding = 1;
+	writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	writes[1].descriptorCount = MIP_STORAGE_LEVELS;
+	writes[1].pImageInfo = level_infos.data();
+	writes[2].dstBinding = 2;
+	writes[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	writes[2].pBufferInfo = &scratch_info;
+	vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+
+	// The previous dispatch on this queue may still use the scratch buffer
+	VkBufferMemoryBarrier scratch_barrier{};
+	scratch_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	scratch_barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	scratch_barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	scratch_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	scratch_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	scratch_barrier.buffer = _scratch_buffer;
+	scratch_barrier.offset = 0;
+	scratch_barrier.size = VK_WHOLE_SIZE;
+	vkCmdPipelineBarrier(command_buffer,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+		0, nullptr,
+		1, &scratch_barrier,
+		0, nullptr);
+	vkCmdFillBuffer(command_buffer, _scratch_buffer, 0, sizeof(uint32_t), 0);
+
+	scratch_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	scratch_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	// Level 0 is read by the shader, the others are written
+	std::array<VkImageMemoryBarrier, 2> image_barriers{};
+	for (auto& barrier : image_barriers) {
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = 1;
+	}
+	image_barriers[0].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	image_barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	image_barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	image_barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	image_barriers[0].subresourceRange.baseMipLevel = 0;
+	image_barriers[0].subresourceRange.levelCount = 1;
+	image_barriers[1].srcAccessMask = 0;
+	image_barriers[1].dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	image_barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	image_barriers[1].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	image_barriers[1].subresourceRange.baseMipLevel = 1;
+	image_barriers[1].subresourceRange.levelCount = mip_levels - 1;
+	vkCmdPipelineBarrier(command_buffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+		0, nullptr,
+		1, &scratch_barrier,
+		static_cast<uint32_t>(image_barriers.size()), image_barriers.data());
+
+	MipConstants constants{};
+	constants.width = static_cast<int32_t>(width);
+	constants.height = static_cast<int32_t>(height);
+	constants.level_count = mip_levels - 1;
+	constants.srgb = IsSrgb(format) ? 1 : 0;
+	constants.group_count_x = (width + MIP_GROUP_TILE - 1) / MIP_GROUP_TILE;
+	uint32_t group_count_y = (height + MIP_GROUP_TILE - 1) / MIP_GROUP_TILE;
+	constants.group_count = constants.group_count_x * group_count_y;
+
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipeline);
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipeline_layout, 0, 1, &dispatch.descriptor_set, 0, nullptr);
+	vkCmdPushConstants(command_buffer, _pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+	vkCmdDispatch(command_buffer, constants.group_count_x, group_count_y, 1);
+
+	image_barriers[1].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	image_barriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	image_barriers[1].oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+	image_barriers[1].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	vkCmdPipelineBarrier(command_buffer,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+		0, nullptr,
+		0, nullptr,
+		1, &image_barriers[1]);
+
+	_in_flight.push_back(std::move(dispatch));
+}
+
+void GpuMipGenerator::Retire(UploadTicket completed_ticket)
+{
+	auto device = _renderer->GetVulkanDevice();
+	while (!_in_flight.empty() && _in_flight.front().ticket <= completed_ticket) {
+		Dispatch& dispatch = _in_flight.front();
+		for (auto view : dispatch.views) {
+			vkDestroyImageView(device, view, nullptr);
+		}
+		ErrorCheck(vkFreeDescriptorSets(device, dispatch.descriptor_pool, 1, &dispatch.descriptor_set));
+		_in_flight.pop_front();
+	}
+}
+
+void GpuMipGenerator::_CreatePipeline()
+{
+	auto device = _renderer->GetVulkanDevice();
+
+	std::array<VkDescriptorSetLayoutBinding, 3> bindings{};
+	bindings[0].binding = 0;
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	bindings[0].descriptorCount = 1;
+	bindings[1].binding = 1;
+	bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	bindings[1].descriptorCount = MIP_STORAGE_LEVELS;
+	bindings[2].binding = 2;
+	bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[2].descriptorCount = 1;
+	for (auto& binding : bindings) {
+		binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layout_info{};
+	layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
+	layout_info.pBindings = bindings.data();
+	ErrorCheck(vkCreateDescriptorSetLayout(device, &layout_info, nullptr, &_descriptor_set_layout));
+
+	VkPushConstantRange push_constant_range{};
+	push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	push_constant_range.offset = 0;
+	push_constant_range.size = sizeof(MipConstants);
+
+	VkPipelineLayoutCreateInfo pipeline_layout_info{};
+	pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipeline_layout_info.setLayoutCount = 1;
+	pipeline_layout_info.pSetLayouts = &_descriptor_set_layout;
+	pipeline_layout_info.pushConstantRangeCount = 1;
+	pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+	ErrorCheck(vkCreatePipelineLayout(device, &pipeline_layout_info, nullptr, &_pipeline_layout));
+
+	auto code = ReadFile("../shaders/mipgen.spv");
+	VkShaderModuleCreateInfo module_info{};
+	module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	module_info.codeSize = code.size();
+	module_info.pCode = reinterpret_cast<const uint32_t*>(code.data());
+	VkShaderModule shader_module = VK_NULL_HANDLE;
+	ErrorCheck(vkCreateShaderModule(device, &module_info, nullptr, &shader_module));
+
+	VkComputePipelineCreateInfo pipeline_info{};
+	pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipeline_info.stage.module = shader_module;
+	pipeline_info.stage.pName = "main";
+	pipeline_info.layout = _pipeline_layout;
+
+	VkResult result = vkCreateComputePipelines(device, _renderer->GetVulkanPipelineCache(), 1, &pipeline_info, nullptr, &_pipeline);
+	vkDestroyShaderModule(device, shader_module, nullptr);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("Vulkan: Failed to create mip generation pipeline!");
+	}
+
+	// texelFetch ignores filtering, the sampler is only there because the binding needs one
+	VkSamplerCreateInfo sampler_info{};
+	sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	sampler_info.magFilter = VK_FILTER_NEAREST;
+	sampler_info.minFilter = VK_FILTER_NEAREST;
+	sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_info.maxLod = 0.0f;
+	ErrorCheck(vkCreateSampler(device, &sampler_info, nullptr, &_sampler));
+}
+
+void GpuMipGenerator::_DestroyPipeline()
+{
+	auto device = _renderer->GetVulkanDevice();
+	vkDestroySampler(device, _sampler, nullptr);
+	vkDestroyPipeline(device, _pipeline, nullptr);
+	vkDestroyPipelineLayout(device, _pipeline_layout, nullptr);
+	vkDestroyDescriptorSetLayout(device, _descriptor_set_layout, nullptr);
+	_sampler = VK_NULL_HANDLE;
+	_pipeline = VK_NULL_HANDLE;
+	_pipeline_layout = VK_NULL_HANDLE;
+	_descriptor_set_layout = VK_NULL_HANDLE;
+}
+
+void GpuMipGenerator::_CreateScratch()
+{
+	// A std430 vec4 array after the counter starts at offset 16
+	uint32_t max_groups = GPU_MIP_MAX_SIZE / MIP_GROUP_TILE;
+	VkBufferCreateInfo buffer_create_info{};
+	buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_create_info.size = 16 + sizeof(float) * 4 * max_groups * max_groups;
+	buffer_create_info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	ErrorCheck(vkCreateBuffer(_renderer->GetVulkanDevice(), &buffer_create_info, nullptr, &_scratch_buffer));
+	_scratch_memory = _renderer->GetMemoryAllocator()->AllocateForBuffer(_scratch_buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+}
+
+void GpuMipGenerator::_DestroyScratch()
+{
+	vkDestroyBuffer(_renderer->GetVulkanDevice(), _scratch_buffer, nullptr);
+	_renderer->GetMemoryAllocator()->Free(_scratch_memory);
+	_scratch_buffer = VK_NULL_HANDLE;
+}
+
+VkDescriptorSet GpuMipGenerator::_AllocateDescriptorSet(VkDescriptorPool* pool)
+{
+	auto device = _renderer->GetVulkanDevice();
+
+	VkDescriptorSetAllocateInfo allocate_info{};
+	allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocate_info.descriptorSetCount = 1;
+	allocate_info.pSetLayouts = &_descriptor_set_layout;
+
+	VkDescriptorSet set = VK_NULL_HANDLE;
+	for (auto candidate : _descriptor_pools) {
+		allocate_info.descriptorPool = candidate;
+		if (vkAllocateDescriptorSets(device, &allocate_info, &set) == VK_SUCCESS) {
+			*pool = candidate;
+			return set;
+		}
+	}
+
+	std::array<VkDescriptorPoolSize, 3> pool_sizes{};
+	pool_sizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	pool_sizes[0].descriptorCount = MIP_SETS_PER_POOL;
+	pool_sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	pool_sizes[1].descriptorCount = MIP_SETS_PER_POOL * MIP_STORAGE_LEVELS;
+	pool_sizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	pool_sizes[2].descriptorCount = MIP_SETS_PER_POOL;
+
+	VkDescriptorPoolCreateInfo pool_info{};
+	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+	pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+	pool_info.pPoolSizes = pool_sizes.data();
+	pool_info.maxSets = MIP_SETS_PER_POOL;
+
+	VkDescriptorPool new_pool = VK_NULL_HANDLE;
+	ErrorCheck(vkCreateDescriptorPool(device, &pool_info, nullptr, &new_pool));
+	_descriptor_pools.push_back(new_pool);
+
+	allocate_info.descriptorPool = new_pool;
+	ErrorCheck(vkAllocateDescriptorSets(device, &allocate_info, &set));
+	*pool = new_pool;
+	return set;
+}
+
+VkImageView GpuMipGenerator::_CreateView(VkImage image, VkFormat format, uint32_t level, VkImageUsageFlags usage)
+{
+	// Each view only claims the usage its format supports, the sRGB one is never a storage image
+	VkImageViewUsageCreateInfo usage_info{};
+	usage_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO;
+	usage_info.usage = usage;
+
+	VkImageViewCreateInfo view_create_info{};
+	view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	view_create_info.pNext = &usage_info;
+	view_create_info.image = image;
+	view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	view_create_info.format = format;
+	view_create_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	view_create_info.subresourceRange.baseMipLevel = level;
+	view_create_info.subresourceRange.levelCount = 1;
+	view_create_info.subresourceRange.baseArrayLayer = 0;
+	view_create_info.subresourceRange.layerCount = 1;
+
+	VkImageView view = VK_NULL_HANDLE;
+	ErrorCheck(vkCreateImageView(_renderer->GetVulkanDevice(), &view_create_info, nullptr, &view));
+	return view;
+}
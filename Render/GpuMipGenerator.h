@@ -0,0 +1,82 @@
+#pragma once
+
+#include"Platform.h"
+#include"Shared.h"
+#include"allincludes.h"
+#include"MemoryAllocator.h"
+#include"UploadQueue.h"
+
+#include<deque>
+
+// Largest level 0 the compute path takes, the second stage reduces one 64x64 tile of level 6
+#define GPU_MIP_MAX_SIZE 4096
+
+// Writes every mip of an RGBA8 image from level 0 with a single compute
+// dispatch (mipgen.comp) instead of a chain of blits with a barrier between
+// each pair of levels. Level 0 is sampled through a view of the image's own
+// format and the levels are written through UNORM storage views, the shader
+// encodes sRGB itself. sRGB images therefore need MUTABLE_FORMAT and
+// EXTENDED_USAGE, see GetImageRequirements.
+//
+// Used by the upload queue, everything runs on the thread that flushes it.
+class GpuMipGenerator
+{
+public:
+	GpuMipGenerator(Renderer* renderer);
+	~GpuMipGenerator();
+
+	bool IsSupported(VkFormat format, uint32_t width, uint32_t height) const;
+	// Usage and create flags an image of format needs on top of TRANSFER_DST and SAMPLED.
+	static void GetImageRequirements(VkFormat format, VkImageUsageFlags* usage, VkImageCreateFlags* flags);
+
+	// Records the dispatch filling levels 1 to mip_levels - 1. Level 0 has just
+	// been copied in TRANSFER_DST_OPTIMAL, every level ends up
+	// SHADER_READ_ONLY_OPTIMAL. The views and the descriptor set it needs are
+	// kept until Retire() sees ticket complete.
+	void Record(VkCommandBuffer command_buffer, VkImage image, VkFormat format, uint32_t width, uint32_t height, uint32_t mip_levels, UploadTicket ticket);
+	void Retire(UploadTicket completed_ticket);
+
+private:
+	// Push constants of mipgen.comp
+	struct MipConstants
+	{
+		int32_t  width;
+		int32_t  height;
+		uint32_t level_count;
+		uint32_t srgb;
+		uint32_t group_count_x;
+		uint32_t group_count;
+	};
+
+	struct Dispatch
+	{
+		UploadTicket             ticket = 0;
+		VkDescriptorPool         descriptor_pool = VK_NULL_HANDLE;
+		VkDescriptorSet          descriptor_set = VK_NULL_HANDLE;
+		std::vector<VkImageView> views;
+	};
+
+	void _CreatePipeline();
+	void _DestroyPipeline();
+	void _CreateScratch();
+	void _DestroyScratch();
+
+	VkDescriptorSet _AllocateDescriptorSet(VkDescriptorPool* pool);
+	VkImageView     _CreateView(VkImage image, VkFormat format, uint32_t level, VkImageUsageFlags usage);
+
+	Renderer*                      _renderer = nullptr;
+	bool                           _supported = false;
+
+	VkDescriptorSetLayout          _descriptor_set_layout = VK_NULL_HANDLE;
+	VkPipelineLayout               _pipeline_layout = VK_NULL_HANDLE;
+	VkPipeline                     _pipeline = VK_NULL_HANDLE;
+	VkSampler                      _sampler = VK_NULL_HANDLE;
+
+	// Group counter and level 6 texels, dispatches run one after the other and share it
+	VkBuffer                       _scratch_buffer = VK_NULL_HANDLE;
+	MemoryAllocation               _scratch_memory;
+
+	// A new pool is added whenever all of them are full
+	std::vector<VkDescriptorPool>  _descriptor_pools;
+	std::deque<Dispatch>           _in_flight;
+};
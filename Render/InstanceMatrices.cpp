@@ -0,0 +1,177 @@
+#include"InstanceMatrices.h"
+#include"CpuFeatures.h"
+
+#include<cstring>
+
+namespace {
+
+// Leaves the material to the caller, it is not part of the math
+const size_t INSTANCE_MATRIX_BYTES = offsetof(InstanceData, material);
+
+void BuildScalar(const glm::mat4& clip_from_scene, const glm::mat4& world_from_scene, const glm::mat4* transforms, const uint32_t* objects,
+	uint32_t count, const glm::mat4& vertex_transform, InstanceData* destination)
+{
+	for (uint32_t i = 0; i < count; ++i) {
+		glm::mat4 scene_from_vertex = transforms[objects[i]] * vertex_transform;
+
+		InstanceData instance;
+		instance.clip_from_vertex = clip_from_scene * scene_from_vertex;
+		instance.world_from_vertex = world_from_scene * scene_from_vertex;
+
+		// Mirroring transforms have a negative determinant, flip the cofactors back outward
+		glm::vec3 x = glm::vec3(instance.world_from_vertex[0]);
+		glm::vec3 y = glm::vec3(instance.world_from_vertex[1]);
+		glm::vec3 z = glm::vec3(instance.world_from_vertex[2]);
+		glm::vec3 yz = glm::cross(y, z);
+		float sign = glm::dot(x, yz) < 0.0f ? -1.0f : 1.0f;
+		instance.normal_from_vertex[0] = glm::vec4(yz * sign, 0.0f);
+		instance.normal_from_vertex[1] = glm::vec4(glm::cross(z, x) * sign, 0.0f);
+		instance.normal_from_vertex[2] = glm::vec4(glm::cross(x, y) * sign, 0.0f);
+
+		// Mapped memory is only as aligned as the buffer requires, copy bytes rather than assign
+		memcpy(destination + i, &instance, INSTANCE_MATRIX_BYTES);
+	}
+}
+
+#if CPU_X86
+// m * v with m held as four columns
+inline __m128 TransformSse(const __m128* m, __m128 v)
+{
+	__m128 result = _mm_mul_ps(m[0], _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)));
+	result = _mm_add_ps(result, _mm_mul_ps(m[1], _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1))));
+	result = _mm_add_ps(result, _mm_mul_ps(m[2], _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2))));
+	result = _mm_add_ps(result, _mm_mul_ps(m[3], _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3))));
+	return result;
+}
+
+inline void MultiplySse(const __m128* a, const __m128* b, __m128* result)
+{
+	for (int column = 0; column < 4; ++column) {
+		result[column] = TransformSse(a, b[column]);
+	}
+}
+
+// a.yzx * b.zxy - a.zxy * b.yzx, computed in zxy order and rotated back; w comes out 0
+inline __m128 CrossSse(__m128 a, __m128 b)
+{
+	__m128 a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 c = _mm_sub_ps(_mm_mul_ps(a, b_yzx), _mm_mul_ps(a_yzx, b));
+	return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+inline void LoadSse(const glm::mat4& m, __m128* columns)
+{
+	for (int column = 0; column < 4; ++column) {
+		columns[column] = _mm_loadu_ps(&m[column][0]);
+	}
+}
+
+void BuildSse(const glm::mat4& clip_from_scene, const glm::mat4& world_from_scene, const glm::mat4* transforms, const uint32_t* objects,
+	uint32_t count, const glm::mat4& vertex_transform, InstanceData* destination)
+{
+	// The same for every instance, they stay in registers
+	__m128 clip_from_scene_sse[4], world_from_scene_sse[4], vertex_transform_sse[4];
+	LoadSse(clip_from_scene, clip_from_scene_sse);
+	LoadSse(world_from_scene, world_from_scene_sse);
+	LoadSse(vertex_transform, vertex_transform_sse);
+	const __m128 sign_mask = _mm_set1_ps(-0.0f);
+
+	for (uint32_t i = 0; i < count; ++i) {
+		__m128 transform[4], scene_from_vertex[4], clip_from_vertex[4], world_from_vertex[4];
+		LoadSse(transforms[objects[i]], transform);
+		MultiplySse(transform, vertex_transform_sse, scene_from_vertex);
+		MultiplySse(clip_from_scene_sse, scene_from_vertex, clip_from_vertex);
+		MultiplySse(world_from_scene_sse, scene_from_vertex, world_from_vertex);
+
+		__m128 yz = CrossSse(world_from_vertex[1], world_from_vertex[2]);
+		__m128 zx = CrossSse(world_from_vertex[2], world_from_vertex[0]);
+		__m128 xy = CrossSse(world_from_vertex[0], world_from_vertex[1]);
+
+		// Determinant in every lane, yz.w is 0 so the w lane adds nothing
+		__m128 determinant = _mm_mul_ps(world_from_vertex[0], yz);
+		determinant = _mm_add_ps(determinant, _mm_shuffle_ps(determinant, determinant, _MM_SHUFFLE(2, 3, 0, 1)));
+		determinant = _mm_add_ps(determinant, _mm_shuffle_ps(determinant, determinant, _MM_SHUFFLE(1, 0, 3, 2)));
+		__m128 sign = _mm_and_ps(determinant, sign_mask);
+
+		float* out = reinterpret_cast<float*>(destination + i);
+		for (int column = 0; column < 4; ++column) {
+			_mm_storeu_ps(out + offsetof(InstanceData, clip_from_vertex) / sizeof(float) + column * 4, clip_from_vertex[column]);
+			_mm_storeu_ps(out + offsetof(InstanceData, world_from_vertex) / sizeof(float) + column * 4, world_from_vertex[column]);
+		}
+		float* normal = out + offsetof(InstanceData, normal_from_vertex) / sizeof(float);
+		_mm_storeu_ps(normal + 0, _mm_xor_ps(yz, sign));
+		_mm_storeu_ps(normal + 4, _mm_xor_ps(zx, sign));
+		_mm_storeu_ps(normal + 8, _mm_xor_ps(xy, sign));
+	}
+}
+#endif
+
+}
+
+InstanceMatrixBuilder::InstanceMatrixBuilder()
+{
+	_kernel = GetBestKernel();
+}
+
+MatrixKernel InstanceMatrixBuilder::GetBestKernel()
+{
+#if CPU_X86
+	// SSE2 is part of every x86 target the project builds for
+	return MatrixKernel::Sse;
+#else
+	return MatrixKernel::Scalar;
+#endif
+}
+
+const char* InstanceMatrixBuilder::GetKernelName(MatrixKernel kernel)
+{
+	switch (kernel) {
+	case MatrixKernel::Sse:
+		return "sse";
+	default:
+		return "scalar";
+	}
+}
+
+void InstanceMatrixBuilder::SetFrame(const glm::mat4& clip_from_world, const glm::mat4& world_from_scene)
+{
+	_clip_from_world = clip_from_world;
+	_world_from_scene = world_from_scene;
+	_clip_from_scene = clip_from_world * world_from_scene;
+}
+
+const glm::mat4& InstanceMatrixBuilder::GetClipFromWorld() const
+{
+	return _clip_from_world;
+}
+
+const glm::mat4& InstanceMatrixBuilder::GetClipFromScene() const
+{
+	return _clip_from_scene;
+}
+
+void InstanceMatrixBuilder::Build(const glm::mat4* transforms, const uint32_t* objects, uint32_t count, const glm::mat4& vertex_transform, InstanceData* destination) const
+{
+	switch (_kernel) {
+#if CPU_X86
+	case MatrixKernel::Sse:
+		BuildSse(_clip_from_scene, _world_from_scene, transforms, objects, count, vertex_transform, destination);
+		break;
+#endif
+	default:
+		BuildScalar(_clip_from_scene, _world_from_scene, transforms, objects, count, vertex_transform, destination);
+		break;
+	}
+}
+
+void InstanceMatrixBuilder::SetKernel(MatrixKernel kernel)
+{
+	MatrixKernel best = GetBestKernel();
+	_kernel = static_cast<int>(kernel) <= static_cast<int>(best) ? kernel : best;
+}
+
+MatrixKernel InstanceMatrixBuilder::GetKernel() const
+{
+	return _kernel;
+}
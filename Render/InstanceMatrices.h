@@ -0,0 +1,65 @@
+#pragma once
+
+#include"allincludes.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#define GLM_FORCE_DEFAULT_ALIGNED_GENTYPES
+#include <glm/glm.hpp>
+
+// One instance as the vertex shader reads it from the instance buffer, the
+// std430 layout of shader.vert's Instance. Every matrix starts from the
+// mesh's vertices as stored, so quantized positions are dequantized on the way.
+struct InstanceData
+{
+	glm::mat4 clip_from_vertex;
+	glm::mat4 world_from_vertex;
+	// Columns of the cofactor matrix of world_from_vertex's upper 3x3, w unused.
+	// The inverse transpose scaled by |determinant|, the fragment shader normalizes.
+	glm::vec4 normal_from_vertex[3];
+	uint32_t  material;
+	uint32_t  padding[3];
+};
+
+enum class MatrixKernel
+{
+	Scalar,
+	Sse,     // one matrix column per instruction
+};
+
+// Precomputes the per-instance matrices on the CPU once per frame, so the
+// vertex shader does a single matrix multiply per position and none of the
+// per-vertex work that only depends on the object. The frame's matrices are
+// folded together in SetFrame, each instance then costs three 4x4 multiplies
+// and three cross products, kept in registers by the SSE kernel.
+class InstanceMatrixBuilder
+{
+public:
+	InstanceMatrixBuilder();
+
+	// Best kernel the running CPU supports.
+	static MatrixKernel GetBestKernel();
+	static const char* GetKernelName(MatrixKernel kernel);
+
+	// world_from_scene places the whole scene (the transforms objects hold) in
+	// the world, clip_from_world is projection times view.
+	void SetFrame(const glm::mat4& clip_from_world, const glm::mat4& world_from_scene);
+	const glm::mat4& GetClipFromWorld() const;
+	const glm::mat4& GetClipFromScene() const;
+
+	// Fills everything but the material of destination[i] for the object
+	// transforms[objects[i]], i < count, whose mesh needs vertex_transform
+	// (its dequantization, or identity) to get from vertices to mesh space.
+	void Build(const glm::mat4* transforms, const uint32_t* objects, uint32_t count, const glm::mat4& vertex_transform, InstanceData* destination) const;
+
+	// Overrides the kernel picked at construction, falls back to the best supported one.
+	void SetKernel(MatrixKernel kernel);
+	MatrixKernel GetKernel() const;
+
+private:
+	glm::mat4    _clip_from_world = glm::mat4(1.0f);
+	glm::mat4    _world_from_scene = glm::mat4(1.0f);
+	glm::mat4    _clip_from_scene = glm::mat4(1.0f);
+
+	MatrixKernel _kernel = MatrixKernel::Scalar;
+};
@@ -0,0 +1,354 @@
+#include"KtxFile.h"
+#include"Platform.h"
+
+#include<algorithm>
+#include<cstdio>
+#include<cstring>
+#include<iostream>
+
+static const uint8_t KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+// Khronos data format descriptor values the basic descriptor block uses
+static const uint32_t KHR_DF_MODEL_RGBSDA        = 1;
+static const uint32_t KHR_DF_MODEL_BC1A          = 128;
+static const uint32_t KHR_DF_MODEL_BC3           = 130;
+static const uint32_t KHR_DF_MODEL_BC5           = 132;
+static const uint32_t KHR_DF_MODEL_BC7           = 134;
+static const uint32_t KHR_DF_PRIMARIES_BT709     = 1;
+static const uint32_t KHR_DF_TRANSFER_LINEAR     = 1;
+static const uint32_t KHR_DF_TRANSFER_SRGB       = 2;
+static const uint32_t KHR_DF_CHANNEL_RED         = 0;
+static const uint32_t KHR_DF_CHANNEL_GREEN       = 1;
+static const uint32_t KHR_DF_CHANNEL_BLUE        = 2;
+static const uint32_t KHR_DF_CHANNEL_ALPHA       = 15;
+static const uint32_t KHR_DF_SAMPLE_LINEAR       = 0x10;
+
+struct Ktx2Header
+{
+	uint8_t  identifier[12];
+	uint32_t vk_format;
+	uint32_t type_size;
+	uint32_t pixel_width;
+	uint32_t pixel_height;
+	uint32_t pixel_depth;
+	uint32_t layer_count;
+	uint32_t face_count;
+	uint32_t level_count;
+	uint32_t supercompression_scheme;
+	uint32_t dfd_byte_offset;
+	uint32_t dfd_byte_length;
+	uint32_t kvd_byte_offset;
+	uint32_t kvd_byte_length;
+	uint64_t sgd_byte_offset;
+	uint64_t sgd_byte_length;
+};
+
+struct Ktx2Level
+{
+	uint64_t byte_offset;
+	uint64_t byte_length;
+	uint64_t uncompressed_byte_length;
+};
+
+static bool IsSrgb(VkFormat format)
+{
+	return format == VK_FORMAT_BC1_RGB_SRGB_BLOCK || format == VK_FORMAT_BC3_SRGB_BLOCK ||
+		format == VK_FORMAT_BC7_SRGB_BLOCK || format == VK_FORMAT_R8G8B8A8_SRGB;
+}
+
+static uint64_t AlignOffset(uint64_t offset, uint64_t alignment)
+{
+	return (offset + alignment - 1) / alignment * alignment;
+}
+
+// Level alignment KTX2 asks for: the least common multiple of the block size and 4
+static uint32_t LevelAlignment(const TextureFormatInfo& info)
+{
+	return info.block_size % 4 == 0 ? info.block_size : info.block_size * 4;
+}
+
+// Basic descriptor block of format, preceded by the total size word
+static std::vector<uint32_t> BuildDataFormatDescriptor(VkFormat format, const TextureFormatInfo& info)
+{
+	struct Sample
+	{
+		uint32_t bit_offset;
+		uint32_t bit_length;
+		uint32_t channel;
+		uint32_t upper;
+	};
+	uint32_t transfer = IsSrgb(format) ? KHR_DF_TRANSFER_SRGB : KHR_DF_TRANSFER_LINEAR;
+	uint32_t model = KHR_DF_MODEL_RGBSDA;
+	std::vector<Sample> samples;
+	switch (format) {
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+		model = KHR_DF_MODEL_BC1A;
+		samples = { { 0, 64, KHR_DF_CHANNEL_RED, UINT32_MAX } };
+		break;
+	case VK_FORMAT_BC3_UNORM_BLOCK:
+	case VK_FORMAT_BC3_SRGB_BLOCK:
+		model = KHR_DF_MODEL_BC3;
+		samples = { { 0, 64, KHR_DF_CHANNEL_ALPHA, UINT32_MAX }, { 64, 64, KHR_DF_CHANNEL_RED, UINT32_MAX } };
+		break;
+	case VK_FORMAT_BC5_UNORM_BLOCK:
+		model = KHR_DF_MODEL_BC5;
+		samples = { { 0, 64, KHR_DF_CHANNEL_RED, UINT32_MAX }, { 64, 64, KHR_DF_CHANNEL_GREEN, UINT32_MAX } };
+		break;
+	case VK_FORMAT_BC7_UNORM_BLOCK:
+	case VK_FORMAT_BC7_SRGB_BLOCK:
+		model = KHR_DF_MODEL_BC7;
+		samples = { { 0, 128, KHR_DF_CHANNEL_RED, UINT32_MAX } };
+		break;
+	default:
+		samples = {
+			{ 0, 8, KHR_DF_CHANNEL_RED, 255 }, { 8, 8, KHR_DF_CHANNEL_GREEN, 255 },
+			{ 16, 8, KHR_DF_CHANNEL_BLUE, 255 }, { 24, 8, KHR_DF_CHANNEL_ALPHA, 255 } };
+		break;
+	}
+
+	uint32_t block_size = 24 + 16 * static_cast<uint32_t>(samples.size());
+	std::vector<uint32_t> words;
+	words.push_back(4 + block_size);
+	words.push_back(0);                               // Khronos vendor, basic descriptor type
+	words.push_back(2 | (block_size << 16));          // version 1.3 of the specification
+	words.push_back(model | (KHR_DF_PRIMARIES_BT709 << 8) | (transfer << 16));
+	words.push_back((info.block_width - 1) | ((info.block_height - 1) << 8));
+	words.push_back(info.block_size);
+	words.push_back(0);
+	for (const auto& sample : samples) {
+		// Alpha is never sRGB encoded
+		uint32_t qualifiers = (transfer == KHR_DF_TRANSFER_SRGB && sample.channel == KHR_DF_CHANNEL_ALPHA) ? KHR_DF_SAMPLE_LINEAR : 0;
+		words.push_back(sample.bit_offset | ((sample.bit_length - 1) << 16) | ((sample.channel | qualifiers) << 24));
+		words.push_back(0);
+		words.push_back(0);
+		words.push_back(sample.upper);
+	}
+	return words;
+}
+
+bool GetTextureFormatInfo(VkFormat format, TextureFormatInfo* info)
+{
+	switch (format) {
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+		*info = { 4, 4, 8, true };
+		return true;
+	case VK_FORMAT_BC3_UNORM_BLOCK:
+	case VK_FORMAT_BC3_SRGB_BLOCK:
+	case VK_FORMAT_BC5_UNORM_BLOCK:
+	case VK_FORMAT_BC7_UNORM_BLOCK:
+	case VK_FORMAT_BC7_SRGB_BLOCK:
+		*info = { 4, 4, 16, true };
+		return true;
+	case VK_FORMAT_R8G8B8A8_UNORM:
+	case VK_FORMAT_R8G8B8A8_SRGB:
+		*info = { 1, 1, 4, false };
+		return true;
+	default:
+		return false;
+	}
+}
+
+VkDeviceSize GetTextureLevelSize(VkFormat format, uint32_t width, uint32_t height)
+{
+	TextureFormatInfo info;
+	if (!GetTextureFormatInfo(format, &info)) {
+		return 0;
+	}
+	VkDeviceSize blocks_x = (width + info.block_width - 1) / info.block_width;
+	VkDeviceSize blocks_y = (height + info.block_height - 1) / info.block_height;
+	return blocks_x * blocks_y * info.block_size;
+}
+
+KtxFile::KtxFile()
+{
+}
+
+KtxFile::~KtxFile()
+{
+	Close();
+}
+
+bool KtxFile::Open(const std::string& path)
+{
+	Close();
+	if (!_file.Open(path)) {
+		return false;
+	}
+
+	const uint8_t* data = _file.GetData();
+	size_t size = _file.GetSize();
+	Ktx2Header header;
+	if (size < sizeof(header)) {
+		_file.Close();
+		return false;
+	}
+	memcpy(&header, data, sizeof(header));
+
+	TextureFormatInfo info;
+	VkFormat format = static_cast<VkFormat>(header.vk_format);
+	bool valid =
+		memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) == 0 &&
+		GetTextureFormatInfo(format, &info) &&
+		header.pixel_width > 0 && header.pixel_height > 0 && header.pixel_depth == 0 &&
+		header.layer_count <= 1 && header.face_count == 1 &&
+		header.level_count > 0 && header.level_count <= 16 &&
+		header.supercompression_scheme == 0 &&
+		sizeof(header) + uint64_t(header.level_count) * sizeof(Ktx2Level) <= size;
+	if (!valid) {
+		std::cout << "Texture: " << path << " is not a single 2D KTX2 texture in a supported format" << std::endl;
+		_file.Close();
+		return false;
+	}
+
+	// Every level has to be complete, inside the file and block aligned
+	std::vector<Ktx2Level> levels(header.level_count);
+	memcpy(levels.data(), data + sizeof(header), levels.size() * sizeof(Ktx2Level));
+	uint64_t begin = UINT64_MAX;
+	uint64_t end = 0;
+	for (uint32_t i = 0; i < header.level_count; ++i) {
+		uint32_t width = std::max<uint32_t>(header.pixel_width >> i, 1);
+		uint32_t height = std::max<uint32_t>(header.pixel_height >> i, 1);
+		if (levels[i].byte_length != GetTextureLevelSize(format, width, height) ||
+			levels[i].byte_offset % LevelAlignment(info) != 0 ||
+			levels[i].byte_offset + levels[i].byte_length > size) {
+			std::cout << "Texture: " << path << " has a broken level " << i << std::endl;
+			_file.Close();
+			return false;
+		}
+		begin = std::min<uint64_t>(begin, levels[i].byte_offset);
+		end = std::max<uint64_t>(end, levels[i].byte_offset + levels[i].byte_length);
+	}
+
+	_format      = format;
+	_width       = header.pixel_width;
+	_height      = header.pixel_height;
+	_data_offset = begin;
+	_data_size   = end - begin;
+	_level_offsets.resize(header.level_count);
+	for (uint32_t i = 0; i < header.level_count; ++i) {
+		_level_offsets[i] = levels[i].byte_offset - begin;
+	}
+	return true;
+}
+
+void KtxFile::Close()
+{
+	_file.Close();
+	_format = VK_FORMAT_UNDEFINED;
+	_width = _height = 0;
+	_data_offset = _data_size = 0;
+	_level_offsets.clear();
+}
+
+VkFormat KtxFile::GetFormat() const
+{
+	return _format;
+}
+
+uint32_t KtxFile::GetWidth() const
+{
+	return _width;
+}
+
+uint32_t KtxFile::GetHeight() const
+{
+	return _height;
+}
+
+uint32_t KtxFile::GetLevelCount() const
+{
+	return static_cast<uint32_t>(_level_offsets.size());
+}
+
+const uint8_t* KtxFile::GetLevelData() const
+{
+	return _file.GetData() + _data_offset;
+}
+
+VkDeviceSize KtxFile::GetLevelDataSize() const
+{
+	return _data_size;
+}
+
+VkDeviceSize KtxFile::GetLevelOffset(uint32_t level) const
+{
+	return _level_offsets[level];
+}
+
+bool KtxFile::Write(const std::string& path, VkFormat format, uint32_t width, uint32_t height, const std::vector<std::vector<uint8_t>>& levels)
+{
+	TextureFormatInfo info;
+	if (!GetTextureFormatInfo(format, &info) || levels.empty()) {
+		return false;
+	}
+	for (size_t i = 0; i < levels.size(); ++i) {
+		uint32_t level_width = std::max<uint32_t>(width >> i, 1);
+		uint32_t level_height = std::max<uint32_t>(height >> i, 1);
+		if (levels[i].size() != GetTextureLevelSize(format, level_width, level_height)) {
+			return false;
+		}
+	}
+
+	std::vector<uint32_t> dfd = BuildDataFormatDescriptor(format, info);
+
+	Ktx2Header header{};
+	memcpy(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+	header.vk_format       = static_cast<uint32_t>(format);
+	header.type_size       = 1;
+	header.pixel_width     = width;
+	header.pixel_height    = height;
+	header.face_count      = 1;
+	header.level_count     = static_cast<uint32_t>(levels.size());
+	header.dfd_byte_offset = static_cast<uint32_t>(sizeof(header) + levels.size() * sizeof(Ktx2Level));
+	header.dfd_byte_length = static_cast<uint32_t>(dfd.size() * sizeof(uint32_t));
+
+	// Level data follows the descriptor, smallest level first
+	std::vector<Ktx2Level> index(levels.size());
+	uint64_t offset = header.dfd_byte_offset + header.dfd_byte_length;
+	for (size_t i = levels.size(); i-- > 0;) {
+		offset = AlignOffset(offset, LevelAlignment(info));
+		index[i].byte_offset = offset;
+		index[i].byte_length = levels[i].size();
+		index[i].uncompressed_byte_length = levels[i].size();
+		offset += levels[i].size();
+	}
+
+	std::string temp_path = path + ".tmp";
+	FILE* file = fopen(temp_path.c_str(), "wb");
+	if (file == nullptr) {
+		std::cout << "Texture: Could not open " << temp_path << std::endl;
+		return false;
+	}
+	static const uint8_t padding[16] = {};
+	uint64_t written_size = header.dfd_byte_offset + header.dfd_byte_length;
+	bool written =
+		fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(index.data(), sizeof(Ktx2Level), index.size(), file) == index.size() &&
+		fwrite(dfd.data(), sizeof(uint32_t), dfd.size(), file) == dfd.size();
+	for (size_t i = levels.size(); written && i-- > 0;) {
+		size_t pad = static_cast<size_t>(index[i].byte_offset - written_size);
+		written = fwrite(padding, 1, pad, file) == pad &&
+			fwrite(levels[i].data(), 1, levels[i].size(), file) == levels[i].size();
+		written_size = index[i].byte_offset + index[i].byte_length;
+	}
+	written = (fclose(file) == 0) && written;
+
+	if (!written) {
+		remove(temp_path.c_str());
+		std::cout << "Texture: Could not write " << temp_path << std::endl;
+		return false;
+	}
+#ifdef _WIN32
+	bool renamed = MoveFileExA(temp_path.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	bool renamed = rename(temp_path.c_str(), path.c_str()) == 0;
+#endif
+	if (!renamed) {
+		remove(temp_path.c_str());
+		std::cout << "Texture: Could not replace " << path << std::endl;
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include"MappedFile.h"
+
+#include<vulkan/vulkan.h>
+#include<string>
+#include<vector>
+
+// Texel block of a format the cooker writes and the loader accepts: 4x4 for
+// the BC formats, 1x1 for plain RGBA8.
+struct TextureFormatInfo
+{
+	uint32_t block_width  = 1;
+	uint32_t block_height = 1;
+	uint32_t block_size   = 0; // bytes per block
+	bool     compressed   = false;
+};
+
+// False for formats the cooked texture pipeline does not know.
+bool GetTextureFormatInfo(VkFormat format, TextureFormatInfo* info);
+
+// Bytes of one mip level of format at width x height, partial blocks included.
+VkDeviceSize GetTextureLevelSize(VkFormat format, uint32_t width, uint32_t height);
+
+// KTX 2.0 file holding a single 2D texture with its complete mip chain in one
+// of the formats above, without supercompression. The file is mapped and the
+// levels are read in place; KTX2 stores them smallest first and aligned to
+// their texel block, so the whole level range can be staged with one copy.
+class KtxFile
+{
+public:
+	KtxFile();
+	~KtxFile();
+
+	// False when path cannot be read or is not a texture this loader takes.
+	bool Open(const std::string& path);
+	void Close();
+
+	VkFormat     GetFormat() const;
+	uint32_t     GetWidth() const;
+	uint32_t     GetHeight() const;
+	uint32_t     GetLevelCount() const;
+
+	// All levels as stored in the file, offsets are relative to GetLevelData().
+	const uint8_t* GetLevelData() const;
+	VkDeviceSize   GetLevelDataSize() const;
+	VkDeviceSize   GetLevelOffset(uint32_t level) const;
+
+	// Writes levels, largest first, as a KTX2 file, returns false if nothing was written.
+	static bool Write(const std::string& path, VkFormat format, uint32_t width, uint32_t height, const std::vector<std::vector<uint8_t>>& levels);
+
+private:
+	MappedFile                 _file;
+	VkFormat                   _format = VK_FORMAT_UNDEFINED;
+	uint32_t                   _width = 0;
+	uint32_t                   _height = 0;
+	VkDeviceSize               _data_offset = 0;
+	VkDeviceSize               _data_size = 0;
+	std::vector<VkDeviceSize>  _level_offsets;
+};
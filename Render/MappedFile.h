@@ -0,0 +1,30 @@
+#pragma once
+
+#include<cstddef>
+#include<cstdint>
+#include<string>
+
+// Read only view of a whole file through the OS's memory mapping.
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool Open(const std::string& path);
+	void Close();
+
+	const uint8_t* GetData() const;
+	size_t         GetSize() const;
+
+private:
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	const uint8_t* _data = nullptr;
+	size_t         _size = 0;
+#ifdef _WIN32
+	void*          _file = nullptr;
+	void*          _mapping = nullptr;
+#endif
+};
@@ -0,0 +1,312 @@
+#include"MemoryAllocator.h"
+
+#include<algorithm>
+
+static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+MemoryAllocator::MemoryAllocator(VkDevice device, const VkPhysicalDeviceProperties& gpu_properties, const VkPhysicalDeviceMemoryProperties& memory_properties, VkDeviceSize block_size)
+{
+	_device                   = device;
+	_memory_properties        = memory_properties;
+	_block_size               = block_size;
+	_buffer_image_granularity = std::max<VkDeviceSize>(gpu_properties.limits.bufferImageGranularity, 1);
+	_max_allocation_count     = gpu_properties.limits.maxMemoryAllocationCount;
+}
+
+MemoryAllocator::~MemoryAllocator()
+{
+	for (uint32_t i = 0; i < _blocks.size(); ++i) {
+		if (nullptr != _blocks[i]) {
+			if (_blocks[i]->allocation_count > 0) {
+				std::cout << "Vulkan: Memory block " << i << " destroyed with " << _blocks[i]->allocation_count << " live allocations" << std::endl;
+			}
+			_DestroyBlock(i);
+		}
+	}
+	std::cout << "Vulkan: Memory allocator destroyed successfully" << std::endl;
+}
+
+MemoryAllocation MemoryAllocator::AllocateForBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties)
+{
+	VkMemoryRequirements requirements;
+	vkGetBufferMemoryRequirements(_device, buffer, &requirements);
+
+	MemoryAllocation allocation = _Allocate(requirements, properties, false);
+	ErrorCheck(vkBindBufferMemory(_device, buffer, allocation.memory, allocation.offset));
+	return allocation;
+}
+
+MemoryAllocation MemoryAllocator::AllocateForImage(VkImage image, VkMemoryPropertyFlags properties, VkImageTiling tiling)
+{
+	VkMemoryRequirements requirements;
+	vkGetImageMemoryRequirements(_device, image, &requirements);
+
+	MemoryAllocation allocation = _Allocate(requirements, properties, tiling == VK_IMAGE_TILING_OPTIMAL);
+	ErrorCheck(vkBindImageMemory(_device, image, allocation.memory, allocation.offset));
+	return allocation;
+}
+
+void MemoryAllocator::Free(MemoryAllocation& allocation)
+{
+	if (VK_NULL_HANDLE == allocation.memory) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	Block* block = _blocks[allocation.block];
+	assert(nullptr != block && block->memory == allocation.memory);
+
+	block->allocation_count--;
+	block->used -= allocation.range_size;
+
+	if (block->dedicated) {
+		_DestroyBlock(allocation.block);
+	}
+	else {
+		_InsertFreeRange(*block, allocation.range_offset, allocation.range_size);
+
+		// Keep one empty block per memory type around so a free/allocate cycle
+		// does not go back to the driver every time.
+		if (0 == block->allocation_count) {
+			for (uint32_t i = 0; i < _blocks.size(); ++i) {
+				Block* other = _blocks[i];
+				if (i != allocation.block && nullptr != other && !other->dedicated &&
+					other->memory_type == block->memory_type && other->optimal == block->optimal &&
+					0 == other->allocation_count) {
+					_DestroyBlock(allocation.block);
+					break;
+				}
+			}
+		}
+	}
+	allocation = MemoryAllocation();
+}
+
+MemoryAllocatorStats MemoryAllocator::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	MemoryAllocatorStats stats;
+	for (auto block : _blocks) {
+		if (nullptr == block) {
+			continue;
+		}
+		if (block->dedicated) {
+			stats.dedicated_count++;
+		}
+		else {
+			stats.block_count++;
+		}
+		stats.allocation_count += block->allocation_count;
+		stats.reserved_bytes += block->size;
+		stats.used_bytes += block->used;
+		stats.free_range_count += static_cast<uint32_t>(block->free_by_offset.size());
+		if (!block->free_by_size.empty()) {
+			stats.largest_free_range = std::max(stats.largest_free_range, block->free_by_size.rbegin()->first);
+		}
+	}
+	return stats;
+}
+
+void MemoryAllocator::PrintStats() const
+{
+	MemoryAllocatorStats stats = GetStats();
+	std::cout << "Vulkan: Memory " << stats.allocation_count << " allocations in "
+		<< stats.block_count << " blocks + " << stats.dedicated_count << " dedicated, "
+		<< stats.used_bytes / 1024 << " KiB used of " << stats.reserved_bytes / 1024 << " KiB reserved, "
+		<< stats.free_range_count << " free ranges, largest " << stats.largest_free_range / 1024 << " KiB" << std::endl;
+}
+
+MemoryAllocation MemoryAllocator::_Allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, bool optimal)
+{
+	uint32_t memory_type = FindMemoryTypeIndex(&_memory_properties, &requirements, properties);
+	if (UINT32_MAX == memory_type) {
+		throw std::runtime_error("Vulkan: Failed to find suitable memory type!");
+	}
+
+	// With a granularity of 1 the driver does not care about neighbours, so
+	// everything can share blocks.
+	if (1 == _buffer_image_granularity) {
+		optimal = false;
+	}
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	MemoryAllocation allocation;
+
+	VkDeviceSize heap_size = _memory_properties.memoryHeaps[_memory_properties.memoryTypes[memory_type].heapIndex].size;
+	VkDeviceSize block_size = std::min(_block_size, heap_size / 8);
+
+	if (requirements.size > block_size / 2) {
+		uint32_t block_index = _CreateBlock(memory_type, requirements.size, optimal, true);
+		Block* block = _blocks[block_index];
+		block->allocation_count = 1;
+		block->used = requirements.size;
+
+		allocation.memory       = block->memory;
+		allocation.offset       = 0;
+		allocation.size         = requirements.size;
+		allocation.mapped       = block->mapped;
+		allocation.memory_type  = memory_type;
+		allocation.block        = block_index;
+		allocation.range_offset = 0;
+		allocation.range_size   = requirements.size;
+		return allocation;
+	}
+
+	for (uint32_t i = 0; i < _blocks.size(); ++i) {
+		Block* block = _blocks[i];
+		if (nullptr == block || block->dedicated || block->memory_type != memory_type || block->optimal != optimal) {
+			continue;
+		}
+		if (_AllocateFromBlock(i, requirements.size, requirements.alignment, allocation)) {
+			return allocation;
+		}
+	}
+
+	uint32_t block_index = _CreateBlock(memory_type, block_size, optimal, false);
+	if (!_AllocateFromBlock(block_index, requirements.size, requirements.alignment, allocation)) {
+		throw std::runtime_error("Vulkan: Fresh memory block can't fit allocation!");
+	}
+	return allocation;
+}
+
+bool MemoryAllocator::_AllocateFromBlock(uint32_t block_index, VkDeviceSize size, VkDeviceSize alignment, MemoryAllocation& allocation)
+{
+	Block& block = *_blocks[block_index];
+
+	// Smallest free range that still fits once the start is aligned
+	auto it = block.free_by_size.lower_bound(size);
+	for (; it != block.free_by_size.end(); ++it) {
+		VkDeviceSize range_offset = it->second;
+		VkDeviceSize range_size = it->first;
+		VkDeviceSize offset = AlignUp(range_offset, alignment);
+		VkDeviceSize padding = offset - range_offset;
+		if (padding + size > range_size) {
+			continue;
+		}
+
+		_EraseFreeRange(block, range_offset, range_size);
+
+		// Give the tail back unless it is too small to ever be useful
+		VkDeviceSize taken = padding + size;
+		VkDeviceSize tail = range_size - taken;
+		if (tail >= 256) {
+			_InsertFreeRange(block, range_offset + taken, tail);
+		}
+		else {
+			taken = range_size;
+		}
+
+		block.allocation_count++;
+		block.used += taken;
+
+		allocation.memory       = block.memory;
+		allocation.offset       = offset;
+		allocation.size         = size;
+		allocation.mapped       = block.mapped ? block.mapped + offset : nullptr;
+		allocation.memory_type  = block.memory_type;
+		allocation.block        = block_index;
+		allocation.range_offset = range_offset;
+		allocation.range_size   = taken;
+		return true;
+	}
+	return false;
+}
+
+uint32_t MemoryAllocator::_CreateBlock(uint32_t memory_type, VkDeviceSize size, bool optimal, bool dedicated)
+{
+	if (_device_allocation_count >= _max_allocation_count) {
+		throw std::runtime_error("Vulkan: maxMemoryAllocationCount reached!");
+	}
+
+	Block* block = new Block();
+	block->size        = size;
+	block->memory_type = memory_type;
+	block->optimal     = optimal;
+	block->dedicated   = dedicated;
+
+	VkMemoryAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = size;
+	allocInfo.memoryTypeIndex = memory_type;
+
+	if (vkAllocateMemory(_device, &allocInfo, nullptr, &block->memory) != VK_SUCCESS) {
+		delete block;
+		throw std::runtime_error("Vulkan: Failed to allocate memory block!");
+	}
+	_device_allocation_count++;
+
+	if (_memory_properties.memoryTypes[memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+		void* data = nullptr;
+		ErrorCheck(vkMapMemory(_device, block->memory, 0, VK_WHOLE_SIZE, 0, &data));
+		block->mapped = static_cast<uint8_t*>(data);
+	}
+
+	if (!dedicated) {
+		_InsertFreeRange(*block, 0, size);
+	}
+
+	for (uint32_t i = 0; i < _blocks.size(); ++i) {
+		if (nullptr == _blocks[i]) {
+			_blocks[i] = block;
+			return i;
+		}
+	}
+	_blocks.push_back(block);
+	return static_cast<uint32_t>(_blocks.size() - 1);
+}
+
+void MemoryAllocator::_DestroyBlock(uint32_t block_index)
+{
+	Block* block = _blocks[block_index];
+	if (nullptr != block->mapped) {
+		vkUnmapMemory(_device, block->memory);
+	}
+	vkFreeMemory(_device, block->memory, nullptr);
+	_device_allocation_count--;
+
+	delete block;
+	_blocks[block_index] = nullptr;
+}
+
+void MemoryAllocator::_InsertFreeRange(Block& block, VkDeviceSize offset, VkDeviceSize size)
+{
+	// Merge with the free range right after ...
+	auto next = block.free_by_offset.find(offset + size);
+	if (next != block.free_by_offset.end()) {
+		VkDeviceSize next_size = next->second;
+		_EraseFreeRange(block, offset + size, next_size);
+		size += next_size;
+	}
+	// ... and with the one right before
+	auto prev = block.free_by_offset.lower_bound(offset);
+	if (prev != block.free_by_offset.begin()) {
+		--prev;
+		if (prev->first + prev->second == offset) {
+			VkDeviceSize prev_offset = prev->first;
+			VkDeviceSize prev_size = prev->second;
+			_EraseFreeRange(block, prev_offset, prev_size);
+			offset = prev_offset;
+			size += prev_size;
+		}
+	}
+	block.free_by_offset[offset] = size;
+	block.free_by_size.insert(std::make_pair(size, offset));
+}
+
+void MemoryAllocator::_EraseFreeRange(Block& block, VkDeviceSize offset, VkDeviceSize size)
+{
+	block.free_by_offset.erase(offset);
+	auto range = block.free_by_size.equal_range(size);
+	for (auto it = range.first; it != range.second; ++it) {
+		if (it->second == offset) {
+			block.free_by_size.erase(it);
+			return;
+		}
+	}
+	assert(0 && "Free range missing from size index.");
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include"Platform.h"
+#include"Shared.h"
+#include"allincludes.h"
+
+#include<map>
+#include<mutex>
+
+// A piece of device memory handed out by the MemoryAllocator. The resource is
+// already bound at memory + offset when the allocation is returned.
+struct MemoryAllocation
+{
+	VkDeviceMemory memory      = VK_NULL_HANDLE;
+	VkDeviceSize   offset      = 0;
+	VkDeviceSize   size        = 0;
+	// Persistently mapped pointer to offset, nullptr for memory that is not host visible.
+	void*          mapped      = nullptr;
+	uint32_t       memory_type = UINT32_MAX;
+
+	// Bookkeeping for Free(): the range taken from the block including alignment padding.
+	uint32_t       block        = UINT32_MAX;
+	VkDeviceSize   range_offset = 0;
+	VkDeviceSize   range_size   = 0;
+};
+
+struct MemoryAllocatorStats
+{
+	uint32_t     block_count        = 0;
+	uint32_t     dedicated_count    = 0;
+	uint32_t     allocation_count   = 0;
+	uint32_t     free_range_count   = 0;
+	VkDeviceSize reserved_bytes     = 0;
+	VkDeviceSize used_bytes         = 0;
+	VkDeviceSize largest_free_range = 0;
+};
+
+// Sub-allocates buffers and images out of large VkDeviceMemory blocks, one
+// pool of blocks per memory type. Inside a block free ranges are kept both by
+// offset (to merge neighbours on free) and by size (best fit on allocate).
+// Resources too big for a block get a dedicated allocation.
+class MemoryAllocator
+{
+public:
+	MemoryAllocator(VkDevice device, const VkPhysicalDeviceProperties& gpu_properties, const VkPhysicalDeviceMemoryProperties& memory_properties, VkDeviceSize block_size);
+	~MemoryAllocator();
+
+	MemoryAllocation AllocateForBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties);
+	MemoryAllocation AllocateForImage(VkImage image, VkMemoryPropertyFlags properties, VkImageTiling tiling);
+	void             Free(MemoryAllocation& allocation);
+
+	MemoryAllocatorStats GetStats() const;
+	void                 PrintStats() const;
+
+private:
+	struct Block
+	{
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize   size = 0;
+		uint8_t*       mapped = nullptr;
+		uint32_t       memory_type = 0;
+		// Linear and optimal resources never share a block when bufferImageGranularity > 1
+		bool           optimal = false;
+		bool           dedicated = false;
+
+		uint32_t       allocation_count = 0;
+		VkDeviceSize   used = 0;
+
+		std::map<VkDeviceSize, VkDeviceSize>      free_by_offset;
+		std::multimap<VkDeviceSize, VkDeviceSize> free_by_size;
+	};
+
+	MemoryAllocation _Allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, bool optimal);
+	bool             _AllocateFromBlock(uint32_t block_index, VkDeviceSize size, VkDeviceSize alignment, MemoryAllocation& allocation);
+	uint32_t         _CreateBlock(uint32_t memory_type, VkDeviceSize size, bool optimal, bool dedicated);
+	void             _DestroyBlock(uint32_t block_index);
+	void             _InsertFreeRange(Block& block, VkDeviceSize offset, VkDeviceSize size);
+	void             _EraseFreeRange(Block& block, VkDeviceSize offset, VkDeviceSize size);
+
+	VkDevice                         _device = VK_NULL_HANDLE;
+	VkPhysicalDeviceMemoryProperties _memory_properties = {};
+	VkDeviceSize                     _block_size = 0;
+	VkDeviceSize                     _buffer_image_granularity = 1;
+	uint32_t                         _max_allocation_count = 4096;
+	uint32_t                         _device_allocation_count = 0;
+
+	// Destroyed blocks leave a nullptr so allocation block indices stay valid.
+	std::vector<Block*>              _blocks;
+	mutable std::mutex               _mutex;
+};
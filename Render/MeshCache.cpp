@@ -0,0 +1,273 @@
+#include"MeshCache.h"
+#include"Platform.h"
+
+#include<cstdio>
+#include<cstring>
+#include<sys/stat.h>
+#include<sys/types.h>
+
+static const uint32_t MESH_CACHE_FILE_MAGIC   = 0x48534D56; // "VMSH"
+static const uint32_t MESH_CACHE_FILE_VERSION = 1;
+
+// Anything that changes what the loader writes into the arrays
+static uint32_t LoaderSettings()
+{
+#if BUILD_ENABLE_MESH_OPTIMIZATION
+	float threshold = BUILD_MESH_OVERDRAW_THRESHOLD;
+	uint32_t settings;
+	memcpy(&settings, &threshold, sizeof(settings));
+	return settings ^ 1u;
+#else
+	return 0;
+#endif
+}
+
+static uint64_t AlignOffset(uint64_t offset)
+{
+	return (offset + 15) & ~uint64_t(15);
+}
+
+static bool StatFile(const std::string& path, uint64_t* size, int64_t* mtime)
+{
+#ifdef _WIN32
+	struct _stat64 info;
+	if (_stat64(path.c_str(), &info) != 0) {
+		return false;
+	}
+#else
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0) {
+		return false;
+	}
+#endif
+	*size = static_cast<uint64_t>(info.st_size);
+	*mtime = static_cast<int64_t>(info.st_mtime);
+	return true;
+}
+
+static uint64_t HashFile(const std::string& path)
+{
+	MappedFile file;
+	if (!file.Open(path)) {
+		return 0;
+	}
+	// 8 bytes per step, only meant to tell changed content from a touched file
+	const uint8_t* data = file.GetData();
+	size_t size = file.GetSize();
+	uint64_t hash = 14695981039346656037ull ^ size;
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8) {
+		uint64_t word;
+		memcpy(&word, data + i, sizeof(word));
+		hash = (hash ^ word) * 0x9E3779B97F4A7C15ull;
+		hash ^= hash >> 31;
+	}
+	for (; i < size; ++i) {
+		hash = (hash ^ data[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+MeshCache::MeshCache()
+{
+}
+
+MeshCache::~MeshCache()
+{
+	Close();
+}
+
+std::string MeshCache::GetCachePath(const std::string& source_path)
+{
+	return source_path + ".meshcache";
+}
+
+bool MeshCache::Open(const std::string& source_path)
+{
+	Close();
+
+	std::string cache_path = GetCachePath(source_path);
+	FileHeader header{};
+	if (!_ReadHeader(cache_path, source_path, header)) {
+		return false;
+	}
+	if (!_file.Open(cache_path)) {
+		return false;
+	}
+
+	// Everything the header points at has to be inside the file
+	uint64_t vertex_end = header.vertex_offset + uint64_t(header.vertex_count) * sizeof(Vertex);
+	uint64_t index_end = header.index_offset + uint64_t(header.index_count) * sizeof(uint32_t);
+	if (_file.GetSize() < sizeof(FileHeader) || vertex_end > _file.GetSize() || index_end > _file.GetSize() ||
+		header.vertex_offset % 16 != 0 || header.index_offset % 4 != 0 ||
+		memcmp(_file.GetData(), &header, sizeof(header)) != 0) {
+		std::cout << "Mesh cache: " << cache_path << " is truncated, ignoring it" << std::endl;
+		_file.Close();
+		return false;
+	}
+
+	_header = reinterpret_cast<const FileHeader*>(_file.GetData());
+	_report.before.acmr   = _header->acmr_before;
+	_report.before.atvr   = _header->atvr_before;
+	_report.after.acmr    = _header->acmr_after;
+	_report.after.atvr    = _header->atvr_after;
+	_report.vertex_count  = _header->optimized_vertex_count;
+
+	std::cout << "Mesh cache: Mapped " << cache_path << " (" << _header->vertex_count << " vertices, " << _header->index_count << " indices)" << std::endl;
+	return true;
+}
+
+void MeshCache::Close()
+{
+	_file.Close();
+	_header = nullptr;
+	_report = MeshOptimizeReport();
+}
+
+const Vertex* MeshCache::GetVertices() const
+{
+	return reinterpret_cast<const Vertex*>(_file.GetData() + _header->vertex_offset);
+}
+
+uint32_t MeshCache::GetVertexCount() const
+{
+	return _header->vertex_count;
+}
+
+const uint32_t* MeshCache::GetIndices() const
+{
+	return reinterpret_cast<const uint32_t*>(_file.GetData() + _header->index_offset);
+}
+
+uint32_t MeshCache::GetIndexCount() const
+{
+	return _header->index_count;
+}
+
+glm::vec3 MeshCache::GetBoundsCenter() const
+{
+	return glm::vec3(_header->bounds_center[0], _header->bounds_center[1], _header->bounds_center[2]);
+}
+
+float MeshCache::GetBoundsRadius() const
+{
+	return _header->bounds_radius;
+}
+
+const MeshOptimizeReport& MeshCache::GetOptimizeReport() const
+{
+	return _report;
+}
+
+bool MeshCache::Write(const std::string& source_path, const Vertex* vertices, uint32_t vertex_count, const uint32_t* indices, uint32_t index_count,
+	const glm::vec3& bounds_center, float bounds_radius, const MeshOptimizeReport& report)
+{
+	FileHeader header{};
+	header.magic            = MESH_CACHE_FILE_MAGIC;
+	header.version          = MESH_CACHE_FILE_VERSION;
+	header.vertex_size      = sizeof(Vertex);
+	header.settings         = LoaderSettings();
+	if (!StatFile(source_path, &header.source_size, &header.source_mtime)) {
+		return false;
+	}
+	header.source_hash      = HashFile(source_path);
+	header.source_path_size = static_cast<uint32_t>(source_path.size());
+	header.vertex_count     = vertex_count;
+	header.index_count      = index_count;
+	header.bounds_center[0] = bounds_center.x;
+	header.bounds_center[1] = bounds_center.y;
+	header.bounds_center[2] = bounds_center.z;
+	header.bounds_radius    = bounds_radius;
+	header.acmr_before      = report.before.acmr;
+	header.acmr_after       = report.after.acmr;
+	header.atvr_before      = report.before.atvr;
+	header.atvr_after       = report.after.atvr;
+	header.optimized_vertex_count = report.vertex_count;
+	header.vertex_offset    = AlignOffset(sizeof(FileHeader) + source_path.size());
+	header.index_offset     = AlignOffset(header.vertex_offset + uint64_t(vertex_count) * sizeof(Vertex));
+
+	// Write next to the real file and swap it in once everything is on disk
+	std::string cache_path = GetCachePath(source_path);
+	std::string temp_path = cache_path + ".tmp";
+	FILE* file = fopen(temp_path.c_str(), "wb");
+	if (file == nullptr) {
+		std::cout << "Mesh cache: Could not open " << temp_path << std::endl;
+		return false;
+	}
+	static const char padding[16] = {};
+	uint64_t vertex_padding = header.vertex_offset - sizeof(FileHeader) - source_path.size();
+	uint64_t index_padding = header.index_offset - header.vertex_offset - uint64_t(vertex_count) * sizeof(Vertex);
+	bool written =
+		fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(source_path.data(), 1, source_path.size(), file) == source_path.size() &&
+		fwrite(padding, 1, vertex_padding, file) == vertex_padding &&
+		fwrite(vertices, sizeof(Vertex), vertex_count, file) == vertex_count &&
+		fwrite(padding, 1, index_padding, file) == index_padding &&
+		fwrite(indices, sizeof(uint32_t), index_count, file) == index_count &&
+		fflush(file) == 0;
+	written = (fclose(file) == 0) && written;
+
+	if (!written) {
+		remove(temp_path.c_str());
+		std::cout << "Mesh cache: Could not write " << temp_path << std::endl;
+		return false;
+	}
+
+#ifdef _WIN32
+	bool renamed = MoveFileExA(temp_path.c_str(), cache_path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	bool renamed = rename(temp_path.c_str(), cache_path.c_str()) == 0;
+#endif
+	if (!renamed) {
+		remove(temp_path.c_str());
+		std::cout << "Mesh cache: Could not replace " << cache_path << std::endl;
+		return false;
+	}
+
+	std::cout << "Mesh cache: Written " << cache_path << std::endl;
+	return true;
+}
+
+bool MeshCache::_ReadHeader(const std::string& cache_path, const std::string& source_path, FileHeader& header) const
+{
+	FILE* file = fopen(cache_path.c_str(), "rb");
+	if (file == nullptr) {
+		return false;
+	}
+
+	std::string cached_path(source_path.size(), '\0');
+	bool valid =
+		fread(&header, sizeof(header), 1, file) == 1 &&
+		header.magic == MESH_CACHE_FILE_MAGIC &&
+		header.version == MESH_CACHE_FILE_VERSION &&
+		header.vertex_size == sizeof(Vertex) &&
+		header.settings == LoaderSettings() &&
+		header.source_path_size == source_path.size() &&
+		fread(&cached_path[0], 1, cached_path.size(), file) == cached_path.size() &&
+		cached_path == source_path;
+
+	uint64_t source_size = 0;
+	int64_t source_mtime = 0;
+	valid = valid && StatFile(source_path, &source_size, &source_mtime) && source_size == header.source_size;
+
+	fclose(file);
+
+	if (valid && source_mtime != header.source_mtime) {
+		// Same size, different time: only a changed content hash makes the cache stale
+		valid = HashFile(source_path) == header.source_hash;
+		FILE* update = valid ? fopen(cache_path.c_str(), "r+b") : nullptr;
+		if (update != nullptr) {
+			FileHeader touched = header;
+			touched.source_mtime = source_mtime;
+			if (fwrite(&touched, sizeof(touched), 1, update) == 1) {
+				header = touched;
+			}
+			fclose(update);
+		}
+	}
+
+	if (!valid) {
+		std::cout << "Mesh cache: " << cache_path << " is stale, rebuilding it" << std::endl;
+	}
+	return valid;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include"allincludes.h"
+#include"VertexStruct.h"
+#include"MeshOptimizer.h"
+#include"MappedFile.h"
+
+#include<string>
+
+// Preprocessed mesh next to its source file (<source>.meshcache): the welded
+// and optimized vertices and indices exactly as the scene stores them, the
+// bounds and the optimizer's statistics. The file is mapped and the arrays are
+// read in place, nothing is parsed.
+//
+// A cache belongs to one source path, the loader settings it was built with
+// and the layout of Vertex. It is used as is when the source's size and
+// modification time still match; when only the time changed the source's
+// content hash decides, so a touched or checked out file does not force a
+// rebuild.
+class MeshCache
+{
+public:
+	MeshCache();
+	~MeshCache();
+
+	static std::string GetCachePath(const std::string& source_path);
+
+	// Maps the cache of source_path, false when there is none or it is stale.
+	bool Open(const std::string& source_path);
+	void Close();
+
+	const Vertex*   GetVertices() const;
+	uint32_t        GetVertexCount() const;
+	const uint32_t* GetIndices() const;
+	uint32_t        GetIndexCount() const;
+	glm::vec3       GetBoundsCenter() const;
+	float           GetBoundsRadius() const;
+	// Statistics of the optimization the cached mesh went through, zero when it was not optimized.
+	const MeshOptimizeReport& GetOptimizeReport() const;
+
+	// Writes the cache of source_path, returns false if nothing was written.
+	static bool Write(const std::string& source_path, const Vertex* vertices, uint32_t vertex_count, const uint32_t* indices, uint32_t index_count,
+		const glm::vec3& bounds_center, float bounds_radius, const MeshOptimizeReport& report);
+
+private:
+	struct FileHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t vertex_size;
+		uint32_t settings;       // loader settings the arrays depend on
+		uint64_t source_size;
+		int64_t  source_mtime;
+		uint64_t source_hash;
+		uint32_t source_path_size;
+		uint32_t vertex_count;
+		uint32_t index_count;
+		float    bounds_center[3];
+		float    bounds_radius;
+		float    acmr_before;
+		float    acmr_after;
+		float    atvr_before;
+		float    atvr_after;
+		uint32_t optimized_vertex_count;
+		uint64_t vertex_offset;  // from the start of the file, 16 byte aligned
+		uint64_t index_offset;
+	};
+
+	// Reads and checks the header, updating the recorded modification time when only that changed.
+	bool _ReadHeader(const std::string& cache_path, const std::string& source_path, FileHeader& header) const;
+
+	MappedFile          _file;
+	const FileHeader*   _header = nullptr;
+	MeshOptimizeReport  _report;
+};
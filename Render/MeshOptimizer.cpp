@@ -0,0 +1,337 @@
+#include"MeshOptimizer.h"
+
+#include<algorithm>
+#include<cmath>
+
+namespace {
+
+// Forsyth's tuning, the cache he scores against is larger than the one the
+// statistics simulate so recently used vertices keep some weight for longer
+const uint32_t FORSYTH_CACHE_SIZE      = 32;
+const float    FORSYTH_DECAY_POWER     = 1.5f;
+const float    FORSYTH_LAST_TRI_SCORE  = 0.75f;
+const float    FORSYTH_VALENCE_SCALE   = 2.0f;
+const float    FORSYTH_VALENCE_POWER   = 0.5f;
+
+float VertexScore(int32_t cache_position, uint32_t live_triangles)
+{
+	if (live_triangles == 0) {
+		// Nothing left to draw with this vertex
+		return -1.0f;
+	}
+
+	float score = 0.0f;
+	if (cache_position >= 0) {
+		if (cache_position < 3) {
+			// Used by the last triangle, fixed score so no strip is favored over fans
+			score = FORSYTH_LAST_TRI_SCORE;
+		}
+		else {
+			float scale = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+			score = std::pow(1.0f - (cache_position - 3) * scale, FORSYTH_DECAY_POWER);
+		}
+	}
+	// Vertices with few triangles left are finished off before they get evicted
+	score += FORSYTH_VALENCE_SCALE * std::pow(static_cast<float>(live_triangles), -FORSYTH_VALENCE_POWER);
+	return score;
+}
+
+// FIFO simulation that only needs one timestamp per vertex: a vertex is still
+// cached when fewer than cache_size other vertices were inserted since it was.
+struct FifoCache
+{
+	std::vector<uint32_t> inserted;
+	uint32_t              time;
+	uint32_t              size;
+
+	FifoCache(uint32_t vertex_count, uint32_t cache_size) : inserted(vertex_count, 0), time(cache_size + 1), size(cache_size) {}
+
+	// Returns 1 when the vertex had to be transformed.
+	uint32_t Access(uint32_t vertex)
+	{
+		if (time - inserted[vertex] > size) {
+			inserted[vertex] = time++;
+			return 1;
+		}
+		return 0;
+	}
+
+	void Clear()
+	{
+		time += size + 1;
+	}
+};
+
+}
+
+VertexCacheStats AnalyzeVertexCache(const uint32_t* indices, size_t index_count, uint32_t vertex_count, uint32_t cache_size)
+{
+	VertexCacheStats stats;
+	if (index_count < 3 || vertex_count == 0) {
+		return stats;
+	}
+
+	FifoCache cache(vertex_count, cache_size);
+	std::vector<uint8_t> used(vertex_count, 0);
+	uint32_t unique = 0;
+	for (size_t i = 0; i < index_count; ++i) {
+		stats.transformed += cache.Access(indices[i]);
+		unique += used[indices[i]] == 0 ? 1 : 0;
+		used[indices[i]] = 1;
+	}
+	stats.acmr = static_cast<float>(stats.transformed) / static_cast<float>(index_count / 3);
+	stats.atvr = static_cast<float>(stats.transformed) / static_cast<float>(unique);
+	return stats;
+}
+
+void OptimizeVertexCache(uint32_t* dst, const uint32_t* indices, size_t index_count, uint32_t vertex_count)
+{
+	assert(dst != indices);
+	size_t triangle_count = index_count / 3;
+	if (triangle_count == 0) {
+		return;
+	}
+
+	// Triangles per vertex, the first live_triangles entries of each range are the ones not emitted yet
+	std::vector<uint32_t> live_triangles(vertex_count, 0);
+	for (size_t i = 0; i < triangle_count * 3; ++i) {
+		live_triangles[indices[i]]++;
+	}
+	std::vector<uint32_t> adjacency_offset(vertex_count + 1, 0);
+	for (uint32_t v = 0; v < vertex_count; ++v) {
+		adjacency_offset[v + 1] = adjacency_offset[v] + live_triangles[v];
+	}
+	std::vector<uint32_t> adjacency(triangle_count * 3);
+	std::vector<uint32_t> fill(adjacency_offset.begin(), adjacency_offset.end() - 1);
+	for (size_t t = 0; t < triangle_count; ++t) {
+		for (size_t k = 0; k < 3; ++k) {
+			adjacency[fill[indices[t * 3 + k]]++] = static_cast<uint32_t>(t);
+		}
+	}
+
+	std::vector<int32_t> cache_position(vertex_count, -1);
+	std::vector<float> vertex_score(vertex_count);
+	for (uint32_t v = 0; v < vertex_count; ++v) {
+		vertex_score[v] = VertexScore(-1, live_triangles[v]);
+	}
+
+	std::vector<float> triangle_score(triangle_count);
+	uint32_t best_triangle = 0;
+	for (size_t t = 0; t < triangle_count; ++t) {
+		triangle_score[t] = vertex_score[indices[t * 3 + 0]] + vertex_score[indices[t * 3 + 1]] + vertex_score[indices[t * 3 + 2]];
+		if (triangle_score[t] > triangle_score[best_triangle]) {
+			best_triangle = static_cast<uint32_t>(t);
+		}
+	}
+
+	std::vector<uint8_t> emitted(triangle_count, 0);
+	// The last three entries only hold the vertices pushed out by the newest triangle
+	uint32_t cache[FORSYTH_CACHE_SIZE + 3];
+	uint32_t cache_count = 0;
+	size_t scan = 0;
+
+	for (size_t output = 0; output < triangle_count; ++output) {
+		if (best_triangle == UINT32_MAX) {
+			// Nothing in the cache has triangles left, continue with the next unused one
+			while (emitted[scan]) {
+				++scan;
+			}
+			best_triangle = static_cast<uint32_t>(scan);
+		}
+
+		const uint32_t* triangle = indices + best_triangle * 3;
+		dst[output * 3 + 0] = triangle[0];
+		dst[output * 3 + 1] = triangle[1];
+		dst[output * 3 + 2] = triangle[2];
+		emitted[best_triangle] = 1;
+
+		for (size_t k = 0; k < 3; ++k) {
+			uint32_t v = triangle[k];
+			uint32_t* begin = adjacency.data() + adjacency_offset[v];
+			uint32_t* end = begin + live_triangles[v];
+			uint32_t* found = std::find(begin, end, best_triangle);
+			// A degenerate triangle lists the vertex twice, the second time it is already gone
+			if (found != end) {
+				*found = *(end - 1);
+				live_triangles[v]--;
+			}
+		}
+
+		// The triangle's vertices move to the front, the rest shift back
+		uint32_t new_cache[FORSYTH_CACHE_SIZE + 3];
+		uint32_t new_count = 0;
+		for (size_t k = 0; k < 3; ++k) {
+			if (std::find(new_cache, new_cache + new_count, triangle[k]) == new_cache + new_count) {
+				new_cache[new_count++] = triangle[k];
+			}
+		}
+		for (uint32_t i = 0; i < cache_count; ++i) {
+			uint32_t v = cache[i];
+			if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+				new_cache[new_count++] = v;
+			}
+		}
+
+		for (uint32_t i = 0; i < new_count; ++i) {
+			uint32_t v = new_cache[i];
+			cache_position[v] = i < FORSYTH_CACHE_SIZE ? static_cast<int32_t>(i) : -1;
+			vertex_score[v] = VertexScore(cache_position[v], live_triangles[v]);
+		}
+
+		// Only triangles around vertices whose score changed need rescoring
+		best_triangle = UINT32_MAX;
+		float best_score = -1.0f;
+		for (uint32_t i = 0; i < new_count; ++i) {
+			uint32_t v = new_cache[i];
+			const uint32_t* begin = adjacency.data() + adjacency_offset[v];
+			for (uint32_t j = 0; j < live_triangles[v]; ++j) {
+				uint32_t t = begin[j];
+				const uint32_t* corners = indices + t * 3;
+				triangle_score[t] = vertex_score[corners[0]] + vertex_score[corners[1]] + vertex_score[corners[2]];
+				if (triangle_score[t] > best_score) {
+					best_score = triangle_score[t];
+					best_triangle = t;
+				}
+			}
+		}
+
+		cache_count = std::min<uint32_t>(new_count, FORSYTH_CACHE_SIZE);
+		std::copy(new_cache, new_cache + cache_count, cache);
+	}
+}
+
+void OptimizeOverdraw(uint32_t* indices, size_t index_count, const Vertex* vertices, uint32_t vertex_count, float threshold)
+{
+	size_t triangle_count = index_count / 3;
+	if (triangle_count == 0) {
+		return;
+	}
+
+	// Hard boundaries: triangles that miss the cache with all three vertices
+	FifoCache cache(vertex_count, MESH_STATS_CACHE_SIZE);
+	std::vector<size_t> hard;
+	for (size_t t = 0; t < triangle_count; ++t) {
+		uint32_t misses = cache.Access(indices[t * 3 + 0]) + cache.Access(indices[t * 3 + 1]) + cache.Access(indices[t * 3 + 2]);
+		if (t == 0 || misses == 3) {
+			hard.push_back(t);
+		}
+	}
+	hard.push_back(triangle_count);
+
+	// Soft boundaries: split a cluster again as soon as the part so far is
+	// within threshold of the whole cluster's ACMR, each part starts cold
+	std::vector<size_t> clusters;
+	for (size_t c = 0; c + 1 < hard.size(); ++c) {
+		size_t begin = hard[c];
+		size_t end = hard[c + 1];
+
+		cache.Clear();
+		uint32_t cluster_misses = 0;
+		for (size_t i = begin * 3; i < end * 3; ++i) {
+			cluster_misses += cache.Access(indices[i]);
+		}
+		float limit = threshold * static_cast<float>(cluster_misses) / static_cast<float>(end - begin);
+
+		cache.Clear();
+		clusters.push_back(begin);
+		size_t part_begin = begin;
+		uint32_t part_misses = 0;
+		for (size_t t = begin; t + 1 < end; ++t) {
+			part_misses += cache.Access(indices[t * 3 + 0]) + cache.Access(indices[t * 3 + 1]) + cache.Access(indices[t * 3 + 2]);
+			if (part_misses <= limit * static_cast<float>(t + 1 - part_begin)) {
+				clusters.push_back(t + 1);
+				part_begin = t + 1;
+				part_misses = 0;
+				cache.Clear();
+			}
+		}
+	}
+	clusters.push_back(triangle_count);
+	size_t cluster_count = clusters.size() - 1;
+
+	// Area weighted centroid and normal per cluster
+	std::vector<glm::vec3> cluster_centroid(cluster_count, glm::vec3(0.0f));
+	std::vector<glm::vec3> cluster_normal(cluster_count, glm::vec3(0.0f));
+	glm::vec3 mesh_centroid(0.0f);
+	float mesh_area = 0.0f;
+	for (size_t c = 0; c < cluster_count; ++c) {
+		float area = 0.0f;
+		for (size_t t = clusters[c]; t < clusters[c + 1]; ++t) {
+			const glm::vec3& p0 = vertices[indices[t * 3 + 0]].pos;
+			const glm::vec3& p1 = vertices[indices[t * 3 + 1]].pos;
+			const glm::vec3& p2 = vertices[indices[t * 3 + 2]].pos;
+			glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+			float triangle_area = glm::length(normal) * 0.5f;
+			cluster_centroid[c] += (p0 + p1 + p2) * (triangle_area / 3.0f);
+			cluster_normal[c] += normal;
+			area += triangle_area;
+		}
+		mesh_centroid += cluster_centroid[c];
+		mesh_area += area;
+		cluster_centroid[c] = area > 0.0f ? cluster_centroid[c] / area : vertices[indices[clusters[c] * 3]].pos;
+	}
+	if (mesh_area > 0.0f) {
+		mesh_centroid /= mesh_area;
+	}
+
+	// Clusters far out along their own normal are unlikely to be covered by the rest
+	std::vector<float> sort_key(cluster_count);
+	for (size_t c = 0; c < cluster_count; ++c) {
+		float length = glm::length(cluster_normal[c]);
+		sort_key[c] = length > 0.0f ? glm::dot(cluster_centroid[c] - mesh_centroid, cluster_normal[c] / length) : 0.0f;
+	}
+	std::vector<uint32_t> order(cluster_count);
+	for (size_t c = 0; c < cluster_count; ++c) {
+		order[c] = static_cast<uint32_t>(c);
+	}
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+		return sort_key[a] > sort_key[b];
+	});
+
+	std::vector<uint32_t> source(indices, indices + triangle_count * 3);
+	uint32_t* out = indices;
+	for (uint32_t c : order) {
+		out = std::copy(source.begin() + clusters[c] * 3, source.begin() + clusters[c + 1] * 3, out);
+	}
+}
+
+uint32_t OptimizeVertexFetch(Vertex* vertices, uint32_t* indices, size_t index_count, uint32_t vertex_count)
+{
+	std::vector<uint32_t> remap(vertex_count, UINT32_MAX);
+	uint32_t next = 0;
+	for (size_t i = 0; i < index_count; ++i) {
+		uint32_t& slot = remap[indices[i]];
+		if (slot == UINT32_MAX) {
+			slot = next++;
+		}
+		indices[i] = slot;
+	}
+
+	std::vector<Vertex> source(vertices, vertices + vertex_count);
+	uint32_t unused = next;
+	for (uint32_t v = 0; v < vertex_count; ++v) {
+		vertices[remap[v] != UINT32_MAX ? remap[v] : unused++] = source[v];
+	}
+	return next;
+}
+
+MeshOptimizeReport OptimizeMesh(Vertex* vertices, uint32_t vertex_count, uint32_t* indices, size_t index_count, float overdraw_threshold)
+{
+	MeshOptimizeReport report;
+	report.vertex_count = vertex_count;
+	if (index_count < 3 || vertex_count == 0) {
+		return report;
+	}
+
+	report.before = AnalyzeVertexCache(indices, index_count, vertex_count);
+
+	std::vector<uint32_t> source(indices, indices + index_count);
+	OptimizeVertexCache(indices, source.data(), index_count, vertex_count);
+	if (overdraw_threshold > 0.0f) {
+		OptimizeOverdraw(indices, index_count, vertices, vertex_count, overdraw_threshold);
+	}
+	report.vertex_count = OptimizeVertexFetch(vertices, indices, index_count, vertex_count);
+
+	report.after = AnalyzeVertexCache(indices, index_count, vertex_count);
+	return report;
+}
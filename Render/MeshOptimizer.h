@@ -0,0 +1,47 @@
+#pragma once
+
+#include"allincludes.h"
+#include"VertexStruct.h"
+
+// FIFO size the statistics simulate, close to the post-transform cache of current GPUs.
+const uint32_t MESH_STATS_CACHE_SIZE = 16;
+
+struct VertexCacheStats
+{
+	uint32_t transformed = 0;    // vertex shader invocations the simulated cache misses cause
+	float    acmr        = 0.0f; // average cache miss ratio, transformed vertices per triangle (0.5 to 3)
+	float    atvr        = 0.0f; // average transformed vertex ratio, transformed per unique vertex (1 is ideal)
+};
+
+// Simulates a FIFO post-transform cache of cache_size entries over the index list.
+VertexCacheStats AnalyzeVertexCache(const uint32_t* indices, size_t index_count, uint32_t vertex_count, uint32_t cache_size = MESH_STATS_CACHE_SIZE);
+
+// Reorders the triangles of a triangle list for post-transform vertex cache
+// locality with Forsyth's greedy scoring: triangles whose vertices were used
+// recently or have few triangles left are emitted first. dst and indices may
+// not overlap.
+void OptimizeVertexCache(uint32_t* dst, const uint32_t* indices, size_t index_count, uint32_t vertex_count);
+
+// Reorders an already cache optimized triangle list so that outward facing
+// parts of the mesh are drawn before the ones they are likely to hide (Tipsy
+// style). The list is split into clusters where the vertex cache has to start
+// over anyway, and further only while a cluster's ACMR stays within threshold
+// times the original one, so 1.05 allows 5% more vertex shading.
+void OptimizeOverdraw(uint32_t* indices, size_t index_count, const Vertex* vertices, uint32_t vertex_count, float threshold);
+
+// Moves vertices into the order the index list first references them and
+// rewrites the indices to match, so vertex fetch walks memory forward.
+// Returns the number of referenced vertices, unused ones end up past it.
+uint32_t OptimizeVertexFetch(Vertex* vertices, uint32_t* indices, size_t index_count, uint32_t vertex_count);
+
+struct MeshOptimizeReport
+{
+	VertexCacheStats before;
+	VertexCacheStats after;
+	uint32_t         vertex_count = 0; // referenced vertices after the fetch remap
+};
+
+// Runs the vertex cache, optionally the overdraw and then the vertex fetch
+// pass over a mesh in place and measures the cache before and after.
+// overdraw_threshold of 0 skips the overdraw pass.
+MeshOptimizeReport OptimizeMesh(Vertex* vertices, uint32_t vertex_count, uint32_t* indices, size_t index_count, float overdraw_threshold);
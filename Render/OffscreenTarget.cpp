@@ -0,0 +1,131 @@
+#include"OffscreenTarget.h"
+#include"Renderer.h"
+
+OffscreenTarget::OffscreenTarget(Renderer* renderer, VkFormat format, VkExtent2D extent, uint32_t image_count)
+{
+	_renderer    = renderer;
+	_format      = format;
+	_extent      = extent;
+	_image_count = image_count;
+
+	_InitImages();
+}
+
+OffscreenTarget::~OffscreenTarget()
+{
+	_DeInitImages();
+}
+
+VkFormat OffscreenTarget::GetFormat() const
+{
+	return _format;
+}
+
+VkExtent2D OffscreenTarget::GetExtent() const
+{
+	return _extent;
+}
+
+uint32_t OffscreenTarget::GetImageCount() const
+{
+	return _image_count;
+}
+
+VkImage OffscreenTarget::GetImage(uint32_t index) const
+{
+	return _images[index];
+}
+
+VkImageView OffscreenTarget::GetImageView(uint32_t index) const
+{
+	return _images_views[index];
+}
+
+VkImageLayout OffscreenTarget::GetFinalLayout() const
+{
+	return VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+}
+
+bool OffscreenTarget::IsPresentable() const
+{
+	return false;
+}
+
+VkResult OffscreenTarget::AcquireNextImage(VkSemaphore image_available, uint32_t* image_index)
+{
+	// Reuse of an image is guarded by the window's per-image fences, so the
+	// semaphore is not needed here.
+	*image_index = _next_image;
+	_next_image = (_next_image + 1) % _image_count;
+	return VK_SUCCESS;
+}
+
+VkResult OffscreenTarget::Present(VkSemaphore render_finished, uint32_t image_index)
+{
+	return VK_SUCCESS;
+}
+
+void OffscreenTarget::Resize(VkExtent2D extent)
+{
+	_DeInitImages();
+	_extent = extent;
+	_next_image = 0;
+	_InitImages();
+}
+
+void OffscreenTarget::_InitImages()
+{
+	auto device = _renderer->GetVulkanDevice();
+
+	_images.resize(_image_count);
+	_images_memory.resize(_image_count);
+	_images_views.resize(_image_count);
+
+	for (uint32_t i = 0; i < _image_count; ++i) {
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.extent.width = _extent.width;
+		imageInfo.extent.height = _extent.height;
+		imageInfo.extent.depth = 1;
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.format = _format;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		ErrorCheck(vkCreateImage(device, &imageInfo, nullptr, &_images[i]));
+
+		_images_memory[i] = _renderer->GetMemoryAllocator()->AllocateForImage(_images[i], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_TILING_OPTIMAL);
+
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = _images[i];
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = _format;
+		viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		viewInfo.subresourceRange.baseMipLevel = 0;
+		viewInfo.subresourceRange.levelCount = 1;
+		viewInfo.subresourceRange.baseArrayLayer = 0;
+		viewInfo.subresourceRange.layerCount = 1;
+
+		ErrorCheck(vkCreateImageView(device, &viewInfo, nullptr, &_images_views[i]));
+	}
+	std::cout << "Vulkan: Offscreen target with " << _image_count << " images created successfully" << std::endl;
+}
+
+void OffscreenTarget::_DeInitImages()
+{
+	auto device = _renderer->GetVulkanDevice();
+	for (uint32_t i = 0; i < _images.size(); ++i) {
+		vkDestroyImageView(device, _images_views[i], nullptr);
+		vkDestroyImage(device, _images[i], nullptr);
+		_renderer->GetMemoryAllocator()->Free(_images_memory[i]);
+	}
+	_images_views.clear();
+	_images.clear();
+	_images_memory.clear();
+}
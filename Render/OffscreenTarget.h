@@ -0,0 +1,42 @@
+#pragma once
+
+#include"RenderTarget.h"
+#include"MemoryAllocator.h"
+
+class Renderer;
+
+// N device-local color images with no surface behind them. Frames are handed
+// out round robin and left in TRANSFER_SRC layout so they can be copied out.
+class OffscreenTarget : public RenderTarget
+{
+public:
+	OffscreenTarget(Renderer* renderer, VkFormat format, VkExtent2D extent, uint32_t image_count);
+	~OffscreenTarget();
+
+	VkFormat      GetFormat() const override;
+	VkExtent2D    GetExtent() const override;
+	uint32_t      GetImageCount() const override;
+	VkImage       GetImage(uint32_t index) const override;
+	VkImageView   GetImageView(uint32_t index) const override;
+	VkImageLayout GetFinalLayout() const override;
+	bool          IsPresentable() const override;
+
+	VkResult      AcquireNextImage(VkSemaphore image_available, uint32_t* image_index) override;
+	VkResult      Present(VkSemaphore render_finished, uint32_t image_index) override;
+	void          Resize(VkExtent2D extent) override;
+
+private:
+	void _InitImages();
+	void _DeInitImages();
+
+	Renderer* _renderer = nullptr;
+
+	VkFormat   _format = VK_FORMAT_UNDEFINED;
+	VkExtent2D _extent = {};
+	uint32_t   _image_count = 0;
+	uint32_t   _next_image = 0;
+
+	std::vector<VkImage>        _images;
+	std::vector<MemoryAllocation> _images_memory;
+	std::vector<VkImageView>    _images_views;
+};
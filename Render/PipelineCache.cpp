@@ -0,0 +1,199 @@
+#include"PipelineCache.h"
+#include"Renderer.h"
+
+#include<cstdio>
+#include<cstring>
+
+#ifdef _WIN32
+#include<io.h>
+#else
+#include<unistd.h>
+#endif
+
+static const uint32_t PIPELINE_CACHE_FILE_MAGIC   = 0x48435056; // "VPCH"
+static const uint32_t PIPELINE_CACHE_FILE_VERSION = 1;
+
+static uint64_t HashBytes(const char* data, size_t size)
+{
+	// FNV-1a, only meant to catch truncated or corrupted files
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= static_cast<uint8_t>(data[i]);
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+PipelineCache::PipelineCache(Renderer* renderer, std::string path)
+{
+	_renderer = renderer;
+	_path     = path;
+
+	std::vector<char> data;
+	bool loaded = _Load(data);
+
+	VkPipelineCacheCreateInfo pipeline_cache_create_info{};
+	pipeline_cache_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	pipeline_cache_create_info.initialDataSize = loaded ? data.size() : 0;
+	pipeline_cache_create_info.pInitialData = loaded ? data.data() : nullptr;
+
+	VkResult result = vkCreatePipelineCache(_renderer->GetVulkanDevice(), &pipeline_cache_create_info, nullptr, &_pipeline_cache);
+	if (result != VK_SUCCESS && loaded) {
+		// The driver may still refuse a blob that passed our checks, fall back to a cold cache
+		pipeline_cache_create_info.initialDataSize = 0;
+		pipeline_cache_create_info.pInitialData = nullptr;
+		loaded = false;
+		result = vkCreatePipelineCache(_renderer->GetVulkanDevice(), &pipeline_cache_create_info, nullptr, &_pipeline_cache);
+	}
+	ErrorCheck(result);
+
+	if (loaded) {
+		std::cout << "Vulkan: Pipeline cache loaded successfully from " << _path << " (" << data.size() << " bytes)" << std::endl;
+	}
+	else {
+		std::cout << "Vulkan: Pipeline cache created empty" << std::endl;
+	}
+}
+
+PipelineCache::~PipelineCache()
+{
+	Save();
+	vkDestroyPipelineCache(_renderer->GetVulkanDevice(), _pipeline_cache, nullptr);
+	_pipeline_cache = VK_NULL_HANDLE;
+	std::cout << "Vulkan: Pipeline cache destroyed successfully" << std::endl;
+}
+
+VkPipelineCache PipelineCache::GetVulkanPipelineCache() const
+{
+	return _pipeline_cache;
+}
+
+bool PipelineCache::Save()
+{
+	auto device = _renderer->GetVulkanDevice();
+
+	size_t data_size = 0;
+	if (vkGetPipelineCacheData(device, _pipeline_cache, &data_size, nullptr) != VK_SUCCESS || data_size == 0) {
+		return false;
+	}
+	std::vector<char> data(data_size);
+	if (vkGetPipelineCacheData(device, _pipeline_cache, &data_size, data.data()) != VK_SUCCESS) {
+		return false;
+	}
+	data.resize(data_size);
+
+	FileHeader header{};
+	_FillHeader(header, data);
+
+	// Write next to the real file and swap it in once everything is on disk
+	std::string temp_path = _path + ".tmp";
+	FILE* file = fopen(temp_path.c_str(), "wb");
+	if (file == nullptr) {
+		std::cout << "Vulkan: Pipeline cache could not open " << temp_path << std::endl;
+		return false;
+	}
+	bool written =
+		fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(data.data(), 1, data.size(), file) == data.size() &&
+		fflush(file) == 0;
+#ifdef _WIN32
+	written = written && _commit(_fileno(file)) == 0;
+#else
+	written = written && fsync(fileno(file)) == 0;
+#endif
+	written = (fclose(file) == 0) && written;
+
+	if (!written) {
+		remove(temp_path.c_str());
+		std::cout << "Vulkan: Pipeline cache could not be written to " << temp_path << std::endl;
+		return false;
+	}
+
+#ifdef _WIN32
+	bool renamed = MoveFileExA(temp_path.c_str(), _path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	bool renamed = rename(temp_path.c_str(), _path.c_str()) == 0;
+#endif
+	if (!renamed) {
+		remove(temp_path.c_str());
+		std::cout << "Vulkan: Pipeline cache could not replace " << _path << std::endl;
+		return false;
+	}
+
+	std::cout << "Vulkan: Pipeline cache saved successfully to " << _path << " (" << data.size() << " bytes)" << std::endl;
+	return true;
+}
+
+bool PipelineCache::_Load(std::vector<char>& data)
+{
+	std::ifstream file(_path, std::ios::binary | std::ios::ate);
+	if (!file.is_open()) {
+		return false;
+	}
+
+	std::streamoff file_size = file.tellg();
+	if (file_size < static_cast<std::streamoff>(sizeof(FileHeader))) {
+		std::cout << "Vulkan: Pipeline cache " << _path << " is truncated, ignoring it" << std::endl;
+		return false;
+	}
+	file.seekg(0);
+
+	FileHeader header{};
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	data.resize(static_cast<size_t>(file_size) - sizeof(header));
+	file.read(data.data(), data.size());
+	if (!file) {
+		return false;
+	}
+
+	if (!_Validate(header, data)) {
+		std::cout << "Vulkan: Pipeline cache " << _path << " belongs to another device or driver, ignoring it" << std::endl;
+		data.clear();
+		return false;
+	}
+	return true;
+}
+
+bool PipelineCache::_Validate(const FileHeader& header, const std::vector<char>& data) const
+{
+	FileHeader expected{};
+	_FillHeader(expected, data);
+
+	if (header.magic != expected.magic ||
+		header.version != expected.version ||
+		header.vendor_id != expected.vendor_id ||
+		header.device_id != expected.device_id ||
+		header.driver_version != expected.driver_version ||
+		memcmp(header.pipeline_cache_uuid, expected.pipeline_cache_uuid, VK_UUID_SIZE) != 0 ||
+		header.data_size != expected.data_size ||
+		header.data_hash != expected.data_hash) {
+		return false;
+	}
+
+	// The driver's own header has to agree as well
+	VkPipelineCacheHeaderVersionOne driver_header{};
+	if (data.size() < sizeof(driver_header)) {
+		return false;
+	}
+	memcpy(&driver_header, data.data(), sizeof(driver_header));
+
+	auto& properties = _renderer->GetVulkanPhysicalDeviceProperties();
+	return driver_header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+		driver_header.vendorID == properties.vendorID &&
+		driver_header.deviceID == properties.deviceID &&
+		memcmp(driver_header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+void PipelineCache::_FillHeader(FileHeader& header, const std::vector<char>& data) const
+{
+	auto& properties = _renderer->GetVulkanPhysicalDeviceProperties();
+
+	header.magic          = PIPELINE_CACHE_FILE_MAGIC;
+	header.version        = PIPELINE_CACHE_FILE_VERSION;
+	header.vendor_id      = properties.vendorID;
+	header.device_id      = properties.deviceID;
+	header.driver_version = properties.driverVersion;
+	memcpy(header.pipeline_cache_uuid, properties.pipelineCacheUUID, VK_UUID_SIZE);
+	header.data_size      = data.size();
+	header.data_hash      = HashBytes(data.data(), data.size());
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include"Platform.h"
+#include"Shared.h"
+#include"allincludes.h"
+
+#include<string>
+
+class Renderer;
+
+// VkPipelineCache that outlives the process. The blob is loaded at startup and
+// only handed to the driver when it was written by the same vendor, device,
+// driver and pipelineCacheUUID; anything else starts an empty cache. On save
+// the blob goes to a temporary file first and is renamed over the old one, so
+// a crash mid-write never leaves a torn cache behind.
+class PipelineCache
+{
+public:
+	PipelineCache(Renderer* renderer, std::string path);
+	~PipelineCache();
+
+	VkPipelineCache GetVulkanPipelineCache() const;
+
+	// Writes the current cache contents to disk, returns false if nothing was written.
+	bool Save();
+
+private:
+	// Prepended to the driver's blob so stale or truncated files are recognised without asking the driver.
+	struct FileHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t vendor_id;
+		uint32_t device_id;
+		uint32_t driver_version;
+		uint8_t  pipeline_cache_uuid[VK_UUID_SIZE];
+		uint64_t data_size;
+		uint64_t data_hash;
+	};
+
+	bool _Load(std::vector<char>& data);
+	bool _Validate(const FileHeader& header, const std::vector<char>& data) const;
+	void _FillHeader(FileHeader& header, const std::vector<char>& data) const;
+
+	Renderer*        _renderer = nullptr;
+	std::string      _path;
+	VkPipelineCache  _pipeline_cache = VK_NULL_HANDLE;
+};
@@ -1,11 +1,30 @@
 #pragma once
 
+#include"BUILD_OPTIONS.h"
+
 #ifdef _WIN32
 
 #define VK_USE_PLATFORM_WIN32_KHR  1
 #define PLATFORM_SURFACE_EXTENSION_NAME VK_KHR_WIN32_SURFACE_EXTENSION_NAME
 #include<Windows.h>
 
+#elif defined(__linux__)
+
+#if BUILD_USE_XCB
+
+#define VK_USE_PLATFORM_XCB_KHR  1
+#define PLATFORM_SURFACE_EXTENSION_NAME VK_KHR_XCB_SURFACE_EXTENSION_NAME
+#include<xcb/xcb.h>
+
+#else
+
+// No display server at all: VK_EXT_headless_surface gives us a surface and a
+// swapchain whose presents go nowhere, which is what the render nodes need.
+#define USE_PLATFORM_HEADLESS  1
+#define PLATFORM_SURFACE_EXTENSION_NAME VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME
+
+#endif
+
 #else
 
 #error Platform not yet supported
@@ -0,0 +1,338 @@
+#include"Profiler.h"
+#include"Renderer.h"
+
+#include<algorithm>
+#include<chrono>
+#include<cmath>
+#include<cstring>
+#include<fstream>
+
+namespace {
+
+// Events a thread may record between two MarkFrame calls before it drops any
+const uint32_t THREAD_BUFFER_CAPACITY = 16384;
+
+std::atomic<uint64_t> next_profiler_id { 1 };
+
+// The calling thread's buffer and the profiler it belongs to
+thread_local uint64_t thread_profiler_id = 0;
+thread_local void*    thread_buffer = nullptr;
+
+void WriteJsonString(std::ofstream& file, const char* text)
+{
+	file << '"';
+	for (const char* c = text; *c != '\0'; ++c) {
+		if (*c == '"' || *c == '\\') {
+			file << '\\';
+		}
+		file << *c;
+	}
+	file << '"';
+}
+
+}
+
+Profiler::Profiler(uint32_t frame_history, uint32_t trace_capacity)
+{
+	_id = next_profiler_id++;
+	_trace_capacity = trace_capacity;
+	for (auto& history : _history) {
+		history.samples.assign(std::max<uint32_t>(frame_history, 1), 0.0);
+	}
+	_last_mark = Now();
+}
+
+Profiler::~Profiler()
+{
+}
+
+uint64_t Profiler::Now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Profiler::AddCpuEvent(const char* name, uint64_t begin_ns, uint64_t end_ns)
+{
+	_Push(Event{ name, nullptr, begin_ns, end_ns });
+}
+
+void Profiler::AddGpuEvent(const char* track, const char* name, uint64_t begin_ns, uint64_t end_ns)
+{
+	_Push(Event{ name, track, begin_ns, end_ns });
+}
+
+void Profiler::AddFrameSample(FrameTrack track, double milliseconds)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	FrameHistory& history = _history[static_cast<int>(track)];
+	history.samples[history.next] = milliseconds;
+	history.next = (history.next + 1) % history.samples.size();
+	history.count = std::min<uint32_t>(history.count + 1, static_cast<uint32_t>(history.samples.size()));
+}
+
+void Profiler::MarkFrame()
+{
+	uint64_t now = Now();
+	AddFrameSample(FrameTrack::Cpu, (now - _last_mark) / 1000000.0);
+#if BUILD_ENABLE_PROFILER
+	AddCpuEvent("Frame", _last_mark, now);
+#endif
+	_last_mark = now;
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	_Drain();
+}
+
+FrameTimeSummary Profiler::GetFrameTimeSummary(FrameTrack track)
+{
+	std::vector<double> samples;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		const FrameHistory& history = _history[static_cast<int>(track)];
+		samples.assign(history.samples.begin(), history.samples.begin() + history.count);
+	}
+
+	FrameTimeSummary summary;
+	summary.count = static_cast<uint32_t>(samples.size());
+	if (samples.empty()) {
+		return summary;
+	}
+	std::sort(samples.begin(), samples.end());
+
+	// Nearest rank: the smallest sample that at least p of all samples do not exceed
+	auto percentile = [&](double p) {
+		size_t rank = static_cast<size_t>(std::ceil(p * samples.size()));
+		return samples[std::max<size_t>(rank, 1) - 1];
+	};
+	double total = 0.0;
+	for (double sample : samples) {
+		total += sample;
+	}
+	summary.average_ms = total / samples.size();
+	summary.p50_ms = percentile(0.50);
+	summary.p95_ms = percentile(0.95);
+	summary.p99_ms = percentile(0.99);
+	summary.max_ms = samples.back();
+	return summary;
+}
+
+uint64_t Profiler::GetDroppedEventCount()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	uint64_t dropped = 0;
+	for (const auto& buffer : _threads) {
+		dropped += buffer->dropped.load(std::memory_order_relaxed);
+	}
+	return dropped;
+}
+
+bool Profiler::WriteChromeTrace(const std::string& path)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_Drain();
+
+	std::ofstream file(path, std::ios::out | std::ios::trunc);
+	if (!file.is_open()) {
+		std::cout << "Profiler: Failed to write trace " << path << std::endl;
+		return false;
+	}
+
+	// CPU threads are rows of process 0, each GPU track a row of process 1
+	std::vector<const char*> tracks;
+	auto track_row = [&](const char* track) {
+		for (size_t i = 0; i < tracks.size(); ++i) {
+			if (strcmp(tracks[i], track) == 0) {
+				return static_cast<uint32_t>(i);
+			}
+		}
+		tracks.push_back(track);
+		return static_cast<uint32_t>(tracks.size() - 1);
+	};
+
+	uint64_t origin = _trace.empty() ? 0 : _trace.front().event.begin_ns;
+	for (const auto& trace_event : _trace) {
+		origin = std::min<uint64_t>(origin, trace_event.event.begin_ns);
+	}
+
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << std::endl;
+	file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"CPU\"}}," << std::endl;
+	file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"GPU\"}}";
+	file.precision(3);
+	file << std::fixed;
+	for (const auto& trace_event : _trace) {
+		const Event& event = trace_event.event;
+		bool gpu = event.track != nullptr;
+		file << "," << std::endl << "{\"name\":";
+		WriteJsonString(file, event.name);
+		file << ",\"ph\":\"X\",\"pid\":" << (gpu ? 1 : 0)
+			<< ",\"tid\":" << (gpu ? track_row(event.track) : trace_event.thread)
+			<< ",\"ts\":" << (event.begin_ns - origin) / 1000.0
+			<< ",\"dur\":" << (event.end_ns - event.begin_ns) / 1000.0 << "}";
+	}
+	for (size_t i = 0; i < tracks.size(); ++i) {
+		file << "," << std::endl << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << i << ",\"args\":{\"name\":";
+		WriteJsonString(file, tracks[i]);
+		file << "}}";
+	}
+	file << std::endl << "]}" << std::endl;
+
+	std::cout << "Profiler: Wrote " << _trace.size() << " events to " << path << std::endl;
+	return file.good();
+}
+
+Profiler::ThreadBuffer* Profiler::_GetThreadBuffer()
+{
+	// A thread registers once per profiler, every later event finds its buffer without locking
+	if (thread_profiler_id != _id) {
+		std::unique_ptr<ThreadBuffer> buffer(new ThreadBuffer());
+		buffer->events.reset(new Event[THREAD_BUFFER_CAPACITY]);
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		buffer->index = static_cast<uint32_t>(_threads.size());
+		thread_buffer = buffer.get();
+		thread_profiler_id = _id;
+		_threads.push_back(std::move(buffer));
+	}
+	return static_cast<ThreadBuffer*>(thread_buffer);
+}
+
+void Profiler::_Push(const Event& event)
+{
+	ThreadBuffer* buffer = _GetThreadBuffer();
+	uint64_t write = buffer->write.load(std::memory_order_relaxed);
+	if (write - buffer->read.load(std::memory_order_acquire) >= THREAD_BUFFER_CAPACITY) {
+		buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	buffer->events[write % THREAD_BUFFER_CAPACITY] = event;
+	buffer->write.store(write + 1, std::memory_order_release);
+}
+
+void Profiler::_Drain()
+{
+	// Called with _mutex held, which makes this the only reader of every buffer
+	for (const auto& buffer : _threads) {
+		uint64_t read = buffer->read.load(std::memory_order_relaxed);
+		uint64_t write = buffer->write.load(std::memory_order_acquire);
+		for (; read < write; ++read) {
+			_trace.push_back(TraceEvent{ buffer->events[read % THREAD_BUFFER_CAPACITY], buffer->index });
+		}
+		buffer->read.store(read, std::memory_order_release);
+	}
+	while (_trace.size() > _trace_capacity) {
+		_trace.pop_front();
+	}
+}
+
+GpuTimer::GpuTimer(Renderer* renderer, uint32_t queue_family, const char* track, uint32_t slot_count, uint32_t regions_per_slot)
+{
+	_renderer = renderer;
+	_track = track;
+	_regions_per_slot = regions_per_slot;
+	_slots.resize(slot_count);
+
+#if BUILD_ENABLE_PROFILER
+	uint32_t family_count = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(_renderer->GetVulkanPhysicalDevice(), &family_count, nullptr);
+	std::vector<VkQueueFamilyProperties> families(family_count);
+	vkGetPhysicalDeviceQueueFamilyProperties(_renderer->GetVulkanPhysicalDevice(), &family_count, families.data());
+
+	uint32_t valid_bits = queue_family < family_count ? families[queue_family].timestampValidBits : 0;
+	if (valid_bits == 0) {
+		std::cout << "Profiler: Queue family " << queue_family << " writes no timestamps, " << _track << " is not timed" << std::endl;
+		return;
+	}
+	_host_reset = _renderer->GetVulkanPhysicalDeviceFeatures12().hostQueryReset == VK_TRUE;
+	if (!_host_reset && !(families[queue_family].queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+		std::cout << "Profiler: Queue family " << queue_family << " cannot reset queries, " << _track << " is not timed" << std::endl;
+		return;
+	}
+	_mask = valid_bits >= 64 ? ~0ull : (1ull << valid_bits) - 1;
+	_period = _renderer->GetVulkanPhysicalDeviceProperties().limits.timestampPeriod;
+
+	// Two queries per region, begin and end
+	VkQueryPoolCreateInfo create_info{};
+	create_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	create_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	create_info.queryCount = slot_count * regions_per_slot * 2;
+	ErrorCheck(vkCreateQueryPool(_renderer->GetVulkanDevice(), &create_info, nullptr, &_query_pool));
+#endif
+}
+
+GpuTimer::~GpuTimer()
+{
+	vkDestroyQueryPool(_renderer->GetVulkanDevice(), _query_pool, nullptr);
+}
+
+bool GpuTimer::IsSupported() const
+{
+	return _query_pool != VK_NULL_HANDLE;
+}
+
+double GpuTimer::Collect(uint32_t slot)
+{
+	Slot& state = _slots[slot];
+	uint32_t region_count = static_cast<uint32_t>(state.names.size());
+	if (!IsSupported() || region_count == 0) {
+		return 0.0;
+	}
+
+	// No wait: the caller has waited on the fence, a region still unavailable was never submitted
+	std::vector<uint64_t> ticks(region_count * 2);
+	VkResult result = vkGetQueryPoolResults(_renderer->GetVulkanDevice(), _query_pool,
+		slot * _regions_per_slot * 2, region_count * 2,
+		ticks.size() * sizeof(uint64_t), ticks.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+	std::vector<const char*> names;
+	names.swap(state.names);
+	if (result != VK_SUCCESS) {
+		return 0.0;
+	}
+
+	Profiler* profiler = _renderer->GetProfiler();
+	uint64_t first = ticks[0] & _mask;
+	uint64_t last = first;
+	for (uint32_t region = 0; region < region_count; ++region) {
+		uint64_t begin = ((ticks[region * 2] & _mask) - first) & _mask;
+		uint64_t end = ((ticks[region * 2 + 1] & _mask) - first) & _mask;
+		uint64_t begin_ns = state.cpu_begin_ns + static_cast<uint64_t>(begin * _period);
+		uint64_t end_ns = state.cpu_begin_ns + static_cast<uint64_t>(end * _period);
+		profiler->AddGpuEvent(_track, names[region], begin_ns, end_ns);
+		last = std::max<uint64_t>(last, end);
+	}
+	return last * _period / 1000000.0;
+}
+
+void GpuTimer::Reset(VkCommandBuffer command_buffer, uint32_t slot)
+{
+	if (!IsSupported()) {
+		return;
+	}
+	_slots[slot].names.clear();
+	_slots[slot].cpu_begin_ns = Profiler::Now();
+	if (_host_reset) {
+		vkResetQueryPool(_renderer->GetVulkanDevice(), _query_pool, slot * _regions_per_slot * 2, _regions_per_slot * 2);
+	}
+	else {
+		vkCmdResetQueryPool(command_buffer, _query_pool, slot * _regions_per_slot * 2, _regions_per_slot * 2);
+	}
+}
+
+uint32_t GpuTimer::Begin(VkCommandBuffer command_buffer, uint32_t slot, const char* name)
+{
+	Slot& state = _slots[slot];
+	if (!IsSupported() || state.names.size() >= _regions_per_slot) {
+		return UINT32_MAX;
+	}
+	uint32_t region = static_cast<uint32_t>(state.names.size());
+	state.names.push_back(name);
+	vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, _query_pool, (slot * _regions_per_slot + region) * 2);
+	return region;
+}
+
+void GpuTimer::End(VkCommandBuffer command_buffer, uint32_t slot, uint32_t region)
+{
+	if (region == UINT32_MAX) {
+		return;
+	}
+	vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, _query_pool, (slot * _regions_per_slot + region) * 2 + 1);
+}
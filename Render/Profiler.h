@@ -0,0 +1,189 @@
+#pragma once
+
+#include"Platform.h"
+#include"Shared.h"
+#include"BUILD_OPTIONS.h"
+#include"allincludes.h"
+
+#include<atomic>
+#include<deque>
+#include<memory>
+#include<mutex>
+#include<string>
+
+class Renderer;
+
+// Which frame time a sample belongs to.
+enum class FrameTrack
+{
+	Cpu,   // main loop iteration, MarkFrame to MarkFrame
+	Gpu,   // first to last timestamp of a frame's command buffer
+};
+
+// Frame times over the profiler's rolling window, nearest rank percentiles.
+struct FrameTimeSummary
+{
+	uint32_t count      = 0;
+	double   average_ms = 0.0;
+	double   p50_ms     = 0.0;
+	double   p95_ms     = 0.0;
+	double   p99_ms     = 0.0;
+	double   max_ms     = 0.0;
+};
+
+// Collects timed scopes from every thread and frame times for percentiles.
+// Each thread appends to its own single producer ring, so recording an event
+// takes no lock after the thread's first one; MarkFrame drains the rings
+// into a bounded trace window that WriteChromeTrace exports. A thread whose
+// ring is full drops events rather than wait, GetDroppedEventCount says how many.
+//
+// Event names are kept as pointers, they have to be literals or otherwise
+// outlive the profiler.
+class Profiler
+{
+public:
+	Profiler(uint32_t frame_history, uint32_t trace_capacity);
+	~Profiler();
+
+	// Nanoseconds on the clock every event is stamped with.
+	static uint64_t Now();
+
+	void AddCpuEvent(const char* name, uint64_t begin_ns, uint64_t end_ns);
+	// Goes to its own row of the trace named by track, from whichever thread read the timestamps back.
+	void AddGpuEvent(const char* track, const char* name, uint64_t begin_ns, uint64_t end_ns);
+	void AddFrameSample(FrameTrack track, double milliseconds);
+
+	// Ends the CPU frame started by the previous call and moves the events
+	// recorded since into the trace window. Call from the thread that drives the frames.
+	void MarkFrame();
+
+	FrameTimeSummary GetFrameTimeSummary(FrameTrack track);
+	uint64_t         GetDroppedEventCount();
+
+	// Writes the trace window as Chrome trace JSON (chrome://tracing, Perfetto), returns false if the file could not be written.
+	bool WriteChromeTrace(const std::string& path);
+
+private:
+	struct Event
+	{
+		const char* name;
+		// nullptr for CPU events
+		const char* track;
+		uint64_t    begin_ns;
+		uint64_t    end_ns;
+	};
+
+	struct TraceEvent
+	{
+		Event    event;
+		uint32_t thread;
+	};
+
+	// Written by its thread only, read by whoever holds _mutex
+	struct ThreadBuffer
+	{
+		std::unique_ptr<Event[]> events;
+		uint32_t                 index = 0;
+		std::atomic<uint64_t>    write { 0 };
+		std::atomic<uint64_t>    read { 0 };
+		std::atomic<uint64_t>    dropped { 0 };
+	};
+
+	struct FrameHistory
+	{
+		std::vector<double> samples;
+		uint32_t            next = 0;
+		uint32_t            count = 0;
+	};
+
+	ThreadBuffer* _GetThreadBuffer();
+	void          _Push(const Event& event);
+	void          _Drain();
+
+	// Tells apart profilers that lived at the same address, see _GetThreadBuffer
+	uint64_t                                    _id = 0;
+	uint64_t                                    _last_mark = 0;
+
+	std::mutex                                  _mutex;
+	std::vector<std::unique_ptr<ThreadBuffer>>  _threads;
+	std::deque<TraceEvent>                      _trace;
+	uint32_t                                    _trace_capacity = 0;
+	FrameHistory                                _history[2];
+};
+
+// Times the enclosing block on the calling thread.
+class ProfileScope
+{
+public:
+	ProfileScope(Profiler* profiler, const char* name)
+		: _profiler(profiler), _name(name), _begin(Profiler::Now())
+	{
+	}
+	~ProfileScope()
+	{
+		_profiler->AddCpuEvent(_name, _begin, Profiler::Now());
+	}
+
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+	Profiler*   _profiler;
+	const char* _name;
+	uint64_t    _begin;
+};
+
+#if BUILD_ENABLE_PROFILER
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(profiler, name) ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(profiler, name)
+#else
+#define PROFILE_SCOPE(profiler, name) ((void)0)
+#endif
+
+// Timestamp queries around regions of command buffers, reported to the
+// renderer's profiler as GPU events. There is one slot per command buffer
+// that may be in flight; a slot is read back with Collect once the fence of
+// its last submit has been waited on, then reset for its next recording.
+//
+// Timestamps are not calibrated against the CPU clock: a slot's events start
+// at the CPU time it was reset, only their durations and spacing are measured.
+// Does nothing when the queue family writes no timestamps or BUILD_ENABLE_PROFILER is 0.
+class GpuTimer
+{
+public:
+	GpuTimer(Renderer* renderer, uint32_t queue_family, const char* track, uint32_t slot_count, uint32_t regions_per_slot);
+	~GpuTimer();
+
+	bool IsSupported() const;
+
+	// Reports the slot's regions recorded since its last reset and returns the
+	// time from the first begin to the last end in milliseconds, 0 when there was nothing.
+	double Collect(uint32_t slot);
+
+	// Resets the slot's queries before any region is recorded, on the host or
+	// in command_buffer (outside a render pass). Call after Collect.
+	void Reset(VkCommandBuffer command_buffer, uint32_t slot);
+
+	// Returns the region to end, regions past regions_per_slot are not timed.
+	uint32_t Begin(VkCommandBuffer command_buffer, uint32_t slot, const char* name);
+	void     End(VkCommandBuffer command_buffer, uint32_t slot, uint32_t region);
+
+private:
+	struct Slot
+	{
+		std::vector<const char*> names;
+		uint64_t                 cpu_begin_ns = 0;
+	};
+
+	Renderer*          _renderer = nullptr;
+	const char*        _track = nullptr;
+	VkQueryPool        _query_pool = VK_NULL_HANDLE;
+	uint32_t           _regions_per_slot = 0;
+	std::vector<Slot>  _slots;
+	// Queries are reset from the host where the device allows it, transfer queues cannot do it themselves
+	bool               _host_reset = false;
+	// Nanoseconds per tick and the bits of a timestamp that count
+	double             _period = 1.0;
+	uint64_t           _mask = ~0ull;
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include"Platform.h"
+#include"Shared.h"
+#include"allincludes.h"
+
+// Set of single-sampled color images the window's render pass resolves into.
+// The swapchain is one kind of target, plain device images are another.
+class RenderTarget
+{
+public:
+	virtual ~RenderTarget() {}
+
+	virtual VkFormat      GetFormat() const = 0;
+	virtual VkExtent2D    GetExtent() const = 0;
+	virtual uint32_t      GetImageCount() const = 0;
+	virtual VkImage       GetImage(uint32_t index) const = 0;
+	virtual VkImageView   GetImageView(uint32_t index) const = 0;
+
+	// Layout the render pass leaves the resolved image in.
+	virtual VkImageLayout GetFinalLayout() const = 0;
+
+	// Presentable targets signal acquire and wait for rendering through semaphores,
+	// other targets hand out images immediately and never present.
+	virtual bool          IsPresentable() const = 0;
+
+	virtual VkResult      AcquireNextImage(VkSemaphore image_available, uint32_t* image_index) = 0;
+	virtual VkResult      Present(VkSemaphore render_finished, uint32_t image_index) = 0;
+
+	// Recreates the images at a new extent, none of them may still be in use by the GPU.
+	virtual void          Resize(VkExtent2D extent) = 0;
+};
@@ -2,19 +2,33 @@
 
 Renderer::Renderer()
 {
+	// First in, last out, everything else may time itself with it
+	_InitProfiler();
 	_SetupLayersAndExtentions();
 	_SetupDebug();
 	_InitInstance();
 	_InitDebug();
 	_InitDevice();
+	_InitAllocator();
+	// The upload queue builds its mip generation pipeline into the cache
+	_InitPipelineCache();
+	_InitUploadQueue();
+	_InitThreadPool();
+	_InitTextureStreamer();
 }
 
 Renderer::~Renderer()
 {
 	delete _window;
+	_DeInitTextureStreamer();
+	_DeInitThreadPool();
+	_DeInitUploadQueue();
+	_DeInitPipelineCache();
+	_DeInitAllocator();
 	_DeInitDevice();
 	_DeInitDebug();
 	_DeInitInstance();
+	_DeInitProfiler();
 }
 
 Window* Renderer::OpenWindow(uint32_t size_x, uint32_t size_y, std::string name)
@@ -23,8 +37,16 @@ Window* Renderer::OpenWindow(uint32_t size_x, uint32_t size_y, std::string name)
 	return _window;
 }
 
+Window* Renderer::OpenOffscreen(uint32_t size_x, uint32_t size_y, std::string name, bool load_model)
+{
+	_window = new Window(this, size_x, size_y, name, true, load_model);
+	return _window;
+}
+
 bool Renderer::Run()
 {
+	// One pass of the main loop is one frame
+	_profiler->MarkFrame();
 	if (nullptr != _window) {
 		return _window->Update();
 	}
@@ -56,6 +78,16 @@ const uint32_t Renderer::GetVulkanGraphicsQueueFamilyIndex() const
 	return _graphics_family_index;
 }
 
+const VkQueue Renderer::GetVulkanTransferQueue() const
+{
+	return _transfer_queue;
+}
+
+const uint32_t Renderer::GetVulkanTransferQueueFamilyIndex() const
+{
+	return _transfer_family_index;
+}
+
 const VkPhysicalDeviceProperties& Renderer::GetVulkanPhysicalDeviceProperties() const
 {
 	return _gpu_propertie;
@@ -66,6 +98,16 @@ const VkPhysicalDeviceMemoryProperties& Renderer::GetVulkanPhysicalDeviceMemoryP
 	return _gpu_memory_propertie;
 }
 
+const VkPhysicalDeviceFeatures& Renderer::GetVulkanPhysicalDeviceFeatures() const
+{
+	return supported_physical_device_feature;
+}
+
+const VkPhysicalDeviceVulkan12Features& Renderer::GetVulkanPhysicalDeviceFeatures12() const
+{
+	return _enabled_features_12;
+}
+
 const VkDebugReportCallbackEXT Renderer::GetVulkanDebugReportCallback() const
 {
 	return _debug_report;
@@ -76,6 +118,36 @@ const VkSampleCountFlagBits Renderer::GetVulkanMsaa() const
 	return msaaSamples;
 }
 
+MemoryAllocator* Renderer::GetMemoryAllocator() const
+{
+	return _allocator;
+}
+
+UploadQueue* Renderer::GetUploadQueue() const
+{
+	return _upload_queue;
+}
+
+const VkPipelineCache Renderer::GetVulkanPipelineCache() const
+{
+	return _pipeline_cache->GetVulkanPipelineCache();
+}
+
+ThreadPool* Renderer::GetThreadPool() const
+{
+	return _thread_pool;
+}
+
+TextureStreamer* Renderer::GetTextureStreamer() const
+{
+	return _texture_streamer;
+}
+
+Profiler* Renderer::GetProfiler() const
+{
+	return _profiler;
+}
+
 
 void Renderer::_SetupLayersAndExtentions() {
 //	_instance_extentions.push_back(VK_KHR_DISPLAY_EXTENSION_NAME);
@@ -148,6 +220,26 @@ void Renderer::_InitDevice()
 		vkGetPhysicalDeviceFeatures(_gpu, &supported_physical_device_feature);
 		supported_physical_device_feature.samplerAnisotropy = VK_TRUE;
 		supported_physical_device_feature.sampleRateShading = VK_TRUE;
+
+		// Vulkan 1.2 features are opt in, only the ones something uses get enabled
+		if (_gpu_propertie.apiVersion >= VK_API_VERSION_1_2) {
+			VkPhysicalDeviceVulkan12Features supported_features_12{};
+			supported_features_12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+			VkPhysicalDeviceFeatures2 supported_features{};
+			supported_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+			supported_features.pNext = &supported_features_12;
+			vkGetPhysicalDeviceFeatures2(_gpu, &supported_features);
+
+			_enabled_features_12.drawIndirectCount = supported_features_12.drawIndirectCount;
+			// The bindless texture table
+			_enabled_features_12.runtimeDescriptorArray = supported_features_12.runtimeDescriptorArray;
+			_enabled_features_12.descriptorBindingPartiallyBound = supported_features_12.descriptorBindingPartiallyBound;
+			_enabled_features_12.descriptorBindingSampledImageUpdateAfterBind = supported_features_12.descriptorBindingSampledImageUpdateAfterBind;
+			_enabled_features_12.descriptorBindingUpdateUnusedWhilePending = supported_features_12.descriptorBindingUpdateUnusedWhilePending;
+			_enabled_features_12.shaderSampledImageArrayNonUniformIndexing = supported_features_12.shaderSampledImageArrayNonUniformIndexing;
+			// Profiler timestamps on queues that cannot reset queries themselves
+			_enabled_features_12.hostQueryReset = supported_features_12.hostQueryReset;
+		}
 	}
 	{
 		uint32_t family_count = 0;
@@ -157,12 +249,17 @@ void Renderer::_InitDevice()
 	
 		
 
+		// The graphics queue also runs compute work (culling), prefer a family that has both
 		bool found = false;
+		bool found_compute = false;
 		for (uint32_t i = 0; i < family_count; ++i) {
-			if (familu_property_list[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-				found = true;
-				_graphics_family_index = i;
+			VkQueueFlags flags = familu_property_list[i].queueFlags;
+			if (!(flags & VK_QUEUE_GRAPHICS_BIT) || (found_compute && !(flags & VK_QUEUE_COMPUTE_BIT))) {
+				continue;
 			}
+			found = true;
+			found_compute = (flags & VK_QUEUE_COMPUTE_BIT) != 0;
+			_graphics_family_index = i;
 		}
 		if (!found) {
 			std::cout << "Vulkan ERROR: Queue family supporting graphics not found." << std::endl;
@@ -170,6 +267,23 @@ void Renderer::_InitDevice()
 			std::exit(-1);
 		}
 
+		// Uploads prefer a transfer only family (the copy engine), then any family
+		// without graphics, and share the graphics queue when there is neither.
+		_transfer_family_index = _graphics_family_index;
+#if BUILD_ENABLE_TRANSFER_QUEUE
+		uint32_t best_score = 0;
+		for (uint32_t i = 0; i < family_count; ++i) {
+			VkQueueFlags flags = familu_property_list[i].queueFlags;
+			if (!(flags & VK_QUEUE_TRANSFER_BIT) || (flags & VK_QUEUE_GRAPHICS_BIT)) {
+				continue;
+			}
+			uint32_t score = (flags & VK_QUEUE_COMPUTE_BIT) ? 1 : 2;
+			if (score > best_score) {
+				best_score = score;
+				_transfer_family_index = i;
+			}
+		}
+#endif
 	}
 
 	/*
@@ -187,35 +301,118 @@ void Renderer::_InitDevice()
 	*/
 
 	float queue_priorities[]{ 1.0f };
-	VkDeviceQueueCreateInfo device_queue_create_info{};
-	device_queue_create_info.sType                 = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-	device_queue_create_info.pNext = VK_NULL_HANDLE;
-	device_queue_create_info.queueFamilyIndex      = _graphics_family_index;
-	device_queue_create_info.queueCount            = 1;
-	device_queue_create_info.pQueuePriorities      = queue_priorities;
-	device_queue_create_info.pNext = NULL;
+	std::vector<VkDeviceQueueCreateInfo> device_queue_create_infos(1);
+	device_queue_create_infos[0].sType                 = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+	device_queue_create_infos[0].queueFamilyIndex      = _graphics_family_index;
+	device_queue_create_infos[0].queueCount            = 1;
+	device_queue_create_infos[0].pQueuePriorities      = queue_priorities;
+	device_queue_create_infos[0].pNext = NULL;
+	if (_transfer_family_index != _graphics_family_index) {
+		device_queue_create_infos.push_back(device_queue_create_infos[0]);
+		device_queue_create_infos[1].queueFamilyIndex  = _transfer_family_index;
+	}
 
 	VkDeviceCreateInfo device_create_info{}; 
 	device_create_info.sType                        = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-	device_queue_create_info.pNext = VK_NULL_HANDLE;
-	device_create_info.queueCreateInfoCount         = 1;
-	device_create_info.pQueueCreateInfos            = &device_queue_create_info;
+	device_create_info.queueCreateInfoCount         = device_queue_create_infos.size();
+	device_create_info.pQueueCreateInfos            = device_queue_create_infos.data();
 	device_create_info.enabledExtensionCount = _device_extentions.size();
 	device_create_info.ppEnabledExtensionNames = _device_extentions.data();
 	device_create_info.pEnabledFeatures = &supported_physical_device_feature;
-	device_create_info.pNext = NULL;
+	device_create_info.pNext = _gpu_propertie.apiVersion >= VK_API_VERSION_1_2 ? &_enabled_features_12 : NULL;
 
 	
 
 	ErrorCheck(vkCreateDevice(_gpu ,&device_create_info, nullptr, &_device));
 	
 	vkGetDeviceQueue(_device, _graphics_family_index, 0, &_queue);
+	vkGetDeviceQueue(_device, _transfer_family_index, 0, &_transfer_queue);
 //	vkGetDeviceQueue(_device, _graphics_family_index, 1, &_queue);
 	
 	std::cout << "Vulkan: Device successfully initialized "
 		<< std::endl;
 } 
 
+void Renderer::_InitAllocator()
+{
+	_allocator = new MemoryAllocator(_device, _gpu_propertie, _gpu_memory_propertie, BUILD_MEMORY_BLOCK_SIZE);
+	std::cout << "Vulkan: Memory allocator successfully initialized" << std::endl;
+}
+
+void Renderer::_DeInitAllocator()
+{
+	_allocator->PrintStats();
+	delete _allocator;
+	_allocator = nullptr;
+}
+
+void Renderer::_InitUploadQueue()
+{
+	_upload_queue = new UploadQueue(this, BUILD_UPLOAD_STAGING_SIZE);
+}
+
+void Renderer::_DeInitUploadQueue()
+{
+	delete _upload_queue;
+	_upload_queue = nullptr;
+}
+
+void Renderer::_InitPipelineCache()
+{
+	_pipeline_cache = new PipelineCache(this, BUILD_PIPELINE_CACHE_PATH);
+}
+
+void Renderer::_DeInitPipelineCache()
+{
+	// Saves the cache on the way out
+	delete _pipeline_cache;
+	_pipeline_cache = nullptr;
+}
+
+void Renderer::_InitThreadPool()
+{
+	uint32_t thread_count = BUILD_WORKER_THREADS;
+	if (thread_count == 0) {
+		// Leave one core to the thread that drives the frame, it works along in ParallelFor
+		uint32_t cores = std::thread::hardware_concurrency();
+		thread_count = cores > 1 ? cores - 1 : 1;
+	}
+	_thread_pool = new ThreadPool(thread_count);
+}
+
+void Renderer::_DeInitThreadPool()
+{
+	delete _thread_pool;
+	_thread_pool = nullptr;
+}
+
+void Renderer::_InitTextureStreamer()
+{
+	_texture_streamer = new TextureStreamer(this);
+}
+
+void Renderer::_DeInitTextureStreamer()
+{
+	// Jobs still decoding for it finish into their own results once it is gone
+	delete _texture_streamer;
+	_texture_streamer = nullptr;
+}
+
+void Renderer::_InitProfiler()
+{
+	_profiler = new Profiler(BUILD_PROFILER_FRAME_HISTORY, BUILD_PROFILER_TRACE_EVENTS);
+}
+
+void Renderer::_DeInitProfiler()
+{
+#if BUILD_ENABLE_PROFILER
+	// The last BUILD_PROFILER_TRACE_EVENTS events, the run up to the exit
+	_profiler->WriteChromeTrace(BUILD_PROFILER_TRACE_PATH);
+#endif
+	delete _profiler;
+	_profiler = nullptr;
+}
+
 void Renderer::_DeInitDevice()
 {
 	vkDestroyDevice(_device, nullptr);
@@ -5,6 +5,12 @@
 #include"Platform.h"
 #include"BUILD_OPTIONS.h"
 #include"Shared.h"
+#include"MemoryAllocator.h"
+#include"UploadQueue.h"
+#include"PipelineCache.h"
+#include"ThreadPool.h"
+#include"TextureStreamer.h"
+#include"Profiler.h"
 
 class Window;
 
@@ -15,6 +21,7 @@ public:
 	~Renderer();
 
 	Window* OpenWindow(uint32_t size_x, uint32_t size_y, std::string name);
+	Window* OpenOffscreen(uint32_t size_x, uint32_t size_y, std::string name, bool load_model = true);
 
 	bool   Run();
 
@@ -23,10 +30,21 @@ public:
 	const VkDevice                            GetVulkanDevice() const; 
 	const VkQueue                             GetVulkanQueue() const;
 	const uint32_t                            GetVulkanGraphicsQueueFamilyIndex() const;
+	const VkQueue                             GetVulkanTransferQueue() const;
+	const uint32_t                            GetVulkanTransferQueueFamilyIndex() const;
 	const VkPhysicalDeviceProperties       &  GetVulkanPhysicalDeviceProperties() const;
 	const VkPhysicalDeviceMemoryProperties &  GetVulkanPhysicalDeviceMemoryProperties() const;
+	// Features the device was created with
+	const VkPhysicalDeviceFeatures         &  GetVulkanPhysicalDeviceFeatures() const;
+	const VkPhysicalDeviceVulkan12Features &  GetVulkanPhysicalDeviceFeatures12() const;
 	const VkDebugReportCallbackEXT            GetVulkanDebugReportCallback() const;
 	const VkSampleCountFlagBits               GetVulkanMsaa() const;
+	MemoryAllocator                         * GetMemoryAllocator() const;
+	UploadQueue                             * GetUploadQueue() const;
+	const VkPipelineCache                     GetVulkanPipelineCache() const;
+	ThreadPool                              * GetThreadPool() const;
+	TextureStreamer                         * GetTextureStreamer() const;
+	Profiler                                * GetProfiler() const;
 
 private:
 	void _SetupLayersAndExtentions();
@@ -37,6 +55,24 @@ private:
 	void _InitDevice();
 	void _DeInitDevice();
 
+	void _InitAllocator();
+	void _DeInitAllocator();
+
+	void _InitUploadQueue();
+	void _DeInitUploadQueue();
+
+	void _InitPipelineCache();
+	void _DeInitPipelineCache();
+
+	void _InitThreadPool();
+	void _DeInitThreadPool();
+
+	void _InitTextureStreamer();
+	void _DeInitTextureStreamer();
+
+	void _InitProfiler();
+	void _DeInitProfiler();
+
 	void _SetupDebug();
 	void _InitDebug();
 	void _DeInitDebug();
@@ -48,15 +84,25 @@ private:
 	VkPhysicalDevice                  _gpu           = VK_NULL_HANDLE;
 	VkDevice                          _device        = VK_NULL_HANDLE;
 	VkQueue                           _queue         = VK_NULL_HANDLE;
+	VkQueue                           _transfer_queue = VK_NULL_HANDLE;
 	VkPhysicalDeviceProperties        _gpu_propertie = {};
 	VkPhysicalDeviceMemoryProperties  _gpu_memory_propertie = {};
 	VkPhysicalDeviceFeatures          supported_physical_device_feature = {};
+	VkPhysicalDeviceVulkan12Features  _enabled_features_12 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
 
 
 	uint32_t          _graphics_family_index = 0;
+	uint32_t          _transfer_family_index = 0;
 
 	Window*           _window     = nullptr;
 
+	MemoryAllocator*  _allocator  = nullptr;
+	UploadQueue*      _upload_queue = nullptr;
+	PipelineCache*    _pipeline_cache = nullptr;
+	ThreadPool*       _thread_pool = nullptr;
+	TextureStreamer*  _texture_streamer = nullptr;
+	Profiler*         _profiler = nullptr;
+
 	std::vector<const char*> _instance_layers;
 	std::vector<const char*> _instance_extentions;
 	std::vector<const char*> _device_extentions;
@@ -0,0 +1,279 @@
+#include"Scene.h"
+
+#include<algorithm>
+#include<cmath>
+#include<cstring>
+
+Scene::Scene()
+{
+}
+
+Scene::~Scene()
+{
+}
+
+MeshHandle Scene::AddMesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+{
+	MeshHandle mesh = AllocateMesh(static_cast<uint32_t>(vertices.size()), static_cast<uint32_t>(indices.size()));
+	std::copy(vertices.begin(), vertices.end(), GetMeshVertices(mesh));
+	std::copy(indices.begin(), indices.end(), GetMeshIndices(mesh));
+	UpdateMeshBounds(mesh);
+	return mesh;
+}
+
+MeshHandle Scene::AddMesh(const Vertex* vertices, uint32_t vertex_count, const uint32_t* indices, uint32_t index_count, const glm::vec3& bounds_center, float bounds_radius)
+{
+	MeshHandle mesh = AllocateMesh(vertex_count, index_count);
+	memcpy(GetMeshVertices(mesh), vertices, sizeof(Vertex) * vertex_count);
+	memcpy(GetMeshIndices(mesh), indices, sizeof(uint32_t) * index_count);
+	_meshes[mesh].bounds_center = bounds_center;
+	_meshes[mesh].bounds_radius = bounds_radius;
+	_meshes[mesh].dequantize    = glm::vec4(bounds_center, bounds_radius > 0.0f ? bounds_radius : 1.0f);
+	return mesh;
+}
+
+MeshHandle Scene::AllocateMesh(uint32_t vertex_count, uint32_t index_count)
+{
+	SceneMesh mesh{};
+	mesh.first_index   = static_cast<uint32_t>(_indices.size());
+	mesh.index_count   = index_count;
+	mesh.vertex_offset = static_cast<int32_t>(_vertices.size());
+	mesh.vertex_count  = vertex_count;
+
+	_vertices.resize(_vertices.size() + vertex_count);
+	_indices.resize(_indices.size() + index_count);
+	_meshes.push_back(mesh);
+	_geometry_version++;
+
+	return static_cast<MeshHandle>(_meshes.size() - 1);
+}
+
+void Scene::ReleaseMesh(MeshHandle mesh)
+{
+	assert(mesh + 1 == _meshes.size());
+	_vertices.resize(_meshes[mesh].vertex_offset);
+	_indices.resize(_meshes[mesh].first_index);
+	_meshes.pop_back();
+	_geometry_version++;
+}
+
+Vertex* Scene::GetMeshVertices(MeshHandle mesh)
+{
+	return _vertices.data() + _meshes[mesh].vertex_offset;
+}
+
+uint32_t* Scene::GetMeshIndices(MeshHandle mesh)
+{
+	return _indices.data() + _meshes[mesh].first_index;
+}
+
+void Scene::UpdateMeshBounds(MeshHandle handle)
+{
+	SceneMesh& mesh = _meshes[handle];
+	const Vertex* vertices = GetMeshVertices(handle);
+	if (mesh.vertex_count == 0) {
+		return;
+	}
+
+	glm::vec3 lower = vertices[0].pos;
+	glm::vec3 upper = vertices[0].pos;
+	for (uint32_t i = 0; i < mesh.vertex_count; ++i) {
+		lower = glm::min(lower, vertices[i].pos);
+		upper = glm::max(upper, vertices[i].pos);
+	}
+	mesh.bounds_center = (lower + upper) * 0.5f;
+	float radius_squared = 0.0f;
+	for (uint32_t i = 0; i < mesh.vertex_count; ++i) {
+		glm::vec3 offset = vertices[i].pos - mesh.bounds_center;
+		radius_squared = std::max<float>(radius_squared, glm::dot(offset, offset));
+	}
+	mesh.bounds_radius = std::sqrt(radius_squared);
+	// Every position is inside the sphere, so every component lands in -1..1
+	mesh.dequantize = glm::vec4(mesh.bounds_center, mesh.bounds_radius > 0.0f ? mesh.bounds_radius : 1.0f);
+}
+
+MeshOptimizeReport Scene::OptimizeMesh(MeshHandle handle, float overdraw_threshold)
+{
+	SceneMesh& mesh = _meshes[handle];
+	MeshOptimizeReport report = ::OptimizeMesh(GetMeshVertices(handle), mesh.vertex_count, GetMeshIndices(handle), mesh.index_count, overdraw_threshold);
+	_geometry_version++;
+
+	std::cout << "Mesh: " << mesh.index_count / 3 << " triangles, ACMR " << report.before.acmr << " -> " << report.after.acmr
+		<< ", ATVR " << report.before.atvr << " -> " << report.after.atvr << std::endl;
+	return report;
+}
+
+uint32_t Scene::AddMaterial(const SceneMaterial& material)
+{
+	_materials.push_back(material);
+	return static_cast<uint32_t>(_materials.size() - 1);
+}
+
+ObjectHandle Scene::AddObject(MeshHandle mesh, const glm::mat4& transform, uint32_t material)
+{
+	assert(mesh < _meshes.size());
+
+	ObjectHandle handle;
+	if (!_free_objects.empty()) {
+		handle = _free_objects.back();
+		_free_objects.pop_back();
+	}
+	else {
+		handle = static_cast<ObjectHandle>(_objects.size());
+		_objects.emplace_back();
+		_transforms.emplace_back();
+	}
+
+	_objects[handle].mesh     = mesh;
+	_objects[handle].material = material;
+	_objects[handle].alive    = true;
+	_transforms[handle]       = transform;
+
+	_object_count++;
+	_batches_dirty = true;
+	return handle;
+}
+
+void Scene::SetTransform(ObjectHandle object, const glm::mat4& transform)
+{
+	assert(object < _objects.size() && _objects[object].alive);
+	_transforms[object] = transform;
+}
+
+void Scene::RemoveObject(ObjectHandle object)
+{
+	assert(object < _objects.size() && _objects[object].alive);
+	_objects[object].alive = false;
+	_free_objects.push_back(object);
+	_object_count--;
+	_batches_dirty = true;
+}
+
+const std::vector<Vertex>& Scene::GetVertices() const
+{
+	return _vertices;
+}
+
+const std::vector<uint32_t>& Scene::GetIndices() const
+{
+	return _indices;
+}
+
+const SceneMesh& Scene::GetMesh(MeshHandle mesh) const
+{
+	return _meshes[mesh];
+}
+
+uint32_t Scene::GetMeshCount() const
+{
+	return static_cast<uint32_t>(_meshes.size());
+}
+
+const SceneMaterial& Scene::GetMaterial(uint32_t material) const
+{
+	return _materials[material];
+}
+
+uint32_t Scene::GetMaterialCount() const
+{
+	return static_cast<uint32_t>(_materials.size());
+}
+
+uint64_t Scene::GetGeometryVersion() const
+{
+	return _geometry_version;
+}
+
+uint32_t Scene::GetObjectCount() const
+{
+	return _object_count;
+}
+
+const glm::mat4& Scene::GetTransform(ObjectHandle object) const
+{
+	return _transforms[object];
+}
+
+uint32_t Scene::GetObjectMaterial(ObjectHandle object) const
+{
+	return _objects[object].material;
+}
+
+glm::mat4 Scene::GetDequantizeTransform(MeshHandle mesh) const
+{
+	const glm::vec4& dequantize = _meshes[mesh].dequantize;
+	return glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(dequantize)), glm::vec3(dequantize.w));
+}
+
+const std::vector<SceneBatch>& Scene::GetBatches()
+{
+	if (_batches_dirty) {
+		_BuildBatches();
+	}
+	return _batches;
+}
+
+const std::vector<ObjectHandle>& Scene::GetBatchOrder()
+{
+	if (_batches_dirty) {
+		_BuildBatches();
+	}
+	return _batch_order;
+}
+
+uint32_t Scene::WriteInstances(InstanceData* destination, const InstanceMatrixBuilder& builder, bool dequantize)
+{
+	const auto& order = GetBatchOrder();
+	for (const auto& batch : _batches) {
+		WriteInstances(destination + batch.first_instance, order.data() + batch.first_instance, batch.instance_count, batch.mesh, builder, dequantize);
+	}
+	return static_cast<uint32_t>(order.size());
+}
+
+void Scene::WriteInstances(InstanceData* destination, const ObjectHandle* objects, uint32_t count, MeshHandle mesh,
+	const InstanceMatrixBuilder& builder, bool dequantize) const
+{
+	glm::mat4 vertex_transform = dequantize ? GetDequantizeTransform(mesh) : glm::mat4(1.0f);
+	builder.Build(_transforms.data(), objects, count, vertex_transform, destination);
+
+	// Mapped memory is only as aligned as the buffer requires, copy bytes rather than assign
+	for (uint32_t i = 0; i < count; ++i) {
+		memcpy(&destination[i].material, &_objects[objects[i]].material, sizeof(uint32_t));
+	}
+}
+
+void Scene::_BuildBatches()
+{
+	_batch_order.clear();
+	_batch_order.reserve(_object_count);
+	for (ObjectHandle i = 0; i < _objects.size(); ++i) {
+		if (_objects[i].alive) {
+			_batch_order.push_back(i);
+		}
+	}
+
+	// Materials come from the material table per instance, only the mesh splits
+	// batches; within one the instances of a material stay next to each other
+	std::stable_sort(_batch_order.begin(), _batch_order.end(), [this](ObjectHandle a, ObjectHandle b) {
+		const Object& object_a = _objects[a];
+		const Object& object_b = _objects[b];
+		if (object_a.mesh != object_b.mesh) {
+			return object_a.mesh < object_b.mesh;
+		}
+		return object_a.material < object_b.material;
+	});
+
+	_batches.clear();
+	for (uint32_t i = 0; i < _batch_order.size(); ++i) {
+		const Object& object = _objects[_batch_order[i]];
+		if (_batches.empty() || _batches.back().mesh != object.mesh) {
+			SceneBatch batch{};
+			batch.mesh           = object.mesh;
+			batch.first_instance = i;
+			_batches.push_back(batch);
+		}
+		_batches.back().instance_count++;
+	}
+
+	_batches_dirty = false;
+}
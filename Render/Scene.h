@@ -0,0 +1,137 @@
+#pragma once
+
+#include"allincludes.h"
+#include"VertexStruct.h"
+#include"MeshOptimizer.h"
+#include"InstanceMatrices.h"
+
+#include<memory>
+
+typedef uint32_t MeshHandle;
+typedef uint32_t ObjectHandle;
+
+// Range of the scene's shared vertex and index arrays that makes up one mesh.
+// Indices are local to the mesh, vertex_offset rebases them when drawing.
+struct SceneMesh
+{
+	uint32_t  first_index   = 0;
+	uint32_t  index_count   = 0;
+	int32_t   vertex_offset = 0;
+	uint32_t  vertex_count  = 0;
+
+	// Bounding sphere in mesh space
+	glm::vec3 bounds_center = glm::vec3(0.0f);
+	float     bounds_radius = 0.0f;
+
+	// Maps quantized positions in -1..1 back to mesh space: offset in xyz, uniform
+	// scale in w. Uniform, so a sphere stays a sphere in both spaces.
+	glm::vec4 dequantize    = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+};
+
+// Surface description objects refer to by index. The renderer turns each one
+// into an entry of the material table the fragment shader reads, with the
+// base color texture as an index into the bindless texture table.
+struct SceneMaterial
+{
+	std::string name;
+	glm::vec4   base_color_factor = glm::vec4(1.0f);
+	// Image file of the base color texture, empty when there is none. For an
+	// embedded image it only names it, base_color_image holds its encoded bytes.
+	std::string base_color_texture;
+	std::shared_ptr<const std::vector<uint8_t>> base_color_image;
+};
+
+// All live objects that share a mesh, drawn with one instanced draw whatever
+// their materials. Their instances are contiguous starting at first_instance,
+// each one carries its own material index.
+struct SceneBatch
+{
+	MeshHandle mesh           = 0;
+	uint32_t   first_instance = 0;
+	uint32_t   instance_count = 0;
+};
+
+// Objects placed in the world, each one a mesh, a material and a transform.
+// Grouping into batches only happens when objects are added or removed,
+// moving an object just changes its transform.
+class Scene
+{
+public:
+	Scene();
+	~Scene();
+
+	MeshHandle   AddMesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+	// Copies the arrays in with one memcpy each, bounds are taken as given.
+	MeshHandle   AddMesh(const Vertex* vertices, uint32_t vertex_count, const uint32_t* indices, uint32_t index_count, const glm::vec3& bounds_center, float bounds_radius);
+	// Reserves a mesh that the caller fills in place through GetMeshVertices and
+	// GetMeshIndices, UpdateMeshBounds has to follow once the positions are written.
+	// The pointers stay valid until the next mesh is added.
+	MeshHandle   AllocateMesh(uint32_t vertex_count, uint32_t index_count);
+	// Gives back the mesh AllocateMesh just returned to a caller that could not fill it, only the newest mesh can go.
+	void         ReleaseMesh(MeshHandle mesh);
+	Vertex*      GetMeshVertices(MeshHandle mesh);
+	uint32_t*    GetMeshIndices(MeshHandle mesh);
+	// Recomputes the bounds and the dequantization from the mesh's positions.
+	void         UpdateMeshBounds(MeshHandle mesh);
+	// Reorders the mesh's triangles and vertices in place for the vertex cache,
+	// overdraw and vertex fetch, see MeshOptimizer.h.
+	MeshOptimizeReport OptimizeMesh(MeshHandle mesh, float overdraw_threshold);
+
+	uint32_t     AddMaterial(const SceneMaterial& material);
+	ObjectHandle AddObject(MeshHandle mesh, const glm::mat4& transform, uint32_t material = 0);
+	void         SetTransform(ObjectHandle object, const glm::mat4& transform);
+	void         RemoveObject(ObjectHandle object);
+
+	const std::vector<Vertex>&    GetVertices() const;
+	const std::vector<uint32_t>&  GetIndices() const;
+	const SceneMesh&              GetMesh(MeshHandle mesh) const;
+	uint32_t                      GetMeshCount() const;
+	const SceneMaterial&          GetMaterial(uint32_t material) const;
+	uint32_t                      GetMaterialCount() const;
+	// Changes whenever meshes are added, so the GPU copy knows when to follow.
+	uint64_t                      GetGeometryVersion() const;
+
+	uint32_t                      GetObjectCount() const;
+	const glm::mat4&              GetTransform(ObjectHandle object) const;
+	uint32_t                      GetObjectMaterial(ObjectHandle object) const;
+	// Matrix that turns the mesh's quantized positions into mesh space.
+	glm::mat4                     GetDequantizeTransform(MeshHandle mesh) const;
+
+	const std::vector<SceneBatch>& GetBatches();
+
+	// Object handles in batch order, instance i of the frame is GetBatchOrder()[i].
+	const std::vector<ObjectHandle>& GetBatchOrder();
+
+	// Writes the instances of all live objects in batch order for the builder's frame and returns how many were written.
+	// With dequantize every transform is followed by its mesh's GetDequantizeTransform.
+	uint32_t WriteInstances(InstanceData* destination, const InstanceMatrixBuilder& builder, bool dequantize = false);
+	// The same for count objects that all draw mesh.
+	void     WriteInstances(InstanceData* destination, const ObjectHandle* objects, uint32_t count, MeshHandle mesh,
+		const InstanceMatrixBuilder& builder, bool dequantize = false) const;
+
+private:
+	struct Object
+	{
+		MeshHandle mesh      = 0;
+		uint32_t   material  = 0;
+		bool       alive     = false;
+	};
+
+	void _BuildBatches();
+
+	std::vector<Vertex>      _vertices;
+	std::vector<uint32_t>    _indices;
+	std::vector<SceneMesh>   _meshes;
+	std::vector<SceneMaterial> _materials;
+	uint64_t                 _geometry_version = 0;
+
+	// Transforms are kept apart from the rest so the per-frame gather only touches them
+	std::vector<Object>      _objects;
+	std::vector<glm::mat4>   _transforms;
+	std::vector<ObjectHandle> _free_objects;
+	uint32_t                 _object_count = 0;
+
+	std::vector<SceneBatch>  _batches;
+	std::vector<ObjectHandle> _batch_order;
+	bool                     _batches_dirty = true;
+};
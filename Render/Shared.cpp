@@ -1,6 +1,9 @@
 #include"Shared.h"
 #include"BUILD_OPTIONS.h"
 
+#include<fstream>
+#include<stdexcept>
+
 #if BUILD_ENABLE_VULKAN_RUNTIME_DEBUG
 
 void ErrorCheck(VkResult result)
@@ -96,6 +99,11 @@ void ErrorCheck(VkResult result)
 	}
 }
 
+#else
+void ErrorCheck(VkResult result) {};
+
+#endif //BUILD_ENABLE_VULKAN_RUNTIME_DEBUG
+
 uint32_t FindMemoryTypeIndex(const VkPhysicalDeviceMemoryProperties* gpu_memory_properties, const VkMemoryRequirements* memory_requirements, const VkMemoryPropertyFlags required_properties)
 {
 	for (uint32_t i = 0; i < gpu_memory_properties->memoryTypeCount; ++i) {
@@ -109,7 +117,20 @@ uint32_t FindMemoryTypeIndex(const VkPhysicalDeviceMemoryProperties* gpu_memory_
 	return UINT32_MAX;
 }
 
-#else
-void ErrorCheck(VkResult result) {};
+std::vector<char> ReadFile(const std::string& filename)
+{
+	std::ifstream file(filename, std::ios::ate | std::ios::binary);
+
+	if (!file.is_open()) {
+		throw std::runtime_error("Failed to open file " + filename);
+	}
 
-#endif //BUILD_ENABLE_VULKAN_RUNTIME_DEBUG
\ No newline at end of file
+	size_t fileSize = (size_t)file.tellg();
+	std::vector<char> buffer(fileSize);
+
+	file.seekg(0);
+	file.read(buffer.data(), fileSize);
+	file.close();
+
+	return buffer;
+}
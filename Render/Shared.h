@@ -4,7 +4,12 @@
 
 #include<iostream>
 #include<assert.h>
+#include<string>
+#include<vector>
 
 void ErrorCheck(VkResult result);
 
-uint32_t FindMemoryTypeIndex(const VkPhysicalDeviceMemoryProperties *gpu_memory_properties, const VkMemoryRequirements *memory_requirements,const VkMemoryPropertyFlags memory_properties);
\ No newline at end of file
+uint32_t FindMemoryTypeIndex(const VkPhysicalDeviceMemoryProperties *gpu_memory_properties, const VkMemoryRequirements *memory_requirements,const VkMemoryPropertyFlags memory_properties);
+
+// Whole file as bytes, throws when it cannot be opened.
+std::vector<char> ReadFile(const std::string& filename);
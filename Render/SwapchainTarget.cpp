@@ -0,0 +1,182 @@
+#include"SwapchainTarget.h"
+#include"Renderer.h"
+
+SwapchainTarget::SwapchainTarget(Renderer* renderer, VkSurfaceKHR surface, VkSurfaceFormatKHR surface_format, VkExtent2D extent, uint32_t image_count)
+{
+	_renderer              = renderer;
+	_surface               = surface;
+	_surface_format        = surface_format;
+	_extent                = extent;
+	_swapchain_image_count = image_count;
+
+	_InitSwapchain();
+	_InitSwapchainImages();
+}
+
+SwapchainTarget::~SwapchainTarget()
+{
+	_DeInitSwapchainImages();
+	_DeinitSwapchain();
+}
+
+VkFormat SwapchainTarget::GetFormat() const
+{
+	return _surface_format.format;
+}
+
+VkExtent2D SwapchainTarget::GetExtent() const
+{
+	return _extent;
+}
+
+uint32_t SwapchainTarget::GetImageCount() const
+{
+	return _swapchain_image_count;
+}
+
+VkImage SwapchainTarget::GetImage(uint32_t index) const
+{
+	return _swapchain_images[index];
+}
+
+VkImageView SwapchainTarget::GetImageView(uint32_t index) const
+{
+	return _swapchain_images_views[index];
+}
+
+VkImageLayout SwapchainTarget::GetFinalLayout() const
+{
+	return VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+}
+
+bool SwapchainTarget::IsPresentable() const
+{
+	return true;
+}
+
+VkResult SwapchainTarget::AcquireNextImage(VkSemaphore image_available, uint32_t* image_index)
+{
+	return vkAcquireNextImageKHR(_renderer->GetVulkanDevice(),
+		_swapchain, UINT64_MAX,
+		image_available,
+		VK_NULL_HANDLE, image_index);
+}
+
+VkResult SwapchainTarget::Present(VkSemaphore render_finished, uint32_t image_index)
+{
+	VkResult result = VK_SUCCESS;
+	VkSwapchainKHR swapChains[] = { _swapchain };
+
+	VkPresentInfoKHR presentInfo{};
+	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+	presentInfo.waitSemaphoreCount = 1;
+	presentInfo.pWaitSemaphores = &render_finished;
+	presentInfo.swapchainCount = 1;
+	presentInfo.pSwapchains = swapChains;
+	presentInfo.pImageIndices = &image_index;
+	presentInfo.pResults = &result;
+
+	return vkQueuePresentKHR(_renderer->GetVulkanQueue(), &presentInfo);
+}
+
+void SwapchainTarget::Resize(VkExtent2D extent)
+{
+	_extent = extent;
+
+	// The old swapchain is handed over to the new one and only destroyed
+	// afterwards, so the presentation engine never runs out of images to show
+	VkSwapchainKHR old_swapchain = _swapchain;
+	_DeInitSwapchainImages();
+	_InitSwapchain(old_swapchain);
+	vkDestroySwapchainKHR(_renderer->GetVulkanDevice(), old_swapchain, nullptr);
+	_InitSwapchainImages();
+}
+
+void SwapchainTarget::_InitSwapchain(VkSwapchainKHR old_swapchain)
+{
+	auto device = _renderer->GetVulkanDevice();
+	auto gpu = _renderer->GetVulkanPhysicalDevice();
+
+	VkSurfaceCapabilitiesKHR surface_capabilities{};
+	ErrorCheck(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(gpu, _surface, &surface_capabilities));
+
+	if (_swapchain_image_count < surface_capabilities.minImageCount + 1) _swapchain_image_count = surface_capabilities.minImageCount + 1;
+	if (surface_capabilities.maxImageCount > 0) {
+		if (_swapchain_image_count > surface_capabilities.maxImageCount) _swapchain_image_count = surface_capabilities.maxImageCount;
+	}
+
+	VkPresentModeKHR persent_mode = VK_PRESENT_MODE_FIFO_KHR;
+	{
+		uint32_t present_mode_count = 0;
+		ErrorCheck(vkGetPhysicalDeviceSurfacePresentModesKHR(gpu, _surface, &present_mode_count, nullptr));
+		std::vector<VkPresentModeKHR>present_mode_list(present_mode_count);
+		ErrorCheck(vkGetPhysicalDeviceSurfacePresentModesKHR(gpu, _surface, &present_mode_count, present_mode_list.data()));
+		for (auto m : present_mode_list) {
+			if (m == VK_PRESENT_MODE_MAILBOX_KHR) persent_mode = m;
+		}
+	}
+
+	VkSwapchainCreateInfoKHR swapchain_creater_info{};
+	swapchain_creater_info.sType               = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+	swapchain_creater_info.surface             = _surface;
+	swapchain_creater_info.minImageCount       = _swapchain_image_count;
+	swapchain_creater_info.imageFormat         = _surface_format.format;
+	swapchain_creater_info.imageColorSpace     = _surface_format.colorSpace;
+	swapchain_creater_info.imageExtent         = _extent;
+	swapchain_creater_info.imageArrayLayers    = 1;
+	swapchain_creater_info.imageUsage          = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+	swapchain_creater_info.imageSharingMode    = VK_SHARING_MODE_EXCLUSIVE;
+	swapchain_creater_info.queueFamilyIndexCount = 0;
+	swapchain_creater_info.pQueueFamilyIndices = nullptr;
+	swapchain_creater_info.preTransform        = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
+	swapchain_creater_info.compositeAlpha      = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+	swapchain_creater_info.presentMode         = persent_mode;
+	swapchain_creater_info.clipped             = VK_TRUE;
+	swapchain_creater_info.oldSwapchain        = old_swapchain;
+
+	ErrorCheck(vkCreateSwapchainKHR(device, &swapchain_creater_info, nullptr, &_swapchain));
+
+	ErrorCheck(vkGetSwapchainImagesKHR(device, _swapchain, &_swapchain_image_count, nullptr));
+}
+
+void SwapchainTarget::_DeinitSwapchain()
+{
+	vkDestroySwapchainKHR(_renderer->GetVulkanDevice(), _swapchain, nullptr);
+	_swapchain = VK_NULL_HANDLE;
+}
+
+void SwapchainTarget::_InitSwapchainImages()
+{
+	auto device = _renderer->GetVulkanDevice();
+
+	_swapchain_images.resize(_swapchain_image_count);
+	_swapchain_images_views.resize(_swapchain_image_count);
+
+	ErrorCheck(vkGetSwapchainImagesKHR(device, _swapchain, &_swapchain_image_count, _swapchain_images.data()));
+
+	for (uint32_t i = 0; i < _swapchain_image_count; ++i) {
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = _swapchain_images[i];
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = _surface_format.format;
+		viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		viewInfo.subresourceRange.baseMipLevel = 0;
+		viewInfo.subresourceRange.levelCount = 1;
+		viewInfo.subresourceRange.baseArrayLayer = 0;
+		viewInfo.subresourceRange.layerCount = 1;
+
+		ErrorCheck(vkCreateImageView(device, &viewInfo, nullptr, &_swapchain_images_views[i]));
+	}
+}
+
+void SwapchainTarget::_DeInitSwapchainImages()
+{
+	auto device = _renderer->GetVulkanDevice();
+
+	for (auto view : _swapchain_images_views) {
+		vkDestroyImageView(device, view, nullptr);
+	}
+	_swapchain_images_views.clear();
+	_swapchain_images.clear();
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include"RenderTarget.h"
+
+class Renderer;
+
+class SwapchainTarget : public RenderTarget
+{
+public:
+	SwapchainTarget(Renderer* renderer, VkSurfaceKHR surface, VkSurfaceFormatKHR surface_format, VkExtent2D extent, uint32_t image_count);
+	~SwapchainTarget();
+
+	VkFormat      GetFormat() const override;
+	VkExtent2D    GetExtent() const override;
+	uint32_t      GetImageCount() const override;
+	VkImage       GetImage(uint32_t index) const override;
+	VkImageView   GetImageView(uint32_t index) const override;
+	VkImageLayout GetFinalLayout() const override;
+	bool          IsPresentable() const override;
+
+	VkResult      AcquireNextImage(VkSemaphore image_available, uint32_t* image_index) override;
+	VkResult      Present(VkSemaphore render_finished, uint32_t image_index) override;
+	void          Resize(VkExtent2D extent) override;
+
+private:
+	void _InitSwapchain(VkSwapchainKHR old_swapchain = VK_NULL_HANDLE);
+	void _DeinitSwapchain();
+
+	void _InitSwapchainImages();
+	void _DeInitSwapchainImages();
+
+	Renderer* _renderer = nullptr;
+
+	VkSurfaceKHR       _surface = VK_NULL_HANDLE;
+	VkSurfaceFormatKHR _surface_format = {};
+	VkExtent2D         _extent = {};
+
+	VkSwapchainKHR _swapchain = VK_NULL_HANDLE;
+	uint32_t       _swapchain_image_count = 2;
+
+	std::vector<VkImage>     _swapchain_images;
+	std::vector<VkImageView> _swapchain_images_views;
+};
@@ -0,0 +1,455 @@
+#include"TextureStreamer.h"
+#include"Renderer.h"
+
+#include<stb_image.h>
+
+#include<algorithm>
+#include<cmath>
+#include<iterator>
+
+// Formats the cooker writes, checked once against the device
+static const VkFormat COOKED_FORMATS[] = {
+	VK_FORMAT_BC1_RGB_UNORM_BLOCK, VK_FORMAT_BC1_RGB_SRGB_BLOCK,
+	VK_FORMAT_BC3_UNORM_BLOCK, VK_FORMAT_BC3_SRGB_BLOCK,
+	VK_FORMAT_BC5_UNORM_BLOCK,
+	VK_FORMAT_BC7_UNORM_BLOCK, VK_FORMAT_BC7_SRGB_BLOCK,
+	VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_R8G8B8A8_SRGB,
+};
+
+TextureStreamer::TextureStreamer(Renderer* renderer)
+{
+	_renderer = renderer;
+	_results  = std::make_shared<DecodeResults>();
+
+	// BC formats also need textureCompressionBC, which the device enables whenever it has it
+	for (VkFormat format : COOKED_FORMATS) {
+		TextureFormatInfo info;
+		GetTextureFormatInfo(format, &info);
+		VkFormatProperties format_properties;
+		vkGetPhysicalDeviceFormatProperties(_renderer->GetVulkanPhysicalDevice(), format, &format_properties);
+		VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+		if ((format_properties.optimalTilingFeatures & needed) == needed &&
+			(!info.compressed || _renderer->GetVulkanPhysicalDeviceFeatures().textureCompressionBC)) {
+			_sampleable_formats.push_back(format);
+		}
+	}
+
+	_InitPlaceholder();
+	_InitDescriptors();
+	std::cout << "Vulkan: Texture streamer created successfully (" << _descriptor_count << " texture slots)" << std::endl;
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	_renderer->GetUploadQueue()->WaitIdle();
+	for (auto& texture : _textures) {
+		_Destroy(texture);
+	}
+	_DeInitDescriptors();
+	_DeInitPlaceholder();
+	std::cout << "Vulkan: Texture streamer destroyed successfully" << std::endl;
+}
+
+TextureHandle TextureStreamer::Request(const std::string& path, std::shared_ptr<const std::vector<uint8_t>> encoded)
+{
+	TextureHandle handle;
+	if (!_free_handles.empty()) {
+		handle = _free_handles.back();
+		_free_handles.pop_back();
+	}
+	else {
+		handle = static_cast<TextureHandle>(_textures.size());
+		_textures.emplace_back();
+	}
+	Texture& texture = _textures[handle];
+	texture.path  = path;
+	texture.state = TextureState::Decoding;
+	++_pending_count;
+
+	auto results = _results;
+	auto sampleable_formats = _sampleable_formats;
+	// Both outlive the streamer, the pool runs every queued job before it goes
+	const UploadQueue* upload_queue = _renderer->GetUploadQueue();
+	ThreadPool* pool = _renderer->GetThreadPool();
+	pool->Enqueue([results, sampleable_formats, upload_queue, pool, path, encoded, handle]() {
+		DecodedImage image;
+		image.texture = handle;
+		_Decode(path, encoded.get(), sampleable_formats, upload_queue, pool, image);
+		std::lock_guard<std::mutex> lock(results->mutex);
+		results->images.push_back(std::move(image));
+	});
+	return handle;
+}
+
+void TextureStreamer::Release(TextureHandle texture)
+{
+	Texture& entry = _textures[texture];
+	if (entry.state == TextureState::Decoding) {
+		// The slot is recycled when the worker's result comes in
+		entry.state = TextureState::Released;
+		--_pending_count;
+		return;
+	}
+	if (entry.state == TextureState::Uploading) {
+		_renderer->GetUploadQueue()->Wait(entry.ticket);
+		_uploading.erase(std::find(_uploading.begin(), _uploading.end(), texture));
+		--_pending_count;
+	}
+	_Destroy(entry);
+	entry = Texture();
+	_free_handles.push_back(texture);
+}
+
+bool TextureStreamer::Update()
+{
+	PROFILE_SCOPE(_renderer->GetProfiler(), "TextureStreamer::Update");
+	auto upload_queue = _renderer->GetUploadQueue();
+
+	// Take the oldest decoded images that fit the budget, always at least one
+	std::vector<DecodedImage> decoded;
+	{
+		std::lock_guard<std::mutex> lock(_results->mutex);
+		auto& images = _results->images;
+		VkDeviceSize staged = 0;
+		size_t count = 0;
+		while (count < images.size() && (count == 0 || staged < BUILD_TEXTURE_UPLOAD_BUDGET)) {
+			staged += images[count].cooked ? images[count].cooked->GetLevelDataSize() : images[count].pixels.size();
+			++count;
+		}
+		decoded.reserve(count);
+		std::move(images.begin(), images.begin() + count, std::back_inserter(decoded));
+		images.erase(images.begin(), images.begin() + count);
+	}
+
+	size_t first_staged = _uploading.size();
+	for (auto& image : decoded) {
+		Texture& texture = _textures[image.texture];
+		if (texture.state == TextureState::Released) {
+			texture = Texture();
+			_free_handles.push_back(image.texture);
+			continue;
+		}
+		if (image.format == VK_FORMAT_UNDEFINED) {
+			std::cout << "Vulkan: Failed to load texture " << texture.path << ", keeping the placeholder" << std::endl;
+			texture.state = TextureState::Failed;
+			--_pending_count;
+			continue;
+		}
+		_Stage(texture, image);
+		_uploading.push_back(image.texture);
+	}
+
+	// One batch for everything staged this frame, its ticket tells when all of it is resident
+	if (_uploading.size() > first_staged) {
+		UploadTicket ticket = upload_queue->Flush();
+		for (size_t i = first_staged; i < _uploading.size(); ++i) {
+			_textures[_uploading[i]].ticket = ticket;
+		}
+	}
+
+	bool promoted = false;
+	for (size_t i = 0; i < _uploading.size();) {
+		Texture& texture = _textures[_uploading[i]];
+		if (!upload_queue->IsComplete(texture.ticket)) {
+			++i;
+			continue;
+		}
+		texture.state = TextureState::Resident;
+		// No frame has been handed this slot yet, it can be written while they run
+		if (_uploading[i] + 1 < _descriptor_count) {
+			_WriteDescriptor(_uploading[i] + 1, texture.view);
+		}
+		else {
+			std::cout << "Vulkan: Texture table is full, " << texture.path << " keeps the placeholder" << std::endl;
+		}
+		--_pending_count;
+		promoted = true;
+		_uploading[i] = _uploading.back();
+		_uploading.pop_back();
+	}
+	return promoted;
+}
+
+VkImageView TextureStreamer::GetImageView(TextureHandle texture) const
+{
+	const Texture& entry = _textures[texture];
+	return entry.state == TextureState::Resident ? entry.view : _placeholder_view;
+}
+
+uint32_t TextureStreamer::GetDescriptorIndex(TextureHandle texture) const
+{
+	if (texture == TEXTURE_NONE || _textures[texture].state != TextureState::Resident || texture + 1 >= _descriptor_count) {
+		return 0;
+	}
+	return texture + 1;
+}
+
+VkDescriptorSetLayout TextureStreamer::GetDescriptorSetLayout() const
+{
+	return _descriptor_set_layout;
+}
+
+VkDescriptorSet TextureStreamer::GetDescriptorSet() const
+{
+	return _descriptor_set;
+}
+
+bool TextureStreamer::IsResident(TextureHandle texture) const
+{
+	return _textures[texture].state == TextureState::Resident;
+}
+
+uint32_t TextureStreamer::GetPendingCount() const
+{
+	return _pending_count;
+}
+
+void TextureStreamer::_Decode(const std::string& path, const std::vector<uint8_t>* encoded, const std::vector<VkFormat>& sampleable_formats,
+	const UploadQueue* upload_queue, ThreadPool* pool, DecodedImage& image)
+{
+#if BUILD_ENABLE_COOKED_TEXTURES
+	// The cooker writes <name>.ktx2 next to <name>.png, embedded images have no file to sit next to
+	std::string cooked_path = path.substr(0, path.find_last_of('.')) + ".ktx2";
+	std::unique_ptr<KtxFile> cooked(new KtxFile());
+	if (encoded == nullptr && cooked->Open(cooked_path)) {
+		if (std::find(sampleable_formats.begin(), sampleable_formats.end(), cooked->GetFormat()) != sampleable_formats.end()) {
+			image.format      = cooked->GetFormat();
+			image.width       = cooked->GetWidth();
+			image.height      = cooked->GetHeight();
+			image.level_count = cooked->GetLevelCount();
+			image.cooked      = std::move(cooked);
+			return;
+		}
+		std::cout << "Vulkan: Device cannot sample the format of " << cooked_path << ", decoding " << path << " instead" << std::endl;
+	}
+#else
+	(void)sampleable_formats;
+#endif
+
+	int width, height, channels;
+	stbi_uc* pixels = encoded != nullptr
+		? stbi_load_from_memory(encoded->data(), static_cast<int>(encoded->size()), &width, &height, &channels, STBI_rgb_alpha)
+		: stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+	if (pixels == nullptr) {
+		return;
+	}
+	image.format      = VK_FORMAT_R8G8B8A8_SRGB;
+	image.width       = static_cast<uint32_t>(width);
+	image.height      = static_cast<uint32_t>(height);
+	image.level_count = static_cast<uint32_t>(std::floor(std::log2(std::max<int>(width, height)))) + 1;
+	if (image.level_count > 1 && upload_queue->GetMipGeneration(image.format, image.width, image.height) == MipGeneration::Cpu) {
+		image.pixels = CpuMipGenerator().Generate(pixels, image.width, image.height, image.level_count, true, pool, &image.level_offsets);
+	}
+	else {
+		image.pixels.assign(pixels, pixels + size_t(width) * height * 4);
+	}
+	stbi_image_free(pixels);
+}
+
+void TextureStreamer::_InitPlaceholder()
+{
+	_CreateImage(1, 1, 1, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, 0,
+		&_placeholder_image, &_placeholder_memory);
+	_placeholder_view = _CreateView(_placeholder_image, VK_FORMAT_R8G8B8A8_UNORM, 1);
+
+	const uint8_t white[4] = { 255, 255, 255, 255 };
+	_renderer->GetUploadQueue()->UploadImage(_placeholder_image, VK_FORMAT_R8G8B8A8_UNORM, 1, 1, 1, white, sizeof(white));
+}
+
+void TextureStreamer::_DeInitPlaceholder()
+{
+	auto device = _renderer->GetVulkanDevice();
+	vkDestroyImageView(device, _placeholder_view, nullptr);
+	vkDestroyImage(device, _placeholder_image, nullptr);
+	_renderer->GetMemoryAllocator()->Free(_placeholder_memory);
+	_placeholder_view = VK_NULL_HANDLE;
+	_placeholder_image = VK_NULL_HANDLE;
+}
+
+void TextureStreamer::_InitDescriptors()
+{
+	auto device = _renderer->GetVulkanDevice();
+	const auto& features_12 = _renderer->GetVulkanPhysicalDeviceFeatures12();
+	if (!features_12.runtimeDescriptorArray || !features_12.descriptorBindingPartiallyBound ||
+		!features_12.descriptorBindingSampledImageUpdateAfterBind || !features_12.descriptorBindingUpdateUnusedWhilePending ||
+		!features_12.shaderSampledImageArrayNonUniformIndexing) {
+		throw std::runtime_error("Vulkan: Device lacks the descriptor indexing features the texture table needs!");
+	}
+
+	// Update after bind descriptors have limits of their own
+	VkPhysicalDeviceVulkan12Properties properties_12{};
+	properties_12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+	VkPhysicalDeviceProperties2 properties{};
+	properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	properties.pNext = &properties_12;
+	vkGetPhysicalDeviceProperties2(_renderer->GetVulkanPhysicalDevice(), &properties);
+	_descriptor_count = std::min<uint32_t>(BUILD_BINDLESS_TEXTURE_COUNT, std::min<uint32_t>(
+		properties_12.maxDescriptorSetUpdateAfterBindSampledImages, properties_12.maxPerStageDescriptorUpdateAfterBindSampledImages));
+
+	VkDescriptorSetLayoutBinding binding{};
+	binding.binding = 0;
+	binding.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+	binding.descriptorCount = _descriptor_count;
+	binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	// Slots nobody indexes may be unwritten or stale, and slots no frame was handed may be written any time
+	VkDescriptorBindingFlags binding_flags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+		VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+	VkDescriptorSetLayoutBindingFlagsCreateInfo binding_flags_info{};
+	binding_flags_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+	binding_flags_info.bindingCount = 1;
+	binding_flags_info.pBindingFlags = &binding_flags;
+
+	VkDescriptorSetLayoutCreateInfo layout_create_info{};
+	layout_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layout_create_info.pNext = &binding_flags_info;
+	layout_create_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+	layout_create_info.bindingCount = 1;
+	layout_create_info.pBindings = &binding;
+	ErrorCheck(vkCreateDescriptorSetLayout(device, &layout_create_info, nullptr, &_descriptor_set_layout));
+
+	VkDescriptorPoolSize pool_size{};
+	pool_size.type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+	pool_size.descriptorCount = _descriptor_count;
+
+	VkDescriptorPoolCreateInfo pool_create_info{};
+	pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_create_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+	pool_create_info.maxSets = 1;
+	pool_create_info.poolSizeCount = 1;
+	pool_create_info.pPoolSizes = &pool_size;
+	ErrorCheck(vkCreateDescriptorPool(device, &pool_create_info, nullptr, &_descriptor_pool));
+
+	VkDescriptorSetAllocateInfo allocate_info{};
+	allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocate_info.descriptorPool = _descriptor_pool;
+	allocate_info.descriptorSetCount = 1;
+	allocate_info.pSetLayouts = &_descriptor_set_layout;
+	ErrorCheck(vkAllocateDescriptorSets(device, &allocate_info, &_descriptor_set));
+
+	_WriteDescriptor(0, _placeholder_view);
+}
+
+void TextureStreamer::_DeInitDescriptors()
+{
+	auto device = _renderer->GetVulkanDevice();
+	vkDestroyDescriptorPool(device, _descriptor_pool, nullptr);
+	vkDestroyDescriptorSetLayout(device, _descriptor_set_layout, nullptr);
+	_descriptor_pool = VK_NULL_HANDLE;
+	_descriptor_set_layout = VK_NULL_HANDLE;
+	_descriptor_set = VK_NULL_HANDLE;
+}
+
+void TextureStreamer::_WriteDescriptor(uint32_t slot, VkImageView view)
+{
+	VkDescriptorImageInfo image_info{};
+	image_info.imageView = view;
+	image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	VkWriteDescriptorSet write{};
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet = _descriptor_set;
+	write.dstBinding = 0;
+	write.dstArrayElement = slot;
+	write.descriptorCount = 1;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+	write.pImageInfo = &image_info;
+	vkUpdateDescriptorSets(_renderer->GetVulkanDevice(), 1, &write, 0, nullptr);
+}
+
+void TextureStreamer::_CreateImage(uint32_t width, uint32_t height, uint32_t level_count, VkFormat format, VkImageUsageFlags usage, VkImageCreateFlags flags, VkImage* image, MemoryAllocation* memory)
+{
+	VkImageCreateInfo image_create_info{};
+	image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	image_create_info.flags = flags;
+	image_create_info.imageType = VK_IMAGE_TYPE_2D;
+	image_create_info.extent = { width, height, 1 };
+	image_create_info.mipLevels = level_count;
+	image_create_info.arrayLayers = 1;
+	image_create_info.format = format;
+	image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+	image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	image_create_info.usage = usage;
+	image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+	image_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	// Written by the transfer queue, sampled on the graphics queue
+	auto& families = _renderer->GetUploadQueue()->GetQueueFamilyIndices();
+	if (families.size() > 1) {
+		image_create_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		image_create_info.queueFamilyIndexCount = static_cast<uint32_t>(families.size());
+		image_create_info.pQueueFamilyIndices = families.data();
+	}
+
+	ErrorCheck(vkCreateImage(_renderer->GetVulkanDevice(), &image_create_info, nullptr, image));
+	*memory = _renderer->GetMemoryAllocator()->AllocateForImage(*image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_TILING_OPTIMAL);
+}
+
+VkImageView TextureStreamer::_CreateView(VkImage image, VkFormat format, uint32_t level_count)
+{
+	// Images the mip generator writes also have storage usage, which an sRGB view cannot have
+	VkImageViewUsageCreateInfo usage_info{};
+	usage_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO;
+	usage_info.usage = VK_IMAGE_USAGE_SAMPLED_BIT;
+
+	VkImageViewCreateInfo view_create_info{};
+	view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	view_create_info.pNext = &usage_info;
+	view_create_info.image = image;
+	view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	view_create_info.format = format;
+	view_create_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	view_create_info.subresourceRange.baseMipLevel = 0;
+	view_create_info.subresourceRange.levelCount = level_count;
+	view_create_info.subresourceRange.baseArrayLayer = 0;
+	view_create_info.subresourceRange.layerCount = 1;
+
+	VkImageView view = VK_NULL_HANDLE;
+	ErrorCheck(vkCreateImageView(_renderer->GetVulkanDevice(), &view_create_info, nullptr, &view));
+	return view;
+}
+
+void TextureStreamer::_Stage(Texture& texture, DecodedImage& decoded)
+{
+	auto upload_queue = _renderer->GetUploadQueue();
+	const VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	if (decoded.cooked) {
+		_CreateImage(decoded.width, decoded.height, decoded.level_count, decoded.format, usage, 0, &texture.image, &texture.memory);
+
+		std::vector<VkDeviceSize> level_offsets(decoded.level_count);
+		for (uint32_t level = 0; level < decoded.level_count; ++level) {
+			level_offsets[level] = decoded.cooked->GetLevelOffset(level);
+		}
+		upload_queue->UploadImageLevels(texture.image, decoded.width, decoded.height, decoded.level_count,
+			decoded.cooked->GetLevelData(), decoded.cooked->GetLevelDataSize(), level_offsets.data());
+	}
+	else if (!decoded.level_offsets.empty()) {
+		_CreateImage(decoded.width, decoded.height, decoded.level_count, decoded.format, usage, 0, &texture.image, &texture.memory);
+		upload_queue->UploadImageLevels(texture.image, decoded.width, decoded.height, decoded.level_count,
+			decoded.pixels.data(), decoded.pixels.size(), decoded.level_offsets.data());
+	}
+	else {
+		VkImageUsageFlags mip_usage;
+		VkImageCreateFlags mip_flags;
+		upload_queue->GetMipImageRequirements(decoded.format, decoded.width, decoded.height, &mip_usage, &mip_flags);
+		_CreateImage(decoded.width, decoded.height, decoded.level_count, decoded.format, usage | mip_usage, mip_flags, &texture.image, &texture.memory);
+		upload_queue->UploadImage(texture.image, decoded.format, decoded.width, decoded.height, decoded.level_count,
+			decoded.pixels.data(), decoded.pixels.size());
+	}
+	texture.view  = _CreateView(texture.image, decoded.format, decoded.level_count);
+	texture.state = TextureState::Uploading;
+}
+
+void TextureStreamer::_Destroy(Texture& texture)
+{
+	auto device = _renderer->GetVulkanDevice();
+	if (texture.view != VK_NULL_HANDLE) {
+		vkDestroyImageView(device, texture.view, nullptr);
+		texture.view = VK_NULL_HANDLE;
+	}
+	if (texture.image != VK_NULL_HANDLE) {
+		vkDestroyImage(device, texture.image, nullptr);
+		_renderer->GetMemoryAllocator()->Free(texture.memory);
+		texture.image = VK_NULL_HANDLE;
+	}
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include"allincludes.h"
+#include"MemoryAllocator.h"
+#include"UploadQueue.h"
+#include"KtxFile.h"
+#include"ThreadPool.h"
+
+#include<memory>
+#include<mutex>
+#include<string>
+
+class Renderer;
+
+typedef uint32_t TextureHandle;
+
+// No texture at all, it samples as the placeholder.
+const TextureHandle TEXTURE_NONE = UINT32_MAX;
+
+// Loads textures in the background so no frame waits for them. Request()
+// only queues the file; a worker of the renderer's thread pool decodes it
+// (the cooked .ktx2 next to it when the device can sample its format, the
+// image itself through stb_image otherwise, or the encoded image it was
+// handed in memory), Update() stages decoded images
+// through the upload queue without waiting on anything, and a texture turns
+// resident once its upload batch's fence has signaled. Until then its handle
+// shows a 1x1 white placeholder.
+//
+// Shaders reach every texture through one bindless table, a descriptor set
+// holding a single partially bound array of sampled images. Slot 0 is the
+// placeholder, a texture gets slot handle + 1 written when it turns resident.
+// Nothing can index that slot before GetDescriptorIndex hands it out, so the
+// set is updated after bind while earlier frames still read it, and draws
+// never switch sets to change textures.
+//
+// Everything but the decoding runs on the thread that submits frames.
+class TextureStreamer
+{
+public:
+	TextureStreamer(Renderer* renderer);
+	~TextureStreamer();
+
+	// With encoded the image is decoded from those bytes, a PNG or JPEG embedded
+	// in a model, and path only names it in messages.
+	TextureHandle Request(const std::string& path, std::shared_ptr<const std::vector<uint8_t>> encoded = nullptr);
+	// Frees the texture. Frames that sample it have to be finished.
+	void          Release(TextureHandle texture);
+
+	// Called once per frame before the upload queue is flushed. Stages up to
+	// BUILD_TEXTURE_UPLOAD_BUDGET bytes of decoded images and returns true
+	// when some texture became resident since the last call.
+	bool          Update();
+
+	// The texture's own view once it is resident, the placeholder's before that or when loading failed.
+	VkImageView   GetImageView(TextureHandle texture) const;
+	// Slot of the texture in the table once it is resident, the placeholder's (0) before that,
+	// when loading failed, for TEXTURE_NONE or when the table is full.
+	uint32_t      GetDescriptorIndex(TextureHandle texture) const;
+
+	// The texture table, bound as its own set next to the pipeline's other sets.
+	VkDescriptorSetLayout GetDescriptorSetLayout() const;
+	VkDescriptorSet       GetDescriptorSet() const;
+	bool          IsResident(TextureHandle texture) const;
+	// Requested textures that are neither resident nor failed yet.
+	uint32_t      GetPendingCount() const;
+
+private:
+	enum class TextureState
+	{
+		Free,
+		Decoding,
+		Uploading,
+		Resident,
+		Failed,
+		Released, // released while a worker still decodes it
+	};
+
+	struct Texture
+	{
+		std::string      path;
+		TextureState     state = TextureState::Free;
+		VkImage          image = VK_NULL_HANDLE;
+		MemoryAllocation memory;
+		VkImageView      view = VK_NULL_HANDLE;
+		UploadTicket     ticket = 0;
+	};
+
+	// What a worker hands back, format is VK_FORMAT_UNDEFINED when decoding failed
+	struct DecodedImage
+	{
+		TextureHandle             texture = 0;
+		VkFormat                  format = VK_FORMAT_UNDEFINED;
+		uint32_t                  width = 0;
+		uint32_t                  height = 0;
+		uint32_t                  level_count = 0;
+		// Level 0 as RGBA8, the upload queue generates the other levels from it
+		std::vector<uint8_t>      pixels;
+		// Unless the CPU builds them anyway, then they follow level 0 in pixels at these offsets
+		std::vector<VkDeviceSize> level_offsets;
+		// Or every level, read in place from the mapped file
+		std::unique_ptr<KtxFile>  cooked;
+	};
+
+	// Shared with the decode jobs, which may still finish after the streamer is gone
+	struct DecodeResults
+	{
+		std::mutex                mutex;
+		std::vector<DecodedImage> images;
+	};
+
+	// Runs on a worker, touches nothing but its arguments. Mips the upload
+	// queue would leave to the CPU are built right here, on the pool.
+	static void _Decode(const std::string& path, const std::vector<uint8_t>* encoded, const std::vector<VkFormat>& sampleable_formats,
+		const UploadQueue* upload_queue, ThreadPool* pool, DecodedImage& image);
+
+	void _InitPlaceholder();
+	void _DeInitPlaceholder();
+	void _InitDescriptors();
+	void _DeInitDescriptors();
+
+	void _WriteDescriptor(uint32_t slot, VkImageView view);
+
+	void _CreateImage(uint32_t width, uint32_t height, uint32_t level_count, VkFormat format, VkImageUsageFlags usage, VkImageCreateFlags flags, VkImage* image, MemoryAllocation* memory);
+	VkImageView _CreateView(VkImage image, VkFormat format, uint32_t level_count);
+	void _Stage(Texture& texture, DecodedImage& decoded);
+	void _Destroy(Texture& texture);
+
+	Renderer*                       _renderer = nullptr;
+
+	VkImage                         _placeholder_image = VK_NULL_HANDLE;
+	MemoryAllocation                _placeholder_memory;
+	VkImageView                     _placeholder_view = VK_NULL_HANDLE;
+
+	VkDescriptorSetLayout           _descriptor_set_layout = VK_NULL_HANDLE;
+	VkDescriptorPool                _descriptor_pool = VK_NULL_HANDLE;
+	VkDescriptorSet                 _descriptor_set = VK_NULL_HANDLE;
+	// Slots in the table, the placeholder's included
+	uint32_t                        _descriptor_count = 0;
+
+	// Formats a cooked file may come in that this device samples with linear filtering
+	std::vector<VkFormat>           _sampleable_formats;
+
+	std::vector<Texture>            _textures;
+	std::vector<TextureHandle>      _free_handles;
+	std::vector<TextureHandle>      _uploading;
+	uint32_t                        _pending_count = 0;
+
+	std::shared_ptr<DecodeResults>  _results;
+};
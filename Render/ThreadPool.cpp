@@ -0,0 +1,111 @@
+#include"ThreadPool.h"
+
+#include<algorithm>
+#include<memory>
+
+static thread_local const ThreadPool* tls_thread_pool = nullptr;
+static thread_local uint32_t          tls_thread_index = 0;
+
+ThreadPool::ThreadPool(uint32_t thread_count)
+{
+	_threads.reserve(thread_count);
+	for (uint32_t i = 0; i < thread_count; ++i) {
+		_threads.emplace_back(&ThreadPool::_WorkerLoop, this, i);
+	}
+	std::cout << "Thread pool with " << thread_count << " workers created successfully" << std::endl;
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_condition.notify_all();
+	for (auto& thread : _threads) {
+		thread.join();
+	}
+	std::cout << "Thread pool destroyed successfully" << std::endl;
+}
+
+uint32_t ThreadPool::GetThreadCount() const
+{
+	return static_cast<uint32_t>(_threads.size());
+}
+
+uint32_t ThreadPool::GetCurrentThreadIndex() const
+{
+	return tls_thread_pool == this ? tls_thread_index : GetThreadCount();
+}
+
+void ThreadPool::Enqueue(std::function<void()> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_jobs.push_back(std::move(job));
+	}
+	_condition.notify_one();
+}
+
+void ThreadPool::ParallelFor(uint32_t task_count, const std::function<void(uint32_t, uint32_t)>& task)
+{
+	if (task_count == 0) {
+		return;
+	}
+
+	struct Progress
+	{
+		std::atomic<uint32_t>   next{ 0 };
+		std::atomic<uint32_t>   done{ 0 };
+		std::mutex              mutex;
+		std::condition_variable finished;
+	};
+	// Helpers may only get to run after everything is done, so the shared state
+	// outlives this call; they find no task left and never touch `task`.
+	auto progress = std::make_shared<Progress>();
+	const auto* task_pointer = &task;
+
+	auto run = [this, progress, task_pointer, task_count]() {
+		uint32_t thread_index = GetCurrentThreadIndex();
+		for (;;) {
+			uint32_t i = progress->next.fetch_add(1);
+			if (i >= task_count) {
+				break;
+			}
+			(*task_pointer)(i, thread_index);
+			if (progress->done.fetch_add(1) + 1 == task_count) {
+				std::lock_guard<std::mutex> lock(progress->mutex);
+				progress->finished.notify_all();
+			}
+		}
+	};
+
+	uint32_t helpers = std::min<uint32_t>(task_count - 1, GetThreadCount());
+	for (uint32_t i = 0; i < helpers; ++i) {
+		Enqueue(run);
+	}
+	run();
+
+	std::unique_lock<std::mutex> lock(progress->mutex);
+	progress->finished.wait(lock, [&]() { return progress->done.load() == task_count; });
+}
+
+void ThreadPool::_WorkerLoop(uint32_t index)
+{
+	tls_thread_pool  = this;
+	tls_thread_index = index;
+
+	for (;;) {
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_condition.wait(lock, [this]() { return _stop || !_jobs.empty(); });
+			if (_stop && _jobs.empty()) {
+				return;
+			}
+			job = std::move(_jobs.front());
+			_jobs.pop_front();
+		}
+		job();
+	}
+}
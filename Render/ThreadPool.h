@@ -0,0 +1,41 @@
+#pragma once
+
+#include"allincludes.h"
+
+#include<atomic>
+#include<condition_variable>
+#include<deque>
+#include<functional>
+#include<mutex>
+#include<thread>
+
+// Fixed set of worker threads pulling jobs from one shared queue. Workers are
+// numbered 0..GetThreadCount()-1 so callers can keep per-thread resources
+// (command pools, scratch memory) without locking; every thread that is not
+// a worker of this pool gets the index GetThreadCount().
+class ThreadPool
+{
+public:
+	explicit ThreadPool(uint32_t thread_count);
+	~ThreadPool();
+
+	uint32_t GetThreadCount() const;
+	uint32_t GetCurrentThreadIndex() const;
+
+	// Runs the job on some worker at some later point.
+	void Enqueue(std::function<void()> job);
+
+	// Calls task(task_index, thread_index) for every task_index below task_count
+	// and returns once all of them ran. The calling thread works along, so the
+	// number of distinct thread indices is at most GetThreadCount() + 1.
+	void ParallelFor(uint32_t task_count, const std::function<void(uint32_t, uint32_t)>& task);
+
+private:
+	void _WorkerLoop(uint32_t index);
+
+	std::vector<std::thread>            _threads;
+	std::deque<std::function<void()>>   _jobs;
+	std::mutex                          _mutex;
+	std::condition_variable             _condition;
+	bool                                _stop = false;
+};
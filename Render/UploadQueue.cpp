@@ -0,0 +1,623 @@
+#include"UploadQueue.h"
+#include"GpuMipGenerator.h"
+#include"Renderer.h"
+
+#include<algorithm>
+#include<cstring>
+
+static uint64_t AlignUp(uint64_t value, uint64_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+UploadQueue::UploadQueue(Renderer* renderer, VkDeviceSize staging_size)
+{
+	_renderer     = renderer;
+	_staging_size = staging_size;
+
+	_graphics_queue = _renderer->GetVulkanQueue();
+	_transfer_queue = _renderer->GetVulkanTransferQueue();
+
+	uint32_t graphics_family = _renderer->GetVulkanGraphicsQueueFamilyIndex();
+	uint32_t transfer_family = _renderer->GetVulkanTransferQueueFamilyIndex();
+	_dedicated = graphics_family != transfer_family;
+
+	_queue_family_indices.push_back(graphics_family);
+	if (_dedicated) {
+		_queue_family_indices.push_back(transfer_family);
+	}
+
+	// Buffer to image copies want texel aligned offsets, 16 covers every format we upload
+	_copy_alignment = std::max<VkDeviceSize>(_renderer->GetVulkanPhysicalDeviceProperties().limits.optimalBufferCopyOffsetAlignment, 16);
+
+	_InitStaging();
+	_InitCommandPools();
+#if BUILD_ENABLE_COMPUTE_MIPMAPS
+	_gpu_mip_generator = new GpuMipGenerator(_renderer);
+#endif
+
+	std::cout << "Vulkan: Upload queue created successfully on "
+		<< (_dedicated ? "a dedicated transfer queue" : "the graphics queue") << std::endl;
+}
+
+UploadQueue::~UploadQueue()
+{
+	WaitIdle();
+	delete _gpu_mip_generator;
+	_gpu_mip_generator = nullptr;
+
+	auto device = _renderer->GetVulkanDevice();
+	for (auto batch : _free_batches) {
+		vkDestroyFence(device, batch->fence, nullptr);
+		vkDestroySemaphore(device, batch->transfer_finished, nullptr);
+		delete batch->timer;
+		delete batch;
+	}
+	_free_batches.clear();
+
+	_DeInitCommandPools();
+	_DeInitStaging();
+	std::cout << "Vulkan: Upload queue destroyed successfully" << std::endl;
+}
+
+void UploadQueue::UploadBuffer(VkBuffer dst, VkDeviceSize dst_offset, const void* data, VkDeviceSize size)
+{
+	if (size == 0) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	BufferCopy copy{};
+	_Stage(data, size, _copy_alignment, &copy.source, &copy.region.srcOffset);
+	copy.destination      = dst;
+	copy.region.dstOffset = dst_offset;
+	copy.region.size      = size;
+	_buffer_copies.push_back(copy);
+}
+
+void UploadQueue::UploadImage(VkImage dst, VkFormat format, uint32_t width, uint32_t height, uint32_t mip_levels, const void* data, VkDeviceSize size)
+{
+	MipGeneration mip_generation = GetMipGeneration(format, width, height);
+	if (mip_levels > 1 && mip_generation == MipGeneration::Cpu) {
+		if (!CpuMipGenerator::IsSupported(format)) {
+			throw std::runtime_error("Vulkan: Texture image format supports neither linear blitting nor CPU mip generation!");
+		}
+		// Built before taking the lock, the levels then go in like precomputed ones
+		std::vector<VkDeviceSize> level_offsets;
+		std::vector<uint8_t> levels = _cpu_mip_generator.Generate(static_cast<const uint8_t*>(data), width, height, mip_levels,
+			CpuMipGenerator::IsSrgb(format), _renderer->GetThreadPool(), &level_offsets);
+		UploadImageLevels(dst, width, height, mip_levels, levels.data(), levels.size(), level_offsets.data());
+		return;
+	}
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	ImageCopy copy{};
+	_Stage(data, size, _copy_alignment, &copy.source, &copy.source_offset);
+	copy.destination    = dst;
+	copy.format         = format;
+	copy.width          = width;
+	copy.height         = height;
+	copy.mip_levels     = mip_levels;
+	copy.mip_generation = mip_generation;
+	_image_copies.push_back(copy);
+}
+
+void UploadQueue::UploadImageLevels(VkImage dst, uint32_t width, uint32_t height, uint32_t mip_levels, const void* data, VkDeviceSize size, const VkDeviceSize* level_offsets)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	ImageCopy copy{};
+	_Stage(data, size, _copy_alignment, &copy.source, &copy.source_offset);
+	copy.destination    = dst;
+	copy.format         = VK_FORMAT_UNDEFINED;
+	copy.width          = width;
+	copy.height         = height;
+	copy.mip_levels     = mip_levels;
+	copy.mip_generation = MipGeneration::Cpu;
+	copy.level_offsets.assign(level_offsets, level_offsets + mip_levels);
+	_image_copies.push_back(copy);
+}
+
+UploadTicket UploadQueue::Flush()
+{
+	PROFILE_SCOPE(_renderer->GetProfiler(), "UploadQueue::Flush");
+	std::lock_guard<std::mutex> lock(_mutex);
+	_Collect();
+	if (_buffer_copies.empty() && _image_copies.empty()) {
+		return _next_ticket - 1;
+	}
+	_Submit();
+	return _next_ticket - 1;
+}
+
+bool UploadQueue::IsComplete(UploadTicket ticket)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_Collect();
+	return ticket <= _completed_ticket;
+}
+
+void UploadQueue::Wait(UploadTicket ticket)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (ticket >= _next_ticket && !(_buffer_copies.empty() && _image_copies.empty())) {
+		_Submit();
+	}
+	while (_completed_ticket < ticket && _RetireOldest(true)) {
+	}
+}
+
+void UploadQueue::WaitIdle()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (!(_buffer_copies.empty() && _image_copies.empty())) {
+		_Submit();
+	}
+	while (_RetireOldest(true)) {
+	}
+}
+
+MipGeneration UploadQueue::GetMipGeneration(VkFormat format, uint32_t width, uint32_t height) const
+{
+	if (_gpu_mip_generator != nullptr && _gpu_mip_generator->IsSupported(format, width, height)) {
+		return MipGeneration::Compute;
+	}
+	VkFormatProperties format_properties;
+	vkGetPhysicalDeviceFormatProperties(_renderer->GetVulkanPhysicalDevice(), format, &format_properties);
+	VkFormatFeatureFlags blit = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+	if ((format_properties.optimalTilingFeatures & blit) == blit) {
+		return MipGeneration::Blit;
+	}
+	return MipGeneration::Cpu;
+}
+
+void UploadQueue::GetMipImageRequirements(VkFormat format, uint32_t width, uint32_t height, VkImageUsageFlags* usage, VkImageCreateFlags* flags) const
+{
+	*usage = 0;
+	*flags = 0;
+	switch (GetMipGeneration(format, width, height)) {
+	case MipGeneration::Compute:
+		GpuMipGenerator::GetImageRequirements(format, usage, flags);
+		break;
+	case MipGeneration::Blit:
+		*usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		break;
+	default:
+		break;
+	}
+}
+
+const std::vector<uint32_t>& UploadQueue::GetQueueFamilyIndices() const
+{
+	return _queue_family_indices;
+}
+
+bool UploadQueue::HasDedicatedTransferQueue() const
+{
+	return _dedicated;
+}
+
+void UploadQueue::_InitStaging()
+{
+	VkBufferCreateInfo buffer_create_info{};
+	buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_create_info.size = _staging_size;
+	buffer_create_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	ErrorCheck(vkCreateBuffer(_renderer->GetVulkanDevice(), &buffer_create_info, nullptr, &_staging_buffer));
+
+	_staging_memory = _renderer->GetMemoryAllocator()->AllocateForBuffer(_staging_buffer,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	_staging_mapped = static_cast<uint8_t*>(_staging_memory.mapped);
+}
+
+void UploadQueue::_DeInitStaging()
+{
+	vkDestroyBuffer(_renderer->GetVulkanDevice(), _staging_buffer, nullptr);
+	_renderer->GetMemoryAllocator()->Free(_staging_memory);
+	_staging_buffer = VK_NULL_HANDLE;
+	_staging_mapped = nullptr;
+}
+
+void UploadQueue::_InitCommandPools()
+{
+	auto device = _renderer->GetVulkanDevice();
+
+	VkCommandPoolCreateInfo pool_create_info{};
+	pool_create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	pool_create_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	pool_create_info.queueFamilyIndex = _renderer->GetVulkanTransferQueueFamilyIndex();
+
+	ErrorCheck(vkCreateCommandPool(device, &pool_create_info, nullptr, &_transfer_command_pool));
+
+	if (_dedicated) {
+		pool_create_info.queueFamilyIndex = _renderer->GetVulkanGraphicsQueueFamilyIndex();
+		ErrorCheck(vkCreateCommandPool(device, &pool_create_info, nullptr, &_graphics_command_pool));
+	}
+}
+
+void UploadQueue::_DeInitCommandPools()
+{
+	auto device = _renderer->GetVulkanDevice();
+	// Destroying the pools frees the batches' command buffers with them
+	vkDestroyCommandPool(device, _transfer_command_pool, nullptr);
+	if (_graphics_command_pool != VK_NULL_HANDLE) {
+		vkDestroyCommandPool(device, _graphics_command_pool, nullptr);
+	}
+	_transfer_command_pool = VK_NULL_HANDLE;
+	_graphics_command_pool = VK_NULL_HANDLE;
+}
+
+void UploadQueue::_Stage(const void* data, VkDeviceSize size, VkDeviceSize alignment, VkBuffer* buffer, VkDeviceSize* offset)
+{
+	// Anything this large would keep the ring drained, it gets a staging buffer of its own
+	if (size > _staging_size / 2) {
+		VkBufferCreateInfo buffer_create_info{};
+		buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		buffer_create_info.size = size;
+		buffer_create_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		VkBuffer oversized = VK_NULL_HANDLE;
+		ErrorCheck(vkCreateBuffer(_renderer->GetVulkanDevice(), &buffer_create_info, nullptr, &oversized));
+		MemoryAllocation memory = _renderer->GetMemoryAllocator()->AllocateForBuffer(oversized,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		memcpy(memory.mapped, data, static_cast<size_t>(size));
+
+		_oversized_buffers.push_back(oversized);
+		_oversized_memory.push_back(memory);
+		*buffer = oversized;
+		*offset = 0;
+		return;
+	}
+
+	for (;;) {
+		// Nothing pending and nothing in flight: start over at the beginning of the ring
+		if (_ring_write == _ring_retired && _in_flight.empty()) {
+			_ring_write = _ring_retired = 0;
+		}
+
+		uint64_t position = _ring_write % _staging_size;
+		uint64_t aligned  = AlignUp(position, alignment);
+		uint64_t consumed = aligned - position + size;
+		if (aligned + size > _staging_size) {
+			// Does not fit in front of the end, skip the rest of the ring and wrap around
+			aligned  = 0;
+			consumed = _staging_size - position + size;
+		}
+
+		if (_ring_write + consumed - _ring_retired <= _staging_size) {
+			_ring_write += consumed;
+			memcpy(_staging_mapped + aligned, data, static_cast<size_t>(size));
+			*buffer = _staging_buffer;
+			*offset = aligned;
+			return;
+		}
+
+		// The ring is full. Once nothing is in flight the pending copies are all
+		// that hold it, so they are submitted and waited for like any other batch.
+		if (_in_flight.empty()) {
+			_Submit();
+		}
+		_RetireOldest(true);
+	}
+}
+
+UploadQueue::Batch* UploadQueue::_AcquireBatch()
+{
+	auto device = _renderer->GetVulkanDevice();
+
+	if (!_free_batches.empty()) {
+		Batch* batch = _free_batches.back();
+		_free_batches.pop_back();
+		ErrorCheck(vkResetFences(device, 1, &batch->fence));
+		return batch;
+	}
+
+	Batch* batch = new Batch();
+
+	VkCommandBufferAllocateInfo allocate_info{};
+	allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocate_info.commandBufferCount = 1;
+	allocate_info.commandPool = _transfer_command_pool;
+	ErrorCheck(vkAllocateCommandBuffers(device, &allocate_info, &batch->transfer_command_buffer));
+
+	if (_dedicated) {
+		allocate_info.commandPool = _graphics_command_pool;
+		ErrorCheck(vkAllocateCommandBuffers(device, &allocate_info, &batch->graphics_command_buffer));
+
+		VkSemaphoreCreateInfo semaphore_create_info{};
+		semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		ErrorCheck(vkCreateSemaphore(device, &semaphore_create_info, nullptr, &batch->transfer_finished));
+	}
+
+	VkFenceCreateInfo fence_create_info{};
+	fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	ErrorCheck(vkCreateFence(device, &fence_create_info, nullptr, &batch->fence));
+
+	batch->timer = new GpuTimer(_renderer, _renderer->GetVulkanTransferQueueFamilyIndex(), "Upload queue", 1, 1);
+
+	return batch;
+}
+
+void UploadQueue::_Submit()
+{
+	Batch* batch = _AcquireBatch();
+	batch->ticket   = _next_ticket++;
+	batch->ring_end = _ring_write;
+	batch->oversized_buffers.swap(_oversized_buffers);
+	batch->oversized_memory.swap(_oversized_memory);
+
+	VkCommandBufferBeginInfo begin_info{};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	VkCommandBuffer transfer = batch->transfer_command_buffer;
+	ErrorCheck(vkBeginCommandBuffer(transfer, &begin_info));
+	batch->timer->Reset(transfer, 0);
+	uint32_t copy_region = batch->timer->Begin(transfer, 0, "Upload copies");
+
+	// One barrier moves every destination image of the batch into TRANSFER_DST
+	std::vector<VkImageMemoryBarrier> image_barriers(_image_copies.size());
+	for (size_t i = 0; i < _image_copies.size(); ++i) {
+		auto& barrier = image_barriers[i];
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = _image_copies[i].destination;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = _image_copies[i].mip_levels;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = 1;
+	}
+	if (!image_barriers.empty()) {
+		vkCmdPipelineBarrier(transfer,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+			0, nullptr,
+			0, nullptr,
+			static_cast<uint32_t>(image_barriers.size()), image_barriers.data());
+	}
+
+	for (auto& copy : _buffer_copies) {
+		vkCmdCopyBuffer(transfer, copy.source, copy.destination, 1, &copy.region);
+	}
+
+	std::vector<VkBufferImageCopy> regions;
+	for (auto& copy : _image_copies) {
+		// Level 0 only, unless the levels came with the data
+		uint32_t level_count = copy.level_offsets.empty() ? 1 : copy.mip_levels;
+		regions.assign(level_count, VkBufferImageCopy{});
+		for (uint32_t level = 0; level < level_count; ++level) {
+			VkBufferImageCopy& region = regions[level];
+			region.bufferOffset = copy.source_offset + (copy.level_offsets.empty() ? 0 : copy.level_offsets[level]);
+			region.bufferRowLength = 0;
+			region.bufferImageHeight = 0;
+			region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			region.imageSubresource.mipLevel = level;
+			region.imageSubresource.baseArrayLayer = 0;
+			region.imageSubresource.layerCount = 1;
+			region.imageOffset = { 0, 0, 0 };
+			region.imageExtent = { std::max<uint32_t>(copy.width >> level, 1), std::max<uint32_t>(copy.height >> level, 1), 1 };
+		}
+
+		vkCmdCopyBufferToImage(transfer, copy.source, copy.destination, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, level_count, regions.data());
+	}
+
+	batch->timer->End(transfer, 0, copy_region);
+
+	// Everything after the copies needs a graphics queue
+	VkCommandBuffer graphics = transfer;
+	if (_dedicated) {
+		ErrorCheck(vkEndCommandBuffer(transfer));
+		graphics = batch->graphics_command_buffer;
+		ErrorCheck(vkBeginCommandBuffer(graphics, &begin_info));
+	}
+
+	// Images with all their levels go straight to shader reads, the rest are finished by the mip chain
+	image_barriers.clear();
+	for (auto& copy : _image_copies) {
+		if (_NeedsMipmaps(copy)) {
+			continue;
+		}
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = copy.destination;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = copy.mip_levels;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = 1;
+		image_barriers.push_back(barrier);
+	}
+
+	// Buffer copies become visible to any later reader with one global barrier
+	VkMemoryBarrier memory_barrier{};
+	memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	memory_barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+	uint32_t memory_barrier_count = _buffer_copies.empty() ? 0 : 1;
+
+	if (memory_barrier_count || !image_barriers.empty()) {
+		vkCmdPipelineBarrier(graphics,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+			memory_barrier_count, &memory_barrier,
+			0, nullptr,
+			static_cast<uint32_t>(image_barriers.size()), image_barriers.data());
+	}
+
+	for (auto& copy : _image_copies) {
+		if (!_NeedsMipmaps(copy)) {
+			continue;
+		}
+		if (copy.mip_generation == MipGeneration::Compute) {
+			_gpu_mip_generator->Record(graphics, copy.destination, copy.format, copy.width, copy.height, copy.mip_levels, batch->ticket);
+		}
+		else {
+			_RecordMipmaps(graphics, copy);
+		}
+	}
+
+	ErrorCheck(vkEndCommandBuffer(graphics));
+
+	VkSubmitInfo submit_info{};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.commandBufferCount = 1;
+
+	if (_dedicated) {
+		submit_info.pCommandBuffers = &transfer;
+		submit_info.signalSemaphoreCount = 1;
+		submit_info.pSignalSemaphores = &batch->transfer_finished;
+		ErrorCheck(vkQueueSubmit(_transfer_queue, 1, &submit_info, VK_NULL_HANDLE));
+
+		VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		submit_info.pCommandBuffers = &graphics;
+		submit_info.waitSemaphoreCount = 1;
+		submit_info.pWaitSemaphores = &batch->transfer_finished;
+		submit_info.pWaitDstStageMask = &wait_stage;
+		submit_info.signalSemaphoreCount = 0;
+		submit_info.pSignalSemaphores = nullptr;
+	}
+	else {
+		submit_info.pCommandBuffers = &graphics;
+	}
+	ErrorCheck(vkQueueSubmit(_graphics_queue, 1, &submit_info, batch->fence));
+
+	_buffer_copies.clear();
+	_image_copies.clear();
+	_in_flight.push_back(batch);
+}
+
+bool UploadQueue::_NeedsMipmaps(const ImageCopy& copy) const
+{
+	return copy.mip_levels > 1 && copy.level_offsets.empty();
+}
+
+void UploadQueue::_RecordMipmaps(VkCommandBuffer command_buffer, const ImageCopy& copy)
+{
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.image = copy.destination;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+	barrier.subresourceRange.levelCount = 1;
+
+	int32_t mip_width  = static_cast<int32_t>(copy.width);
+	int32_t mip_height = static_cast<int32_t>(copy.height);
+
+	for (uint32_t i = 1; i < copy.mip_levels; i++) {
+		barrier.subresourceRange.baseMipLevel = i - 1;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+		vkCmdPipelineBarrier(command_buffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+			0, nullptr,
+			0, nullptr,
+			1, &barrier);
+
+		VkImageBlit blit{};
+		blit.srcOffsets[0] = { 0, 0, 0 };
+		blit.srcOffsets[1] = { mip_width, mip_height, 1 };
+		blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		blit.srcSubresource.mipLevel = i - 1;
+		blit.srcSubresource.baseArrayLayer = 0;
+		blit.srcSubresource.layerCount = 1;
+		blit.dstOffsets[0] = { 0, 0, 0 };
+		blit.dstOffsets[1] = { mip_width > 1 ? mip_width / 2 : 1, mip_height > 1 ? mip_height / 2 : 1, 1 };
+		blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		blit.dstSubresource.mipLevel = i;
+		blit.dstSubresource.baseArrayLayer = 0;
+		blit.dstSubresource.layerCount = 1;
+
+		vkCmdBlitImage(command_buffer,
+			copy.destination, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			copy.destination, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			1, &blit,
+			VK_FILTER_LINEAR);
+
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		vkCmdPipelineBarrier(command_buffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+			0, nullptr,
+			0, nullptr,
+			1, &barrier);
+
+		if (mip_width > 1) mip_width /= 2;
+		if (mip_height > 1) mip_height /= 2;
+	}
+
+	barrier.subresourceRange.baseMipLevel = copy.mip_levels - 1;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	vkCmdPipelineBarrier(command_buffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+		0, nullptr,
+		0, nullptr,
+		1, &barrier);
+}
+
+bool UploadQueue::_RetireOldest(bool wait)
+{
+	if (_in_flight.empty()) {
+		return false;
+	}
+
+	auto device = _renderer->GetVulkanDevice();
+	Batch* batch = _in_flight.front();
+	if (wait) {
+		ErrorCheck(vkWaitForFences(device, 1, &batch->fence, VK_TRUE, UINT64_MAX));
+	}
+	else if (vkGetFenceStatus(device, batch->fence) != VK_SUCCESS) {
+		return false;
+	}
+	_in_flight.pop_front();
+	batch->timer->Collect(0);
+
+	for (size_t i = 0; i < batch->oversized_buffers.size(); ++i) {
+		vkDestroyBuffer(device, batch->oversized_buffers[i], nullptr);
+		_renderer->GetMemoryAllocator()->Free(batch->oversized_memory[i]);
+	}
+	batch->oversized_buffers.clear();
+	batch->oversized_memory.clear();
+
+	// Batches retire in submission order, so the ring is free up to this batch's end
+	_ring_retired    = batch->ring_end;
+	_completed_ticket = batch->ticket;
+	if (_gpu_mip_generator != nullptr) {
+		_gpu_mip_generator->Retire(_completed_ticket);
+	}
+
+	_free_batches.push_back(batch);
+	return true;
+}
+
+void UploadQueue::_Collect()
+{
+	while (_RetireOldest(false)) {
+	}
+}
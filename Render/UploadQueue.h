@@ -0,0 +1,163 @@
+#pragma once
+
+#include"Platform.h"
+#include"Shared.h"
+#include"allincludes.h"
+#include"MemoryAllocator.h"
+#include"CpuMipGenerator.h"
+
+#include<deque>
+#include<mutex>
+
+class Renderer;
+class GpuMipGenerator;
+class GpuTimer;
+
+// Identifies a submitted upload batch, tickets grow monotonically.
+typedef uint64_t UploadTicket;
+
+// How UploadImage fills the levels below level 0, in order of preference.
+enum class MipGeneration
+{
+	Compute,   // one dispatch for every level
+	Blit,      // a linear blit per level
+	Cpu,       // box filtered on the thread pool and copied in with level 0
+};
+
+// Packs buffer and image uploads into batches that are submitted as a whole.
+// Source data is copied into a persistently mapped staging ring right away,
+// the GPU copies are recorded into one command buffer when the batch is
+// flushed. Copies run on a dedicated transfer queue when the device has one;
+// layout changes and mip generation follow on the graphics queue behind a
+// semaphore. Every batch owns a fence, so staging space is recycled as soon
+// as the GPU is done with it and no queue is ever idled.
+//
+// Flush() submits to the graphics queue, so it has to be called from the
+// thread that submits frames.
+class UploadQueue
+{
+public:
+	UploadQueue(Renderer* renderer, VkDeviceSize staging_size);
+	~UploadQueue();
+
+	// Copies size bytes of data into dst at dst_offset with the next batch.
+	void UploadBuffer(VkBuffer dst, VkDeviceSize dst_offset, const void* data, VkDeviceSize size);
+
+	// Fills mip 0 of a 2D image from tightly packed texels and leaves every mip
+	// in SHADER_READ_ONLY_OPTIMAL, mips below 0 are generated from it the way
+	// GetMipGeneration picks. With mip_levels > 1 the image needs what
+	// GetMipImageRequirements returns on top of TRANSFER_DST and SAMPLED.
+	void UploadImage(VkImage dst, VkFormat format, uint32_t width, uint32_t height, uint32_t mip_levels, const void* data, VkDeviceSize size);
+
+	// Fills every mip of a 2D image from data that already holds them, level i
+	// starting level_offsets[i] bytes into data, and leaves them in
+	// SHADER_READ_ONLY_OPTIMAL. Offsets have to be multiples of the format's
+	// block size, which is how KTX2 lays levels out. Works for compressed formats.
+	void UploadImageLevels(VkImage dst, uint32_t width, uint32_t height, uint32_t mip_levels, const void* data, VkDeviceSize size, const VkDeviceSize* level_offsets);
+
+	MipGeneration GetMipGeneration(VkFormat format, uint32_t width, uint32_t height) const;
+	void          GetMipImageRequirements(VkFormat format, uint32_t width, uint32_t height, VkImageUsageFlags* usage, VkImageCreateFlags* flags) const;
+
+	// Submits everything recorded so far and returns the ticket it completes with.
+	UploadTicket Flush();
+
+	bool IsComplete(UploadTicket ticket);
+	void Wait(UploadTicket ticket);
+	void WaitIdle();
+
+	// Queue families that access uploaded resources. With more than one entry
+	// destinations must be created VK_SHARING_MODE_CONCURRENT over all of them.
+	const std::vector<uint32_t>& GetQueueFamilyIndices() const;
+	bool                         HasDedicatedTransferQueue() const;
+
+private:
+	struct Batch
+	{
+		VkCommandBuffer transfer_command_buffer = VK_NULL_HANDLE;
+		// Only used with a dedicated transfer queue, otherwise everything goes into the transfer one
+		VkCommandBuffer graphics_command_buffer = VK_NULL_HANDLE;
+		VkSemaphore     transfer_finished = VK_NULL_HANDLE;
+		VkFence         fence = VK_NULL_HANDLE;
+		// Times the copies, read back when the batch retires
+		GpuTimer*       timer = nullptr;
+
+		UploadTicket    ticket = 0;
+		// Staging ring position the batch's data ends at, everything before it is free once the fence signals
+		uint64_t        ring_end = 0;
+
+		std::vector<VkBuffer>          oversized_buffers;
+		std::vector<MemoryAllocation>  oversized_memory;
+	};
+
+	struct BufferCopy
+	{
+		VkBuffer     source;
+		VkBuffer     destination;
+		VkBufferCopy region;
+	};
+
+	struct ImageCopy
+	{
+		VkBuffer      source;
+		VkDeviceSize  source_offset;
+		VkImage       destination;
+		VkFormat      format;
+		uint32_t      width;
+		uint32_t      height;
+		uint32_t      mip_levels;
+		MipGeneration mip_generation;
+		// Offsets of precomputed levels from source_offset, empty when the mips are generated from level 0
+		std::vector<VkDeviceSize> level_offsets;
+	};
+
+	void _InitStaging();
+	void _DeInitStaging();
+
+	void _InitCommandPools();
+	void _DeInitCommandPools();
+
+	void   _Stage(const void* data, VkDeviceSize size, VkDeviceSize alignment, VkBuffer* buffer, VkDeviceSize* offset);
+	Batch* _AcquireBatch();
+	void   _Submit();
+	bool   _NeedsMipmaps(const ImageCopy& copy) const;
+	void   _RecordMipmaps(VkCommandBuffer command_buffer, const ImageCopy& copy);
+	bool   _RetireOldest(bool wait);
+	void   _Collect();
+
+	Renderer*              _renderer = nullptr;
+
+	VkQueue                _transfer_queue = VK_NULL_HANDLE;
+	VkQueue                _graphics_queue = VK_NULL_HANDLE;
+	std::vector<uint32_t>  _queue_family_indices;
+	bool                   _dedicated = false;
+
+	GpuMipGenerator*       _gpu_mip_generator = nullptr;
+	CpuMipGenerator        _cpu_mip_generator;
+
+	VkCommandPool          _transfer_command_pool = VK_NULL_HANDLE;
+	VkCommandPool          _graphics_command_pool = VK_NULL_HANDLE;
+
+	VkBuffer               _staging_buffer = VK_NULL_HANDLE;
+	MemoryAllocation       _staging_memory;
+	uint8_t*               _staging_mapped = nullptr;
+	VkDeviceSize           _staging_size = 0;
+	VkDeviceSize           _copy_alignment = 16;
+
+	// Monotonic byte counters, their difference is the part of the ring in use
+	uint64_t               _ring_write = 0;
+	uint64_t               _ring_retired = 0;
+
+	// Recorded since the last flush
+	std::vector<BufferCopy>        _buffer_copies;
+	std::vector<ImageCopy>         _image_copies;
+	std::vector<VkBuffer>          _oversized_buffers;
+	std::vector<MemoryAllocation>  _oversized_memory;
+
+	std::deque<Batch*>     _in_flight;
+	std::vector<Batch*>    _free_batches;
+
+	UploadTicket           _next_ticket = 1;
+	UploadTicket           _completed_ticket = 0;
+
+	std::mutex             _mutex;
+};
@@ -0,0 +1,87 @@
+#include"VertexStruct.h"
+
+#include<algorithm>
+#include<cmath>
+#include<cstring>
+
+namespace {
+
+int16_t PackSnorm16(float value)
+{
+	return static_cast<int16_t>(std::round(std::min<float>(std::max<float>(value, -1.0f), 1.0f) * 32767.0f));
+}
+
+uint16_t PackUnorm16(float value)
+{
+	return static_cast<uint16_t>(std::round(std::min<float>(std::max<float>(value, 0.0f), 1.0f) * 65535.0f));
+}
+
+uint8_t PackUnorm8(float value)
+{
+	return static_cast<uint8_t>(std::round(std::min<float>(std::max<float>(value, 0.0f), 1.0f) * 255.0f));
+}
+
+uint64_t MixFloat(uint64_t hash, float value)
+{
+	// 0 and -0 compare equal, so both hash as 0
+	uint32_t bits = 0;
+	if (value != 0.0f) {
+		memcpy(&bits, &value, sizeof(bits));
+	}
+	hash = (hash ^ bits) * 0x9E3779B97F4A7C15ull;
+	return hash ^ (hash >> 29);
+}
+
+}
+
+size_t HashVertex(const Vertex& vertex)
+{
+	uint64_t hash = 0xCBF29CE484222325ull;
+	hash = MixFloat(hash, vertex.pos.x);
+	hash = MixFloat(hash, vertex.pos.y);
+	hash = MixFloat(hash, vertex.pos.z);
+	hash = MixFloat(hash, vertex.color.x);
+	hash = MixFloat(hash, vertex.color.y);
+	hash = MixFloat(hash, vertex.color.z);
+	hash = MixFloat(hash, vertex.texCoord.x);
+	hash = MixFloat(hash, vertex.texCoord.y);
+	hash = MixFloat(hash, vertex.normal.x);
+	hash = MixFloat(hash, vertex.normal.y);
+	hash = MixFloat(hash, vertex.normal.z);
+	return static_cast<size_t>(hash ^ (hash >> 32));
+}
+
+PackedVertex PackedVertex::Pack(const Vertex& vertex, const glm::vec4& dequantize)
+{
+	PackedVertex packed;
+
+	glm::vec3 position = (vertex.pos - glm::vec3(dequantize)) / dequantize.w;
+	packed.pos[0] = PackSnorm16(position.x);
+	packed.pos[1] = PackSnorm16(position.y);
+	packed.pos[2] = PackSnorm16(position.z);
+	packed.pos[3] = 0;
+
+	// Octahedral: project onto |x| + |y| + |z| = 1 and fold the lower half over the diagonals
+	glm::vec3 normal = vertex.normal;
+	float length = std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z);
+	glm::vec2 octahedral(0.0f);
+	if (length > 0.0f) {
+		octahedral = glm::vec2(normal.x, normal.y) / length;
+		if (normal.z < 0.0f) {
+			octahedral = glm::vec2(
+				(1.0f - std::fabs(octahedral.y)) * (octahedral.x >= 0.0f ? 1.0f : -1.0f),
+				(1.0f - std::fabs(octahedral.x)) * (octahedral.y >= 0.0f ? 1.0f : -1.0f));
+		}
+	}
+	packed.normal[0] = PackSnorm16(octahedral.x);
+	packed.normal[1] = PackSnorm16(octahedral.y);
+
+	packed.texCoord[0] = PackUnorm16(vertex.texCoord.x);
+	packed.texCoord[1] = PackUnorm16(vertex.texCoord.y);
+
+	packed.color[0] = PackUnorm8(vertex.color.x);
+	packed.color[1] = PackUnorm8(vertex.color.y);
+	packed.color[2] = PackUnorm8(vertex.color.z);
+	packed.color[3] = 255;
+	return packed;
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include"allincludes.h"
+#include"BUILD_OPTIONS.h"
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -47,7 +48,7 @@ struct Vertex {
 
         attributeDescriptions[3].binding = 0;
         attributeDescriptions[3].location = 3;
-        attributeDescriptions[3].format = VK_FORMAT_R32G32_SFLOAT;
+        attributeDescriptions[3].format = VK_FORMAT_R32G32B32_SFLOAT;
         attributeDescriptions[3].offset = offsetof(Vertex, normal);
 
         return attributeDescriptions;
@@ -58,13 +59,70 @@ struct Vertex {
     }
 };
 
+// Compact copy of a Vertex for the GPU, 20 bytes. Positions are snorm16
+// inside the mesh's bounding sphere and dequantized by the instance transform
+// (see SceneMesh::dequantize), normals are octahedral snorm16 that the vertex
+// shader unpacks, texture coordinates unorm16 (clamped to 0..1) and the
+// color unorm8.
+struct PackedVertex {
+    int16_t  pos[4];
+    int16_t  normal[2];
+    uint16_t texCoord[2];
+    uint8_t  color[4];
+
+    // dequantize holds the offset in xyz and the scale in w, position = offset + scale * pos.
+    static PackedVertex Pack(const Vertex& vertex, const glm::vec4& dequantize);
+
+    static VkVertexInputBindingDescription getBindingDescription() {
+        VkVertexInputBindingDescription bindingDescription{};
+        bindingDescription.binding = 0;
+        bindingDescription.stride = sizeof(PackedVertex);
+        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+        return bindingDescription;
+    }
+
+    static std::array<VkVertexInputAttributeDescription, 4> getAttributeDescriptions() {
+        std::array<VkVertexInputAttributeDescription, 4> attributeDescriptions{};
+
+        attributeDescriptions[0].binding = 0;
+        attributeDescriptions[0].location = 0;
+        attributeDescriptions[0].format = VK_FORMAT_R16G16B16A16_SNORM;
+        attributeDescriptions[0].offset = offsetof(PackedVertex, pos);
+
+        attributeDescriptions[1].binding = 0;
+        attributeDescriptions[1].location = 1;
+        attributeDescriptions[1].format = VK_FORMAT_R8G8B8A8_UNORM;
+        attributeDescriptions[1].offset = offsetof(PackedVertex, color);
+
+        attributeDescriptions[2].binding = 0;
+        attributeDescriptions[2].location = 2;
+        attributeDescriptions[2].format = VK_FORMAT_R16G16_UNORM;
+        attributeDescriptions[2].offset = offsetof(PackedVertex, texCoord);
+
+        attributeDescriptions[3].binding = 0;
+        attributeDescriptions[3].location = 3;
+        attributeDescriptions[3].format = VK_FORMAT_R16G16_SNORM;
+        attributeDescriptions[3].offset = offsetof(PackedVertex, normal);
+
+        return attributeDescriptions;
+    }
+};
+
+// Layout of the vertex buffer the pipeline reads.
+#if BUILD_ENABLE_VERTEX_QUANTIZATION
+typedef PackedVertex GpuVertex;
+#else
+typedef Vertex GpuVertex;
+#endif
+
+// Hash over the bits of every attribute, consistent with operator== (0 and -0 hash alike).
+size_t HashVertex(const Vertex& vertex);
+
 namespace std {
     template<> struct hash<Vertex> {
         size_t operator()(Vertex const& vertex) const {
-            return ((hash<glm::vec3>()(vertex.pos) ^
-                (hash<glm::vec3>()(vertex.color) << 1)) >> 1) ^
-                (hash<glm::vec2>()(vertex.texCoord) << 1) ^
-                (hash<glm::vec2>()(vertex.texCoord) >> 1);
+            return HashVertex(vertex);
         }
     };
 }
\ No newline at end of file
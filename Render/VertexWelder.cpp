@@ -0,0 +1,134 @@
+#include"VertexWelder.h"
+#include"ThreadPool.h"
+
+#include<algorithm>
+
+namespace {
+
+// Corners each welding task handles, small enough to spread a large model
+// over every worker and big enough that the merge sees mostly unique vertices
+const size_t WELD_CHUNK_CORNERS = 64 * 1024;
+
+// The table is grown once it is more than half full
+const size_t WELD_MIN_SLOTS = 64;
+
+}
+
+VertexWelder::VertexWelder(size_t expected_vertices)
+{
+	size_t slot_count = WELD_MIN_SLOTS;
+	while (slot_count < expected_vertices * 2) {
+		slot_count *= 2;
+	}
+	_Rehash(slot_count);
+	_vertices.reserve(expected_vertices);
+}
+
+uint32_t VertexWelder::Insert(const Vertex& vertex)
+{
+	if ((_vertices.size() + 1) * 2 > _slots.size()) {
+		_Rehash(_slots.size() * 2);
+	}
+
+	uint32_t hash = static_cast<uint32_t>(HashVertex(vertex));
+	for (size_t slot = hash & _mask;; slot = (slot + 1) & _mask) {
+		Slot& entry = _slots[slot];
+		if (entry.index == UINT32_MAX) {
+			entry.hash = hash;
+			entry.index = static_cast<uint32_t>(_vertices.size());
+			_vertices.push_back(vertex);
+			return entry.index;
+		}
+		if (entry.hash == hash && _vertices[entry.index] == vertex) {
+			return entry.index;
+		}
+	}
+}
+
+const std::vector<Vertex>& VertexWelder::GetVertices() const
+{
+	return _vertices;
+}
+
+std::vector<Vertex> VertexWelder::TakeVertices()
+{
+	std::vector<Vertex> vertices;
+	vertices.swap(_vertices);
+	_slots.clear();
+	_Rehash(WELD_MIN_SLOTS);
+	return vertices;
+}
+
+void VertexWelder::_Rehash(size_t slot_count)
+{
+	std::vector<Slot> old_slots;
+	old_slots.swap(_slots);
+
+	Slot empty = { 0, UINT32_MAX };
+	_slots.assign(slot_count, empty);
+	_mask = slot_count - 1;
+
+	for (const Slot& entry : old_slots) {
+		if (entry.index == UINT32_MAX) {
+			continue;
+		}
+		size_t slot = entry.hash & _mask;
+		while (_slots[slot].index != UINT32_MAX) {
+			slot = (slot + 1) & _mask;
+		}
+		_slots[slot] = entry;
+	}
+}
+
+void WeldVertices(const Vertex* corners, size_t count, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, ThreadPool* pool)
+{
+	indices.resize(count);
+
+	size_t chunk_count = (count + WELD_CHUNK_CORNERS - 1) / WELD_CHUNK_CORNERS;
+	// Without workers the merge would only add a second pass
+	if (pool == nullptr || pool->GetThreadCount() == 0 || chunk_count <= 1) {
+		VertexWelder welder(count / 4);
+		for (size_t i = 0; i < count; ++i) {
+			indices[i] = welder.Insert(corners[i]);
+		}
+		vertices = welder.TakeVertices();
+		return;
+	}
+
+	// Every chunk welds on its own, its indices refer to its own vertices for now
+	std::vector<std::vector<Vertex>> chunk_vertices(chunk_count);
+	pool->ParallelFor(static_cast<uint32_t>(chunk_count), [&](uint32_t chunk, uint32_t) {
+		size_t begin = chunk * WELD_CHUNK_CORNERS;
+		size_t end = std::min<size_t>(begin + WELD_CHUNK_CORNERS, count);
+		VertexWelder welder((end - begin) / 4);
+		for (size_t i = begin; i < end; ++i) {
+			indices[i] = welder.Insert(corners[i]);
+		}
+		chunk_vertices[chunk] = welder.TakeVertices();
+	});
+
+	// Merging in chunk order keeps the first use order of a single thread
+	size_t chunk_unique = 0;
+	for (const auto& chunk : chunk_vertices) {
+		chunk_unique += chunk.size();
+	}
+	VertexWelder merged(chunk_unique);
+	std::vector<std::vector<uint32_t>> remap(chunk_count);
+	for (size_t chunk = 0; chunk < chunk_count; ++chunk) {
+		remap[chunk].resize(chunk_vertices[chunk].size());
+		for (size_t i = 0; i < chunk_vertices[chunk].size(); ++i) {
+			remap[chunk][i] = merged.Insert(chunk_vertices[chunk][i]);
+		}
+		std::vector<Vertex>().swap(chunk_vertices[chunk]);
+	}
+
+	pool->ParallelFor(static_cast<uint32_t>(chunk_count), [&](uint32_t chunk, uint32_t) {
+		size_t begin = chunk * WELD_CHUNK_CORNERS;
+		size_t end = std::min<size_t>(begin + WELD_CHUNK_CORNERS, count);
+		const std::vector<uint32_t>& chunk_remap = remap[chunk];
+		for (size_t i = begin; i < end; ++i) {
+			indices[i] = chunk_remap[indices[i]];
+		}
+	});
+	vertices = merged.TakeVertices();
+}
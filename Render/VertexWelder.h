@@ -0,0 +1,41 @@
+#pragma once
+
+#include"allincludes.h"
+#include"VertexStruct.h"
+
+class ThreadPool;
+
+// Flat open addressing table that hands out one index per distinct vertex.
+// Slots hold the hash next to the index, so probing compares integers and only
+// touches a vertex when the hashes match; there is no allocation per vertex.
+class VertexWelder
+{
+public:
+	explicit VertexWelder(size_t expected_vertices = 0);
+
+	// Index of the vertex in GetVertices(), appended when it was not seen before.
+	uint32_t Insert(const Vertex& vertex);
+
+	const std::vector<Vertex>& GetVertices() const;
+	// Hands the unique vertices over and leaves the welder empty.
+	std::vector<Vertex> TakeVertices();
+
+private:
+	struct Slot
+	{
+		uint32_t hash;
+		uint32_t index;  // UINT32_MAX while the slot is free
+	};
+
+	void _Rehash(size_t slot_count);
+
+	std::vector<Slot>   _slots;
+	std::vector<Vertex> _vertices;
+	size_t              _mask = 0;
+};
+
+// Deduplicates count corners into unique vertices and one index per corner,
+// vertices in the order corners first use them. With a pool, chunks of corners
+// are welded in parallel and merged in chunk order, which gives exactly the
+// result of welding on one thread.
+void WeldVertices(const Vertex* corners, size_t count, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, ThreadPool* pool = nullptr);
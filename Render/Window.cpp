@@ -1,4 +1,11 @@
 #include"Window.h"
+#include"SwapchainTarget.h"
+#include"OffscreenTarget.h"
+#include"VertexWelder.h"
+#include"MeshCache.h"
+#include"TextureStreamer.h"
+
+#include<algorithm>
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -8,21 +15,23 @@
 #include <glm/gtc/type_ptr.hpp>
 
 
-#include <stb_image.h>
-
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
-Window::Window(Renderer * renderer, uint32_t size_x, uint32_t size_y, std::string name)
+Window::Window(Renderer * renderer, uint32_t size_x, uint32_t size_y, std::string name, bool offscreen, bool load_model)
 {
 	_renderer       = renderer;
 	_surface_size_x = size_x;
 	_surface_size_y = size_y;
+	_requested_size_x = size_x;
+	_requested_size_y = size_y;
 	_window_name    = name;
+	_offscreen      = offscreen;
 
-	_InitOSWindow();
-	_InitSurface();
-	_InitSwapchain();
-	_InitSwapchainImages();
+	if (!_offscreen) {
+		_InitOSWindow();
+		_InitSurface();
+	}
+	_InitRenderTarget();
 	_InitRenderPass();
 	createDescriptorSetLayout();
 	_CreateGraphicsPipeline();
@@ -30,13 +39,17 @@ Window::Window(Renderer * renderer, uint32_t size_x, uint32_t size_y, std::strin
 	createColorResources();
 	_InitDepthStencilImage();
 	_InitFramebuffers();
-	createTextureImage();
-	createTextureImageView();
 	createTextureSampler();
-	loadModel();
-	createVertexBuffer();
-	createIndexBuffer();
-	createUniformBuffers();
+	_scene = new Scene();
+	if (load_model) {
+		createModelMaterial();
+		loadModel();
+	}
+	updateSceneGeometry();
+	// Start the copies now, they overlap with the rest of the setup
+	_renderer->GetUploadQueue()->Flush();
+	createInstanceBuffers();
+	createMaterialBuffers();
 	createDescriptorPool();
 	createDescriptorSets();
 	_CreateCommandBuffers();
@@ -45,17 +58,20 @@ Window::Window(Renderer * renderer, uint32_t size_x, uint32_t size_y, std::strin
 
 Window::~Window()
 {
+	_renderer->GetUploadQueue()->WaitIdle();
 	vkQueueWaitIdle(_renderer->GetVulkanQueue());
 
 	destroySyncObjects();
 	_DestroyCommandBuffers();
 	destroyDescriptorPool();
-	destroyUniformBuffers();
+	destroyMaterialBuffers();
+	destroyInstanceBuffers();
 	destroyIndexBuffer();
 	destroyVertexBuffer();
+	releaseMaterialTextures();
+	delete _scene;
+	_scene = nullptr;
 	destroyTextureSampler();
-	destroyTextureImageView();
-	destroyTextureImage();
 	destroyColorResources();
 	_DeInitDepthStencilImage();
 	_DestroyCommandPool();
@@ -63,10 +79,11 @@ Window::~Window()
 	_DestroyGraphicsPipeline();
 	destroyDescriptorSetLayout();
 	_DeInitRednderPass();
-	_DeInitSwapchainImages();
-	_DeinitSwapchain();
-	_DenitSurface();
-	_DeInitOSWindow();
+	_DeInitRenderTarget();
+	if (!_offscreen) {
+		_DenitSurface();
+		_DeInitOSWindow();
+	}
 }
 
 void Window::Close()
@@ -76,21 +93,37 @@ void Window::Close()
 
 bool Window::Update()
 {
-	_UpdateOSWindow();
+	if (!_offscreen) {
+		_UpdateOSWindow();
+	}
 	return _window_should_run;
 }
 
 void Window::DrawFrame()
 {
+	PROFILE_SCOPE(_renderer->GetProfiler(), "Window::DrawFrame");
 	auto device = _renderer->GetVulkanDevice();
-	vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
-	vkResetFences(device, 1, &inFlightFences[currentFrame]);
+	updateSceneGeometry();
+	_renderer->GetTextureStreamer()->Update();
+	// Uploads recorded since the last frame have to be submitted before the draw that reads them
+	_renderer->GetUploadQueue()->Flush();
+
+	if (framebufferResized) {
+		recreateSwapChain();
+		// Still minimized, there is nothing to draw into
+		if (framebufferResized) {
+			return;
+		}
+	}
+
+	// Only the frame that last used this slot has to be finished, the others keep running
+	{
+		PROFILE_SCOPE(_renderer->GetProfiler(), "Window::WaitForFrame");
+		vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+	}
 	uint32_t imageIndex;
 
-	VkResult result = vkAcquireNextImageKHR(device, 
-		_swapchain, UINT64_MAX, 
-		imageAvailableSemaphores[currentFrame],
-		VK_NULL_HANDLE, &imageIndex);
+	VkResult result = _render_target->AcquireNextImage(imageAvailableSemaphores[currentFrame], &imageIndex);
 	if (result == VK_ERROR_OUT_OF_DATE_KHR) {
 		recreateSwapChain();
 		return;
@@ -106,20 +139,41 @@ void Window::DrawFrame()
 	// Mark the image as now being in use by this frame
 	imagesInFlight[imageIndex] = inFlightFences[currentFrame];
 
-	updateUniformBuffer(imageIndex);
+	// The slot's fence has been waited on, so its instance and material buffers are
+	// free again and the materials can point at textures that became resident since
+	uint32_t frame = static_cast<uint32_t>(currentFrame);
+	_UpdateMaterialBuffer(frame);
+	updateFrameConstants();
+	if (_gpu_culler != nullptr) {
+		if (_gpu_culler->Update(frame, _scene, _instance_builder)) {
+			descriptorSetsDirty[frame] = true;
+		}
+	}
+	else {
+		updateInstanceBuffer(frame);
+	}
+	if (descriptorSetsDirty[frame]) {
+		_WriteFrameDescriptors(frame, _gpu_culler != nullptr ? _gpu_culler->GetInstanceBuffer(frame) : instanceBuffers[frame]);
+		descriptorSetsDirty[frame] = false;
+	}
+	_RecordCommandBuffer(currentFrame, imageIndex);
+
 	VkSubmitInfo submitInfo{};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
+	// Offscreen targets have nothing to wait for and nobody to signal
+	bool presentable = _render_target->IsPresentable();
+
 	VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame] };
 	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-	submitInfo.waitSemaphoreCount = 1;
+	submitInfo.waitSemaphoreCount = presentable ? 1 : 0;
 	submitInfo.pWaitSemaphores = waitSemaphores;
 	submitInfo.pWaitDstStageMask = waitStages;
 	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &_commandBuffers[imageIndex];
+	submitInfo.pCommandBuffers = &_commandBuffers[currentFrame];
 
 	VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame] };
-	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.signalSemaphoreCount = presentable ? 1 : 0;
 	submitInfo.pSignalSemaphores = signalSemaphores;
 
 	vkResetFences(device, 1, &inFlightFences[currentFrame]);
@@ -127,30 +181,62 @@ void Window::DrawFrame()
 		throw std::runtime_error("Vulkan: Failed to submit draw command buffer!");
 	}
 
-	VkSwapchainKHR swapChains[] = { _swapchain };
-
-	VkPresentInfoKHR presentInfo{};
-	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-	presentInfo.waitSemaphoreCount = 1;
-	presentInfo.pWaitSemaphores = signalSemaphores;
-	presentInfo.swapchainCount = 1;
-	presentInfo.pSwapchains = swapChains;
-	presentInfo.pImageIndices = &imageIndex;
-	presentInfo.pResults = &result;
-
-	ErrorCheck(result = vkQueuePresentKHR(_renderer->GetVulkanQueue(), &presentInfo));
+	{
+		PROFILE_SCOPE(_renderer->GetProfiler(), "Window::Present");
+		result = _render_target->Present(renderFinishedSemaphores[currentFrame], imageIndex);
+	}
 
 	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebufferResized) {
-		framebufferResized = false;
 		recreateSwapChain();
 	}
 	else if (result != VK_SUCCESS) {
 		throw std::runtime_error("Vulkan: Failed to present swap chain image!");
 	}
 
-	currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+	currentFrame = (currentFrame + 1) % _frames_in_flight;
+}
 
-	ErrorCheck(vkQueueWaitIdle(_renderer->GetVulkanQueue()));
+void Window::Resize(uint32_t size_x, uint32_t size_y)
+{
+	_requested_size_x = size_x;
+	_requested_size_y = size_y;
+	framebufferResized = true;
+}
+
+void Window::SetFramesInFlight(uint32_t count)
+{
+	assert(count > 0);
+	if (count == _frames_in_flight) {
+		return;
+	}
+	vkDeviceWaitIdle(_renderer->GetVulkanDevice());
+
+	destroySyncObjects();
+	_DestroyCommandBuffers();
+	destroyDescriptorPool();
+	destroyMaterialBuffers();
+	destroyInstanceBuffers();
+
+	_frames_in_flight = count;
+	currentFrame = 0;
+
+	createInstanceBuffers();
+	createMaterialBuffers();
+	createDescriptorPool();
+	createDescriptorSets();
+	_CreateCommandBuffers();
+	createSyncObjects();
+}
+
+uint32_t Window::GetFramesInFlight() const
+{
+	return _frames_in_flight;
+}
+
+void Window::SetFixedTimeStep(float seconds)
+{
+	_fixed_time_step = seconds;
+	_animation_time = 0.0f;
 }
 
 std::vector<VkCommandBuffer> Window::GetVulkanCommandBuffer()
@@ -173,6 +259,16 @@ VkExtent2D Window::GetVulkanSurfaceSize()
 	return { _surface_size_x, _surface_size_y };
 }
 
+RenderTarget* Window::GetRenderTarget()
+{
+	return _render_target;
+}
+
+Scene* Window::GetScene()
+{
+	return _scene;
+}
+
 
 void Window::_InitSurface()
 {
@@ -218,85 +314,20 @@ void Window::_DenitSurface()
 	vkDestroySurfaceKHR(_renderer->GetVulkanInstance(), _surface, nullptr);
 }
 
-void Window::_InitSwapchain()
+void Window::_InitRenderTarget()
 {
-	auto device = _renderer->GetVulkanDevice();
-
-	if (_swapchain_image_count < _surface_capabilities.minImageCount  + 1) _swapchain_image_count = _surface_capabilities.minImageCount + 1;
-	if (_surface_capabilities.maxImageCount > 0) {
-		if (_swapchain_image_count > _surface_capabilities.maxImageCount) _swapchain_image_count = _surface_capabilities.maxImageCount;
+	if (_offscreen) {
+		_render_target = new OffscreenTarget(_renderer, VK_FORMAT_R8G8B8A8_UNORM, GetVulkanSurfaceSize(), _render_target_image_count);
 	}
-
-	/// <summary>
-	/// ////////////////
-	/// </summary>
-
-	VkPresentModeKHR persent_mode = VK_PRESENT_MODE_FIFO_KHR;
-	{
-		uint32_t present_mode_count = 0;
-		ErrorCheck(vkGetPhysicalDeviceSurfacePresentModesKHR(_renderer->GetVulkanPhysicalDevice(), _surface, &present_mode_count,nullptr));
-		std::vector<VkPresentModeKHR>present_mode_list(present_mode_count);
-		ErrorCheck(vkGetPhysicalDeviceSurfacePresentModesKHR(_renderer->GetVulkanPhysicalDevice(), _surface, &present_mode_count, present_mode_list.data()));
-		for (auto m : present_mode_list) {
-			if (m == VK_PRESENT_MODE_MAILBOX_KHR) persent_mode = m;
-		}
+	else {
+		_render_target = new SwapchainTarget(_renderer, _surface, _surface_format, GetVulkanSurfaceSize(), _render_target_image_count);
 	}
-
-	/// <summary>
-	/// ////////////
-	/// </summary>
-
-	VkSwapchainCreateInfoKHR swapchain_creater_info{};
-	swapchain_creater_info.sType               = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-	swapchain_creater_info.surface             = _surface;
-	swapchain_creater_info.minImageCount       = _swapchain_image_count;
-	swapchain_creater_info.imageFormat         = _surface_format.format;
-	swapchain_creater_info.imageColorSpace     = _surface_format.colorSpace;
-	swapchain_creater_info.imageExtent.width   = _surface_size_x;
-	swapchain_creater_info.imageExtent.height  = _surface_size_y;
-	swapchain_creater_info.imageArrayLayers    = 1;
-	swapchain_creater_info.imageUsage          = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
-	swapchain_creater_info.imageSharingMode    = VK_SHARING_MODE_EXCLUSIVE;
-	swapchain_creater_info.queueFamilyIndexCount = 0;
-	swapchain_creater_info.pQueueFamilyIndices = nullptr;
-	swapchain_creater_info.preTransform        = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
-	swapchain_creater_info.compositeAlpha      = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-	swapchain_creater_info.presentMode         = persent_mode;
-	swapchain_creater_info.clipped             = VK_TRUE;
-	swapchain_creater_info.oldSwapchain        = VK_NULL_HANDLE;
-
-	ErrorCheck(vkCreateSwapchainKHR(device, &swapchain_creater_info, nullptr, &_swapchain));
-
-	ErrorCheck(vkGetSwapchainImagesKHR(device, _swapchain, &_swapchain_image_count, nullptr));
 }
 
-void Window::_DeinitSwapchain()
+void Window::_DeInitRenderTarget()
 {
-	auto device = _renderer->GetVulkanDevice();
-	vkDestroySwapchainKHR(device, _swapchain, nullptr);
-}
-
-void Window::_InitSwapchainImages()
-{
-	auto device = _renderer->GetVulkanDevice();
-
-	_swapchain_images.resize(_swapchain_image_count);
-	_swapchain_images_views.resize(_swapchain_image_count);
-
-	ErrorCheck(vkGetSwapchainImagesKHR(device, _swapchain, &_swapchain_image_count, _swapchain_images.data()));
-	
-	for (uint32_t i = 0; i < _swapchain_image_count; ++i) {
-		_swapchain_images_views[i] = createImageView(_swapchain_images[i], _surface_format.format, VK_IMAGE_ASPECT_COLOR_BIT, 1);
-	}
-}
-
-void Window::_DeInitSwapchainImages()
-{
-	auto device = _renderer->GetVulkanDevice();
-
-	for (auto view : _swapchain_images_views) {
-		vkDestroyImageView(device, view, nullptr);
-	}
+	delete _render_target;
+	_render_target = nullptr;
 }
 
 void Window::_InitDepthStencilImage()
@@ -307,15 +338,14 @@ void Window::_InitDepthStencilImage()
 
 	createImage(_surface_size_x, _surface_size_y, 1,_renderer->GetVulkanMsaa() , _depth_stencil_format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _depth_stencil_image, _depth_stencil_image_memory);
 	_depth_stencil_image_view = createImageView(_depth_stencil_image, _depth_stencil_format, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
-
-	transitionImageLayout(_depth_stencil_image, _depth_stencil_format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 1);
+	// The render pass takes the image from UNDEFINED, no transition needed here
 }
 
 void Window::_DeInitDepthStencilImage()
 {
 	vkDestroyImageView(_renderer->GetVulkanDevice(), _depth_stencil_image_view, nullptr);
-	vkFreeMemory(_renderer->GetVulkanDevice(), _depth_stencil_image_memory, nullptr);
 	vkDestroyImage(_renderer->GetVulkanDevice(), _depth_stencil_image, nullptr);
+	_renderer->GetMemoryAllocator()->Free(_depth_stencil_image_memory);
 }
 
 
@@ -335,21 +365,21 @@ void Window::_InitRenderPass()
 	attachments[0].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
 	attachments[1].flags = 0;
-	attachments[1].format = _surface_format.format;
+	attachments[1].format = _render_target->GetFormat();
 	attachments[1].samples = msaaSamples;
 	attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
 	attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 	attachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 	attachments[1].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
-	attachments[2].format = _surface_format.format;
+	attachments[2].format = _render_target->GetFormat();
 	attachments[2].samples = VK_SAMPLE_COUNT_1_BIT;
 	attachments[2].loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	attachments[2].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 	attachments[2].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	attachments[2].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	attachments[2].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	attachments[2].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	attachments[2].finalLayout = _render_target->GetFinalLayout();
 
 	VkAttachmentReference sub_pass_0_depth_stancil_attachment{};
 	sub_pass_0_depth_stancil_attachment.attachment = 0;
@@ -396,12 +426,12 @@ void Window::_DeInitRednderPass()
 
 void Window::_InitFramebuffers()
 {
-	_framebuffer.resize(_swapchain_image_count);
-	for(uint32_t i = 0; i < _swapchain_image_count; ++i){
+	_framebuffer.resize(_render_target->GetImageCount());
+	for(uint32_t i = 0; i < _render_target->GetImageCount(); ++i){
 		std::array<VkImageView, 3> attachments{};
 		attachments[0] = _depth_stencil_image_view;
 		attachments[1] = colorImageView;
-		attachments[2] = _swapchain_images_views[i];
+		attachments[2] = _render_target->GetImageView(i);
 	
 
 		VkFramebufferCreateInfo _framebuffer_create_info{};
@@ -424,29 +454,11 @@ void Window::_DeInitFramebuffers()
 	}
 }
 
-static std::vector<char> readFile(const std::string& filename)
-{
-	std::ifstream file(filename, std::ios::ate | std::ios::binary);
-
-	if (!file.is_open()) {
-		throw std::runtime_error("Failed to open file");
-	}
-
-	size_t fileSize = (size_t)file.tellg();
-	std::vector<char> buffer(fileSize);
-
-	file.seekg(0);
-	file.read(buffer.data(), fileSize);
-	file.close();
-	
-	return buffer;
-}
-
 void Window::_CreateGraphicsPipeline()
 {
 	auto device = _renderer->GetVulkanDevice();
-	auto vertShaderCode = readFile("../shaders/vert.spv");
-	auto fragShaderCode = readFile("../shaders/frag.spv");
+	auto vertShaderCode = ReadFile("../shaders/vert.spv");
+	auto fragShaderCode = ReadFile("../shaders/frag.spv");
 
 	VkShaderModule vertShaderModule = CreateShaderModule(vertShaderCode);
 	VkShaderModule fragShaderModule = CreateShaderModule(fragShaderCode);
@@ -457,6 +469,16 @@ void Window::_CreateGraphicsPipeline()
 	vertShaderStageInfo.module = vertShaderModule;
 	vertShaderStageInfo.pName = "main";
 
+	// Constant 0 tells the vertex shader whether normals arrive octahedral encoded
+	VkBool32 packedVertices = BUILD_ENABLE_VERTEX_QUANTIZATION ? VK_TRUE : VK_FALSE;
+	VkSpecializationMapEntry packedVerticesEntry{ 0, 0, sizeof(VkBool32) };
+	VkSpecializationInfo vertSpecialization{};
+	vertSpecialization.mapEntryCount = 1;
+	vertSpecialization.pMapEntries = &packedVerticesEntry;
+	vertSpecialization.dataSize = sizeof(packedVertices);
+	vertSpecialization.pData = &packedVertices;
+	vertShaderStageInfo.pSpecializationInfo = &vertSpecialization;
+
 	VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
 	fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 	fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
@@ -465,8 +487,9 @@ void Window::_CreateGraphicsPipeline()
 
 	VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
 
-	auto bindingDescription = Vertex::getBindingDescription();
-	auto attributeDescriptions = Vertex::getAttributeDescriptions();
+	// Instances are read from the instance buffer by gl_InstanceIndex, only vertices are fetched
+	auto bindingDescription = GpuVertex::getBindingDescription();
+	auto attributeDescriptions = GpuVertex::getAttributeDescriptions();
 
 	VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
 	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
@@ -480,24 +503,13 @@ void Window::_CreateGraphicsPipeline()
 	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 	inputAssembly.primitiveRestartEnable = VK_FALSE;
 
-	VkViewport viewport{};
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = (float)_surface_size_x;
-	viewport.height = (float)_surface_size_y;
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
-
-	VkRect2D scissor{};
-	scissor.offset = { 0, 0 };
-	scissor.extent = GetVulkanSurfaceSize();
-
+	// Viewport and scissor are dynamic, the pipeline survives a resize untouched
 	VkPipelineViewportStateCreateInfo viewportState{};
 	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 	viewportState.viewportCount = 1;
-	viewportState.pViewports = &viewport;
+	viewportState.pViewports = nullptr;
 	viewportState.scissorCount = 1;
-	viewportState.pScissors = &scissor;
+	viewportState.pScissors = nullptr;
 
 	VkPipelineRasterizationStateCreateInfo rasterizer{};
 	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -534,7 +546,7 @@ void Window::_CreateGraphicsPipeline()
 
 	VkDynamicState dynamicStates[] = {
 	VK_DYNAMIC_STATE_VIEWPORT,
-	VK_DYNAMIC_STATE_LINE_WIDTH
+	VK_DYNAMIC_STATE_SCISSOR
 	};
 
 	VkPipelineDynamicStateCreateInfo dynamicState{};
@@ -542,12 +554,21 @@ void Window::_CreateGraphicsPipeline()
 	dynamicState.dynamicStateCount = 2;
 	dynamicState.pDynamicStates = dynamicStates;
 
+	// Set 0 is the window's own per frame set, set 1 the streamer's texture table
+	std::array<VkDescriptorSetLayout, 2> setLayouts = { descriptorSetLayout, _renderer->GetTextureStreamer()->GetDescriptorSetLayout() };
+
+	// What is left per frame once the instances carry their matrices
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(FrameConstants);
+
 	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
 	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutInfo.setLayoutCount = 1;
-	pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
-	pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
-	pipelineLayoutInfo.pPushConstantRanges = nullptr; // Optional
+	pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+	pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
 
 	if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &_pipelineLayout) != VK_SUCCESS) {
 		throw std::runtime_error("Vulkan: Failed to create pipeline layout!");
@@ -579,14 +600,14 @@ void Window::_CreateGraphicsPipeline()
 	pipelineInfo.pMultisampleState = &multisampling;
 	pipelineInfo.pDepthStencilState = &depthStencil; // Optional
 	pipelineInfo.pColorBlendState = &colorBlending;
-	pipelineInfo.pDynamicState = nullptr; // Optional
+	pipelineInfo.pDynamicState = &dynamicState;
 	pipelineInfo.layout = _pipelineLayout;
 	pipelineInfo.renderPass = _render_pass;
 	pipelineInfo.subpass = 0;
 	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
 	pipelineInfo.basePipelineIndex = -1; // Optional
 
-	if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &_graphicsPipeline) != VK_SUCCESS) {
+	if (vkCreateGraphicsPipelines(device, _renderer->GetVulkanPipelineCache(), 1, &pipelineInfo, nullptr, &_graphicsPipeline) != VK_SUCCESS) {
 		throw std::runtime_error("Vulkan: Failed to create graphics pipeline!");
 	}
 	else {
@@ -615,7 +636,8 @@ void Window::_CreateCommandPool()
 	VkCommandPoolCreateInfo poolInfo{};
 	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 	poolInfo.queueFamilyIndex = _renderer->GetVulkanGraphicsQueueFamilyIndex();
-	poolInfo.flags = 0; // Optional
+	// Frame slots re-record their command buffer every frame
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
 	if (vkCreateCommandPool(device, &poolInfo, nullptr, &_commandPool) != VK_SUCCESS) {
 		throw std::runtime_error("Vulkan: Failed to create command pool!");
@@ -636,7 +658,7 @@ void Window::_DestroyCommandPool()
 void Window::_CreateCommandBuffers()
 {
 	auto device = _renderer->GetVulkanDevice();
-	_commandBuffers.resize(_framebuffer.size());
+	_commandBuffers.resize(_frames_in_flight);
 
 	VkCommandBufferAllocateInfo allocInfo{};
 	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -651,66 +673,241 @@ void Window::_CreateCommandBuffers()
 		std::cout << "Vulkan: Command buffers allocate seccessfully" << std::endl;
 	}
 
-	for (size_t i = 0; i < _commandBuffers.size(); i++) {
-		VkCommandBufferBeginInfo beginInfo{};
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		beginInfo.flags = 0; // Optional
-		beginInfo.pInheritanceInfo = nullptr; // Optional
+	_CreateRecordingPools();
+	// Two regions per frame, culling and the render pass
+	_gpu_timer = new GpuTimer(_renderer, _renderer->GetVulkanGraphicsQueueFamilyIndex(), "Graphics queue", _frames_in_flight, 2);
+}
+
+void Window::_RecordCommandBuffer(uint32_t frame, uint32_t image_index)
+{
+	PROFILE_SCOPE(_renderer->GetProfiler(), "Window::RecordCommandBuffer");
+	VkCommandBuffer commandBuffer = _commandBuffers[frame];
+	vkResetCommandBuffer(commandBuffer, 0);
+	_ResetRecordingPools(frame);
+
+	// The slot's last submit is done, its timestamps are the GPU time of that frame
+	double gpuMilliseconds = _gpu_timer->Collect(frame);
+	if (gpuMilliseconds > 0.0) {
+		_renderer->GetProfiler()->AddFrameSample(FrameTrack::Gpu, gpuMilliseconds);
+	}
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	beginInfo.pInheritanceInfo = nullptr; // Optional
 
-		if (vkBeginCommandBuffer(_commandBuffers[i], &beginInfo) != VK_SUCCESS) {
-			throw std::runtime_error("Vulkan: Failed to begin recording command buffer!");
-		}
+	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+		throw std::runtime_error("Vulkan: Failed to begin recording command buffer!");
+	}
 
-		VkRenderPassBeginInfo renderPassInfo{};
-		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassInfo.renderPass = _render_pass;
-		renderPassInfo.framebuffer = _framebuffer[i];
-		renderPassInfo.renderArea.offset = { 0, 0 };
-		renderPassInfo.renderArea.extent = GetVulkanSurfaceSize();
+	VkRenderPassBeginInfo renderPassInfo{};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = _render_pass;
+	renderPassInfo.framebuffer = _framebuffer[image_index];
+	renderPassInfo.renderArea.offset = { 0, 0 };
+	renderPassInfo.renderArea.extent = GetVulkanSurfaceSize();
 
-		std::array<VkClearValue, 2> clearValues{};
-		clearValues[0].depthStencil = { 1.0f, 0 };
-		clearValues[1].color = { 0.0f, 0.0f, 0.0f, 1.0f };
+	std::array<VkClearValue, 2> clearValues{};
+	clearValues[0].depthStencil = { 1.0f, 0 };
+	clearValues[1].color = { 0.0f, 0.0f, 0.0f, 1.0f };
 
-		renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-		renderPassInfo.pClearValues = clearValues.data();
+	renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+	renderPassInfo.pClearValues = clearValues.data();
 
-		vkCmdBeginRenderPass(_commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-		
-		vkCmdBindPipeline(_commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, _graphicsPipeline);
+	_gpu_timer->Reset(commandBuffer, frame);
 
-		VkBuffer vertexBuffers[] = { vertexBuffer };
-		VkDeviceSize offsets[] = { 0 };
-		vkCmdBindVertexBuffers(_commandBuffers[i], 0, 1, vertexBuffers, offsets);
+	// Culling writes the draw commands, it has to run before the render pass starts
+	if (_gpu_culler != nullptr) {
+		uint32_t cullRegion = _gpu_timer->Begin(commandBuffer, frame, "Culling");
+		_gpu_culler->RecordCull(commandBuffer, frame);
+		_gpu_timer->End(commandBuffer, frame, cullRegion);
+	}
 
-		vkCmdBindIndexBuffer(_commandBuffers[i], indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+	// Small draw lists are cheaper to record inline than to fan out
+	uint32_t drawCount = static_cast<uint32_t>(_draw_list.size());
+	uint32_t taskCount = (drawCount + BUILD_DRAWS_PER_RECORDING_TASK - 1) / BUILD_DRAWS_PER_RECORDING_TASK;
+	bool parallel = taskCount > 1;
 
-		vkCmdBindDescriptorSets(_commandBuffers[i], 
-			VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelineLayout, 0, 1, &descriptorSets[i], 0, nullptr);
+	uint32_t renderPassRegion = _gpu_timer->Begin(commandBuffer, frame, "Render pass");
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
+		parallel ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
 
-		vkCmdDrawIndexed(_commandBuffers[i], static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+	if (_gpu_culler != nullptr) {
+		_RecordIndirectDraws(commandBuffer, frame);
+	}
+	else if (!parallel) {
+		_RecordDraws(commandBuffer, frame, 0, drawCount);
+	}
+	else {
+		VkCommandBufferInheritanceInfo inheritanceInfo{};
+		inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritanceInfo.renderPass = _render_pass;
+		inheritanceInfo.subpass = 0;
+		inheritanceInfo.framebuffer = _framebuffer[image_index];
+
+		// Every slice of the draw list goes into its own secondary buffer, taken
+		// from the pool of whichever thread records it
+		std::vector<VkCommandBuffer> secondaryBuffers(taskCount);
+		_renderer->GetThreadPool()->ParallelFor(taskCount, [&](uint32_t task, uint32_t thread) {
+			PROFILE_SCOPE(_renderer->GetProfiler(), "Window::RecordDraws");
+			VkCommandBuffer secondary = _AcquireSecondaryCommandBuffer(frame, thread);
+
+			VkCommandBufferBeginInfo secondaryBeginInfo{};
+			secondaryBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			secondaryBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+			secondaryBeginInfo.pInheritanceInfo = &inheritanceInfo;
+			ErrorCheck(vkBeginCommandBuffer(secondary, &secondaryBeginInfo));
+
+			uint32_t first = task * BUILD_DRAWS_PER_RECORDING_TASK;
+			uint32_t count = std::min<uint32_t>(BUILD_DRAWS_PER_RECORDING_TASK, drawCount - first);
+			_RecordDraws(secondary, frame, first, count);
+
+			ErrorCheck(vkEndCommandBuffer(secondary));
+			secondaryBuffers[task] = secondary;
+		});
+
+		vkCmdExecuteCommands(commandBuffer, taskCount, secondaryBuffers.data());
+	}
 
-		vkCmdEndRenderPass(_commandBuffers[i]);
+	vkCmdEndRenderPass(commandBuffer);
+	_gpu_timer->End(commandBuffer, frame, renderPassRegion);
 
-		if (vkEndCommandBuffer(_commandBuffers[i]) != VK_SUCCESS) {
-			throw std::runtime_error("Vulkan: Failed to record command buffer!");
-		}
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("Vulkan: Failed to record command buffer!");
 	}
 }
 
+void Window::_BindDrawState(VkCommandBuffer commandBuffer, uint32_t frame)
+{
+	// Secondary buffers inherit no state, each one binds everything itself
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _graphicsPipeline);
+
+	VkViewport viewport{};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = (float)_surface_size_x;
+	viewport.height = (float)_surface_size_y;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+	VkRect2D scissor{};
+	scissor.offset = { 0, 0 };
+	scissor.extent = GetVulkanSurfaceSize();
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+	VkDeviceSize offset = 0;
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, &offset);
+
+	vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, _index_type);
+
+	// Every draw samples through the one texture table
+	VkDescriptorSet sets[] = { descriptorSets[frame], _renderer->GetTextureStreamer()->GetDescriptorSet() };
+	vkCmdBindDescriptorSets(commandBuffer,
+		VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelineLayout, 0, 2, sets, 0, nullptr);
+
+	vkCmdPushConstants(commandBuffer, _pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(FrameConstants), &_frame_constants);
+}
+
+void Window::_RecordDraws(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t first, uint32_t count)
+{
+	// An empty scene may not even have buffers to bind
+	if (count == 0) {
+		return;
+	}
+
+	_BindDrawState(commandBuffer, frame);
+	for (uint32_t i = first; i < first + count; ++i) {
+		const DrawItem& draw = _draw_list[i];
+		vkCmdDrawIndexed(commandBuffer, draw.index_count, draw.instance_count, draw.first_index, draw.vertex_offset, draw.first_instance);
+	}
+}
+
+void Window::_RecordIndirectDraws(VkCommandBuffer commandBuffer, uint32_t frame)
+{
+	if (_gpu_culler->GetBatchCount(frame) == 0 || vertexBuffer == VK_NULL_HANDLE) {
+		return;
+	}
+
+	_BindDrawState(commandBuffer, frame);
+	_gpu_culler->RecordDraws(commandBuffer, frame);
+}
+
 void Window::_DestroyCommandBuffers()
 {
+	delete _gpu_timer;
+	_gpu_timer = nullptr;
+	_DestroyRecordingPools();
 	vkFreeCommandBuffers(_renderer->GetVulkanDevice(), _commandPool, static_cast<uint32_t>(_commandBuffers.size()), _commandBuffers.data());
 	std::cout << "Vulkan: Comman pool was free seccessfully" << std::endl;
 }
 
+void Window::_CreateRecordingPools()
+{
+	auto device = _renderer->GetVulkanDevice();
+	// Pool workers plus the thread calling DrawFrame, which records along
+	_recording_thread_slots = _renderer->GetThreadPool()->GetThreadCount() + 1;
+	_recording_pools.resize(_frames_in_flight * _recording_thread_slots);
+
+	VkCommandPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.queueFamilyIndex = _renderer->GetVulkanGraphicsQueueFamilyIndex();
+	// Reset as a whole once the frame slot comes around again
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+	for (auto& recordingPool : _recording_pools) {
+		ErrorCheck(vkCreateCommandPool(device, &poolInfo, nullptr, &recordingPool.pool));
+		recordingPool.used = 0;
+	}
+	std::cout << "Vulkan: Recording pools for " << _recording_thread_slots << " threads created seccessfully" << std::endl;
+}
+
+void Window::_DestroyRecordingPools()
+{
+	auto device = _renderer->GetVulkanDevice();
+	for (auto& recordingPool : _recording_pools) {
+		vkDestroyCommandPool(device, recordingPool.pool, nullptr);
+	}
+	_recording_pools.clear();
+}
+
+void Window::_ResetRecordingPools(uint32_t frame)
+{
+	auto device = _renderer->GetVulkanDevice();
+	for (uint32_t thread = 0; thread < _recording_thread_slots; ++thread) {
+		auto& recordingPool = _recording_pools[frame * _recording_thread_slots + thread];
+		if (recordingPool.used > 0) {
+			ErrorCheck(vkResetCommandPool(device, recordingPool.pool, 0));
+			recordingPool.used = 0;
+		}
+	}
+}
+
+VkCommandBuffer Window::_AcquireSecondaryCommandBuffer(uint32_t frame, uint32_t thread)
+{
+	// Only ever touched by one thread, no locking needed
+	auto& recordingPool = _recording_pools[frame * _recording_thread_slots + thread];
+	if (recordingPool.used == recordingPool.buffers.size()) {
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = recordingPool.pool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		allocInfo.commandBufferCount = 1;
+
+		VkCommandBuffer secondary = VK_NULL_HANDLE;
+		ErrorCheck(vkAllocateCommandBuffers(_renderer->GetVulkanDevice(), &allocInfo, &secondary));
+		recordingPool.buffers.push_back(secondary);
+	}
+	return recordingPool.buffers[recordingPool.used++];
+}
+
 void Window::createSyncObjects()
 {
 	auto device = _renderer->GetVulkanDevice();
-	imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-	renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-	inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-	imagesInFlight.resize(_swapchain_images.size(), VK_NULL_HANDLE);
+	imageAvailableSemaphores.resize(_frames_in_flight);
+	renderFinishedSemaphores.resize(_frames_in_flight);
+	inFlightFences.resize(_frames_in_flight);
+	imagesInFlight.assign(_render_target->GetImageCount(), VK_NULL_HANDLE);
 
 	VkSemaphoreCreateInfo semaphoreInfo{};
 	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -719,7 +916,7 @@ void Window::createSyncObjects()
 	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
 	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+	for (size_t i = 0; i < _frames_in_flight; i++) {
 		if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
 			vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
 			vkCreateFence(device, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
@@ -733,7 +930,7 @@ void Window::createSyncObjects()
 void Window::destroySyncObjects()
 {
 	auto device = _renderer->GetVulkanDevice();
-	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+	for (size_t i = 0; i < _frames_in_flight; i++) {
 		vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
 		vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
 		vkDestroyFence(device, inFlightFences[i], nullptr);
@@ -747,13 +944,12 @@ void Window::cleanup()
 	cleanupSwapChain();
 
 	destroyTextureSampler();
-	destroyTextureImageView();
-	destroyTextureImage();
+	releaseMaterialTextures();
 	destroyDescriptorSetLayout();
 	destroyIndexBuffer();
 	destroyVertexBuffer();
 
-	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+	for (size_t i = 0; i < _frames_in_flight; i++) {
 		vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
 		vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
 		vkDestroyFence(device, inFlightFences[i], nullptr);
@@ -770,91 +966,111 @@ void Window::cleanup()
 
 void Window::recreateSwapChain()
 {
-	vkQueueWaitIdle(_renderer->GetVulkanQueue());
+	VkExtent2D extent = { _requested_size_x, _requested_size_y };
+	if (!_offscreen) {
+		auto gpu = _renderer->GetVulkanPhysicalDevice();
+		ErrorCheck(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(gpu, _surface, &_surface_capabilities));
+		if (_surface_capabilities.currentExtent.width != UINT32_MAX) {
+			extent = _surface_capabilities.currentExtent;
+		}
+		else {
+			extent.width = std::max(_surface_capabilities.minImageExtent.width, std::min(_surface_capabilities.maxImageExtent.width, extent.width));
+			extent.height = std::max(_surface_capabilities.minImageExtent.height, std::min(_surface_capabilities.maxImageExtent.height, extent.height));
+		}
+	}
 
+	// A minimized window has no area to render into, try again once it is restored
+	if (extent.width == 0 || extent.height == 0) {
+		framebufferResized = true;
+		return;
+	}
+	framebufferResized = false;
+
+	// Only frames still in flight can use the old attachments, the device does not have to go idle
+	vkWaitForFences(_renderer->GetVulkanDevice(), static_cast<uint32_t>(inFlightFences.size()), inFlightFences.data(), VK_TRUE, UINT64_MAX);
+
+	// Render pass, pipeline, uniform ring, descriptors and command buffers do not
+	// depend on the extent and stay as they are
 	cleanupSwapChain();
 
-	_InitSwapchain();
-	_InitSwapchainImages();
-	_InitRenderPass();
-	_CreateGraphicsPipeline();
+	_render_target->Resize(extent);
+	_surface_size_x = _render_target->GetExtent().width;
+	_surface_size_y = _render_target->GetExtent().height;
+
 	createColorResources();
 	_InitDepthStencilImage();
 	_InitFramebuffers();
-	createUniformBuffers();
-	createDescriptorPool();
-	createDescriptorSets();
-	_CreateCommandBuffers();
+
+	// The new target may hand out a different number of images
+	imagesInFlight.assign(_render_target->GetImageCount(), VK_NULL_HANDLE);
 }
 
 void Window::cleanupSwapChain()
 {
-	destroyColorResources();
-	_DeInitDepthStencilImage();
 	_DeInitFramebuffers();
-	_DestroyCommandBuffers();
-	_DestroyGraphicsPipeline();
-	_DeInitRednderPass();
-	_DeInitSwapchainImages();
-	_DeinitSwapchain();
-	destroyUniformBuffers();
-	destroyDescriptorPool();
+	_DeInitDepthStencilImage();
+	destroyColorResources();
 }
 
 void Window::createVertexBuffer()
 {
-	auto device = _renderer->GetVulkanDevice();
-	VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
-
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-
-	void* data;
-	vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, vertices.data(), (size_t)bufferSize);
-	vkUnmapMemory(device, stagingBufferMemory);
+	const auto& vertices = _scene->GetVertices();
+	VkDeviceSize bufferSize = sizeof(GpuVertex) * vertices.size();
 
 	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT 
 		| VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
 
-	copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
-
-	vkDestroyBuffer(device, stagingBuffer, nullptr);
-	vkFreeMemory(device, stagingBufferMemory, nullptr);
+#if BUILD_ENABLE_VERTEX_QUANTIZATION
+	// Every mesh quantizes against its own bounds
+	std::vector<PackedVertex> packed(vertices.size());
+	for (MeshHandle mesh = 0; mesh < _scene->GetMeshCount(); ++mesh) {
+		const SceneMesh& range = _scene->GetMesh(mesh);
+		for (uint32_t i = 0; i < range.vertex_count; ++i) {
+			packed[range.vertex_offset + i] = PackedVertex::Pack(vertices[range.vertex_offset + i], range.dequantize);
+		}
+	}
+	_renderer->GetUploadQueue()->UploadBuffer(vertexBuffer, 0, packed.data(), bufferSize);
+#else
+	_renderer->GetUploadQueue()->UploadBuffer(vertexBuffer, 0, vertices.data(), bufferSize);
+#endif
 	std::cout << "Vulkan: Create vertex buffer seccessfully" << std::endl;
 }
 
 void Window::destroyVertexBuffer()
 {
 	vkDestroyBuffer(_renderer->GetVulkanDevice(), vertexBuffer, nullptr);
-	vkFreeMemory(_renderer->GetVulkanDevice(), vertexBufferMemory, nullptr);
+	vertexBuffer = VK_NULL_HANDLE;
+	_renderer->GetMemoryAllocator()->Free(vertexBufferMemory);
 	std::cout << "Vulkan: Destroyed vertex buffer seccessfully" << std::endl;
 }
 
 void Window::createIndexBuffer()
 {
-	auto device = _renderer->GetVulkanDevice();
-	VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
-
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+	const auto& indices = _scene->GetIndices();
 
-	void* data;
-	vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, indices.data(), (size_t)bufferSize);
-	vkUnmapMemory(device, stagingBufferMemory);
+	// Indices are local to their mesh, so 16 bits are enough while no mesh has more vertices than that
+	_index_type = VK_INDEX_TYPE_UINT32;
+#if BUILD_ENABLE_VERTEX_QUANTIZATION
+	_index_type = VK_INDEX_TYPE_UINT16;
+	for (MeshHandle mesh = 0; mesh < _scene->GetMeshCount(); ++mesh) {
+		if (_scene->GetMesh(mesh).vertex_count > UINT16_MAX) {
+			_index_type = VK_INDEX_TYPE_UINT32;
+		}
+	}
+#endif
+	VkDeviceSize indexSize = _index_type == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+	VkDeviceSize bufferSize = indexSize * indices.size();
 
 	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | 
 		VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory);
 
-	copyBuffer(stagingBuffer, indexBuffer, bufferSize);
-
-	vkDestroyBuffer(device, stagingBuffer, nullptr);
-	vkFreeMemory(device, stagingBufferMemory, nullptr);
+	if (_index_type == VK_INDEX_TYPE_UINT16) {
+		std::vector<uint16_t> shortIndices(indices.begin(), indices.end());
+		_renderer->GetUploadQueue()->UploadBuffer(indexBuffer, 0, shortIndices.data(), bufferSize);
+	}
+	else {
+		_renderer->GetUploadQueue()->UploadBuffer(indexBuffer, 0, indices.data(), bufferSize);
+	}
 	std::cout << "Vulkan: Create index buffer seccessfully" << std::endl;
 }
 
@@ -862,29 +1078,190 @@ void Window::destroyIndexBuffer()
 {
 	auto device = _renderer->GetVulkanDevice();
 	vkDestroyBuffer(device, indexBuffer, nullptr);
-	vkFreeMemory(device, indexBufferMemory, nullptr);
+	indexBuffer = VK_NULL_HANDLE;
+	_renderer->GetMemoryAllocator()->Free(indexBufferMemory);
 
 	std::cout << "Vulkan: Destroyed index buffer seccessfully" << std::endl;
 }
 
-void Window::createDescriptorSetLayout()
+void Window::updateSceneGeometry()
+{
+	if (_scene->GetGeometryVersion() == _scene_geometry_version) {
+		return;
+	}
+
+	// Meshes are added rarely, so draining the queues beats keeping old buffers alive per frame
+	if (vertexBuffer != VK_NULL_HANDLE || indexBuffer != VK_NULL_HANDLE) {
+		_renderer->GetUploadQueue()->WaitIdle();
+		vkQueueWaitIdle(_renderer->GetVulkanQueue());
+		destroyIndexBuffer();
+		destroyVertexBuffer();
+	}
+
+	if (!_scene->GetVertices().empty() && !_scene->GetIndices().empty()) {
+		createVertexBuffer();
+		createIndexBuffer();
+	}
+	_scene_geometry_version = _scene->GetGeometryVersion();
+}
+
+void Window::createInstanceBuffers()
+{
+	// Buffers are created on first use and grow with the scene
+	instanceBuffers.assign(_frames_in_flight, VK_NULL_HANDLE);
+	instanceBuffersMemory.assign(_frames_in_flight, MemoryAllocation());
+	instanceBufferCapacity.assign(_frames_in_flight, 0);
+
+#if BUILD_ENABLE_GPU_CULLING
+	if (GpuCuller::IsSupported(_renderer)) {
+		_gpu_culler = new GpuCuller(_renderer, _frames_in_flight);
+	}
+#endif
+}
+
+void Window::destroyInstanceBuffers()
 {
 	auto device = _renderer->GetVulkanDevice();
-	VkDescriptorSetLayoutBinding uboLayoutBinding{};
-	uboLayoutBinding.binding = 0;
-	uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	uboLayoutBinding.descriptorCount = 1;
-	uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-	uboLayoutBinding.pImmutableSamplers = nullptr; // Optional
+	for (size_t i = 0; i < instanceBuffers.size(); ++i) {
+		vkDestroyBuffer(device, instanceBuffers[i], nullptr);
+		_renderer->GetMemoryAllocator()->Free(instanceBuffersMemory[i]);
+	}
+	instanceBuffers.clear();
+	instanceBuffersMemory.clear();
+	instanceBufferCapacity.clear();
 
+	delete _gpu_culler;
+	_gpu_culler = nullptr;
+	std::cout << "Vulkan: Destroyed instance buffers seccessfully" << std::endl;
+}
+
+void Window::updateInstanceBuffer(uint32_t frame)
+{
+	PROFILE_SCOPE(_renderer->GetProfiler(), "Window::updateInstanceBuffer");
+	uint32_t objectCount = _scene->GetObjectCount();
+
+	// Only this slot's previous frame read the buffer and its fence has been waited on
+	if (objectCount > instanceBufferCapacity[frame]) {
+		auto device = _renderer->GetVulkanDevice();
+		vkDestroyBuffer(device, instanceBuffers[frame], nullptr);
+		_renderer->GetMemoryAllocator()->Free(instanceBuffersMemory[frame]);
+
+		uint32_t capacity = std::max<uint32_t>(objectCount, instanceBufferCapacity[frame] * 2);
+		createBuffer(sizeof(InstanceData) * capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			instanceBuffers[frame], instanceBuffersMemory[frame]);
+		instanceBufferCapacity[frame] = capacity;
+		descriptorSetsDirty[frame] = true;
+	}
+
+	_draw_list.clear();
+	if (objectCount == 0) {
+		return;
+	}
+
+#if BUILD_ENABLE_CPU_CULLING
+	uint32_t visibleCount = cullSceneObjects();
+	const auto& order = _scene->GetBatchOrder();
+	auto* instances = static_cast<InstanceData*>(instanceBuffersMemory[frame].mapped);
+
+	// Visible objects come back in batch order, so each batch takes the next run of
+	// them and packs their instances at the front of its range
+	_visible_handles.resize(visibleCount);
+	for (uint32_t i = 0; i < visibleCount; ++i) {
+		_visible_handles[i] = order[_visible_objects[i]];
+	}
+	uint32_t next = 0;
+	for (const auto& batch : _scene->GetBatches()) {
+		uint32_t end = batch.first_instance + batch.instance_count;
+		uint32_t first = next;
+		while (next < visibleCount && _visible_objects[next] < end) {
+			next++;
+		}
+		uint32_t instanceCount = next - first;
+
+		const SceneMesh& mesh = _scene->GetMesh(batch.mesh);
+		if (mesh.index_count == 0 || instanceCount == 0) {
+			continue;
+		}
+		_scene->WriteInstances(instances + batch.first_instance, _visible_handles.data() + first, instanceCount, batch.mesh,
+			_instance_builder, BUILD_ENABLE_VERTEX_QUANTIZATION != 0);
+
+		DrawItem draw{};
+		draw.index_count = mesh.index_count;
+		draw.instance_count = instanceCount;
+		draw.first_index = mesh.first_index;
+		draw.vertex_offset = mesh.vertex_offset;
+		draw.first_instance = batch.first_instance;
+		_draw_list.push_back(draw);
+	}
+#else
+	_scene->WriteInstances(static_cast<InstanceData*>(instanceBuffersMemory[frame].mapped), _instance_builder, BUILD_ENABLE_VERTEX_QUANTIZATION != 0);
+
+	// One instanced draw per batch, the batch's instances start at first_instance
+	for (const auto& batch : _scene->GetBatches()) {
+		const SceneMesh& mesh = _scene->GetMesh(batch.mesh);
+		if (mesh.index_count == 0) {
+			continue;
+		}
+		DrawItem draw{};
+		draw.index_count = mesh.index_count;
+		draw.instance_count = batch.instance_count;
+		draw.first_index = mesh.first_index;
+		draw.vertex_offset = mesh.vertex_offset;
+		draw.first_instance = batch.first_instance;
+		_draw_list.push_back(draw);
+	}
+#endif
+}
+
+uint32_t Window::cullSceneObjects()
+{
+	uint32_t objectCount = _scene->GetObjectCount();
+	const auto& order = _scene->GetBatchOrder();
+
+	// Bounding spheres in instance space, laid out in batch order
+	_cpu_culler.Resize(objectCount);
+	for (const auto& batch : _scene->GetBatches()) {
+		const SceneMesh& mesh = _scene->GetMesh(batch.mesh);
+		for (uint32_t i = batch.first_instance; i < batch.first_instance + batch.instance_count; ++i) {
+			const glm::mat4& transform = _scene->GetTransform(order[i]);
+			glm::vec3 center = glm::vec3(transform * glm::vec4(mesh.bounds_center, 1.0f));
+			float scale = std::max<float>(std::max<float>(glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1]))), glm::length(glm::vec3(transform[2])));
+			_cpu_culler.SetSphere(i, center, mesh.bounds_radius * scale);
+		}
+	}
+
+	_visible_objects.resize(objectCount);
+	return _cpu_culler.CullSpheres(ExtractFrustum(_clip_from_instance), 0, objectCount, _visible_objects.data());
+}
+
+void Window::createDescriptorSetLayout()
+{
+	auto device = _renderer->GetVulkanDevice();
+	// The frame's instances, written by the CPU or the GPU culler
+	VkDescriptorSetLayoutBinding instanceLayoutBinding{};
+	instanceLayoutBinding.binding = 0;
+	instanceLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	instanceLayoutBinding.descriptorCount = 1;
+	instanceLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	instanceLayoutBinding.pImmutableSamplers = nullptr; // Optional
+
+	// Textures come from the streamer's table in set 1, combined with this sampler in the shader
 	VkDescriptorSetLayoutBinding samplerLayoutBinding{};
 	samplerLayoutBinding.binding = 1;
 	samplerLayoutBinding.descriptorCount = 1;
-	samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
 	samplerLayoutBinding.pImmutableSamplers = nullptr;
 	samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-	std::array<VkDescriptorSetLayoutBinding, 2> bindings = { uboLayoutBinding, samplerLayoutBinding };
+	VkDescriptorSetLayoutBinding materialLayoutBinding{};
+	materialLayoutBinding.binding = 2;
+	materialLayoutBinding.descriptorCount = 1;
+	materialLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	materialLayoutBinding.pImmutableSamplers = nullptr;
+	materialLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	std::array<VkDescriptorSetLayoutBinding, 3> bindings = { instanceLayoutBinding, samplerLayoutBinding, materialLayoutBinding };
 	VkDescriptorSetLayoutCreateInfo layoutInfo{};
 	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
 	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
@@ -901,46 +1278,23 @@ void Window::destroyDescriptorSetLayout()
 	std::cout << "Vulkan: Destroyed description set layout seccessfully" << std::endl;
 }
 
-void Window::createUniformBuffers()
-{
-	VkDeviceSize bufferSize = sizeof(UniformBufferObject);
-
-	uniformBuffers.resize(_swapchain_images.size());
-	uniformBuffersMemory.resize(_swapchain_images.size());
-
-	for (size_t i = 0; i < _swapchain_images.size(); i++) {
-		createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformBuffers[i], uniformBuffersMemory[i]);
-		std::cout << "Vulkan: Create uniform buffer seccessfully" << std::endl;
-	}
-}
-
-void Window::destroyUniformBuffers()
-{
-	auto device = _renderer->GetVulkanDevice();
-	for (size_t i = 0; i < _swapchain_images.size(); i++) {
-		vkDestroyBuffer(device, uniformBuffers[i], nullptr);
-		vkFreeMemory(device, uniformBuffersMemory[i], nullptr);
-		std::cout << "Vulkan: Destroy uniform buffer seccessfully" << std::endl;
-	}
-}
-
 void Window::createDescriptorPool()
 {
 	auto device = _renderer->GetVulkanDevice();
 
+	// Instances and materials are storage buffers
 	std::array<VkDescriptorPoolSize, 2> poolSizes{};
-	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	poolSizes[0].descriptorCount = static_cast<uint32_t>(_swapchain_images.size());
-	poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	poolSizes[1].descriptorCount = static_cast<uint32_t>(_swapchain_images.size());
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[0].descriptorCount = _frames_in_flight * 2;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_SAMPLER;
+	poolSizes[1].descriptorCount = _frames_in_flight;
 
 	VkDescriptorPoolCreateInfo poolInfo{};
 	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
 	poolInfo.pPoolSizes = poolSizes.data();
-	poolInfo.maxSets = static_cast<uint32_t>(_swapchain_images.size());
+	poolInfo.maxSets = _frames_in_flight;
 
-	poolInfo.maxSets = static_cast<uint32_t>(_swapchain_images.size());
 	if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
 		throw std::runtime_error("Vulkan: Failed to create descriptor pool!");
 	}
@@ -958,141 +1312,195 @@ void Window::destroyDescriptorPool()
 void Window::createDescriptorSets()
 {
 	auto device = _renderer->GetVulkanDevice();
-	std::vector<VkDescriptorSetLayout> layouts(_swapchain_images.size(), descriptorSetLayout);
+	// One set per frame in flight, each pointing at its own copy of the material table
+	std::vector<VkDescriptorSetLayout> layouts(_frames_in_flight, descriptorSetLayout);
+	descriptorSets.resize(_frames_in_flight);
 	VkDescriptorSetAllocateInfo allocInfo{};
 	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	allocInfo.descriptorPool = descriptorPool;
-	allocInfo.descriptorSetCount = static_cast<uint32_t>(_swapchain_images.size());
+	allocInfo.descriptorSetCount = _frames_in_flight;
 	allocInfo.pSetLayouts = layouts.data();
 
-	descriptorSets.resize(_swapchain_images.size());
 	if (vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data()) != VK_SUCCESS) {
 		throw std::runtime_error("Vulkan: Failed to allocate descriptor sets!");
 	}
 
-	for (size_t i = 0; i < _swapchain_images.size(); i++) {
-		VkDescriptorBufferInfo bufferInfo{};
-		bufferInfo.buffer = uniformBuffers[i];
-		bufferInfo.offset = 0;
-		bufferInfo.range = sizeof(UniformBufferObject);
+	// The buffers are only known once a frame has filled them, see _WriteFrameDescriptors
+	descriptorSetsDirty.assign(_frames_in_flight, true);
+	VkDescriptorImageInfo samplerInfo{};
+	samplerInfo.sampler = textureSampler;
+
+	std::vector<VkWriteDescriptorSet> descriptorWrites(_frames_in_flight);
+	for (uint32_t frame = 0; frame < _frames_in_flight; ++frame) {
+		VkWriteDescriptorSet& samplerWrite = descriptorWrites[frame];
+		samplerWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		samplerWrite.dstSet = descriptorSets[frame];
+		samplerWrite.dstBinding = 1;
+		samplerWrite.dstArrayElement = 0;
+		samplerWrite.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+		samplerWrite.descriptorCount = 1;
+		samplerWrite.pImageInfo = &samplerInfo;
+	}
+	vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+}
+
+void Window::_WriteFrameDescriptors(uint32_t frame, VkBuffer instance_buffer)
+{
+	// Only called after one of the buffers was replaced when it grew, the set keeps
+	// pointing at them otherwise
+	VkDescriptorBufferInfo bufferInfos[2] = {};
+	bufferInfos[0].buffer = instance_buffer;
+	bufferInfos[0].offset = 0;
+	bufferInfos[0].range = VK_WHOLE_SIZE;
+	bufferInfos[1].buffer = materialBuffers[frame];
+	bufferInfos[1].offset = 0;
+	bufferInfos[1].range = VK_WHOLE_SIZE;
+
+	VkWriteDescriptorSet descriptorWrites[2] = {};
+	uint32_t writeCount = 0;
+	for (uint32_t i = 0; i < 2; ++i) {
+		// Nothing to point at while the scene has no objects or materials, nothing draws either
+		if (bufferInfos[i].buffer == VK_NULL_HANDLE) {
+			continue;
+		}
+		VkWriteDescriptorSet& descriptorWrite = descriptorWrites[writeCount++];
+		descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite.dstSet = descriptorSets[frame];
+		descriptorWrite.dstBinding = i == 0 ? 0 : 2;
+		descriptorWrite.dstArrayElement = 0;
+		descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorWrite.descriptorCount = 1;
+		descriptorWrite.pBufferInfo = &bufferInfos[i];
+	}
+	vkUpdateDescriptorSets(_renderer->GetVulkanDevice(), writeCount, descriptorWrites, 0, nullptr);
+}
 
-		VkDescriptorImageInfo imageInfo{};
-		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		imageInfo.imageView = textureImageView;
-		imageInfo.sampler = textureSampler;
+void Window::createMaterialBuffers()
+{
+	// Buffers are created on first use and grow with the scene's materials
+	materialBuffers.assign(_frames_in_flight, VK_NULL_HANDLE);
+	materialBuffersMemory.assign(_frames_in_flight, MemoryAllocation());
+	materialBufferCapacity.assign(_frames_in_flight, 0);
+}
 
-		std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+void Window::destroyMaterialBuffers()
+{
+	auto device = _renderer->GetVulkanDevice();
+	for (size_t i = 0; i < materialBuffers.size(); ++i) {
+		vkDestroyBuffer(device, materialBuffers[i], nullptr);
+		_renderer->GetMemoryAllocator()->Free(materialBuffersMemory[i]);
+	}
+	materialBuffers.clear();
+	materialBuffersMemory.clear();
+	materialBufferCapacity.clear();
+	std::cout << "Vulkan: Destroyed material buffers seccessfully" << std::endl;
+}
 
-		descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorWrites[0].dstSet = descriptorSets[i];
-		descriptorWrites[0].dstBinding = 0;
-		descriptorWrites[0].dstArrayElement = 0;
-		descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		descriptorWrites[0].descriptorCount = 1;
-		descriptorWrites[0].pBufferInfo = &bufferInfo;
+void Window::_UpdateMaterialBuffer(uint32_t frame)
+{
+	// Only called while no submitted frame uses this frame's buffer or set
+	_RequestMaterialTextures();
+	uint32_t materialCount = _scene->GetMaterialCount();
 
-		descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorWrites[1].dstSet = descriptorSets[i];
-		descriptorWrites[1].dstBinding = 1;
-		descriptorWrites[1].dstArrayElement = 0;
-		descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		descriptorWrites[1].descriptorCount = 1;
-		descriptorWrites[1].pImageInfo = &imageInfo;
+	if (materialCount > materialBufferCapacity[frame]) {
+		auto device = _renderer->GetVulkanDevice();
+		vkDestroyBuffer(device, materialBuffers[frame], nullptr);
+		_renderer->GetMemoryAllocator()->Free(materialBuffersMemory[frame]);
 
-		vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+		uint32_t capacity = std::max<uint32_t>(materialCount, materialBufferCapacity[frame] * 2);
+		createBuffer(sizeof(GpuMaterial) * capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			materialBuffers[frame], materialBuffersMemory[frame]);
+		materialBufferCapacity[frame] = capacity;
+		descriptorSetsDirty[frame] = true;
+	}
+
+	// A texture's table slot is handed out once it is resident, the placeholder's until then
+	TextureStreamer* streamer = _renderer->GetTextureStreamer();
+	auto* materials = static_cast<GpuMaterial*>(materialBuffersMemory[frame].mapped);
+	for (uint32_t i = 0; i < materialCount; ++i) {
+		GpuMaterial material{};
+		material.base_color_factor = _scene->GetMaterial(i).base_color_factor;
+		material.base_color_texture = streamer->GetDescriptorIndex(_material_textures[i]);
+		memcpy(materials + i, &material, sizeof(GpuMaterial));
 	}
 }
 
-void Window::updateUniformBuffer(uint32_t currentImage)
+void Window::_RequestMaterialTextures()
 {
-	auto device = _renderer->GetVulkanDevice();
+	// Materials added since the last call, textures of the same file are shared
+	TextureStreamer* streamer = _renderer->GetTextureStreamer();
+	while (_material_textures.size() < _scene->GetMaterialCount()) {
+		const SceneMaterial& material = _scene->GetMaterial(static_cast<uint32_t>(_material_textures.size()));
+		const std::string& path = material.base_color_texture;
+		TextureHandle texture = TEXTURE_NONE;
+		for (uint32_t i = 0; i < _material_textures.size() && !path.empty(); ++i) {
+			if (_scene->GetMaterial(i).base_color_texture == path) {
+				texture = _material_textures[i];
+				break;
+			}
+		}
+		if (texture == TEXTURE_NONE && !path.empty()) {
+			texture = streamer->Request(path, material.base_color_image);
+		}
+		_material_textures.push_back(texture);
+	}
+}
 
+void Window::updateFrameConstants()
+{
+	PROFILE_SCOPE(_renderer->GetProfiler(), "Window::updateFrameConstants");
 	static auto startTime = std::chrono::high_resolution_clock::now();
 
 	auto currentTime = std::chrono::high_resolution_clock::now();
 	float time = std::chrono::duration<float, 
 		std::chrono::seconds::period>(currentTime - startTime).count();
+	if (_fixed_time_step > 0.0f) {
+		time = _animation_time;
+		_animation_time += _fixed_time_step;
+	}
 
-	UniformBufferObject ubo{};
-	ubo.model = glm::rotate(glm::mat4(1.0f), 
+	// The whole scene turns, the instance builder folds it into every instance
+	glm::mat4 worldFromScene = glm::rotate(glm::mat4(1.0f), 
 		time * glm::radians(30.0f), glm::vec3(0.0f, 0.0f, 1.0f));
 
-	ubo.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), 
+	glm::mat4 view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), 
 		glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
 
-	ubo.proj = glm::perspective(glm::radians(45.0f), 
+	glm::mat4 proj = glm::perspective(glm::radians(45.0f), 
 		_surface_size_x / (float)_surface_size_y, 0.1f, 10.0f);
 
-	ubo.proj[1][1] *= -1;
-
-	void* data;
-	vkMapMemory(device, uniformBuffersMemory[currentImage], 0, sizeof(ubo), 0, &data);
-	memcpy(data, &ubo, sizeof(ubo));
-	vkUnmapMemory(device, uniformBuffersMemory[currentImage]);
-}
-
-void Window::createTextureImage()
-{
-	auto device = _renderer->GetVulkanDevice();
-	int texWidth, texHeight, texChannels;
-	stbi_uc* pixels = stbi_load(TEXTURE_PATH.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-	VkDeviceSize imageSize = texWidth * texHeight * 4;
-	if (!pixels) {
-		throw std::runtime_error("Failed to load texture image!");
-	}
-
-	mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
-
-	std::cout << mipLevels << std::endl;
-
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		stagingBuffer, stagingBufferMemory);
+	proj[1][1] *= -1;
 
-	void* data;
-	vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data);
-	memcpy(data, pixels, static_cast<size_t>(imageSize));
-	vkUnmapMemory(device, stagingBufferMemory);
+	_instance_builder.SetFrame(proj * view, worldFromScene);
+	_clip_from_instance = _instance_builder.GetClipFromScene();
 
-	stbi_image_free(pixels);
-
-	createImage(texWidth, texHeight, mipLevels, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_SRGB, 
-		VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | 
-		VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageMemory);
-
-
-	transitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels);;
-	copyBufferToImage(stagingBuffer, textureImage, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
-
-	vkDestroyBuffer(device, stagingBuffer, nullptr);
-	vkFreeMemory(device, stagingBufferMemory, nullptr);
-
-	generateMipmaps(textureImage, VK_FORMAT_R8G8B8A8_SRGB, texWidth, texHeight, mipLevels);
-
-	std::cout << "Vulkan: Create texture image seccessfully" << std::endl;
+	// The light turns with the scene, once per frame instead of once per vertex
+	_frame_constants.light_position = glm::vec4(glm::mat3(worldFromScene) * LIGHT_POSITION, 0.0f);
 }
 
-void Window::destroyTextureImage()
+void Window::createModelMaterial()
 {
-	auto device = _renderer->GetVulkanDevice();
-	vkDestroyImage(device, textureImage, nullptr);
-	vkFreeMemory(device, textureImageMemory, nullptr);
-	std::cout << "Vulkan: Destroy texture image seccessfully" << std::endl;
-}
+	SceneMaterial material;
+	material.name = "model";
+	material.base_color_texture = TEXTURE_PATH;
+	_model_material = _scene->AddMaterial(material);
 
-void Window::createTextureImageView()
-{
-	textureImageView = createImageView(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, 1);
-	std::cout << "Vulkan: Create texture image view seccessfully" << std::endl;
+	// Decoded while the model loads, the placeholder is drawn until it is resident
+	_RequestMaterialTextures();
 }
 
-void Window::destroyTextureImageView()
+void Window::releaseMaterialTextures()
 {
-	auto device = _renderer->GetVulkanDevice();
-	vkDestroyImageView(device, textureImageView, nullptr);
-	std::cout << "Vulkan: Destroy texture image view seccessfully" << std::endl;
+	// Materials may share a texture, each one is released once
+	std::sort(_material_textures.begin(), _material_textures.end());
+	_material_textures.erase(std::unique(_material_textures.begin(), _material_textures.end()), _material_textures.end());
+	for (TextureHandle texture : _material_textures) {
+		if (texture != TEXTURE_NONE) {
+			_renderer->GetTextureStreamer()->Release(texture);
+		}
+	}
+	_material_textures.clear();
 }
 
 void Window::createTextureSampler()
@@ -1113,7 +1521,7 @@ void Window::createTextureSampler()
 	samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
 	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
 	samplerInfo.minLod = 0.0f; // Optional
-	samplerInfo.maxLod = static_cast<float>(mipLevels);
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE; // the level count is only known once the texture is loaded
 	samplerInfo.mipLodBias = 0.0f; // Optional
 
 	if (vkCreateSampler(device, &samplerInfo, nullptr, &textureSampler) != VK_SUCCESS) {
@@ -1129,6 +1537,16 @@ void Window::destroyTextureSampler()
 
 void Window::loadModel()
 {
+#if BUILD_ENABLE_MESH_CACHE
+	MeshCache cache;
+	if (cache.Open(MODEL_PATH)) {
+		MeshHandle cached = _scene->AddMesh(cache.GetVertices(), cache.GetVertexCount(), cache.GetIndices(), cache.GetIndexCount(),
+			cache.GetBoundsCenter(), cache.GetBoundsRadius());
+		_scene->AddObject(cached, glm::mat4(1.0f), _model_material);
+		return;
+	}
+#endif
+
 	tinyobj::attrib_t attrib;
 	std::vector<tinyobj::shape_t> shapes;
 	std::vector<tinyobj::material_t> materials;
@@ -1138,130 +1556,66 @@ void Window::loadModel()
 		throw std::runtime_error(warn + err);
 	}
 
-	std::unordered_map<Vertex, uint32_t> uniqueVertices{};
+	// One vertex per face corner, shapes fill their own range in parallel
+	std::vector<size_t> shapeFirstCorner(shapes.size() + 1, 0);
+	for (size_t i = 0; i < shapes.size(); ++i) {
+		shapeFirstCorner[i + 1] = shapeFirstCorner[i] + shapes[i].mesh.indices.size();
+	}
+	std::vector<Vertex> corners(shapeFirstCorner.back());
 
-	for (const auto& shape : shapes) {
-	
-		for (const auto& index : shape.mesh.indices) {
+	ThreadPool* pool = _renderer->GetThreadPool();
+	pool->ParallelFor(static_cast<uint32_t>(shapes.size()), [&](uint32_t shapeIndex, uint32_t) {
+		Vertex* corner = corners.data() + shapeFirstCorner[shapeIndex];
+		for (const auto& index : shapes[shapeIndex].mesh.indices) {
 			Vertex vertex{};
+			// The fragment shader multiplies by the vertex color, OBJ has none
+			vertex.color = { 1.0f, 1.0f, 1.0f };
 			vertex.pos = {
 				attrib.vertices[3 * index.vertex_index + 0],
 				attrib.vertices[3 * index.vertex_index + 1],
 				attrib.vertices[3 * index.vertex_index + 2]
 			};
 
-			vertex.texCoord = {
-				attrib.texcoords[2 * index.texcoord_index + 0],
-				1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
-			};
+			if (index.texcoord_index >= 0) {
+				vertex.texCoord = {
+					attrib.texcoords[2 * index.texcoord_index + 0],
+					1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
+				};
+			}
 
-			vertex.normal = {
-			attrib.normals[3 * index.normal_index + 0],
-			attrib.normals[3 * index.normal_index + 1],
-			attrib.normals[3 * index.normal_index + 2]
-			};
-			
-			if (uniqueVertices.count(vertex) == 0) {
-				uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-				vertices.push_back(vertex);
+			if (index.normal_index >= 0) {
+				vertex.normal = {
+					attrib.normals[3 * index.normal_index + 0],
+					attrib.normals[3 * index.normal_index + 1],
+					attrib.normals[3 * index.normal_index + 2]
+				};
 			}
 
-			indices.push_back(uniqueVertices[vertex]);
+			*corner++ = vertex;
 		}
-	}
-}
-
-
-void Window::generateMipmaps(VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels)
-{
-	// Check if image format supports linear blitting
-	VkFormatProperties formatProperties;
-	vkGetPhysicalDeviceFormatProperties(_renderer->GetVulkanPhysicalDevice(), imageFormat, &formatProperties);
-	if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) {
-		throw std::runtime_error("Vulkan: Texture image format does not support linear blitting!");
-	}
-
-	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+	});
 
-	VkImageMemoryBarrier barrier{};
-	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-	barrier.image = image;
-	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	barrier.subresourceRange.baseArrayLayer = 0;
-	barrier.subresourceRange.layerCount = 1;
-	barrier.subresourceRange.levelCount = 1;
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	WeldVertices(corners.data(), corners.size(), vertices, indices, pool);
 
-	int32_t mipWidth = texWidth;
-	int32_t mipHeight = texHeight;
-
-	for (uint32_t i = 1; i < mipLevels; i++) {
-		barrier.subresourceRange.baseMipLevel = i - 1;
-		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-
-		vkCmdPipelineBarrier(commandBuffer,
-			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
-			0, nullptr,
-			0, nullptr,
-			1, &barrier);
-
-		VkImageBlit blit{};
-		blit.srcOffsets[0] = { 0, 0, 0 };
-		blit.srcOffsets[1] = { mipWidth, mipHeight, 1 };
-		blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		blit.srcSubresource.mipLevel = i - 1;
-		blit.srcSubresource.baseArrayLayer = 0;
-		blit.srcSubresource.layerCount = 1;
-		blit.dstOffsets[0] = { 0, 0, 0 };
-		blit.dstOffsets[1] = { mipWidth > 1 ? mipWidth / 2 : 1, mipHeight > 1 ? mipHeight / 2 : 1, 1 };
-		blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		blit.dstSubresource.mipLevel = i;
-		blit.dstSubresource.baseArrayLayer = 0;
-		blit.dstSubresource.layerCount = 1;
-
-		vkCmdBlitImage(commandBuffer,
-			image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-			image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			1, &blit,
-			VK_FILTER_LINEAR);
-
-		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-		vkCmdPipelineBarrier(commandBuffer,
-			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
-			0, nullptr,
-			0, nullptr,
-			1, &barrier);
-
-		if (mipWidth > 1) mipWidth /= 2;
-		if (mipHeight > 1) mipHeight /= 2;
-	}
-
-	barrier.subresourceRange.baseMipLevel = mipLevels - 1;
-	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-	vkCmdPipelineBarrier(commandBuffer,
-		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
-		0, nullptr,
-		0, nullptr,
-		1, &barrier);
-
-	endSingleTimeCommands(commandBuffer);
+	MeshHandle mesh = _scene->AddMesh(vertices, indices);
+	MeshOptimizeReport report;
+#if BUILD_ENABLE_MESH_OPTIMIZATION
+	report = _scene->OptimizeMesh(mesh, BUILD_MESH_OVERDRAW_THRESHOLD);
+#endif
+#if BUILD_ENABLE_MESH_CACHE
+	const SceneMesh& sceneMesh = _scene->GetMesh(mesh);
+	MeshCache::Write(MODEL_PATH, _scene->GetMeshVertices(mesh), sceneMesh.vertex_count, _scene->GetMeshIndices(mesh), sceneMesh.index_count,
+		sceneMesh.bounds_center, sceneMesh.bounds_radius, report);
+#endif
+	_scene->AddObject(mesh, glm::mat4(1.0f), _model_material);
 }
 
+
 void Window::createColorResources()
 {
-	VkFormat colorFormat = _surface_format.format;
+	VkFormat colorFormat = _render_target->GetFormat();
 
 	createImage(_surface_size_x, _surface_size_y, 1, _renderer->GetVulkanMsaa(), colorFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, colorImage, colorImageMemory);
 	colorImageView = createImageView(colorImage, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
@@ -1272,23 +1626,10 @@ void Window::destroyColorResources()
 	auto device = _renderer->GetVulkanDevice();
 	vkDestroyImageView(device, colorImageView, nullptr);
 	vkDestroyImage(device, colorImage, nullptr);
-	vkFreeMemory(device, colorImageMemory, nullptr);
+	_renderer->GetMemoryAllocator()->Free(colorImageMemory);
 }
 
-uint32_t Window::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
-{
-	VkPhysicalDeviceMemoryProperties memProperties;
-	vkGetPhysicalDeviceMemoryProperties(_renderer->GetVulkanPhysicalDevice(), &memProperties);
-	for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-		if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-			return i;
-		}
-	}
-
-	throw std::runtime_error("Vulkan: Failed to find suitable memory type!");
-}
-
-void Window::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory)
+void Window::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, MemoryAllocation& bufferMemory)
 {
 	auto device = _renderer->GetVulkanDevice();
 	VkBufferCreateInfo bufferInfo{};
@@ -1297,39 +1638,22 @@ void Window::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryP
 	bufferInfo.usage = usage;
 	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-	if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
-		throw std::runtime_error("Vulkan: Failed to create buffer!");
+	// Upload destinations are written on the transfer queue and read on the graphics queue
+	auto& families = _renderer->GetUploadQueue()->GetQueueFamilyIndices();
+	if ((usage & VK_BUFFER_USAGE_TRANSFER_DST_BIT) && families.size() > 1) {
+		bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(families.size());
+		bufferInfo.pQueueFamilyIndices = families.data();
 	}
 
-	VkMemoryRequirements memRequirements;
-	vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
-
-	VkMemoryAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-	if (vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-		throw std::runtime_error("Vulkan: Failed to allocate buffer memory!");
+	if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+		throw std::runtime_error("Vulkan: Failed to create buffer!");
 	}
 
-	vkBindBufferMemory(device, buffer, bufferMemory, 0);
-}
-
-void Window::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
-{
-	auto device = _renderer->GetVulkanDevice();
-
-	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
-	VkBufferCopy copyRegion{};
-	copyRegion.size = size;
-	vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-
-	endSingleTimeCommands(commandBuffer);
+	bufferMemory = _renderer->GetMemoryAllocator()->AllocateForBuffer(buffer, properties);
 }
 
-void Window::createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory)
+void Window::createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, MemoryAllocation& imageMemory)
 {
 	auto device = _renderer->GetVulkanDevice();
 	VkImageCreateInfo imageInfo{};
@@ -1347,125 +1671,18 @@ void Window::createImage(uint32_t width, uint32_t height, uint32_t mipLevels, Vk
 	imageInfo.samples = numSamples;
 	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-	if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create image!");
-	}
-
-	VkMemoryRequirements memRequirements;
-	vkGetImageMemoryRequirements(device, image, &memRequirements);
-
-	VkMemoryAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-	if (vkAllocateMemory(device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-		throw std::runtime_error("failed to allocate image memory!");
-	}
-
-	vkBindImageMemory(device, image, imageMemory, 0);
-}
-
-void Window::transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels)
-{
-	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
-	VkImageMemoryBarrier barrier{};
-	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-	barrier.oldLayout = oldLayout;
-	barrier.newLayout = newLayout;
-	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.image = image;
-	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	barrier.subresourceRange.baseMipLevel = 0;
-	barrier.subresourceRange.levelCount = mipLevels;
-	barrier.subresourceRange.baseArrayLayer = 0;
-	barrier.subresourceRange.layerCount = 1;
-	barrier.srcAccessMask = 0; // TODO
-	barrier.dstAccessMask = 0; // TODO
-
-	VkPipelineStageFlags sourceStage;
-	VkPipelineStageFlags destinationStage;
-
-	if (newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
-		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-
-		if (hasStencilComponent(format)) {
-			barrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
-		}
-	}
-	else {
-		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	auto& families = _renderer->GetUploadQueue()->GetQueueFamilyIndices();
+	if ((usage & VK_IMAGE_USAGE_TRANSFER_DST_BIT) && families.size() > 1) {
+		imageInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		imageInfo.queueFamilyIndexCount = static_cast<uint32_t>(families.size());
+		imageInfo.pQueueFamilyIndices = families.data();
 	}
 
-	if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-		barrier.srcAccessMask = 0;
-		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-		sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-	}
-	else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-		sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-		destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-	}
-	else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
-		barrier.srcAccessMask = 0;
-		barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-
-		sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		destinationStage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+	if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create image!");
 	}
-	else {
-		throw std::invalid_argument("unsupported layout transition!");
-	}
-	vkCmdPipelineBarrier(
-		commandBuffer,
-		sourceStage, destinationStage,
-		0,
-		0, nullptr,
-		0, nullptr,
-		1, &barrier
-	);
 
-	endSingleTimeCommands(commandBuffer);
-}
-
-void Window::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height)
-{
-	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
-	VkBufferImageCopy region{};
-	region.bufferOffset = 0;
-	region.bufferRowLength = 0;
-	region.bufferImageHeight = 0;
-
-	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	region.imageSubresource.mipLevel = 0;
-	region.imageSubresource.baseArrayLayer = 0;
-	region.imageSubresource.layerCount = 1;
-
-	region.imageOffset = { 0, 0, 0 };
-	region.imageExtent = {
-		width,
-		height,
-		1
-	};
-
-	vkCmdCopyBufferToImage(
-		commandBuffer,
-		buffer,
-		image,
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		1,
-		&region
-	);
-
-	endSingleTimeCommands(commandBuffer);
+	imageMemory = _renderer->GetMemoryAllocator()->AllocateForImage(image, properties, tiling);
 }
 
 VkImageView Window::createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels)
@@ -1490,41 +1707,6 @@ VkImageView Window::createImageView(VkImage image, VkFormat format, VkImageAspec
 	return imageView;
 }
 
-VkCommandBuffer Window::beginSingleTimeCommands()
-{
-	VkCommandBufferAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandPool = _commandPool;
-	allocInfo.commandBufferCount = 1;
-
-	VkCommandBuffer commandBuffer;
-	vkAllocateCommandBuffers(_renderer->GetVulkanDevice(), &allocInfo, &commandBuffer);
-
-	VkCommandBufferBeginInfo beginInfo{};
-	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-	vkBeginCommandBuffer(commandBuffer, &beginInfo);
-
-	return commandBuffer;
-}
-
-void Window::endSingleTimeCommands(VkCommandBuffer commandBuffer)
-{
-	vkEndCommandBuffer(commandBuffer);
-
-	VkSubmitInfo submitInfo{};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer;
-
-	vkQueueSubmit(_renderer->GetVulkanQueue(), 1, &submitInfo, VK_NULL_HANDLE);
-	vkQueueWaitIdle(_renderer->GetVulkanQueue());
-
-	vkFreeCommandBuffers(_renderer->GetVulkanDevice(), _commandPool, 1, &commandBuffer);
-}
-
 VkFormat Window::findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features)
 {
 	for (VkFormat format : candidates) {
@@ -1,8 +1,17 @@
 #pragma once
 
 #include"Platform.h"
+#include"BUILD_OPTIONS.h"
+#include"RenderTarget.h"
 #include"VertexStruct.h"
-#include"UniformBufferObject.h"
+#include"MemoryAllocator.h"
+#include"ThreadPool.h"
+#include"Scene.h"
+#include"InstanceMatrices.h"
+#include"GpuCuller.h"
+#include"CpuCuller.h"
+#include"TextureStreamer.h"
+#include"Profiler.h"
 #include"Window.h"
 #include"Renderer.h"
 #include"Shared.h"
@@ -11,10 +20,37 @@
 
 class Renderer;
 
+// One indexed draw of the frame's draw list.
+struct DrawItem
+{
+	uint32_t index_count    = 0;
+	uint32_t instance_count = 0;
+	uint32_t first_index    = 0;
+	int32_t  vertex_offset  = 0;
+	uint32_t first_instance = 0;
+};
+
+// Entry of the material table, std430 layout of shader.frag's Material.
+struct GpuMaterial
+{
+	glm::vec4 base_color_factor;
+	// Slot in the streamer's texture table
+	uint32_t  base_color_texture;
+	uint32_t  padding[3];
+};
+
+// Push constants of the graphics pipeline, shader.vert's FrameConstants.
+struct FrameConstants
+{
+	// World space, w unused
+	glm::vec4 light_position;
+};
+
 class Window
 {
 public:
-	Window(Renderer * renderer, uint32_t size_x, uint32_t size_y, std::string name);
+	// Without load_model the scene starts out empty instead of holding MODEL_PATH.
+	Window(Renderer * renderer, uint32_t size_x, uint32_t size_y, std::string name, bool offscreen = false, bool load_model = true);
 	~Window();
 
 	void Close();
@@ -22,10 +58,24 @@ public:
 
 	void DrawFrame();
 
+	// Asks for a new surface size, the swapchain and the attachments follow before the next frame.
+	void Resize(uint32_t size_x, uint32_t size_y);
+
+	// Changes how many frames may be in flight at once, waits for the device first.
+	void SetFramesInFlight(uint32_t count);
+	uint32_t GetFramesInFlight() const;
+
+	// Advances the scene animation by seconds per drawn frame instead of by the
+	// clock, so every run sees the same frames. 0 goes back to the clock.
+	void SetFixedTimeStep(float seconds);
+
 	std::vector<VkCommandBuffer> GetVulkanCommandBuffer();
 	VkRenderPass GetVulkanRenderPass();
 	VkFramebuffer GetVulkanFramebuffer();
 	VkExtent2D GetVulkanSurfaceSize();
+	RenderTarget* GetRenderTarget();
+	// Objects drawn by this window, changes show up from the next frame on.
+	Scene* GetScene();
 	VkShaderModule CreateShaderModule(const std::vector<char>& code);
 
 private:
@@ -38,11 +88,8 @@ private:
 	void _InitSurface();
 	void _DenitSurface();
 
-	void _InitSwapchain();
-	void _DeinitSwapchain();
-
-	void _InitSwapchainImages();
-	void _DeInitSwapchainImages();
+	void _InitRenderTarget();
+	void _DeInitRenderTarget();
 
 	void _InitDepthStencilImage();
 	void _DeInitDepthStencilImage();
@@ -61,6 +108,15 @@ private:
 
 	void _CreateCommandBuffers();
 	void _DestroyCommandBuffers();
+	void _RecordCommandBuffer(uint32_t frame, uint32_t image_index);
+	void _BindDrawState(VkCommandBuffer command_buffer, uint32_t frame);
+	void _RecordDraws(VkCommandBuffer command_buffer, uint32_t frame, uint32_t first, uint32_t count);
+	void _RecordIndirectDraws(VkCommandBuffer command_buffer, uint32_t frame);
+
+	void _CreateRecordingPools();
+	void _DestroyRecordingPools();
+	void _ResetRecordingPools(uint32_t frame);
+	VkCommandBuffer _AcquireSecondaryCommandBuffer(uint32_t frame, uint32_t thread);
 
 	void createSyncObjects();
 	void destroySyncObjects();
@@ -75,57 +131,66 @@ private:
 	void createIndexBuffer();
 	void destroyIndexBuffer();
 
+	void updateSceneGeometry();
+
+	void createInstanceBuffers();
+	void destroyInstanceBuffers();
+	void updateInstanceBuffer(uint32_t frame);
+	uint32_t cullSceneObjects();
+
 	void createDescriptorSetLayout();
 	void destroyDescriptorSetLayout();
 
-	void createUniformBuffers();
-	void destroyUniformBuffers();
-
 	void createDescriptorPool();
 	void destroyDescriptorPool();
 
 	void createDescriptorSets();
+	// Points the frame's set at its instance buffer and material table.
+	void _WriteFrameDescriptors(uint32_t frame, VkBuffer instance_buffer);
 
-	void updateUniformBuffer(uint32_t currentImage);
+	void createMaterialBuffers();
+	void destroyMaterialBuffers();
+	// Writes the scene's materials into the frame's table, with the texture slots as they are now.
+	void _UpdateMaterialBuffer(uint32_t frame);
+	// Requests the base color textures of materials added to the scene since the last call.
+	void _RequestMaterialTextures();
 
-	void createTextureImage();
-	void destroyTextureImage();
+	// Camera, scene rotation and light for this frame.
+	void updateFrameConstants();
 
-	void createTextureImageView();
-	void destroyTextureImageView();
+	// The OBJ model's material, textured with TEXTURE_PATH.
+	void createModelMaterial();
+	void releaseMaterialTextures();
 
 	void createTextureSampler();
 	void destroyTextureSampler();
 
 	void loadModel();
-	void generateMipmaps(VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels);
 
 	void createColorResources();
 	void destroyColorResources();
 
-	uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
-	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
-	void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
-	void createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory);
-	void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels);
-	void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
+	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, MemoryAllocation& bufferMemory);
+	void createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, MemoryAllocation& imageMemory);
 	VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels);
-	VkCommandBuffer beginSingleTimeCommands();
-	void endSingleTimeCommands(VkCommandBuffer commandBuffer);
 	VkFormat findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
 	VkFormat findDepthFormat();
 	bool hasStencilComponent(VkFormat format);
 
 	Renderer   * _renderer = nullptr;
 
-	VkSwapchainKHR _swapchain = VK_NULL_HANDLE;
+	RenderTarget * _render_target = nullptr;
+	bool           _offscreen = false;
 
 	VkSurfaceKHR   _surface = VK_NULL_HANDLE;
 
 	uint32_t _surface_size_x = 800;
 	uint32_t _surface_size_y = 600;
+	// Size asked for through Resize(), used where the surface does not dictate one
+	uint32_t _requested_size_x = 800;
+	uint32_t _requested_size_y = 600;
 	std::string _window_name;
-	uint32_t   _swapchain_image_count = 2;
+	uint32_t   _render_target_image_count = 2;
 	uint32_t _active_swapchain_image_id = UINT32_MAX;
 
 	VkFence _swapchain_image_available = VK_NULL_HANDLE;
@@ -137,13 +202,11 @@ private:
 	VkFormat _depth_stencil_format = VK_FORMAT_UNDEFINED;
 	bool _stencil_avalible = false;
 
-	std::vector<VkImage>  _swapchain_images;
-	std::vector<VkImageView> _swapchain_images_views;
 	std::vector<VkFramebuffer> _framebuffer;
 	std::vector<VkCommandBuffer> _commandBuffers;
 
 	VkImage  _depth_stencil_image = VK_NULL_HANDLE;
-	VkDeviceMemory  _depth_stencil_image_memory = VK_NULL_HANDLE;
+	MemoryAllocation _depth_stencil_image_memory;
 	VkImageView _depth_stencil_image_view = VK_NULL_HANDLE;
 
 	VkShaderModule _shaderModule = VK_NULL_HANDLE;
@@ -154,9 +217,26 @@ private:
 
 	VkCommandPool _commandPool = VK_NULL_HANDLE;
 
+	// Transient pool of secondary buffers for one recording thread in one frame slot
+	struct RecordingPool
+	{
+		VkCommandPool                pool = VK_NULL_HANDLE;
+		std::vector<VkCommandBuffer> buffers;
+		uint32_t                     used = 0;
+	};
+	// Indexed [frame * _recording_thread_slots + thread]
+	std::vector<RecordingPool> _recording_pools;
+	uint32_t                   _recording_thread_slots = 1;
+
+	std::vector<DrawItem> _draw_list;
+
 	bool _window_should_run = true;
 
-	const int MAX_FRAMES_IN_FLIGHT = 2;
+	uint32_t _frames_in_flight = BUILD_DEFAULT_FRAMES_IN_FLIGHT;
+
+	float _fixed_time_step = 0.0f;
+	// Animation time of the next frame while the time step is fixed
+	float _animation_time = 0.0f;
 
 	std::vector<VkSemaphore> imageAvailableSemaphores;
 	std::vector<VkSemaphore> renderFinishedSemaphores;
@@ -167,36 +247,63 @@ private:
 
 	bool framebufferResized = false;
 
-	std::vector<Vertex> vertices;
-	std::vector<uint32_t> indices;
+	Scene* _scene = nullptr;
+	// Version of the scene geometry the vertex and index buffers hold
+	uint64_t _scene_geometry_version = 0;
 
 	VkBuffer vertexBuffer = VK_NULL_HANDLE;
-	VkDeviceMemory vertexBufferMemory = VK_NULL_HANDLE;
+	MemoryAllocation vertexBufferMemory;
 	
 	VkBuffer indexBuffer = VK_NULL_HANDLE;
-	VkDeviceMemory indexBufferMemory = VK_NULL_HANDLE;
+	MemoryAllocation indexBufferMemory;
+	VkIndexType _index_type = VK_INDEX_TYPE_UINT32;
 
-	std::vector<VkBuffer> uniformBuffers;
-	std::vector<VkDeviceMemory> uniformBuffersMemory;
+	// Per frame slot, the instances in batch order that shader.vert indexes with gl_InstanceIndex
+	std::vector<VkBuffer> instanceBuffers;
+	std::vector<MemoryAllocation> instanceBuffersMemory;
+	std::vector<uint32_t> instanceBufferCapacity;
+
+	// Bounds of the scene objects in batch order and the ones that passed, used without GPU culling
+	CpuCuller _cpu_culler;
+	std::vector<uint32_t> _visible_objects;
+	// Scene handles of _visible_objects, what the instance builder reads
+	std::vector<ObjectHandle> _visible_handles;
+
+	// Replaces the instance buffers and the draw list when culling runs on the GPU
+	GpuCuller* _gpu_culler = nullptr;
+
+	// Culling and render pass of every frame slot on the GPU, created with the command buffers
+	GpuTimer* _gpu_timer = nullptr;
+	// Takes instance space (the transform the scene holds) to clip space, updated with the frame constants
+	glm::mat4 _clip_from_instance = glm::mat4(1.0f);
+
+	InstanceMatrixBuilder _instance_builder;
+	FrameConstants _frame_constants{};
 
 	VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
 
 	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
 	std::vector<VkDescriptorSet> descriptorSets;
-
-	uint32_t mipLevels;
-	VkImage textureImage = VK_NULL_HANDLE;
-	VkDeviceMemory textureImageMemory = VK_NULL_HANDLE;
-
-	VkImageView textureImageView = VK_NULL_HANDLE;
+	// Per frame slot, set when the instance or material buffer its set points at was replaced
+	std::vector<bool> descriptorSetsDirty;
+	// Per frame slot, the material table the fragment shader indexes with the instance's material
+	std::vector<VkBuffer> materialBuffers;
+	std::vector<MemoryAllocation> materialBuffersMemory;
+	std::vector<uint32_t> materialBufferCapacity;
+
+	// Base color texture of every scene material so far, TEXTURE_NONE when it has none
+	std::vector<TextureHandle> _material_textures;
+	uint32_t _model_material = 0;
 	VkSampler textureSampler = VK_NULL_HANDLE;
 
 	VkImage colorImage = VK_NULL_HANDLE;
-	VkDeviceMemory colorImageMemory = VK_NULL_HANDLE;
+	MemoryAllocation colorImageMemory;
 	VkImageView colorImageView = VK_NULL_HANDLE;
 
 	const uint32_t WIDTH = 800;
 	const uint32_t HEIGHT = 600;
+	// Before the scene rotation
+	const glm::vec3 LIGHT_POSITION = glm::vec3(0.5f, 0.5f, -0.5f);
 
 	const std::string MODEL_PATH = "../models/viking_room.obj";
 	const std::string TEXTURE_PATH = "../textures/viking_room.png";
@@ -206,5 +313,10 @@ private:
 	HWND              _win32_window   = NULL;
 	std::string       _win32_class_name;
 	static uint64_t   _win32_class_id_counter;
+#elif VK_USE_PLATFORM_XCB_KHR
+	xcb_connection_t        * _xcb_connection = nullptr;
+	xcb_screen_t            * _xcb_screen = nullptr;
+	xcb_window_t              _xcb_window = 0;
+	xcb_intern_atom_reply_t * _xcb_atom_window_reply = nullptr;
 #endif
 };
@@ -0,0 +1,41 @@
+#include"BUILD_OPTIONS.h"
+#include"Window.h"
+
+#include <assert.h>
+
+#if USE_PLATFORM_HEADLESS
+
+// Headless versions of window functions: there is no OS window, the surface
+// comes from VK_EXT_headless_surface and the window only closes through Close().
+
+void Window::_InitOSWindow()
+{
+	assert(_surface_size_x > 0);
+	assert(_surface_size_y > 0);
+}
+
+void Window::_DeInitOSWindow()
+{
+}
+
+void Window::_UpdateOSWindow()
+{
+}
+
+void Window::_InitOSSurface()
+{
+	auto instance = _renderer->GetVulkanInstance();
+	auto fvkCreateHeadlessSurfaceEXT = (PFN_vkCreateHeadlessSurfaceEXT)vkGetInstanceProcAddr(instance, "vkCreateHeadlessSurfaceEXT");
+	if (nullptr == fvkCreateHeadlessSurfaceEXT) {
+		std::cout << "Vulkan ERROR: VK_EXT_headless_surface is not available." << std::endl;
+		assert(0 && "Vulkan ERROR: VK_EXT_headless_surface is not available.");
+		std::exit(-1);
+	}
+
+	VkHeadlessSurfaceCreateInfoEXT create_info{};
+	create_info.sType = VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT;
+
+	ErrorCheck(fvkCreateHeadlessSurfaceEXT(instance, &create_info, nullptr, &_surface));
+}
+
+#endif
@@ -17,9 +17,11 @@ LRESULT CALLBACK WindowsEventHandler(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM
 		window->Close();
 		return 0;
 	case WM_SIZE:
-		// we get here if the window has changed size, we should rebuild most
-		// of our window resources before rendering to this window again.
-		// ( no need for this because our window sizing by hand is disabled )
+		// The swapchain and the attachments are rebuilt before the next frame,
+		// a minimized window reports 0x0 and simply stops drawing
+		if (window != nullptr) {
+			window->Resize(LOWORD(lParam), HIWORD(lParam));
+		}
 		break;
 	default:
 		break;
@@ -61,7 +63,7 @@ void Window::_InitOSWindow()
 	}
 
 	DWORD ex_style = WS_EX_APPWINDOW | WS_EX_WINDOWEDGE;
-	DWORD style = WS_OVERLAPPED | WS_CAPTION | WS_SYSMENU | WS_MINIMIZEBOX;
+	DWORD style = WS_OVERLAPPED | WS_CAPTION | WS_SYSMENU | WS_MINIMIZEBOX | WS_MAXIMIZEBOX | WS_THICKFRAME;
 
 	// Create window with the registered class:
 	RECT wr = { 0, 0, LONG(_surface_size_x), LONG(_surface_size_y) };
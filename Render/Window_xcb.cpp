@@ -0,0 +1,118 @@
+#include"BUILD_OPTIONS.h"
+#include"Window.h"
+
+#include <assert.h>
+
+#if VK_USE_PLATFORM_XCB_KHR
+
+// Linux XCB specific versions of window functions
+void Window::_InitOSWindow()
+{
+	assert(_surface_size_x > 0);
+	assert(_surface_size_y > 0);
+
+	int screen_index = 0;
+	_xcb_connection = xcb_connect(nullptr, &screen_index);
+	if (xcb_connection_has_error(_xcb_connection)) {
+		assert(0 && "Cannot find a compatible X server!\n");
+		fflush(stdout);
+		std::exit(-1);
+	}
+
+	auto setup = xcb_get_setup(_xcb_connection);
+	auto screen_iterator = xcb_setup_roots_iterator(setup);
+	while (screen_index-- > 0) {
+		xcb_screen_next(&screen_iterator);
+	}
+	_xcb_screen = screen_iterator.data;
+
+	uint32_t value_mask = XCB_CW_BACK_PIXEL | XCB_CW_EVENT_MASK;
+	uint32_t value_list[2];
+	value_list[0] = _xcb_screen->white_pixel;
+	value_list[1] = XCB_EVENT_MASK_KEY_RELEASE | XCB_EVENT_MASK_EXPOSURE | XCB_EVENT_MASK_STRUCTURE_NOTIFY;
+
+	_xcb_window = xcb_generate_id(_xcb_connection);
+	xcb_create_window(_xcb_connection,
+		XCB_COPY_FROM_PARENT,					// depth
+		_xcb_window,							// window id
+		_xcb_screen->root,						// parent
+		0, 0,									// x/y coords
+		uint16_t(_surface_size_x),				// width
+		uint16_t(_surface_size_y),				// height
+		0,										// border width
+		XCB_WINDOW_CLASS_INPUT_OUTPUT,
+		_xcb_screen->root_visual,
+		value_mask,
+		value_list);
+
+	xcb_change_property(_xcb_connection, XCB_PROP_MODE_REPLACE, _xcb_window,
+		XCB_ATOM_WM_NAME, XCB_ATOM_STRING, 8,
+		uint32_t(_window_name.size()), _window_name.c_str());
+
+	// Ask the window manager to send WM_DELETE_WINDOW instead of killing the connection
+	xcb_intern_atom_cookie_t protocols_cookie = xcb_intern_atom(_xcb_connection, 1, 12, "WM_PROTOCOLS");
+	xcb_intern_atom_reply_t* protocols_reply = xcb_intern_atom_reply(_xcb_connection, protocols_cookie, 0);
+	xcb_intern_atom_cookie_t delete_cookie = xcb_intern_atom(_xcb_connection, 0, 16, "WM_DELETE_WINDOW");
+	_xcb_atom_window_reply = xcb_intern_atom_reply(_xcb_connection, delete_cookie, 0);
+	xcb_change_property(_xcb_connection, XCB_PROP_MODE_REPLACE, _xcb_window,
+		protocols_reply->atom, 4, 32, 1, &_xcb_atom_window_reply->atom);
+	free(protocols_reply);
+
+	xcb_map_window(_xcb_connection, _xcb_window);
+
+	// Some window managers ignore the position given in create_window
+	const uint32_t coords[] = { 100, 100 };
+	xcb_configure_window(_xcb_connection, _xcb_window, XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y, coords);
+	xcb_flush(_xcb_connection);
+}
+
+void Window::_DeInitOSWindow()
+{
+	xcb_destroy_window(_xcb_connection, _xcb_window);
+	xcb_disconnect(_xcb_connection);
+	_xcb_window = 0;
+	_xcb_connection = nullptr;
+	free(_xcb_atom_window_reply);
+	_xcb_atom_window_reply = nullptr;
+}
+
+void Window::_UpdateOSWindow()
+{
+	xcb_generic_event_t* event = xcb_poll_for_event(_xcb_connection);
+	while (event) {
+		switch (event->response_type & 0x7f) {
+		case XCB_CLIENT_MESSAGE:
+			if (reinterpret_cast<xcb_client_message_event_t*>(event)->data.data32[0] == _xcb_atom_window_reply->atom) {
+				Close();
+			}
+			break;
+		case XCB_DESTROY_NOTIFY:
+			Close();
+			break;
+		case XCB_CONFIGURE_NOTIFY:
+		{
+			auto configure = reinterpret_cast<xcb_configure_notify_event_t*>(event);
+			if (configure->width != _surface_size_x || configure->height != _surface_size_y) {
+				Resize(configure->width, configure->height);
+			}
+			break;
+		}
+		default:
+			break;
+		}
+		free(event);
+		event = xcb_poll_for_event(_xcb_connection);
+	}
+}
+
+void Window::_InitOSSurface()
+{
+	VkXcbSurfaceCreateInfoKHR create_info{};
+	create_info.sType = VK_STRUCTURE_TYPE_XCB_SURFACE_CREATE_INFO_KHR;
+	create_info.connection = _xcb_connection;
+	create_info.window = _xcb_window;
+
+	ErrorCheck(vkCreateXcbSurfaceKHR(_renderer->GetVulkanInstance(), &create_info, nullptr, &_surface));
+}
+
+#endif
@@ -3,14 +3,26 @@
 #include"Window.h"
 #include"GltfLoader.h"
 
+#include<iomanip>
+
 int main()
 {
 	Renderer r;
 
-	GltfLoader gltf;
-
 	auto w = r.OpenWindow(800, 600, "test");
 
+	// The duck is Y up and about a hundred units tall, the room is Z up and about one
+	glm::mat4 duck_transform = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.3f));
+	duck_transform = glm::rotate(duck_transform, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+	duck_transform = glm::scale(duck_transform, glm::vec3(0.002f));
+#if BUILD_ENABLE_DRACO
+	// The same duck with Draco compressed geometry, decoded on the thread pool
+	const char* duck_path = "../models/Duck/glTF-Draco/Duck.gltf";
+#else
+	const char* duck_path = "../models/Duck.glb";
+#endif
+	GltfLoader().Load(duck_path, w->GetScene(), duck_transform, r.GetThreadPool());
+
 	float color_rotator = 0.0f;
 	auto timer = std::chrono::steady_clock();
 	auto last_time = timer.now();
@@ -24,7 +36,13 @@ int main()
 			last_time = timer.now();
 			fps = frame_counter;
 			frame_counter = 0;
-			std::cout << "FPS:" << fps << std::endl;
+
+			// The tail is where the stutters are, the average hides them
+			FrameTimeSummary cpu = r.GetProfiler()->GetFrameTimeSummary(FrameTrack::Cpu);
+			FrameTimeSummary gpu = r.GetProfiler()->GetFrameTimeSummary(FrameTrack::Gpu);
+			std::cout << std::fixed << std::setprecision(2) << "FPS:" << fps
+				<< " frame ms p50 " << cpu.p50_ms << " p95 " << cpu.p95_ms << " p99 " << cpu.p99_ms
+				<< " | gpu ms p50 " << gpu.p50_ms << " p95 " << gpu.p95_ms << " p99 " << gpu.p99_ms << std::endl;
 		}
 
 		w->DrawFrame();
@@ -1,3 +1,12 @@
-C:/VulkanSDK/1.2.170.0/Bin32/glslc.exe shader.vert -o vert.spv
-C:/VulkanSDK/1.2.170.0/Bin32/glslc.exe shader.frag -o frag.spv
-pause
\ No newline at end of file
+@echo off
+rem Compiles the GLSL next to this file, the Visual Studio projects run it before every build.
+rem glslc comes from the Vulkan SDK the installer points VULKAN_SDK at, or from PATH.
+setlocal
+cd /d "%~dp0"
+set GLSLC=glslc
+if defined VULKAN_SDK set GLSLC="%VULKAN_SDK%\Bin\glslc.exe"
+
+%GLSLC% shader.vert -o vert.spv || exit /b 1
+%GLSLC% shader.frag -o frag.spv || exit /b 1
+%GLSLC% cull.comp -o cull.spv || exit /b 1
+%GLSLC% mipgen.comp -o mipgen.spv || exit /b 1
@@ -1,18 +1,31 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_nonuniform_qualifier : require
 
-
+// COLOR_0 of glTF meshes, white for everything else
+layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragTexCoord;
 layout(location = 2) in vec3 inNormal;
 layout(location = 3) in vec3 inViewVec;
 layout(location = 4) in vec3 inLightVec;
+layout(location = 5) flat in uint inMaterial;
 
 layout(location = 0) out vec4 outColor;
 
-layout(binding = 1) uniform sampler2D texSampler;
+struct Material {
+	vec4 baseColorFactor;
+	uint baseColorTexture;
+};
+
+layout(set = 0, binding = 1) uniform sampler texSampler;
+layout(std430, set = 0, binding = 2) readonly buffer Materials { Material materials[]; };
+// The streamer's texture table, slot 0 is the white placeholder
+layout(set = 1, binding = 0) uniform texture2D textures[];
 
 void main() {
-    vec4 textureColor = texture(texSampler, fragTexCoord);
+	// Instances of one draw may have different materials, so the index is not uniform
+	Material material = materials[inMaterial];
+    vec4 textureColor = texture(sampler2D(textures[nonuniformEXT(material.baseColorTexture)], texSampler), fragTexCoord) * material.baseColorFactor * vec4(fragColor, 1.0);
 	
 	
 	vec4 ambient = vec4(0.25) * textureColor;
@@ -1,30 +1,55 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout(set = 0, binding = 0) uniform UniformBufferObject {
-    mat4 model;
-    mat4 view;
-    mat4 proj;
-	vec4 lightPos;
-} ubo;
+// PackedVertex layout: positions arrive as snorm16 and are dequantized by
+// the instance matrices, normals as octahedral snorm16 in xy
+layout(constant_id = 0) const bool PACKED_VERTICES = false;
 
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec2 inTexCoord;
 layout(location = 3) in vec3 inNormal;
 
+// Matches InstanceData, the CPU precomputes everything that only depends on the object
+struct Instance {
+	mat4 clipFromVertex;
+	mat4 worldFromVertex;
+	mat3 normalFromVertex;
+	uint material;
+};
+
+// gl_InstanceIndex counts from the draw's firstInstance, the start of its batch
+layout(std430, set = 0, binding = 0) readonly buffer Instances { Instance instances[]; };
+
+layout(push_constant) uniform FrameConstants {
+	vec4 lightPos;
+} frame;
+
+layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
 layout(location = 2) out vec3 outNormal;
 layout(location = 3) out vec3 outViewVec;
 layout(location = 4) out vec3 outLightVec;
+layout(location = 5) flat out uint outMaterial;
+
+vec3 decodeOctahedral(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0) {
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	}
+	return normalize(n);
+}
 
 void main() {
-	outNormal = inNormal;
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+	Instance instance = instances[gl_InstanceIndex];
+	vec3 normal = PACKED_VERTICES ? decodeOctahedral(inNormal.xy) : inNormal;
+    gl_Position = instance.clipFromVertex * vec4(inPosition, 1.0);
+    fragColor = inColor;
     fragTexCoord = inTexCoord;
-	vec4 pos = ubo.model * vec4(inPosition, 1.0);
-	outNormal = mat3(ubo.model) * inNormal;
-	vec3 lPos = mat3(ubo.model) * ubo.lightPos.xyz;
-	outLightVec = lPos - pos.xyz;
-	outViewVec = -pos.xyz;	
-}
\ No newline at end of file
+	vec3 pos = (instance.worldFromVertex * vec4(inPosition, 1.0)).xyz;
+	outNormal = instance.normalFromVertex * normal;
+	outLightVec = frame.lightPos.xyz - pos;
+	outViewVec = -pos;
+	outMaterial = instance.material;
+}